@@ -325,4 +325,142 @@ technique VesselTech
 		DestBlend = InvSrcAlpha;
 		ZWriteEnable = true;
 	}
-}
\ No newline at end of file
+}
+
+
+
+// ============================================================================
+// Instanced rendering, the world matrix comes from the second vertex stream
+//
+struct INST_VERTEX {
+	float3 posL   : POSITION0;
+	float3 nrmL   : NORMAL0;
+	float3 tanL   : TANGENT0;
+	float3 tex0   : TEXCOORD0;
+	float4 w0     : TEXCOORD1;
+	float4 w1     : TEXCOORD2;
+	float4 w2     : TEXCOORD3;
+	float4 w3     : TEXCOORD4;
+};
+
+
+// ============================================================================
+//
+PBRData InstPBR_VS(INST_VERTEX vrt)
+{
+	// Zero output.
+	PBRData outVS = (PBRData)0;
+
+	float4x4 W = float4x4(vrt.w0, vrt.w1, vrt.w2, vrt.w3);
+
+	float3 posW = mul(float4(vrt.posL, 1.0f), W).xyz;
+	float3 nrmW = mul(float4(vrt.nrmL, 0.0f), W).xyz;
+
+#if SHDMAP > 0
+	outVS.shdH = mul(float4(posW, 1.0f), gLVP);
+#endif
+
+	outVS.nrmW = nrmW;
+	outVS.tanW = float4(mul(float4(vrt.tanL, 0.0f), W).xyz, vrt.tex0.z);
+	outVS.posH = mul(float4(posW, 1.0f), gVP);
+	outVS.camW = -posW;
+	outVS.tex0 = vrt.tex0.xy;
+
+	return outVS;
+}
+
+
+// ============================================================================
+//
+FASTData InstFAST_VS(INST_VERTEX vrt)
+{
+	// Zero output.
+	FASTData outVS = (FASTData)0;
+
+	float4x4 W = float4x4(vrt.w0, vrt.w1, vrt.w2, vrt.w3);
+
+	float3 posW = mul(float4(vrt.posL, 1.0f), W).xyz;
+	float3 nrmW = mul(float4(vrt.nrmL, 0.0f), W).xyz;
+
+	outVS.nrmW = nrmW;
+	outVS.posH = mul(float4(posW, 1.0f), gVP);
+	outVS.camW = -posW;
+	outVS.tex0 = vrt.tex0.xy;
+
+#if SHDMAP > 0
+	outVS.shdH = mul(float4(posW, 1.0f), gLVP);
+#endif
+
+	return outVS;
+}
+
+
+// ============================================================================
+// Same passes as VesselTech for gcCore instance buffers
+//
+technique InstancedTech
+{
+	pass P0
+	{
+		vertexShader = compile vs_3_0 InstPBR_VS();
+		pixelShader = compile ps_3_0 PBR_PS();
+
+		AlphaBlendEnable = true;
+		BlendOp = Add;
+		ZEnable = true;
+		SrcBlend = SrcAlpha;
+		DestBlend = InvSrcAlpha;
+		ZWriteEnable = true;
+	}
+
+	pass P1
+	{
+		vertexShader = compile vs_3_0 InstPBR_VS();
+		pixelShader = compile ps_3_0 AdvancedPS();
+
+		AlphaBlendEnable = true;
+		BlendOp = Add;
+		ZEnable = true;
+		SrcBlend = SrcAlpha;
+		DestBlend = InvSrcAlpha;
+		ZWriteEnable = true;
+	}
+
+	pass P2
+	{
+		vertexShader = compile vs_3_0 InstFAST_VS();
+		pixelShader = compile ps_3_0 FAST_PS();
+
+		AlphaBlendEnable = true;
+		BlendOp = Add;
+		ZEnable = true;
+		SrcBlend = SrcAlpha;
+		DestBlend = InvSrcAlpha;
+		ZWriteEnable = true;
+	}
+
+	pass P3	// XR2 HUD PASS
+	{
+		vertexShader = compile vs_3_0 InstFAST_VS();
+		pixelShader = compile ps_3_0 XRHUD_PS();
+
+		AlphaBlendEnable = true;
+		BlendOp = Add;
+		ZEnable = true;
+		SrcBlend = SrcAlpha;
+		DestBlend = InvSrcAlpha;
+		ZWriteEnable = true;
+	}
+	pass P4
+	{
+		vertexShader = compile vs_3_0 InstPBR_VS();
+		pixelShader = compile ps_3_0 MetalnessPS();
+
+		AlphaBlendEnable = true;
+		BlendOp = Add;
+		ZEnable = true;
+		SrcBlend = SrcAlpha;
+		DestBlend = InvSrcAlpha;
+		ZWriteEnable = true;
+	}
+}
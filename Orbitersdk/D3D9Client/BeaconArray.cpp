@@ -11,19 +11,22 @@
 #include "D3D9Config.h"
 #include "vPlanet.h"
 #include "vBase.h"
+#include "Surfmgr2.h"
 
 using namespace oapi;
 
 // ===========================================================================================
 //
-BeaconArray::BeaconArray(BeaconArrayEntry *pEnt, DWORD nEntry, vBase *_vB)
+BeaconArray::BeaconArray(const BeaconArrayEntry *pEnt, DWORD nEntry, vBase *_vB)
 	: D3D9Effect()
 	, nVert(nEntry)
 	, vB(_vB)
 	, pVB(NULL)
 	, hBase(NULL)
-	, bidx(0)
 	, base_elev()
+	, minlng(1e6), maxlng(-1e6)
+	, minlat(1e6), maxlat(-1e6)
+	, elev_serial(0)
 {
 	_TRACE;
 
@@ -39,7 +42,12 @@ BeaconArray::BeaconArray(BeaconArrayEntry *pEnt, DWORD nEntry, vBase *_vB)
 
 		for (DWORD i=0;i<nEntry;i++) {
 
-			if (vB) pBeaconPos[i].vLoc = unit(vB->ToLocal(pEnt[i].pos, &pBeaconPos[i].lng, &pBeaconPos[i].lat));
+			if (vB) {
+				BeaconPos &bp = pBeaconPos[i];
+				bp.vLoc = unit(vB->ToLocal(pEnt[i].pos, &bp.lng, &bp.lat));
+				minlng = min(minlng, bp.lng); maxlng = max(maxlng, bp.lng);
+				minlat = min(minlat, bp.lat); maxlat = max(maxlat, bp.lat);
+			}
 
 			pVrt[i].pos = D3DXVEC(pEnt[i].pos);
 			pVrt[i].dir = D3DXVEC(pEnt[i].dir);
@@ -78,21 +86,54 @@ BeaconArray::~BeaconArray()
 
 // ===========================================================================================
 //
-void BeaconArray::Update(DWORD nCount, vPlanet *vP)
+void BeaconArray::Update(vPlanet *vP)
 {
-	if (nCount>nVert) nCount = nVert;
+	if (!vB || nVert == 0) return;
+
+	TileManager2<SurfTile> *pMgr = vP->SurfMgr2();
+	if (!pMgr) return;
+
+	static std::vector<TILEBOUNDS> events;
+	events.clear();
+
+	// If the events have been dropped since the last update, resolve all the beacons
+	//
+	if (!pMgr->GetElevationEvents(elev_serial, events)) {
+		TILEBOUNDS all;
+		all.minlng = minlng; all.maxlng = maxlng;
+		all.minlat = minlat; all.maxlat = maxlat;
+		events.push_back(all);
+	}
+
+	BAVERTEX *pVrt = NULL;
 	double meanelev = vP->GetSize();
-	BAVERTEX *pVrt = LockVertexBuffer();
-	if (!pVrt) return;
-	for (DWORD i=0;i<nCount;i++) {
-		double elv = 0;
-		if (vP->GetElevation(pBeaconPos[bidx].lng, pBeaconPos[bidx].lat, &elv)==1) {
-			VECTOR3 vLoc = pBeaconPos[bidx].vLoc * (meanelev+elv);
-			vB->FromLocal(vLoc, &pVrt[bidx].pos);
+
+	for (size_t k = 0; k < events.size(); k++) {
+
+		const TILEBOUNDS &e = events[k];
+
+		if (e.minlng > maxlng || e.maxlng < minlng || e.minlat > maxlat || e.maxlat < minlat) continue;
+
+		if (!pVrt) {
+			pVrt = LockVertexBuffer();
+			if (!pVrt) return;
+		}
+
+		// Resolve the beacons under the tile. Consecutive queries are served by the
+		// planet's tile cache without walking the quadtree.
+		//
+		for (DWORD i = 0; i < nVert; i++) {
+			const BeaconPos &bp = pBeaconPos[i];
+			if (bp.lng < e.minlng || bp.lng > e.maxlng || bp.lat < e.minlat || bp.lat > e.maxlat) continue;
+			double elv = 0;
+			if (vP->GetElevation(bp.lng, bp.lat, &elv) == 1) {
+				VECTOR3 vLoc = bp.vLoc * (meanelev + elv);
+				vB->FromLocal(vLoc, &pVrt[i].pos);
+			}
 		}
-		bidx++;	if (bidx>=nVert) bidx=0;
 	}
-	UnLockVertexBuffer();
+
+	if (pVrt) UnLockVertexBuffer();
 }
 
 
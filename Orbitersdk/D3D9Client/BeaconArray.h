@@ -51,7 +51,7 @@ public:
 	 * \param pArray Pointer into a BeaconArrayEntry list.
 	 * \param nArray Number of entries in the array
 	 */
-	BeaconArray(BeaconArrayEntry *pArray, DWORD nArray, class vBase *vP=NULL);
+	BeaconArray(const BeaconArrayEntry *pArray, DWORD nArray, class vBase *vP=NULL);
 	~BeaconArray();
 
 	void UnLockVertexBuffer();		///< Unlocks the vertex buffer after manipulation is finished
@@ -65,18 +65,25 @@ public:
 	 */
 	void Render(LPDIRECT3DDEVICE9 dev, const LPD3DXMATRIX pW, float time=0.5f);
 
-	void Update(DWORD nCount, vPlanet *vP);
+	/**
+	 * \brief Re-project the beacons onto the surface where the elevation has changed
+	 * since the previous call. Beacons are resolved one batch per changed tile.
+	 * \param vP Planet the base is located on
+	 */
+	void Update(vPlanet *vP);
 
 private:
 
 	DWORD nVert;					///< Number of beacons
-	DWORD bidx;						///< Update index
 	LPDIRECT3DVERTEXBUFFER9 pVB;	///< Vertex buffer pointer
 	SURFHANDLE pBright;				///< D3D9RwyLight.dds texture handle
 	OBJHANDLE hBase;
 	class vBase *vB;
 	BeaconPos *pBeaconPos;
 	double base_elev;
+	double minlng, maxlng;			///< Extents of the beacons
+	double minlat, maxlat;
+	DWORD elev_serial;				///< Last elevation event processed
 };
 
 #endif // !__BEACONARRAY_H
@@ -0,0 +1,192 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "BeaconCache.h"
+#include "Log.h"
+
+#define BEACONCACHE_MAGIC	0x434E4342	// 'BCNC'
+
+// ===========================================================================================
+//
+BeaconCache::BeaconCache(const char *src, const char *kind, const double *prm, int nprm) :
+	key(0),
+	hFile(INVALID_HANDLE_VALUE),
+	hMap(NULL),
+	pData(NULL),
+	nData(0),
+	iPos(0)
+{
+	path[0] = 0;
+
+	// Hash the source file --------------------------------------------------------------------
+	//
+	FILE *file = NULL;
+	if (fopen_s(&file, src, "rb") || file == NULL) return;
+
+	std::vector<BYTE> data;
+	BYTE buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), file)) > 0) data.insert(data.end(), buf, buf + n);
+	fclose(file);
+
+	DWORD version = BEACONCACHE_VERSION;
+	unsigned __int64 h = 14695981039346656037ULL;
+	h = Hash(&version, sizeof(version), h);
+	h = Hash(data.data(), data.size(), h);
+	if (prm && nprm > 0) h = Hash(prm, nprm * sizeof(double), h);
+	key = h ? h : 1;
+
+	// Cache file name from the source path -----------------------------------------------------
+	//
+	char name[MAX_PATH];
+	strcpy_s(name, MAX_PATH, src);
+	for (char *c = name; *c; c++) if (!isalnum((unsigned char)*c)) *c = '_';
+	sprintf_s(path, MAX_PATH, "%s/%s.%s", BEACONCACHE_DIR, name, kind);
+}
+
+// ===========================================================================================
+//
+BeaconCache::~BeaconCache()
+{
+	Close();
+}
+
+// ===========================================================================================
+//
+unsigned __int64 BeaconCache::Hash(const void *data, size_t bytes, unsigned __int64 h)
+{
+	const BYTE *p = (const BYTE *)data;
+	for (size_t i = 0; i < bytes; i++) h = (h ^ p[i]) * 1099511628211ULL;
+	return h;
+}
+
+// ===========================================================================================
+//
+bool BeaconCache::Open()
+{
+	Close();
+
+	if (!IsValid()) return false;
+
+	hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart < LONGLONG(sizeof(BCHEADER)) || size.QuadPart > 0x7FFFFFFF) {
+		Close();
+		return false;
+	}
+
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap) pData = (const BYTE *)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+
+	if (pData == NULL) {
+		Close();
+		return false;
+	}
+
+	nData = DWORD(size.QuadPart);
+
+	const BCHEADER *pHdr = (const BCHEADER *)pData;
+
+	if (pHdr->magic != BEACONCACHE_MAGIC || pHdr->version != BEACONCACHE_VERSION || pHdr->key != key || pHdr->size != nData) {
+		LogAlw("BeaconCache: [%s] is stale", path);
+		Close();
+		return false;
+	}
+
+	iPos = sizeof(BCHEADER);
+	return true;
+}
+
+// ===========================================================================================
+//
+void BeaconCache::Close()
+{
+	if (pData) UnmapViewOfFile(pData);
+	if (hMap) CloseHandle(hMap);
+	if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+	pData = NULL;
+	hMap = NULL;
+	hFile = INVALID_HANDLE_VALUE;
+	nData = iPos = 0;
+}
+
+// ===========================================================================================
+//
+bool BeaconCache::Read(void *data, DWORD bytes)
+{
+	DWORD padded = (bytes + 7) & ~7;
+	if (!pData || padded > nData - iPos) return false;
+	memcpy(data, pData + iPos, bytes);
+	iPos += padded;
+	return true;
+}
+
+// ===========================================================================================
+//
+const BeaconArrayEntry *BeaconCache::GetEntries(DWORD count)
+{
+	DWORD bytes = count * sizeof(BeaconArrayEntry);
+	DWORD padded = (bytes + 7) & ~7;
+	if (!pData || count > nData / sizeof(BeaconArrayEntry) || padded > nData - iPos) return NULL;
+	const BeaconArrayEntry *pEnt = (const BeaconArrayEntry *)(pData + iPos);
+	iPos += padded;
+	return pEnt;
+}
+
+// ===========================================================================================
+//
+void BeaconCache::Write(const void *data, DWORD bytes)
+{
+	if (Buffer.empty()) Buffer.resize(sizeof(BCHEADER), 0);
+	const BYTE *p = (const BYTE *)data;
+	Buffer.insert(Buffer.end(), p, p + bytes);
+	Buffer.resize((Buffer.size() + 7) & ~7, 0);
+}
+
+// ===========================================================================================
+//
+void BeaconCache::PutEntries(const std::vector<BeaconArrayEntry> &list)
+{
+	DWORD count = DWORD(list.size());
+	Put(count);
+	if (count) Write(list.data(), count * sizeof(BeaconArrayEntry));
+}
+
+// ===========================================================================================
+//
+bool BeaconCache::Save()
+{
+	if (!IsValid() || Buffer.empty()) return false;
+
+	Close();
+
+	BCHEADER *pHdr = (BCHEADER *)Buffer.data();
+	pHdr->magic = BEACONCACHE_MAGIC;
+	pHdr->version = BEACONCACHE_VERSION;
+	pHdr->key = key;
+	pHdr->size = DWORD(Buffer.size());
+	pHdr->reserved = 0;
+
+	CreateDirectoryA(BEACONCACHE_DIR, NULL);
+
+	FILE *file = NULL;
+	if (fopen_s(&file, path, "wb") || file == NULL) {
+		LogWrn("BeaconCache: Failed to create [%s]", path);
+		return false;
+	}
+
+	bool bOk = (fwrite(Buffer.data(), 1, Buffer.size(), file) == Buffer.size());
+	fclose(file);
+
+	if (!bOk) {
+		LogWrn("BeaconCache: Failed to write [%s]", path);
+		remove(path);
+	}
+
+	Buffer.clear();
+	return bOk;
+}
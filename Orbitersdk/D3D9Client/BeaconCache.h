@@ -0,0 +1,101 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class BeaconCache (interface)
+//
+// On-disk cache for the compiled runway and taxi light sets of a
+// base. A cache file is a flat stream of records keyed by a hash
+// of the source configuration file, the client version of the
+// format and any parameters the generated lights depend on. A
+// valid file is memory mapped and beacon entries are used in place.
+// ==============================================================
+
+#ifndef __BEACONCACHE_H
+#define __BEACONCACHE_H
+
+#include "D3D9Util.h"
+#include "BeaconArray.h"
+#include <vector>
+
+#define BEACONCACHE_DIR			"Modules/D3D9Client/Cache"
+#define BEACONCACHE_VERSION		1
+
+/**
+ * \brief Cache file header
+ */
+typedef struct {
+	DWORD				magic;			///< 'BCNC'
+	DWORD				version;		///< BEACONCACHE_VERSION
+	unsigned __int64	key;			///< Hash of the source file and parameters
+	DWORD				size;			///< Total file size in bytes
+	DWORD				reserved;
+} BCHEADER;
+
+
+class BeaconCache
+{
+
+public:
+
+	/**
+	 * \brief Compute the key of a light set
+	 * \param src Source configuration file
+	 * \param kind Short name of the light set, used as the cache file extension
+	 * \param prm Parameters the generated lights depend on
+	 * \param nprm Number of parameters
+	 */
+	BeaconCache(const char *src, const char *kind, const double *prm, int nprm);
+	~BeaconCache();
+
+	/**
+	 * \brief Map the cache file for reading
+	 * \return false if the file is missing or stale
+	 */
+	bool	Open();
+	void	Close();
+
+	/**
+	 * \brief Read from the mapped file. Records are 8 byte aligned.
+	 * \return false if the request exceeds the file
+	 */
+	bool	Read(void *data, DWORD bytes);
+	template <class T> bool Get(T &v) { return Read(&v, sizeof(T)); }
+
+	/**
+	 * \brief Get a pointer to beacon entries within the mapped file
+	 * \return NULL if the request exceeds the file
+	 */
+	const BeaconArrayEntry *GetEntries(DWORD count);
+
+	/**
+	 * \brief Append to the write buffer. Records are 8 byte aligned.
+	 */
+	void	Write(const void *data, DWORD bytes);
+	template <class T> void Put(const T &v) { Write(&v, sizeof(T)); }
+	void	PutEntries(const std::vector<BeaconArrayEntry> &list);
+
+	/**
+	 * \brief Write the buffer to disk
+	 */
+	bool	Save();
+
+	bool	IsValid() const { return key != 0; }
+
+private:
+
+	static unsigned __int64 Hash(const void *data, size_t bytes, unsigned __int64 h);
+
+	unsigned __int64	key;
+	char				path[MAX_PATH];
+	HANDLE				hFile;
+	HANDLE				hMap;
+	const BYTE *		pData;
+	DWORD				nData;
+	DWORD				iPos;
+	std::vector<BYTE>	Buffer;
+};
+
+#endif // !__BEACONCACHE_H
@@ -0,0 +1,320 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "BlitScheduler.h"
+#include "D3D9Surface.h"
+#include "Log.h"
+
+#define BLTSCHED_NONE	0xFFFFFFFF
+
+// ===========================================================================================
+//
+BlitScheduler::BlitScheduler() :
+	bFlushing(false)
+{
+
+}
+
+// ===========================================================================================
+//
+BlitScheduler::~BlitScheduler()
+{
+	// Surfaces are gone at this point, only release the bookkeeping
+	Targets.clear();
+}
+
+// ===========================================================================================
+//
+bool BlitScheduler::Covers(const RECT &a, const RECT &b)
+{
+	return (a.left <= b.left && a.top <= b.top && a.right >= b.right && a.bottom >= b.bottom);
+}
+
+// ===========================================================================================
+//
+bool BlitScheduler::Overlap(const RECT &a, const RECT &b)
+{
+	return (a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom);
+}
+
+// ===========================================================================================
+// Union of two rectangles, if it is a rectangle
+//
+bool BlitScheduler::Union(const RECT &a, const RECT &b, RECT *u)
+{
+	if (Covers(a, b)) { *u = a; return true; }
+	if (Covers(b, a)) { *u = b; return true; }
+
+	if (a.top == b.top && a.bottom == b.bottom && a.left <= b.right && b.left <= a.right) {
+		*u = _RECT(min(a.left, b.left), a.top, max(a.right, b.right), a.bottom);
+		return true;
+	}
+
+	if (a.left == b.left && a.right == b.right && a.top <= b.bottom && b.top <= a.bottom) {
+		*u = _RECT(a.left, min(a.top, b.top), a.right, max(a.bottom, b.bottom));
+		return true;
+	}
+
+	return false;
+}
+
+// ===========================================================================================
+//
+int BlitScheduler::Find(D3D9ClientSurface *tgt) const
+{
+	for (size_t i = 0; i < Targets.size(); i++) if (Targets[i].pTgt == tgt) return int(i);
+	return -1;
+}
+
+// ===========================================================================================
+//
+bool BlitScheduler::Uses(const TARGET &tg, D3D9ClientSurface *surf) const
+{
+	if (surf->nSchedSrc == 0) return false;
+	for (size_t i = 0; i < tg.Blits.size(); i++) if (tg.Blits[i].pSrc == surf) return true;
+	return false;
+}
+
+// ===========================================================================================
+// Clear the hazard tracking of a target and its sources
+//
+void BlitScheduler::Release(TARGET &tg)
+{
+	tg.pTgt->bSchedTgt = false;
+	for (size_t i = 0; i < tg.Blits.size(); i++) tg.Blits[i].pSrc->nSchedSrc--;
+}
+
+// ===========================================================================================
+//
+bool BlitScheduler::Add(D3D9ClientSurface *src, D3D9ClientSurface *tgt, const RECT &s, const RECT &t)
+{
+	if (bFlushing || src == tgt) return false;
+
+	// Same surfaces the blit group queue can handle ------------------------------------------
+	//
+	if (tgt->bBackBuffer || tgt->pTex == NULL || !tgt->IsRenderTarget()) return false;
+	if (tgt->bDCOpen || tgt->bBltGroup || tgt->iBindCount > 0 || tgt->SketchPad) return false;
+	if (src->pTex == NULL || src->bDCOpen || src->iBindCount > 0) return false;
+
+	// FlushTech samples points and keeps the alpha, which matches StretchRect only for
+	// unscaled blits between equal formats. Keyed blits go through the queue as in blit groups.
+	//
+	if (src->ColorKey == 0 && src->desc.Format != tgt->desc.Format) return false;
+	if ((s.right - s.left) != (t.right - t.left) || (s.bottom - s.top) != (t.bottom - t.top)) return false;
+
+	// Leave invalid input for CopyRect() to report
+	//
+	if (s.left < 0 || s.top < 0 || s.right <= s.left || s.bottom <= s.top) return false;
+	if (t.left < 0 || t.top < 0) return false;
+	if (s.right > long(src->desc.Width) || s.bottom > long(src->desc.Height)) return false;
+	if (t.right > long(tgt->desc.Width) || t.bottom > long(tgt->desc.Height)) return false;
+
+	// Source must be complete and pending reads of the target done before it's written
+	//
+	if (src->bSchedTgt) Flush(src);
+	if (tgt->nSchedSrc) Flush(tgt);
+
+	int idx = Find(tgt);
+
+	if (idx < 0) {
+		Targets.push_back(TARGET());
+		idx = int(Targets.size()) - 1;
+		Targets[idx].pTgt = tgt;
+		Targets[idx].Blits.reserve(64);
+		tgt->bSchedTgt = true;
+	}
+
+	std::vector<BLT> &list = Targets[idx].Blits;
+
+	// An opaque blit hides everything it covers ---------------------------------------------
+	//
+	if (src->ColorKey == 0) {
+		size_t k = 0;
+		for (size_t i = 0; i < list.size(); i++) {
+			if (Covers(t, list[i].t)) {
+				list[i].pSrc->nSchedSrc--;
+				D3D9Stats.Blit.Dropped++;
+			}
+			else list[k++] = list[i];
+		}
+		list.resize(k);
+	}
+
+	BLT b = { src, s, t };
+	list.push_back(b);
+	src->nSchedSrc++;
+
+	D3D9Stats.Blit.Requests++;
+
+	if (list.size() >= BLTSCHED_MAX) Submit(idx);
+
+	return true;
+}
+
+// ===========================================================================================
+// Merge a blit into an earlier one from the same source with the same offset. A blit is
+// only moved back over blits it doesn't overlap.
+//
+void BlitScheduler::Merge(std::vector<BLT> &list)
+{
+	size_t n = list.size();
+
+	for (size_t j = 1; j < n; j++) {
+
+		BLT &bj = list[j];
+		long dx = bj.s.left - bj.t.left;
+		long dy = bj.s.top - bj.t.top;
+
+		for (size_t i = j; i-- > 0 && j - i <= BLTSCHED_WINDOW;) {
+
+			BLT &bi = list[i];
+			if (bi.pSrc == NULL) continue;
+
+			RECT u;
+			if (bi.pSrc == bj.pSrc && bi.s.left - bi.t.left == dx && bi.s.top - bi.t.top == dy && Union(bi.t, bj.t, &u)) {
+				bi.t = u;
+				bi.s = _RECT(u.left + dx, u.top + dy, u.right + dx, u.bottom + dy);
+				bj.pSrc = NULL;
+				D3D9Stats.Blit.Merged++;
+				break;
+			}
+
+			if (Overlap(bi.t, bj.t)) break;
+		}
+	}
+
+	size_t k = 0;
+	for (size_t i = 0; i < n; i++) if (list[i].pSrc) list[k++] = list[i];
+	list.resize(k);
+}
+
+// ===========================================================================================
+//
+void BlitScheduler::Submit(int idx)
+{
+	bFlushing = true;
+
+	TARGET tg;
+	tg.pTgt = Targets[idx].pTgt;
+	tg.Blits.swap(Targets[idx].Blits);
+	Targets.erase(Targets.begin() + idx);
+
+	Release(tg);
+
+	std::vector<BLT> &list = tg.Blits;
+
+	Merge(list);
+
+	DWORD n = DWORD(list.size());
+
+	// Sort into per-source batches, a blit joins the latest batch of its source unless
+	// a batch in between overlaps it --------------------------------------------------------
+	//
+	Batches.clear();
+	Next.assign(n, BLTSCHED_NONE);
+
+	for (DWORD j = 0; j < n; j++) {
+
+		int target = -1;
+
+		for (int g = int(Batches.size()) - 1; g >= 0; g--) {
+			if (list[Batches[g].iFirst].pSrc == list[j].pSrc) {
+				target = g;
+				break;
+			}
+			if (Overlap(Batches[g].bounds, list[j].t)) break;
+		}
+
+		if (target >= 0) {
+			BATCH &b = Batches[target];
+			Next[b.iLast] = j;
+			b.iLast = j;
+			b.bounds.left = min(b.bounds.left, list[j].t.left);
+			b.bounds.top = min(b.bounds.top, list[j].t.top);
+			b.bounds.right = max(b.bounds.right, list[j].t.right);
+			b.bounds.bottom = max(b.bounds.bottom, list[j].t.bottom);
+		}
+		else {
+			BATCH b = { j, j, list[j].t };
+			Batches.push_back(b);
+		}
+	}
+
+	// Submit through the blit group queue --------------------------------------------------
+	//
+	D3D9ClientSurface *pTgt = tg.pTgt;
+
+	if (n && pTgt->BeginBlitGroup() == S_OK) {
+
+		for (size_t g = 0; g < Batches.size(); g++) {
+			DWORD count = 0;
+			for (DWORD k = Batches[g].iFirst; k != BLTSCHED_NONE; k = Next[k], count++) {
+				pTgt->AddQueue(list[k].pSrc, &list[k].s, &list[k].t);
+			}
+			D3D9Stats.Blit.Draws += (count + BLTSCHED_BATCH - 1) / BLTSCHED_BATCH;
+		}
+
+		pTgt->EndBlitGroup();
+	}
+	else if (n) {
+		LogWrn("BlitScheduler: BeginBlitGroup() failed for %s, blitting one by one", _PTR(pTgt));
+		for (DWORD k = 0; k < n; k++) pTgt->CopyRect(list[k].pSrc, &list[k].s, &list[k].t);
+		D3D9Stats.Blit.Draws += n;
+	}
+
+	bFlushing = false;
+}
+
+// ===========================================================================================
+//
+void BlitScheduler::Flush(D3D9ClientSurface *surf)
+{
+	if (bFlushing) return;
+
+	for (int i = int(Targets.size()) - 1; i >= 0; i--) {
+		if (i >= int(Targets.size())) continue;
+		if (Targets[i].pTgt == surf || Uses(Targets[i], surf)) Submit(i);
+	}
+}
+
+// ===========================================================================================
+//
+void BlitScheduler::Discard(D3D9ClientSurface *tgt)
+{
+	if (bFlushing) return;
+
+	int idx = Find(tgt);
+	if (idx < 0) return;
+
+	D3D9Stats.Blit.Dropped += DWORD(Targets[idx].Blits.size());
+
+	Release(Targets[idx]);
+	Targets.erase(Targets.begin() + idx);
+}
+
+// ===========================================================================================
+//
+void BlitScheduler::FlushAll()
+{
+	if (bFlushing) return;
+	while (!Targets.empty()) Submit(int(Targets.size()) - 1);
+}
+
+// ===========================================================================================
+//
+void BlitScheduler::Remove(D3D9ClientSurface *surf)
+{
+	if (surf->bSchedTgt) Discard(surf);
+	if (surf->nSchedSrc) Flush(surf);
+}
+
+// ===========================================================================================
+//
+DWORD BlitScheduler::GetPendingCount() const
+{
+	DWORD n = 0;
+	for (size_t i = 0; i < Targets.size(); i++) n += DWORD(Targets[i].Blits.size());
+	return n;
+}
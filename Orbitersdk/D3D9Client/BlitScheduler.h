@@ -0,0 +1,102 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class BlitScheduler (interface)
+//
+// Collects blits into render target textures outside of explicit
+// blit groups and submits them through the blit group queue when
+// the target is read next. Before submission blits covered by a
+// later opaque blit are dropped, blits from the same source with
+// the same offset are merged into larger rectangles and the rest
+// are sorted into per-source batches without changing the result.
+//
+// Hazards are tracked per surface: a surface that is a target of
+// pending blits is flushed before it is read, and a surface that
+// is a source of pending blits is flushed before it is written.
+// ==============================================================
+
+#ifndef __BLITSCHEDULER_H
+#define __BLITSCHEDULER_H
+
+#include "D3D9Util.h"
+#include <vector>
+
+#define BLTSCHED_MAX		512		// Pending blits per target before a forced flush
+#define BLTSCHED_WINDOW		64		// Number of earlier blits searched when merging
+#define BLTSCHED_BATCH		16		// Blits per draw in D3D9ClientSurface::FlushQueue()
+
+class D3D9ClientSurface;
+
+class BlitScheduler
+{
+
+public:
+
+	BlitScheduler();
+	~BlitScheduler();
+
+	/**
+	 * \brief Schedule a blit
+	 * \return false if the blit can't be deferred, it must be done immediately
+	 */
+	bool	Add(D3D9ClientSurface *src, D3D9ClientSurface *tgt, const RECT &s, const RECT &t);
+
+	/**
+	 * \brief Submit all pending blits reading or writing a surface
+	 */
+	void	Flush(D3D9ClientSurface *surf);
+
+	/**
+	 * \brief Drop pending blits into a surface which is about to be overwritten
+	 */
+	void	Discard(D3D9ClientSurface *tgt);
+
+	/**
+	 * \brief Submit everything
+	 */
+	void	FlushAll();
+
+	/**
+	 * \brief A surface is being destroyed
+	 */
+	void	Remove(D3D9ClientSurface *surf);
+
+	DWORD	GetPendingCount() const;
+
+private:
+
+	struct BLT {
+		D3D9ClientSurface *pSrc;
+		RECT	s, t;
+	};
+
+	struct TARGET {
+		D3D9ClientSurface *pTgt;
+		std::vector<BLT> Blits;
+	};
+
+	struct BATCH {
+		DWORD	iFirst, iLast;		// First and last blit, linked through Next
+		RECT	bounds;				// Target area covered by the batch
+	};
+
+	static bool	Covers(const RECT &a, const RECT &b);
+	static bool	Overlap(const RECT &a, const RECT &b);
+	static bool	Union(const RECT &a, const RECT &b, RECT *u);
+
+	int		Find(D3D9ClientSurface *tgt) const;
+	bool	Uses(const TARGET &tg, D3D9ClientSurface *surf) const;
+	void	Release(TARGET &tg);
+	void	Submit(int idx);
+	void	Merge(std::vector<BLT> &list);
+
+	std::vector<TARGET>	Targets;
+	std::vector<BATCH>	Batches;
+	std::vector<DWORD>	Next;
+	bool				bFlushing;
+};
+
+#endif // !__BLITSCHEDULER_H
@@ -0,0 +1,177 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "BufferPool.h"
+#include "Log.h"
+
+// ===========================================================================================
+//
+BufferPool::BufferPool(BufferFactory *_pFactory, size_t _budget, DWORD _maxnew) :
+	pFactory(_pFactory),
+	budget(_budget),
+	maxnew(_maxnew),
+	nNew(0),
+	frame(0)
+{
+	memset(&stats, 0, sizeof(STATS));
+	InitializeCriticalSection(&cs);
+}
+
+// ===========================================================================================
+//
+BufferPool::~BufferPool()
+{
+	Trim(0);
+	if (stats.Buffers) LogErr("BufferPool: %u buffers still in use", stats.Buffers);
+	delete pFactory;
+	DeleteCriticalSection(&cs);
+}
+
+// ===========================================================================================
+// Above BPOOL_MINSTEP*8 the classes are 1/8 of a power of two apart, at most 12.5% is wasted
+//
+DWORD BufferPool::ClassSize(DWORD size)
+{
+	DWORD step = BPOOL_MINSTEP;
+	while (step * 16 <= size) step <<= 1;
+	return (size + step - 1) & ~(step - 1);
+}
+
+// ===========================================================================================
+//
+void * BufferPool::Alloc(DWORD size, DWORD *pSize, bool bDefer)
+{
+	DWORD csize = ClassSize(size);
+	void *pBuf = NULL;
+
+	EnterCriticalSection(&cs);
+
+	auto it = Spare.find(csize);
+
+	if (it != Spare.end() && !it->second.empty()) {
+		pBuf = it->second.back().pBuf;
+		it->second.pop_back();
+		stats.Hits++;
+		stats.Idle--;
+		stats.IdleBytes -= csize;
+	}
+	else if (bDefer && maxnew && nNew >= maxnew) {
+		stats.Deferred++;
+	}
+	else {
+		pBuf = pFactory->Create(csize);
+		if (pBuf) {
+			nNew++;
+			stats.Misses++;
+			stats.Buffers++;
+			stats.Bytes += csize;
+		}
+		else LogErr("BufferPool: Failed to create a buffer (%u bytes)", csize);
+	}
+
+	LeaveCriticalSection(&cs);
+
+	if (pSize) *pSize = (pBuf ? csize : 0);
+	return pBuf;
+}
+
+// ===========================================================================================
+//
+void BufferPool::Free(void *pBuf, DWORD size)
+{
+	if (!pBuf) return;
+
+	EnterCriticalSection(&cs);
+
+	if (ClassSize(size) != size) {
+		LogErr("BufferPool: Buffer size %u isn't a size class", size);
+		pFactory->Release(pBuf);
+		stats.Buffers--;
+		stats.Bytes -= size;
+	}
+	else {
+		SPARE s = { pBuf, frame };
+		Spare[size].push_back(s);
+		stats.Idle++;
+		stats.IdleBytes += size;
+	}
+
+	LeaveCriticalSection(&cs);
+}
+
+// ===========================================================================================
+//
+void BufferPool::ReleaseOldest(std::deque<SPARE> &list, DWORD size)
+{
+	pFactory->Release(list.front().pBuf);
+	list.pop_front();
+	stats.Trimmed++;
+	stats.Buffers--;
+	stats.Idle--;
+	stats.Bytes -= size;
+	stats.IdleBytes -= size;
+}
+
+// ===========================================================================================
+//
+DWORD BufferPool::Trim(size_t _budget)
+{
+	DWORD count = 0;
+
+	EnterCriticalSection(&cs);
+
+	while (stats.Bytes > _budget && stats.Idle) {
+		// The front of each list is its least recently used buffer
+		auto oldest = Spare.end();
+		for (auto it = Spare.begin(); it != Spare.end(); ++it) {
+			if (it->second.empty()) continue;
+			if (oldest == Spare.end() || it->second.front().frame < oldest->second.front().frame) oldest = it;
+		}
+		ReleaseOldest(oldest->second, oldest->first);
+		count++;
+	}
+
+	LeaveCriticalSection(&cs);
+	return count;
+}
+
+// ===========================================================================================
+//
+void BufferPool::NewFrame()
+{
+	EnterCriticalSection(&cs);
+
+	frame++;
+	nNew = 0;
+
+	for (auto it = Spare.begin(); it != Spare.end(); ++it) {
+		while (!it->second.empty() && frame - it->second.front().frame > BPOOL_MAXIDLE) ReleaseOldest(it->second, it->first);
+	}
+
+	LeaveCriticalSection(&cs);
+
+	if (budget) Trim(budget);
+}
+
+// ===========================================================================================
+//
+void BufferPool::SetLimits(size_t _budget, DWORD _maxnew)
+{
+	EnterCriticalSection(&cs);
+	budget = _budget;
+	maxnew = _maxnew;
+	LeaveCriticalSection(&cs);
+}
+
+// ===========================================================================================
+//
+BufferPool::STATS BufferPool::GetStats(bool bReset)
+{
+	EnterCriticalSection(&cs);
+	STATS s = stats;
+	if (bReset) stats.Hits = stats.Misses = stats.Deferred = stats.Trimmed = 0;
+	LeaveCriticalSection(&cs);
+	return s;
+}
@@ -0,0 +1,134 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class BufferPool (interface)
+//
+// Recycling of the vertex and index buffers used by the surface
+// tiles. Requests are rounded up to size classes, eight per power
+// of two, so that buffers of similar size can be shared.
+//
+// Released buffers are kept idle for reuse. When the memory of all
+// buffers exceeds the budget, the idle buffers are released least
+// recently used first. Buffers left idle for BPOOL_MAXIDLE frames
+// are released in any case.
+//
+// The number of buffers created in a frame can be limited, a
+// request over the limit returns NULL and is expected to be
+// repeated in a later frame.
+//
+// The pool doesn't know about the device, buffers are created and
+// released through a BufferFactory.
+// ==============================================================
+
+#ifndef __BUFFERPOOL_H
+#define __BUFFERPOOL_H
+
+#include <windows.h>
+#include <map>
+#include <deque>
+
+#define BPOOL_MAXIDLE		3000	// Frames an idle buffer is kept
+#define BPOOL_MINSTEP		16		// Size class granularity of small buffers [bytes]
+
+/**
+ * \brief Creates and releases the buffers of a BufferPool
+ */
+class BufferFactory
+{
+public:
+	virtual ~BufferFactory() {}
+
+	/**
+	 * \brief Create a buffer
+	 * \param size Size in bytes
+	 * \return NULL on failure
+	 */
+	virtual void *	Create(DWORD size) = 0;
+	virtual void	Release(void *pBuf) = 0;
+};
+
+
+class BufferPool
+{
+
+public:
+
+	struct STATS {
+		DWORD	Hits;		///< Requests served with an idle buffer
+		DWORD	Misses;		///< Requests that created a buffer
+		DWORD	Deferred;	///< Requests refused by the per frame limit
+		DWORD	Trimmed;	///< Idle buffers released
+		DWORD	Buffers;	///< Buffers owned by the pool, in use or idle
+		DWORD	Idle;		///< Idle buffers
+		size_t	Bytes;		///< Memory of all buffers
+		size_t	IdleBytes;	///< Memory of the idle buffers
+	};
+
+	/**
+	 * \param pFactory Factory used for the buffers, owned by the pool
+	 * \param budget Memory of all buffers in bytes, 0 = unlimited
+	 * \param maxnew Buffers created per frame, 0 = unlimited
+	 */
+	BufferPool(BufferFactory *pFactory, size_t budget, DWORD maxnew);
+	~BufferPool();
+
+	/**
+	 * \brief Size of the class a request of 'size' bytes falls into
+	 */
+	static DWORD	ClassSize(DWORD size);
+
+	/**
+	 * \brief Get a buffer of at least 'size' bytes
+	 * \param pSize Receives the size of the buffer
+	 * \param bDefer If true, the request may be refused when the per frame limit is reached
+	 * \return NULL if refused or on failure
+	 */
+	void *	Alloc(DWORD size, DWORD *pSize, bool bDefer);
+
+	/**
+	 * \brief Return a buffer for reuse
+	 * \param size Size of the buffer as returned by Alloc()
+	 */
+	void	Free(void *pBuf, DWORD size);
+
+	/**
+	 * \brief Start a new frame, reset the per frame limit and trim the idle buffers
+	 */
+	void	NewFrame();
+
+	/**
+	 * \brief Release idle buffers, least recently used first, until all buffers fit the budget
+	 * \return Number of buffers released
+	 */
+	DWORD	Trim(size_t budget);
+
+	void	SetLimits(size_t budget, DWORD maxnew);
+
+	/**
+	 * \brief Counters since the last call, the sizes are current
+	 */
+	STATS	GetStats(bool bReset);
+
+private:
+
+	struct SPARE {
+		void *	pBuf;
+		DWORD	frame;		///< Frame the buffer was returned
+	};
+
+	void	ReleaseOldest(std::deque<SPARE> &list, DWORD size);
+
+	BufferFactory *pFactory;
+	std::map<DWORD, std::deque<SPARE>> Spare;	///< Idle buffers by size class, most recent last
+	STATS	stats;
+	size_t	budget;
+	DWORD	maxnew;
+	DWORD	nNew;		///< Buffers created in this frame
+	DWORD	frame;
+	CRITICAL_SECTION cs;
+};
+
+#endif // !__BUFFERPOOL_H
@@ -91,6 +91,9 @@ CSphereManager::CSphereManager(D3D9Client *gclient, const Scene *scene) : Planet
 	LoadTileData ();
 	LoadTextures ();
 
+	for (DWORD lvl = 1; lvl <= maxbaselvl; lvl++) BuildConeTable(lvl);
+	vislist.lvl = 0;
+
 	MATRIX3 R = {2000,0,0, 0,2000,0, 0,0,2000};
 
 	// rotation from galactic to ecliptic frame
@@ -332,9 +335,7 @@ void CSphereManager::Render (LPDIRECT3DDEVICE9 dev, int level, int bglvl)
 	RenderParam.viewap = atan(diagscale * tan(scn->GetCameraAperture()));
 
 	int startlvl = min (level, 8);
-	int hemisp, ilat, ilng, idx;
 	int  nlat = NLAT[startlvl];
-	int *nlng = NLNG[startlvl];
 	int texofs = patchidx[startlvl-1];
 	TILEDESC *td = tiledesc + texofs;
 	TEXCRDRANGE range = {0,1,0,1};
@@ -347,6 +348,14 @@ void CSphereManager::Render (LPDIRECT3DDEVICE9 dev, int level, int bglvl)
 
 	RenderParam.camdir = _V(rcam.m13, rcam.m23, rcam.m33);
 
+	CullPatches (startlvl);
+
+	D3DXMATRIX wmat[2];
+	wmat[0] = trans;
+	D3DXMatrixMultiply(&wmat[1], &TileManager::Rsouth, &trans); // flipped to southern hemisphere
+
+	const CONETABLE &ct = cones[startlvl];
+
 	WaitForSingleObject (tilebuf->hQueueMutex, INFINITE);
 
 	HR(Shader()->SetTechnique(eSkyDomeTech));
@@ -359,18 +368,13 @@ void CSphereManager::Render (LPDIRECT3DDEVICE9 dev, int level, int bglvl)
 
 	Shader()->BeginPass(0);
 	
-	for (hemisp = idx = 0; hemisp < 2; hemisp++) {
-		if (hemisp) { // flip world transformation to southern hemisphere
-			D3DXMatrixMultiply(&RenderParam.wmat, &TileManager::Rsouth, &RenderParam.wmat);
-		}
-		for (ilat = nlat-1; ilat >= 0; ilat--) {
-			for (ilng = 0; ilng < nlng[ilat]; ilng++) {
-				ProcessTile (startlvl, hemisp, ilat, nlat, ilng, nlng[ilat], td+idx, 
-					range, td[idx].tex, td[idx].ltex, td[idx].flag,
-					range, td[idx].tex, td[idx].ltex, td[idx].flag);
-				idx++;
-			}
-		}
+	for (size_t i = 0; i < vislist.idx.size(); i++) {
+		DWORD idx = vislist.idx[i];
+		int hemisp = ct.hemisp[idx];
+		RenderParam.wmat = wmat[hemisp];
+		ProcessTile (startlvl, hemisp, ct.ilat[idx], nlat, ct.ilng[idx], ct.nlng[idx], td+idx,
+			range, td[idx].tex, td[idx].ltex, td[idx].flag,
+			range, td[idx].tex, td[idx].ltex, td[idx].flag);
 	}
 
 	HR(Shader()->EndPass());
@@ -385,14 +389,7 @@ void CSphereManager::ProcessTile (int lvl, int hemisp, int ilat, int nlat, int i
 	const TEXCRDRANGE &range, LPDIRECT3DTEXTURE9 tex, LPDIRECT3DTEXTURE9 ltex, DWORD flag,
 	const TEXCRDRANGE &bkp_range, LPDIRECT3DTEXTURE9 bkp_tex, LPDIRECT3DTEXTURE9 bkp_ltex, DWORD bkp_flag)
 {
-	
-	static const double rad0 = sqrt(2.0)*PI05;
-	VECTOR3 cnt = TileCentre (hemisp, ilat, nlat, ilng, nlng);
-	double rad = rad0/(double)nlat;
-	double alpha = acos (dotp (RenderParam.camdir, cnt));
-	double adist = alpha - rad;
-	
-	if (adist > RenderParam.viewap) return;
+	// The patch cone has been tested by CullPatches()
 
 	SetWorldMatrix (ilng, nlng, ilat, nlat);
 
@@ -403,6 +400,119 @@ void CSphereManager::ProcessTile (int lvl, int hemisp, int ilat, int nlat, int i
 	RenderTile(lvl, hemisp, ilat, nlat, ilng, nlng, tile, range, tex, ltex, flag);
 }
 
+// =======================================================================
+// Patches are tested against the view cone with the conservative radius
+// sqrt(2)*pi/2/nlat. Runs of CSPH_GROUP patches of a latitude band share
+// a coarse cone enclosing the patch cones, the patches are tested only if
+// the coarse cone overlaps the view.
+
+void CSphereManager::BuildConeTable (int lvl)
+{
+	static const double rad0 = sqrt(2.0)*PI05;
+
+	CONETABLE &ct = cones[lvl];
+	int nlat = NLAT[lvl];
+	double rad = rad0/(double)nlat;
+
+	for (int hemisp = 0; hemisp < 2; hemisp++) {
+		for (int ilat = nlat-1; ilat >= 0; ilat--) {
+			int nlng = NLNG[lvl] ? NLNG[lvl][ilat] : 1;
+			for (int ilng0 = 0; ilng0 < nlng; ilng0 += CSPH_GROUP) {
+
+				CONETABLE::GROUP g;
+				g.first = DWORD(ct.x.size());
+				g.count = min(CSPH_GROUP, nlng - ilng0);
+
+				VECTOR3 axis = _V(0, 0, 0);
+
+				for (int ilng = ilng0; ilng < ilng0 + int(g.count); ilng++) {
+					VECTOR3 cnt = TileCentre (hemisp, ilat, nlat, ilng, nlng);
+					axis += cnt;
+					ct.x.push_back(float(cnt.x));
+					ct.y.push_back(float(cnt.y));
+					ct.z.push_back(float(cnt.z));
+					ct.rad.push_back(float(rad));
+					ct.crad.push_back(float(cos(rad)));
+					ct.srad.push_back(float(sin(rad)));
+					ct.hemisp.push_back(BYTE(hemisp));
+					ct.ilat.push_back(BYTE(ilat));
+					ct.ilng.push_back(WORD(ilng));
+					ct.nlng.push_back(WORD(nlng));
+				}
+
+				axis = unit(axis);
+
+				double grad = 0.0;
+				for (DWORD i = g.first; i < g.first + g.count; i++) {
+					double d = axis.x*ct.x[i] + axis.y*ct.y[i] + axis.z*ct.z[i];
+					grad = max(grad, acos(max(-1.0, min(1.0, d))) + rad);
+				}
+				grad = min(grad, PI);
+
+				g.x = float(axis.x);
+				g.y = float(axis.y);
+				g.z = float(axis.z);
+				g.rad = float(grad);
+				g.crad = float(cos(grad));
+				g.srad = float(sin(grad));
+
+				ct.groups.push_back(g);
+			}
+		}
+	}
+}
+
+// =======================================================================
+// The patch list is computed for an aperture extended by a margin and
+// reused until the camera has turned more than the margin. A cone with
+// radius r is outside the view if the angle to the camera direction
+// exceeds aperture+r, i.e. dot < cos(ap)cos(r) - sin(ap)sin(r).
+
+void CSphereManager::CullPatches (int lvl)
+{
+	const VECTOR3 &cd = RenderParam.camdir;
+
+	if (vislist.lvl == lvl && vislist.viewap == RenderParam.viewap) {
+		if (dotp(cd, vislist.camdir) >= cos(vislist.margin)) return;
+	}
+
+	vislist.lvl = lvl;
+	vislist.viewap = RenderParam.viewap;
+	vislist.margin = RenderParam.viewap * CSPH_CULL_MARGIN;
+	vislist.camdir = cd;
+	vislist.idx.clear();
+
+	D3D9Stats.CSphere.Rebuilds++;
+
+	const CONETABLE &ct = cones[lvl];
+
+	float ap = float(vislist.viewap + vislist.margin);
+	float cap = cos(ap), sap = sin(ap);
+	float cx = float(cd.x), cy = float(cd.y), cz = float(cd.z);
+
+	DWORD tested = DWORD(ct.groups.size());
+
+	for (size_t k = 0; k < ct.groups.size(); k++) {
+
+		const CONETABLE::GROUP &g = ct.groups[k];
+
+		if (ap + g.rad < float(PI)) {
+			if (cx*g.x + cy*g.y + cz*g.z < cap*g.crad - sap*g.srad) continue;
+		}
+
+		tested += g.count;
+
+		for (DWORD i = g.first; i < g.first + g.count; i++) {
+			if (ap + ct.rad[i] < float(PI)) {
+				if (cx*ct.x[i] + cy*ct.y[i] + cz*ct.z[i] < cap*ct.crad[i] - sap*ct.srad[i]) continue;
+			}
+			vislist.idx.push_back(i);
+		}
+	}
+
+	D3D9Stats.CSphere.Tested += tested;
+}
+
 // =======================================================================
 
 void CSphereManager::SetWorldMatrix (int ilng, int nlng, int ilat, int nlat)
@@ -13,6 +13,10 @@
 #define STRICT 1
 #include "TileMgr.h"
 #include "PlanetRenderer.h"
+#include <vector>
+
+#define CSPH_GROUP			4		// Patches per coarse visibility cone
+#define CSPH_CULL_MARGIN	0.25	// Margin of the cached patch list, relative to the viewport aperture
 
 class D3D9Config;
 
@@ -73,6 +77,12 @@ protected:
 	bool TileInView (int lvl, int ilat);
 	// Check if specified tile intersects viewport
 
+	void BuildConeTable (int lvl);
+	// Precompute the visibility cones of the patches of a level
+
+	void CullPatches (int lvl);
+	// Collect the patches whose cones overlap the view cone, coarse cones first
+
 	static const D3D9Config *cfg;    // configuration parameters
 	const Scene *scn;
 	static int *patchidx;            // texture offsets for different LOD levels
@@ -119,6 +129,29 @@ private:
 		double viewap;               // viewport aperture (semi-diagonal)
 	} RenderParam;
 
+	// Visibility cones of the patches of one level in render order, patch
+	// centres and radii are stored as separate arrays for the culling loop
+	struct CONETABLE {
+		struct GROUP {
+			DWORD first, count;          // range of patches
+			float x, y, z;               // cone axis
+			float rad, crad, srad;       // cone radius, its cosine and sine
+		};
+		std::vector<float> x, y, z;      // patch centre directions
+		std::vector<float> rad, crad, srad;
+		std::vector<BYTE>  hemisp, ilat;
+		std::vector<WORD>  ilng, nlng;
+		std::vector<GROUP> groups;
+	} cones[9];
+
+	struct {
+		std::vector<DWORD> idx;          // patches passing the cone test
+		int lvl;                         // level of the list, 0 if invalid
+		double viewap;                   // aperture of the list
+		double margin;                   // camera motion covered by the list
+		VECTOR3 camdir;                  // camera direction of the list
+	} vislist;
+
 	static DWORD vpX0, vpX1, vpY0, vpY1; // viewport boundaries
 	static double diagscale;
 };
@@ -42,12 +42,10 @@ CelestialSphere::CelestialSphere(D3D9Client *_gc)
 
 CelestialSphere::~CelestialSphere()
 {
-	if (nsbuf) {
-		for (DWORD i = 0; i < nsbuf; ++i) {
-			svtx[i]->Release();
-		}
-		delete []svtx;
+	for (DWORD i = 0; i < nsbuf; ++i) {
+		svtx[i]->Release();
 	}
+	if (svtx) delete []svtx;
 	if (ncline) delete []cnstvtx;
 	grdlng->Release();
 	grdlat->Release();
@@ -74,79 +72,63 @@ void CelestialSphere::LoadStars ()
 		oapiWriteLog("D3D9: WARNING: Inconsistent magnitude limits for background star brightness. Disabling background stars.");
 	}
 
-	DWORD nv;
+	DWORD i, j, nv;
 	float c;
-	int lvl, plvl = 256;
-	DWORD i, j, k, idx = 0;
-	DWORD bufsize = 16;
 	nsbuf = 0;
 	nsvtx = 0;
-	svtx = new LPDIRECT3DVERTEXBUFFER9[bufsize];
-
-	struct StarRec {
-		float lng, lat, mag;
-	} *data = new StarRec[maxNumVertices];
-
-	if (prm->mag_lo <= prm->mag_hi) { delete []data; return; }
-
-	// Read binary data from file
-	FILE *f;
-	fopen_s(&f, "Star.bin", "rb");
-	if (!f) { delete []data; return; }
-	while (nv = DWORD(fread (data, sizeof(StarRec), maxNumVertices, f))) {
-		// limit number of stars to predefined magnitude - SHOULD BE BINARY SEARCH
-		for (i = 0; i < nv; i++)
-			if (data[i].mag > prm->mag_lo) { nv = i; break; }
-		if (nv) {
-			if (nsbuf >= bufsize) { // grow vertex buffer list
-				LPDIRECT3DVERTEXBUFFER9 *tmp = new LPDIRECT3DVERTEXBUFFER9[bufsize+16];
-				memcpy (tmp, svtx, bufsize*sizeof(LPDIRECT3DVERTEXBUFFER9));
-				delete []svtx;
-				svtx = tmp;
-				bufsize += 16;
-			}
-			
-			pDevice->CreateVertexBuffer(UINT(nv*sizeof(VERTEX_XYZC)), D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &svtx[nsbuf], NULL);
-			VERTEX_XYZC *vbuf;
-			svtx[nsbuf]->Lock(0, 0, (LPVOID*)&vbuf, 0);
-			for (j = 0; j < nv; j++) {
-				StarRec &rec = data[j];
-				VERTEX_XYZC &v = vbuf[j];
-				xz = sphere_r * cos (rec.lat);
-				v.x = (float)(xz * cos (rec.lng));
-				v.z = (float)(xz * sin (rec.lng));
-				v.y = (float)(sphere_r * sin (rec.lat));
-
-				if (prm->map_log) c = (float)min (1.0, max (prm->brt_min, exp(-(rec.mag-prm->mag_hi)*a)));
-				else 			  c = (float)min (1.0, max (prm->brt_min, a*rec.mag+b));
-
-				v.col = D3DXCOLOR(c,c,c,1);
-				lvl = (int)(c*256.0*0.5);
-				if (lvl > 255) lvl = 255;
-				for (k = lvl; k < (DWORD)plvl; k++) lvlid[k] = idx;
-				plvl = lvl;
-				idx++;
-			}
-			svtx[nsbuf]->Unlock();
-			nsvtx += nv;
-			nsbuf++;
+	svtx = NULL;
+
+	for (i = 0; i < 256; i++) lvlid[i] = 0;
+
+	if (prm->mag_lo <= prm->mag_hi) return;
+
+	// Map the binary star data base, records are sorted by magnitude
+	if (!catalog.Open("Star.bin")) return;
+
+	const STARREC *data = catalog.Data();
+
+	// Brightness level of a star, decreasing with magnitude
+	auto level = [&](const STARREC &rec) -> float {
+		if (prm->map_log) return (float)min (1.0, max (prm->brt_min, exp(-(rec.mag-prm->mag_hi)*a)));
+		else 			  return (float)min (1.0, max (prm->brt_min, a*rec.mag+b));
+	};
+
+	// limit number of stars to predefined magnitude
+	DWORD nstar = catalog.Count(float(prm->mag_lo));
+
+	nsbuf = (nstar + maxNumVertices - 1) / maxNumVertices;
+	if (nsbuf) svtx = new LPDIRECT3DVERTEXBUFFER9[nsbuf];
+
+	for (i = 0; i < nsbuf; i++) {
+
+		nv = min(maxNumVertices, nstar - nsvtx);
+
+		pDevice->CreateVertexBuffer(UINT(nv*sizeof(VERTEX_XYZC)), D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &svtx[i], NULL);
+		VERTEX_XYZC *vbuf;
+		svtx[i]->Lock(0, 0, (LPVOID*)&vbuf, 0);
+		for (j = 0; j < nv; j++) {
+			const STARREC &rec = data[nsvtx + j];
+			VERTEX_XYZC &v = vbuf[j];
+			xz = sphere_r * cos (rec.lat);
+			v.x = (float)(xz * cos (rec.lng));
+			v.z = (float)(xz * sin (rec.lng));
+			v.y = (float)(sphere_r * sin (rec.lat));
+			c = level(rec);
+			v.col = D3DXCOLOR(c,c,c,1);
 		}
-		if (nv < maxNumVertices) break;
+		svtx[i]->Unlock();
+		nsvtx += nv;
 	}
-	fclose (f);
 
-	if (bufsize > nsbuf) { // shrink buffer list to size
-		LPDIRECT3DVERTEXBUFFER9 *tmp = new LPDIRECT3DVERTEXBUFFER9[nsbuf];
-		memcpy (tmp, svtx, nsbuf*sizeof(LPDIRECT3DVERTEXBUFFER9));
-		delete []svtx;
-		svtx = tmp;
+	// lvlid[k] is the number of stars with a brightness level above k. Brightness decreases
+	// monotonically along the data base, so each entry is a binary search
+	for (i = 0; i < 256; i++) {
+		DWORD n = catalog.Partition([&](const STARREC &rec) { return int(level(rec)*256.0*0.5) > int(i); });
+		lvlid[i] = min(n, nsvtx);
 	}
-
-	for (i = 0; i < (DWORD)plvl; i++) lvlid[i] = idx;
-
-	delete []data;
 }
 
+
 // ==============================================================
 
 void CelestialSphere::LoadConstellationLines()
@@ -10,6 +10,7 @@
 
 #include "D3D9Client.h"
 #include "D3D9Util.h"
+#include "StarCatalog.h"
 
 
 // ==============================================================
@@ -111,6 +112,7 @@ private:
 	UINT maxNumVertices;  ///< number of vertices to use for one chunk at star-drawing
 	DWORD nsvtx;          ///< total number of vertices over all buffers
 	LPDIRECT3DVERTEXBUFFER9 *svtx; ///< star vertex buffers
+	StarCatalog catalog;  ///< memory mapped star data base
 	int lvlid[256];       ///< star brightness hash table
 	DWORD ncline;         ///< number of constellation lines
 	VERTEX_XYZ  *cnstvtx; ///< vertex list of constellation lines
@@ -0,0 +1,309 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "CloudMap.h"
+#include "DXTCodec.h"
+#include <math.h>
+
+static const double CMAP_PI = 3.14159265358979323846;
+
+// ===========================================================================================
+// Sum of the alpha over one 4x4 block, the largest alpha is merged into mx
+//
+static inline DWORD BlockAlphaDXT1(const BYTE *b, DWORD &mx)
+{
+	// Index 3 is transparent in the three colour mode
+	WORD c0 = WORD(b[0] | (b[1] << 8));
+	WORD c1 = WORD(b[2] | (b[3] << 8));
+	if (c0 > c1) { mx = 255; return 16*255; }
+	DWORD bits = b[4] | (b[5] << 8) | (b[6] << 16) | (DWORD(b[7]) << 24);
+	DWORD n = 0;
+	for (int i = 0; i < 16; i++, bits >>= 2) if ((bits & 3) == 3) n++;
+	if (n < 16) mx = 255;
+	return (16 - n) * 255;
+}
+
+static inline DWORD BlockAlphaDXT3(const BYTE *b, DWORD &mx)
+{
+	DWORD sum = 0, m = 0;
+	for (int i = 0; i < 8; i++) {
+		DWORD lo = b[i] & 0xF, hi = b[i] >> 4;
+		sum += lo + hi;
+		m = max(m, max(lo, hi));
+	}
+	mx = max(mx, m * 17);
+	return sum * 17;
+}
+
+static inline DWORD BlockAlphaDXT5(const BYTE *b, DWORD &mx)
+{
+	DWORD a[8];
+	DXTCodec::AlphaPalette(b, a);
+	DWORD sum = 0;
+	for (int h = 0; h < 2; h++) {
+		DWORD bits = b[2+h*3] | (b[3+h*3] << 8) | (b[4+h*3] << 16);
+		for (int i = 0; i < 8; i++, bits >>= 3) {
+			sum += a[bits & 7];
+			mx = max(mx, a[bits & 7]);
+		}
+	}
+	return sum;
+}
+
+// ===========================================================================================
+// Sum of the alpha over n pixels or 4x4 blocks of a row, the largest alpha is merged into mx
+//
+static DWORD RowAlpha(D3DFORMAT fmt, const BYTE *p, int n, DWORD &mx)
+{
+	DWORD sum = 0;
+
+	switch (fmt) {
+	case D3DFMT_A8R8G8B8:
+		for (int x = 0; x < n; x++) { sum += p[x*4 + 3]; mx = max(mx, DWORD(p[x*4 + 3])); }
+		break;
+	case D3DFMT_A8:
+		for (int x = 0; x < n; x++) { sum += p[x]; mx = max(mx, DWORD(p[x])); }
+		break;
+	case D3DFMT_DXT1:
+		for (int x = 0; x < n; x++) sum += BlockAlphaDXT1(p + x*8, mx);
+		break;
+	case D3DFMT_DXT2:
+	case D3DFMT_DXT3:
+		for (int x = 0; x < n; x++) sum += BlockAlphaDXT3(p + x*16, mx);
+		break;
+	case D3DFMT_DXT4:
+	case D3DFMT_DXT5:
+		for (int x = 0; x < n; x++) sum += BlockAlphaDXT5(p + x*16, mx);
+		break;
+	}
+
+	return sum;
+}
+
+// ===========================================================================================
+//
+CloudMap::CloudMap() : rot(0.0)
+{
+	for (int k = 0; k <= CMAP_MAXLVL; k++) {
+		size_t n = size_t(CMAP_TILERES << k) * size_t(2*CMAP_TILERES << k);
+		Mean[k].assign(n, 0);
+		Max[k].assign(n, 255);
+	}
+	Src.assign(Mean[CMAP_MAXLVL].size(), -1);
+	InitializeCriticalSection(&cs);
+}
+
+// ===========================================================================================
+//
+CloudMap::~CloudMap()
+{
+	DeleteCriticalSection(&cs);
+}
+
+// ===========================================================================================
+//
+bool CloudMap::SampleAlpha(D3DFORMAT fmt, const BYTE *pData, int pitch, int w, int h, BYTE *pOut, BYTE *pMax)
+{
+	int bs, es;		// pixels per element side, bytes per element
+
+	switch (fmt) {
+	case D3DFMT_A8R8G8B8:	bs = 1; es = 4;  break;
+	case D3DFMT_A8:			bs = 1; es = 1;  break;
+	case D3DFMT_DXT1:		bs = 4; es = 8;  break;
+	case D3DFMT_DXT2:
+	case D3DFMT_DXT3:
+	case D3DFMT_DXT4:
+	case D3DFMT_DXT5:		bs = 4; es = 16; break;
+	default:
+		return false;
+	}
+
+	// Pixels or blocks
+	int nx = w / bs, ny = h / bs;
+	if (nx < CMAP_TILERES || ny < CMAP_TILERES || nx % CMAP_TILERES || ny % CMAP_TILERES) return false;
+
+	DWORD sum[CMAP_TILERES * CMAP_TILERES];
+	DWORD mx[CMAP_TILERES * CMAP_TILERES];
+	memset(sum, 0, sizeof(sum));
+	memset(mx, 0, sizeof(mx));
+
+	int ex = nx / CMAP_TILERES, ey = ny / CMAP_TILERES;
+
+	for (int y = 0; y < ny; y++) {
+		const BYTE *pRow = pData + y*pitch;
+		DWORD *pSum = sum + (y / ey) * CMAP_TILERES;
+		DWORD *pMx = mx + (y / ey) * CMAP_TILERES;
+		for (int i = 0; i < CMAP_TILERES; i++) pSum[i] += RowAlpha(fmt, pRow + i*ex*es, ex, pMx[i]);
+	}
+
+	DWORD n = DWORD(ex * ey * bs * bs);
+	for (int i = 0; i < CMAP_TILERES * CMAP_TILERES; i++) pOut[i] = BYTE((sum[i] + n/2) / n);
+	for (int i = 0; i < CMAP_TILERES * CMAP_TILERES; i++) pMax[i] = BYTE(mx[i]);
+	return true;
+}
+
+// ===========================================================================================
+//
+void CloudMap::AddTile(int lvl, int ilat, int ilng, const BYTE *pSamples, const BYTE *pPeaks)
+{
+	if (lvl < 0 || lvl > CMAP_MAXLVL) return;
+	if (ilat < 0 || ilat >= (1 << lvl) || ilng < 0 || ilng >= (2 << lvl)) return;
+
+	int s = 1 << (CMAP_MAXLVL - lvl);		// texels per sample
+	int n = CMAP_TILERES * s;				// texels per tile side
+	int W = 2*CMAP_TILERES << CMAP_MAXLVL;
+	int r0 = ilat * n, c0 = ilng * n;
+
+	EnterCriticalSection(&cs);
+
+	BYTE *pMean = &Mean[CMAP_MAXLVL][0];
+	BYTE *pMax = &Max[CMAP_MAXLVL][0];
+
+	for (int r = 0; r < n; r++) {
+		const BYTE *pRow = pSamples + (r / s) * CMAP_TILERES;
+		const BYTE *pPeak = pPeaks + (r / s) * CMAP_TILERES;
+		size_t idx = size_t(r0 + r) * W + c0;
+		for (int c = 0; c < n; c++, idx++) {
+			if (Src[idx] > lvl) continue;	// finer data present
+			Src[idx] = (signed char)lvl;
+			pMean[idx] = pRow[c / s];
+			pMax[idx] = pPeak[c / s];
+		}
+	}
+
+	UpdatePyramid(r0, r0 + n, c0, c0 + n);
+
+	LeaveCriticalSection(&cs);
+}
+
+// ===========================================================================================
+// Rebuild the coarser levels over rows r0..r1-1 and columns c0..c1-1 of the finest level
+//
+void CloudMap::UpdatePyramid(int r0, int r1, int c0, int c1)
+{
+	for (int k = CMAP_MAXLVL - 1; k >= 0; k--) {
+
+		r0 >>= 1; r1 = (r1 + 1) >> 1;
+		c0 >>= 1; c1 = (c1 + 1) >> 1;
+
+		int W = 2*CMAP_TILERES << k;
+		const BYTE *pMs = &Mean[k+1][0], *pXs = &Max[k+1][0];
+		BYTE *pMd = &Mean[k][0], *pXd = &Max[k][0];
+
+		for (int r = r0; r < r1; r++) {
+			for (int c = c0; c < c1; c++) {
+				size_t a = size_t(2*r) * (2*W) + 2*c;
+				size_t b = a + 2*W;
+				pMd[size_t(r)*W + c] = BYTE((pMs[a] + pMs[a+1] + pMs[b] + pMs[b+1] + 2) >> 2);
+				pXd[size_t(r)*W + c] = max(max(pXs[a], pXs[a+1]), max(pXs[b], pXs[b+1]));
+			}
+		}
+	}
+}
+
+// ===========================================================================================
+//
+void CloudMap::SetRotation(double _rot)
+{
+	EnterCriticalSection(&cs);
+	rot = _rot;
+	LeaveCriticalSection(&cs);
+}
+
+// ===========================================================================================
+// Texel centres are at half integer positions, longitude wraps around
+//
+float CloudMap::Sample(const BYTE *pMap, int lvl, double lng, double lat) const
+{
+	int H = CMAP_TILERES << lvl, W = 2*H;
+
+	double x = (lng + rot + CMAP_PI) * (double(W) / (2.0*CMAP_PI)) - 0.5;
+	double y = (0.5*CMAP_PI - lat) * (double(H) / CMAP_PI) - 0.5;
+
+	x -= floor(x / W) * W;
+	y = max(0.0, min(double(H - 1), y));
+
+	int x0 = min(int(x), W - 1), y0 = int(y);
+	int x1 = (x0 + 1 == W ? 0 : x0 + 1), y1 = min(y0 + 1, H - 1);
+	float fx = float(x - x0), fy = float(y - y0);
+
+	const BYTE *p0 = pMap + size_t(y0) * W;
+	const BYTE *p1 = pMap + size_t(y1) * W;
+
+	float a = p0[x0] + (p0[x1] - p0[x0]) * fx;
+	float b = p1[x0] + (p1[x1] - p1[x0]) * fx;
+	return (a + (b - a) * fy) * (1.0f / 255.0f);
+}
+
+// ===========================================================================================
+//
+float CloudMap::Density(double lng, double lat, int lvl) const
+{
+	lvl = max(0, min(CMAP_MAXLVL, lvl));
+	EnterCriticalSection(&cs);
+	float d = Sample(&Mean[lvl][0], lvl, lng, lat);
+	LeaveCriticalSection(&cs);
+	return d;
+}
+
+// ===========================================================================================
+//
+void CloudMap::Density(int n, const double *lng, const double *lat, float *pOut, int lvl) const
+{
+	lvl = max(0, min(CMAP_MAXLVL, lvl));
+	EnterCriticalSection(&cs);
+	const BYTE *pMap = &Mean[lvl][0];
+	for (int i = 0; i < n; i++) pOut[i] = Sample(pMap, lvl, lng[i], lat[i]);
+	LeaveCriticalSection(&cs);
+}
+
+// ===========================================================================================
+// The level is chosen so that the area spans at most two texels in each direction
+//
+float CloudMap::MaxDensity(double latmin, double latmax, double lngmin, double lngmax) const
+{
+	double ext = max(latmax - latmin, lngmax - lngmin);
+
+	int k = CMAP_MAXLVL;
+	while (k > 0 && CMAP_PI / double(CMAP_TILERES << k) < ext) k--;
+
+	int H = CMAP_TILERES << k, W = 2*H;
+	double sy = double(H) / CMAP_PI, sx = double(W) / (2.0*CMAP_PI);
+
+	EnterCriticalSection(&cs);
+
+	int r0 = max(0, min(H - 1, int(floor((0.5*CMAP_PI - latmax) * sy))));
+	int r1 = max(0, min(H - 1, int(floor((0.5*CMAP_PI - latmin) * sy))));
+	int c0 = int(floor((lngmin + rot + CMAP_PI) * sx));
+	int c1 = int(floor((lngmax + rot + CMAP_PI) * sx));
+	if (c1 - c0 >= W) c1 = c0 + W - 1;
+
+	const BYTE *pMap = &Max[k][0];
+	BYTE m = 0;
+
+	for (int r = r0; r <= r1; r++) {
+		const BYTE *pRow = pMap + size_t(r) * W;
+		for (int c = c0; c <= c1; c++) m = max(m, pRow[((c % W) + W) % W]);
+	}
+
+	LeaveCriticalSection(&cs);
+	return float(m) * (1.0f / 255.0f);
+}
+
+// ===========================================================================================
+//
+int CloudMap::Level(double lng, double lat) const
+{
+	int H = CMAP_TILERES << CMAP_MAXLVL, W = 2*H;
+
+	EnterCriticalSection(&cs);
+
+	int c = int(floor((lng + rot + CMAP_PI) * (double(W) / (2.0*CMAP_PI))));
+	int r = max(0, min(H - 1, int(floor((0.5*CMAP_PI - lat) * (double(H) / CMAP_PI)))));
+	int lvl = Src[size_t(r) * W + ((c % W) + W) % W];
+
+	LeaveCriticalSection(&cs);
+	return lvl;
+}
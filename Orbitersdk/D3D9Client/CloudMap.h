@@ -0,0 +1,100 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class CloudMap (interface)
+//
+// Low resolution global map of the cloud density of a planet,
+// built from the alpha channel of the cloud tiles as the loader
+// reads them. A tile of level lvl adds CMAP_TILERES^2 samples,
+// finer tiles replace the data of coarser ones. Tiles above
+// CMAP_MAXLVL aren't sampled.
+//
+// The map is kept as two pyramids, one with the mean and one with
+// the maximum density. The maximum pyramid is built from the largest
+// alpha of each sample and counts unknown areas as fully clouded, so
+// that it can be used to skip cloud work safely.
+//
+// Queries are in planet longitude and latitude, the rotation of
+// the cloud layer (vPlanet::RenderPrm::cloudrot) is applied by the
+// map. The map doesn't depend on the device.
+// ==============================================================
+
+#ifndef __CLOUDMAP_H
+#define __CLOUDMAP_H
+
+#include <windows.h>
+#include <d3d9.h>
+#include <vector>
+
+#define CMAP_TILERES	8		// Density samples per tile side
+#define CMAP_MAXLVL		5		// Finest map level, same as the level of the cloud tiles it's built from
+
+class CloudMap
+{
+
+public:
+
+	CloudMap();
+	~CloudMap();
+
+	/**
+	 * \brief Average the alpha channel of a tile texture into CMAP_TILERES^2 samples
+	 * \param fmt Format of the texture, DXT1-5, A8R8G8B8 or A8
+	 * \param pData Locked top level of the texture
+	 * \param pitch Pitch of the locked level, in bytes per row of pixels or of 4x4 blocks
+	 * \param w, h Size of the texture
+	 * \param pOut Receives the mean of each sample, row 0 at the northern edge
+	 * \param pMax Receives the largest alpha within each sample
+	 * \return false if the format or size isn't supported
+	 */
+	static bool	SampleAlpha(D3DFORMAT fmt, const BYTE *pData, int pitch, int w, int h, BYTE *pOut, BYTE *pMax);
+
+	/**
+	 * \brief Add the samples of a cloud tile
+	 * \param lvl, ilat, ilng Tile index as in Tile::Extents()
+	 * \param pSamples, pPeaks CMAP_TILERES^2 means and maxima from SampleAlpha()
+	 */
+	void	AddTile(int lvl, int ilat, int ilng, const BYTE *pSamples, const BYTE *pPeaks);
+
+	/**
+	 * \brief Set the rotation of the cloud layer [rad]
+	 */
+	void	SetRotation(double rot);
+
+	/**
+	 * \brief Bilinear density [0..1] at a point, 0 where no data is loaded
+	 * \param lvl Map level to sample, lower levels are smoother
+	 */
+	float	Density(double lng, double lat, int lvl = CMAP_MAXLVL) const;
+
+	/**
+	 * \brief Density of n points, same as Density() but the map is locked only once
+	 */
+	void	Density(int n, const double *lng, const double *lat, float *pOut, int lvl = CMAP_MAXLVL) const;
+
+	/**
+	 * \brief Upper bound of the density [0..1] in an area, areas with no data count as 1
+	 */
+	float	MaxDensity(double latmin, double latmax, double lngmin, double lngmax) const;
+
+	/**
+	 * \brief Level of the tile the data at a point comes from, -1 if none
+	 */
+	int		Level(double lng, double lat) const;
+
+private:
+
+	void	UpdatePyramid(int r0, int r1, int c0, int c1);
+	float	Sample(const BYTE *pMap, int lvl, double lng, double lat) const;
+
+	std::vector<BYTE> Mean[CMAP_MAXLVL + 1];	// Mean density, level k is (CMAP_TILERES<<k) x (2*CMAP_TILERES<<k)
+	std::vector<BYTE> Max[CMAP_MAXLVL + 1];		// Maximum density, unknown = 255
+	std::vector<signed char> Src;				// Tile level of each texel of the finest level, -1 = none
+	double	rot;
+	mutable CRITICAL_SECTION cs;
+};
+
+#endif // !__CLOUDMAP_H
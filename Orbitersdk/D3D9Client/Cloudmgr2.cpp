@@ -14,6 +14,7 @@
 #include "Texture.h"
 #include "D3D9Catalog.h"
 #include "D3D9Config.h"
+#include "CloudMap.h"
 
 // =======================================================================
 // =======================================================================
@@ -59,6 +60,20 @@ void CloudTile::PreLoad()
 			cmgr->ZTreeManager(0)->ReleaseData(buf);
 		}
 	}
+
+	// Add the tile to the cloud density map
+	CloudMap *pMap = mgr->GetPlanet()->GetCloudMap();
+	if (pPreSrf && pMap && lvl >= 0 && lvl <= CMAP_MAXLVL) {
+		D3DSURFACE_DESC desc;
+		D3DLOCKED_RECT rect;
+		BYTE samples[CMAP_TILERES * CMAP_TILERES], peaks[CMAP_TILERES * CMAP_TILERES];
+		pPreSrf->GetLevelDesc(0, &desc);
+		if (pPreSrf->LockRect(0, &rect, NULL, D3DLOCK_READONLY) == S_OK) {
+			bool bOk = CloudMap::SampleAlpha(desc.Format, (const BYTE *)rect.pBits, rect.Pitch, desc.Width, desc.Height, samples, peaks);
+			pPreSrf->UnlockRect(0);
+			if (bOk) pMap->AddTile(lvl, ilat, ilng, samples, peaks);
+		}
+	}
 }
 
 
@@ -38,6 +38,10 @@
 #include "OapiExtension.h"
 #include "DebugControls.h"
 #include "Surfmgr2.h"
+#include "Profiler.h"
+#include "BlitScheduler.h"
+#include "DXTCodec.h"
+#include "TextureStreamer.h"
 #include <unordered_map>
 
 
@@ -194,6 +198,8 @@ DLLCLBK void ExitModule(HINSTANCE hDLL)
 	if (bNVAPI) if (NvAPI_Unload()==NVAPI_OK) LogAlw("[nVidia API Unloaded]");
 #endif
 
+	D3D9Profiler::Release();
+
 	LogAlw("Log Closed");
 	D3D9CloseLog();
 }
@@ -753,6 +759,7 @@ HWND D3D9Client::clbkCreateRenderWindow()
 
 	TileManager::GlobalInit(this);
 	TileManager2Base::GlobalInit(this);
+	TextureStreamer::GlobalInit(this);
 	PlanetRenderer::GlobalInit(this);
 	RingManager::GlobalInit(this);
 	HazeManager::GlobalInit(this);
@@ -845,6 +852,9 @@ void D3D9Client::clbkPostCreation()
 		if (pWM->IsOK() == false) SAFE_DELETE(pWM);
 	}
 
+	D3D9Profiler::SetThreadName("Render");
+	D3D9Profiler::Enable(Config->EnableProfiler != 0);
+
 	bRunning = true;
 
 	LogAlw("=============== Loading Completed and Visuals Created ================");
@@ -1078,6 +1088,12 @@ void D3D9Client::clbkCloseSession(bool fastclose)
 	//
 	bRunning = false;
 
+	if (D3D9Profiler::IsEnabled()) {
+		D3D9Profiler::LogSummary();
+		D3D9Profiler::ExportTrace("Modules/D3D9Client/D3D9ClientTrace.json");
+		D3D9Profiler::Enable(false);
+	}
+
 
 	// Face's Cleanup ShapeStore -----------------------
 	//
@@ -1149,12 +1165,14 @@ void D3D9Client::clbkDestroyRenderWindow (bool fastclose)
 	HazeManager2::GlobalExit();
 	TileManager::GlobalExit();
 	TileManager2Base::GlobalExit();
+	TextureStreamer::GlobalExit();
 	PlanetRenderer::GlobalExit();
 	D3D9ParticleStream::GlobalExit();
 	CSphereManager::GlobalExit();
 	vStar::GlobalExit();
 	vVessel::GlobalExit();
 	vObject::GlobalExit();
+	DXTCodec::GlobalExit();
 
 	SAFE_DELETE(defpen);
 	SAFE_DELETE(deffont);
@@ -1369,6 +1387,7 @@ D3D9Pad *D3D9Client::GetTopInterface() const
 void D3D9Client::clbkUpdate(bool running)
 {
 	_TRACE;
+	_PROFILE_ZONE("Update");
 	double tot_update = D3D9GetTime();
 	if (bFailed==false && bRunning) scene->Update();
 	D3D9SetTime(D3D9Stats.Timer.Update, tot_update);
@@ -1387,6 +1406,10 @@ void D3D9Client::clbkRenderScene()
 	if (bFailed) return;
 	if (!bRunning) return;
 
+	D3D9Profiler::EndFrame();
+
+	_PROFILE_ZONE("RenderScene");
+
 	if (pWM) pWM->Animate();
 
 	if (Config->PresentLocation == 1) PresentScene();
@@ -1412,6 +1435,9 @@ void D3D9Client::clbkRenderScene()
 	UINT mem = pDevice->GetAvailableTextureMem()>>20;
 	if (mem<32) TileBuffer::HoldThread(true);
 
+	// Submit the blits of the frame before the scene reads the panel and MFD surfaces
+	if (D3D9ClientSurface::GetBlitScheduler()) D3D9ClientSurface::GetBlitScheduler()->FlushAll();
+
 	scene->RenderMainScene();		// Render the main scene
 
 	VESSEL *hVes = oapiGetFocusInterface();
@@ -1443,6 +1469,10 @@ void D3D9Client::clbkRenderScene()
 
 	memset(&D3D9Stats.Old, 0, sizeof(D3D9Stats.Old));
 	memset(&D3D9Stats.Surf, 0, sizeof(D3D9Stats.Surf));
+
+	D3D9Text::NewFrame();
+	TileManager2Base::NewFrame();
+	TextureStreamer::NewFrame();
 }
 
 // ==============================================================
@@ -1457,6 +1487,7 @@ void D3D9Client::clbkTimeJump(double simt, double simdt, double mjd)
 
 void D3D9Client::PresentScene()
 {
+	_PROFILE_ZONE("Present");
 	double time = D3D9GetTime();
 
 	if (bFullscreen == false) {
@@ -1680,14 +1711,8 @@ void D3D9Client::clbkStoreMeshPersistent(MESHHANDLE hMesh, const char *fname)
 
 DEVMESHHANDLE D3D9Client::GetDevMesh(MESHHANDLE hMesh)
 {
-	const D3D9Mesh *pDevMesh = meshmgr->GetMesh(hMesh);
-	if (!pDevMesh) {
-		meshmgr->StoreMesh(hMesh, "GetDevMesh()");
-		pDevMesh = meshmgr->GetMesh(hMesh);
-	}
-
 	// Create a new Instance from a template
-	return DEVMESHHANDLE(new D3D9Mesh(hMesh, *pDevMesh));
+	return DEVMESHHANDLE(meshmgr->CreateInstance(hMesh, "GetDevMesh()"));
 }
 
 // ==============================================================
@@ -2206,6 +2231,8 @@ bool D3D9Client::clbkSaveSurfaceToImage(SURFHANDLE  surf,  const char *fname, Im
 
 	if (surf==NULL) surf = pFramework->GetBackBufferHandle();
 
+	SURFACE(surf)->Sync(false);
+
 	LPDIRECT3DSURFACE9 pRTG = NULL;
 	LPDIRECT3DSURFACE9 pSystem = NULL;
 	LPDIRECT3DSURFACE9 pSurf = SURFACE(surf)->pSurf;
@@ -2517,6 +2544,9 @@ int D3D9Client::clbkBeginBltGroup(SURFHANDLE tgt)
 		return -2;
 	}
 
+	// Scheduled blits must not be submitted while the group keeps the target bound
+	if (D3D9ClientSurface::GetBlitScheduler()) D3D9ClientSurface::GetBlitScheduler()->FlushAll();
+
 	if (tgt==RENDERTGT_MAINWINDOW) pBltGrpTgt = pFramework->GetBackBufferHandle();
 	else						   pBltGrpTgt = tgt;
 
@@ -2538,6 +2568,16 @@ int D3D9Client::clbkEndBltGroup()
 }
 
 
+// Defer a blit outside of blit groups, returns false if it must be done now
+//
+static bool ScheduleBlt(SURFHANDLE src, SURFHANDLE tgt, const RECT &rs, const RECT &rt)
+{
+	BlitScheduler *pSched = D3D9ClientSurface::GetBlitScheduler();
+	if (!pSched) return false;
+	return pSched->Add(SURFACE(src), SURFACE(tgt), rs, rt);
+}
+
+
 bool D3D9Client::CheckBltGroup(SURFHANDLE src, SURFHANDLE tgt) const
 {
 	if (tgt==pBltGrpTgt) {
@@ -2558,6 +2598,7 @@ bool D3D9Client::CheckBltGroup(SURFHANDLE src, SURFHANDLE tgt) const
 bool D3D9Client::clbkBlt(SURFHANDLE tgt, DWORD tgtx, DWORD tgty, SURFHANDLE src, DWORD flag) const
 {
 	_TRACE;
+	_PROFILE_ZONE("Blit");
 
 	double time = D3D9GetTime();
 
@@ -2574,7 +2615,7 @@ bool D3D9Client::clbkBlt(SURFHANDLE tgt, DWORD tgtx, DWORD tgty, SURFHANDLE src,
 		if (CheckBltGroup(src,tgt)) SURFACE(pBltGrpTgt)->AddQueue(SURFACE(src), &rs, &rt);
 		else 						SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
 	}
-	else SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
+	else if (!ScheduleBlt(src, tgt, rs, rt)) SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
 
 	D3D9SetTime(D3D9Stats.Timer.BlitTime, time);
 
@@ -2586,6 +2627,7 @@ bool D3D9Client::clbkBlt(SURFHANDLE tgt, DWORD tgtx, DWORD tgty, SURFHANDLE src,
 bool D3D9Client::clbkBlt(SURFHANDLE tgt, DWORD tgtx, DWORD tgty, SURFHANDLE src, DWORD srcx, DWORD srcy, DWORD w, DWORD h, DWORD flag) const
 {
 	_TRACE;
+	_PROFILE_ZONE("Blit");
 
 	double time = D3D9GetTime();
 
@@ -2599,7 +2641,7 @@ bool D3D9Client::clbkBlt(SURFHANDLE tgt, DWORD tgtx, DWORD tgty, SURFHANDLE src,
 		if (CheckBltGroup(src,tgt)) SURFACE(pBltGrpTgt)->AddQueue(SURFACE(src), &rs, &rt);
 		else 						SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
 	}
-	else SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
+	else if (!ScheduleBlt(src, tgt, rs, rt)) SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
 
 	D3D9SetTime(D3D9Stats.Timer.BlitTime, time);
 
@@ -2612,7 +2654,8 @@ bool D3D9Client::clbkScaleBlt (SURFHANDLE tgt, DWORD tgtx, DWORD tgty, DWORD tgt
                                SURFHANDLE src, DWORD srcx, DWORD srcy, DWORD srcw, DWORD srch, DWORD flag) const
 {
 	_TRACE;
-	
+	_PROFILE_ZONE("Blit");
+
 	double time = D3D9GetTime();
 
 	if (src==NULL) { LogErr("D3D9Client::clbkScaleBlt() Source surface is NULL"); return false; }
@@ -2625,7 +2668,7 @@ bool D3D9Client::clbkScaleBlt (SURFHANDLE tgt, DWORD tgtx, DWORD tgty, DWORD tgt
 		if (CheckBltGroup(src,tgt)) SURFACE(pBltGrpTgt)->AddQueue(SURFACE(src), &rs, &rt);
 		else 						SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
 	}
-	else SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
+	else if (!ScheduleBlt(src, tgt, rs, rt)) SURFACE(tgt)->CopyRect(SURFACE(src), &rs, &rt, flag);
 
 	D3D9SetTime(D3D9Stats.Timer.BlitTime, time);
 
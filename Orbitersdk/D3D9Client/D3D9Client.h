@@ -84,6 +84,54 @@ struct _D3D9Stats {
 		DWORD MtrlChanges;	///< Number of material changes
 	} Mesh;					///< Mesh related statistics
 
+	struct {
+		DWORD Commands;		///< Number of draw commands recorded
+		DWORD Batches;		///< Number of draws issued after merging
+		DWORD StateChanges;	///< Number of state groups applied
+	} Sketch;				///< Sketchpad related statistics
+
+	struct {
+		DWORD Requests;		///< Number of blits scheduled
+		DWORD Dropped;		///< Number of blits hidden by a later blit
+		DWORD Merged;		///< Number of blits merged into an earlier one
+		DWORD Draws;		///< Number of draws submitted
+	} Blit;					///< Blit scheduler statistics
+
+	struct {
+		DWORD Runs;			///< Number of text run lookups
+		DWORD Hits;			///< Number of lookups found in the cache
+		DWORD Glyphs;		///< Number of glyphs drawn
+	} Text;					///< Text layout statistics
+
+	struct {
+		DWORD Instances;	///< Number of instances submitted
+		DWORD Visible;		///< Number of instances passing the frustum test
+		DWORD Draws;		///< Number of instanced draws
+	} Inst;					///< Instance buffer statistics
+
+	struct {
+		DWORD Tested;		///< Number of visibility cones tested
+		DWORD Rebuilds;		///< Number of times the visible patch list was rebuilt
+	} CSphere;				///< Celestial sphere statistics
+
+	struct {
+		DWORD Hits;			///< Number of requests served with an idle buffer
+		DWORD Misses;		///< Number of buffers created
+		DWORD Deferred;		///< Number of requests deferred by the per frame limit
+		DWORD Trimmed;		///< Number of idle buffers released
+		DWORD Buffers;		///< Number of buffers, in use or idle
+		DWORD Idle;			///< Number of idle buffers
+		DWORD KBytes;		///< Memory of all buffers (kBytes)
+	} TilePool[2];			///< Tile vertex [0] and index [1] buffer pool statistics
+
+	struct {
+		DWORD Loads;		///< Number of mip level loads issued
+		DWORD Drops;		///< Number of mip level releases issued
+		DWORD Deferred;		///< Number of loads deferred by the budget or the loads in flight
+		DWORD Textures;		///< Number of streamed textures
+		DWORD KBytes;		///< Memory of the resident levels (kBytes)
+	} TexStream;			///< Mip level streaming statistics
+
 	struct {
 		DWORD Verts;		///< Number of vertices rendered
 		WORD  Tiles[32];	///< Number of tiles rendered (per level)
@@ -92,6 +140,7 @@ struct _D3D9Stats {
 	struct {
 		DWORD Verts;		///< Number of vertices rendered
 		WORD  Tiles[32];	///< Number of tiles rendered (per level)
+		DWORD Stitched;		///< Number of tiles whose edges were matched to new neighbour levels
 	} Surf;					///< Surface related statistics (new surface engine)
 
 	struct {
@@ -104,14 +153,13 @@ struct _D3D9Stats {
 		D3D9Time CamVis;		///< Object/camera updates
 		D3D9Time Surface;		///< Surface
 		D3D9Time Clouds;		///< Clouds
+		D3D9Time LightCluster;	///< Local light froxel assignment
 		//-------------------------------------------------------------
 		D3D9Time LockWait;		///< Time waiting GetDC or vertex buffer lock
 		D3D9Time BlitTime;		///<
 		D3D9Time GetDC;			///<
 	} Timer;					///< Render timing related statistics
 
-	DWORD TilesCached;		///< Number of cached tiles
-	DWORD TilesCachedMB;	///< Total size of tile cache (MBytes)
 	DWORD TilesAllocated;	///< Number of allocated tiles
 };
 
@@ -68,6 +68,14 @@ void D3D9Config::Reset ()
 	LODBias				= 0.0;
 	MeshRes				= 1;
 	TileDebug			= 0;
+	EnableProfiler		= 0;
+	BlitScheduler		= 1;
+	ConfigCache			= 1;
+	MeshCacheBudget		= 0;
+	TileBufferBudget	= 256;
+	TileBufferRate		= 32;
+	TexStreamBudget		= 512;
+	TexStreamMinSize	= 2048;
 	MicroMode			= 1;
 	MicroFilter			= 2;
 	BlendMode			= 1;
@@ -143,6 +151,14 @@ bool D3D9Config::ReadParams ()
 	if (oapiReadItem_int   (hFile, "TileMipmaps", i))			TileMipmaps = max(0, min(2, i));
 	if (oapiReadItem_int   (hFile, "TextureMips", i))			TextureMips = max(0, min(2, i));
 	if (oapiReadItem_int   (hFile, "TileDebug", i))				TileDebug = max(0, min(1, i));
+	if (oapiReadItem_int   (hFile, "EnableProfiler", i))		EnableProfiler = max(0, min(1, i));
+	if (oapiReadItem_int   (hFile, "BlitScheduler", i))			BlitScheduler = max(0, min(1, i));
+	if (oapiReadItem_int   (hFile, "ConfigCache", i))			ConfigCache = max(0, min(2, i));
+	if (oapiReadItem_int   (hFile, "MeshCacheBudget", i))		MeshCacheBudget = max(0, min(4096, i));
+	if (oapiReadItem_int   (hFile, "TileBufferBudget", i))		TileBufferBudget = max(0, min(4096, i));
+	if (oapiReadItem_int   (hFile, "TileBufferRate", i))		TileBufferRate = max(0, min(1024, i));
+	if (oapiReadItem_int   (hFile, "TexStreamBudget", i))		TexStreamBudget = max(0, min(8192, i));
+	if (oapiReadItem_int   (hFile, "TexStreamMinSize", i))		TexStreamMinSize = max(256, min(16384, i));
 	if (oapiReadItem_float (hFile, "StereoSeparation", d))		Separation = max(10.0, min(100.0, d));
 	if (oapiReadItem_float (hFile, "StereoConvergence", d))		Convergence = max(0.05, min(1.0, d));
 	if (oapiReadItem_int   (hFile, "DebugLvl", i))				DebugLvl = i;
@@ -222,6 +238,14 @@ void D3D9Config::WriteParams ()
 	oapiWriteItem_int   (hFile, "TileMipmaps", TileMipmaps);
 	oapiWriteItem_int   (hFile, "TextureMips", TextureMips);
 	oapiWriteItem_int   (hFile, "TileDebug", TileDebug);
+	oapiWriteItem_int   (hFile, "EnableProfiler", EnableProfiler);
+	oapiWriteItem_int   (hFile, "BlitScheduler", BlitScheduler);
+	oapiWriteItem_int   (hFile, "ConfigCache", ConfigCache);
+	oapiWriteItem_int   (hFile, "MeshCacheBudget", MeshCacheBudget);
+	oapiWriteItem_int   (hFile, "TileBufferBudget", TileBufferBudget);
+	oapiWriteItem_int   (hFile, "TileBufferRate", TileBufferRate);
+	oapiWriteItem_int   (hFile, "TexStreamBudget", TexStreamBudget);
+	oapiWriteItem_int   (hFile, "TexStreamMinSize", TexStreamMinSize);
 	oapiWriteItem_float (hFile, "StereoSeparation", Separation);
 	oapiWriteItem_float (hFile, "StereoConvergence", Convergence);
 	oapiWriteItem_int   (hFile, "DebugLvl", DebugLvl);
@@ -75,6 +75,14 @@ public:
 	double LODBias;					///< 3D Terrain resolution bias
 	int MeshRes;					///< Tile patch mesh resolution
 	int TileDebug;					///< Enable tile debugger
+	int EnableProfiler;				///< Record CPU timing zones and write a trace at session end
+	int BlitScheduler;				///< Defer and coalesce blits into render target textures
+	int ConfigCache;				///< Cache parsed configuration files (0=disabled, 1=enabled, 2=validate against fresh parses)
+	int MeshCacheBudget;			///< Memory budget of unused persistent mesh templates in MB (0=unlimited)
+	int TileBufferBudget;			///< Memory budget of surface tile vertex and index buffers in MB, idle buffers are released above it (0=unlimited)
+	int TileBufferRate;				///< Surface tile buffers created per frame, further tiles wait for the next frame (0=unlimited)
+	int TexStreamBudget;			///< Memory budget of streamed mesh textures in MB (0=streaming disabled)
+	int TexStreamMinSize;			///< Smallest texture size streamed [pixels]
 	int TextureMips;				///< Texture mipmap autogen policy
 	int PostProcess;				///< Enable postprocessing effects
 	int MicroMode;
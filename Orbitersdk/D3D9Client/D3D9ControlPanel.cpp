@@ -12,7 +12,9 @@
 #include "D3D9Client.h"
 #include "D3D9Surface.h"
 #include "D3D9Catalog.h"
+#include "D3D9TextMgr.h"
 #include "Mesh.h"
+#include "MeshMgr.h"
 #include "psapi.h"
 #include "DebugControls.h"
 
@@ -198,9 +200,21 @@ void D3D9Client::RenderControlPanel()
 	LabelPos += 22;
 	Label("Tile Textures Loaded.: %u (%u MB)", tile_count, tile_size>>20); 
 	Label("Tiles Rendered (Old).: %u (%u kVtx)", tile_render_countA, D3D9Stats.Old.Verts>>10);
-	Label("Tiles Rendered (New).: %u (%u kVtx)", tile_render_countB, D3D9Stats.Surf.Verts>>10);
+	Label("Tiles Rendered (New).: %u (%u kVtx, %u stitched)", tile_render_countB, D3D9Stats.Surf.Verts>>10, D3D9Stats.Surf.Stitched);
 	Label("Tiles Allocated (New): %u", D3D9Stats.TilesAllocated);
-	Label("Tile Vertex Cache....: %u (%u MB)", D3D9Stats.TilesCached, D3D9Stats.TilesCachedMB>>20);
+
+	static DWORD poolhit[2] = { 100, 100 }, pooldefer[2] = { 0, 0 }, pooltrim[2] = { 0, 0 };
+	static const char *poolname[2] = { "Tile Vertex Buffers..", "Tile Index Buffers..." };
+
+	for (int i = 0; i < 2; i++) {
+		Label("%s: %u (%u MB, %u idle), %u%% hits, %u deferred, %u trimmed", poolname[i], D3D9Stats.TilePool[i].Buffers,
+			D3D9Stats.TilePool[i].KBytes>>10, D3D9Stats.TilePool[i].Idle, poolhit[i], pooldefer[i], pooltrim[i]);
+	}
+
+	static DWORD strload = 0, strdrop = 0, strdefer = 0;
+
+	Label("Streamed Textures....: %u (%u MB), %u loads, %u drops, %u deferred", D3D9Stats.TexStream.Textures,
+		D3D9Stats.TexStream.KBytes>>10, strload, strdrop, strdefer);
 
 
 
@@ -221,11 +235,17 @@ void D3D9Client::RenderControlPanel()
 
 	static DWORD matchg = 0, texchg = 0;
 	static DWORD verts = 0, grps = 0, meshes = 0;
+	static DWORD skpcmd = 0, skpdraw = 0, skpchg = 0;
+	static DWORD bltreq = 0, bltdraw = 0, bltdrop = 0, bltmerge = 0;
+	static DWORD txtrun = 0, txthit = 0, txtglyph = 0;
+	static DWORD instsub = 0, instvis = 0, instdraw = 0;
+	static DWORD csphtest = 0, csphlist = 0;
 	static double DCPeak = 0.0;
 	static double LockPeak = 0.0;
 
 	LabelPos += 22;
 	Label("Meshes Loaded........: %u ", mesh_count);
+	Label("Mesh Templates.......: %u (%u MB)", meshmgr->GetCount(), DWORD(meshmgr->GetMemSize() >> 20));
 	Label("Vertices Allocated...: %u (%u MB)", tot_verts, (tot_verts*sizeof(NMVERTEX))>>20); 
 	Label("Groups Allocated.....: %u", tot_group);
 	Label("Group Tarnsforms.....: %u", tot_trans); 
@@ -234,6 +254,14 @@ void D3D9Client::RenderControlPanel()
 	Label("Meshes rendered......: %u", meshes);
 	Label("Texture changes......: %u", texchg);
 	Label("Material changes.....: %u", matchg);
+	Label("Sketchpad commands...: %u (%u draws, %u state chg)", skpcmd, skpdraw, skpchg);
+	Label("Scheduled blits......: %u (%u draws, %u dropped, %u merged)", bltreq, bltdraw, bltdrop, bltmerge);
+	Label("Text runs............: %u (%u cached, %u glyphs)", txtrun, txthit, txtglyph);
+	Label("Mesh instances.......: %u (%u visible, %u draws)", instsub, instvis, instdraw);
+	Label("Sky patch cone tests.: %u (%u list rebuilds)", csphtest, csphlist);
+
+	const D3D9FontAtlas *pAtlas = D3D9Text::GetAtlas();
+	if (pAtlas) Label("Glyph atlas..........: %u glyphs, %dx%d (%0.0f%% used)", pAtlas->GetGlyphCount(), pAtlas->GetWidth(), pAtlas->GetHeight(), pAtlas->GetOccupancy()*100.0);
 	Label("GetDC peak time......: %0.2fms", DCPeak*0.001);
 	Label("Lock wait peak time..: %0.2fms", LockPeak*0.001);
 
@@ -290,6 +318,31 @@ void D3D9Client::RenderControlPanel()
 		verts = DWORD(double(D3D9Stats.Mesh.Vertices) * iframes);
 		grps = DWORD(double(D3D9Stats.Mesh.MeshGrps) * iframes);
 		meshes = DWORD(double(D3D9Stats.Mesh.Meshes) * iframes);
+		skpcmd = DWORD(double(D3D9Stats.Sketch.Commands) * iframes);
+		skpdraw = DWORD(double(D3D9Stats.Sketch.Batches) * iframes);
+		skpchg = DWORD(double(D3D9Stats.Sketch.StateChanges) * iframes);
+		bltreq = DWORD(double(D3D9Stats.Blit.Requests) * iframes);
+		bltdraw = DWORD(double(D3D9Stats.Blit.Draws) * iframes);
+		bltdrop = DWORD(double(D3D9Stats.Blit.Dropped) * iframes);
+		bltmerge = DWORD(double(D3D9Stats.Blit.Merged) * iframes);
+		txtrun = DWORD(double(D3D9Stats.Text.Runs) * iframes);
+		txthit = DWORD(double(D3D9Stats.Text.Hits) * iframes);
+		txtglyph = DWORD(double(D3D9Stats.Text.Glyphs) * iframes);
+		instsub = DWORD(double(D3D9Stats.Inst.Instances) * iframes);
+		instvis = DWORD(double(D3D9Stats.Inst.Visible) * iframes);
+		instdraw = DWORD(double(D3D9Stats.Inst.Draws) * iframes);
+		csphtest = DWORD(double(D3D9Stats.CSphere.Tested) * iframes);
+		csphlist = DWORD(double(D3D9Stats.CSphere.Rebuilds) * iframes);
+
+		for (int i = 0; i < 2; i++) {
+			DWORD req = D3D9Stats.TilePool[i].Hits + D3D9Stats.TilePool[i].Misses;
+			poolhit[i] = (req ? DWORD((100.0 * D3D9Stats.TilePool[i].Hits) / req) : 100);
+			pooldefer[i] = D3D9Stats.TilePool[i].Deferred;
+			pooltrim[i] = D3D9Stats.TilePool[i].Trimmed;
+		}
+		strload = D3D9Stats.TexStream.Loads;
+		strdrop = D3D9Stats.TexStream.Drops;
+		strdefer = D3D9Stats.TexStream.Deferred;
 		DCPeak = D3D9Stats.Timer.GetDC.peak;
 		LockPeak = D3D9Stats.Timer.LockWait.peak;
 
@@ -327,6 +380,7 @@ void D3D9Client::RenderControlPanel()
 
 		// -------------------------------------
 		Reset(D3D9Stats.Timer.CamVis);
+		Reset(D3D9Stats.Timer.LightCluster);
 		Reset(D3D9Stats.Timer.Scene);
 		Reset(D3D9Stats.Timer.Update);
 		Reset(D3D9Stats.Timer.Display);
@@ -338,6 +392,16 @@ void D3D9Client::RenderControlPanel()
 		Reset(D3D9Stats.Timer.HUDOverlay);
 		// -------------------------------------
 		memset(&D3D9Stats.Mesh, 0, sizeof(D3D9Stats.Mesh));
+		memset(&D3D9Stats.Sketch, 0, sizeof(D3D9Stats.Sketch));
+		memset(&D3D9Stats.Blit, 0, sizeof(D3D9Stats.Blit));
+		memset(&D3D9Stats.Text, 0, sizeof(D3D9Stats.Text));
+		memset(&D3D9Stats.Inst, 0, sizeof(D3D9Stats.Inst));
+		memset(&D3D9Stats.CSphere, 0, sizeof(D3D9Stats.CSphere));
+		for (int i = 0; i < 2; i++) {
+			D3D9Stats.TilePool[i].Hits = D3D9Stats.TilePool[i].Misses = 0;
+			D3D9Stats.TilePool[i].Deferred = D3D9Stats.TilePool[i].Trimmed = 0;
+		}
+		D3D9Stats.TexStream.Loads = D3D9Stats.TexStream.Drops = D3D9Stats.TexStream.Deferred = 0;
 	}
 	
 
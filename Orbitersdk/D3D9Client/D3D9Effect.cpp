@@ -27,6 +27,7 @@ D3D9MatExt D3D9Effect::emissive_mat;
 D3DXHANDLE D3D9Effect::ePanelTech = 0;		// Used to draw a new style 2D panel
 D3DXHANDLE D3D9Effect::ePanelTechB = 0;		// Used to draw a new style 2D panel
 D3DXHANDLE D3D9Effect::eVesselTech = 0;		// Vessel exterior, surface bases.
+D3DXHANDLE D3D9Effect::eInstancedTech = 0;	// Instanced meshes, same passes as eVesselTech
 D3DXHANDLE D3D9Effect::eBBTech = 0;			// Bounding Box Tech
 D3DXHANDLE D3D9Effect::eTBBTech = 0;
 D3DXHANDLE D3D9Effect::eBSTech = 0;			// Bounding Sphere Tech
@@ -401,6 +402,7 @@ void D3D9Effect::D3D9TechInit(D3D9Client *_gc, LPDIRECT3DDEVICE9 _pDev, const ch
 	eSimpMesh	 = FX->GetTechniqueByName("SimplifiedTech");
 	eGeometry    = FX->GetTechniqueByName("GeometryTech");
 	eVesselTech		 = FX->GetTechniqueByName("VesselTech");
+	eInstancedTech	 = FX->GetTechniqueByName("InstancedTech");
 	eBaseShadowTech	 = FX->GetTechniqueByName("BaseShadowTech");
 	eBeaconArrayTech = FX->GetTechniqueByName("BeaconArrayTech");
 	eDiffuseTech     = FX->GetTechniqueByName("ParticleDiffuseTech");
@@ -82,6 +82,7 @@ public:
 	
 	// Techniques ----------------------------------------------------
 	static D3DXHANDLE	eVesselTech;     ///< Vessel exterior, surface bases
+	static D3DXHANDLE	eInstancedTech;  ///< Instanced meshes, same passes as eVesselTech
 	static D3DXHANDLE	eSimple;
 	static D3DXHANDLE	eBBTech;         ///< Bounding Box Tech
 	static D3DXHANDLE	eTBBTech;        ///< Bounding Box Tech
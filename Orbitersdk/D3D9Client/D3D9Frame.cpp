@@ -24,6 +24,7 @@
 using namespace oapi;
 
 IDirect3DVertexDeclaration9	*pMeshVertexDecl = NULL;
+IDirect3DVertexDeclaration9	*pInstVertexDecl = NULL;
 IDirect3DVertexDeclaration9	*pHazeVertexDecl = NULL;
 IDirect3DVertexDeclaration9	*pNTVertexDecl = NULL;
 IDirect3DVertexDeclaration9	*pBAVertexDecl = NULL;
@@ -119,6 +120,7 @@ HRESULT CD3DFramework9::DestroyObjects ()
 	SAFE_RELEASE(pPosTexDecl);
 	SAFE_RELEASE(pHazeVertexDecl);
 	SAFE_RELEASE(pMeshVertexDecl);
+	SAFE_RELEASE(pInstVertexDecl);
 	SAFE_RELEASE(pPatchVertexDecl);
 	SAFE_RELEASE(pGPUBlitDecl);
 	SAFE_RELEASE(pSketchpadDecl);
@@ -425,6 +427,7 @@ HRESULT CD3DFramework9::Initialize(HWND _hWnd, GraphicsClient::VIDEODATA *vData)
 	HR(pDevice->CreateVertexDeclaration(PosTexDecl,   &pPosTexDecl));
 	HR(pDevice->CreateVertexDeclaration(HazeVertexDecl,  &pHazeVertexDecl));
 	HR(pDevice->CreateVertexDeclaration(MeshVertexDecl,  &pMeshVertexDecl));
+	HR(pDevice->CreateVertexDeclaration(InstVertexDecl,  &pInstVertexDecl));
 	HR(pDevice->CreateVertexDeclaration(PatchVertexDecl, &pPatchVertexDecl));
 	HR(pDevice->CreateVertexDeclaration(GPUBlitDecl, &pGPUBlitDecl));
 	HR(pDevice->CreateVertexDeclaration(SketchpadDecl, &pSketchpadDecl));
@@ -28,6 +28,7 @@
 #include "Log.h"
 #include "Mesh.h"
 #include "Sketchpad2.h"
+#include <float.h>
 
 using namespace oapi;
 
@@ -224,6 +225,10 @@ void D3D9Pad::Reset()
 	bMustEndScene = false;
 	vI = 0;
 	iI = 0;
+	iCmd = 0;
+	iPass = -1;
+	bPointFilter = false;
+	memset(&State, 0, sizeof(SKPSTATE));
 	D3DXMatrixIdentity(&mO);
 	vTarget = D3DXVECTOR4(1,1,1,1);
 	pTgt = NULL;
@@ -445,39 +450,23 @@ bool D3D9Pad::Flush(HPOLY hPoly)
 	if (bBeginDraw == false) _wassert(L"D3D9Pad::Flush() called without BeginDrawing()", _CRT_WIDE(__FILE__), __LINE__);
 	
 	UINT numPasses;
-	static DWORD bkALPHA, bkZEN, bkZW, bkCULL;
+	static DWORD bkALPHA;
 
-	if ((iI == 0) && (hPoly == NULL)) {
+	CloseCommand();
+
+	if (CmdBuf.IsEmpty() && (hPoly == NULL)) {
 #ifdef SKPDBG 
 		Log("Flush (Nothing)", hPoly, iI);
 #endif
 		return false;
 	}
 
-	DWORD dwBlend = dwBlendState & 0xF;
-	DWORD dwFilter = dwBlendState & 0xF0;
-	
 #ifdef SKPDBG 
-	char buf[128]; strcpy_s(buf, 128, "");
-	char buf2[128]; strcpy_s(buf2, 128, "");
-
-	if (dwBlend == SKPBS_ALPHABLEND) strcpy_s(buf, 128, "SKPBS_ALPHABLEND");
-	if (dwBlend == SKPBS_COPY) strcpy_s(buf, 128, "SKPBS_COPY");
-	if (dwBlend == SKPBS_COPY_ALPHA) strcpy_s(buf, 128, "SKPBS_COPY_ALPHA");
-	if (dwBlend == SKPBS_COPY_COLOR) strcpy_s(buf, 128, "SKPBS_COPY_COLOR");
-	
-	if (bDepthEnable && pDep) strcpy_s(buf2, 128, "DEPTH_ENABLED");
-	else strcpy_s(buf2, 128, "DEPTH_DISABLED");
-
-	Log("Flush [%s] [%s] hPloy=%s, iI=%hu", buf, buf2, _PTR(hPoly), iI);
+	Log("Flush hPloy=%s, iI=%hu", _PTR(hPoly), iI);
 #endif
 
 	HR(pDev->GetRenderState(D3DRS_ALPHABLENDENABLE, &bkALPHA));
 
-	//HR(pDev->GetRenderState(D3DRS_ZENABLE, &bkZEN));
-	//HR(pDev->GetRenderState(D3DRS_ZWRITEENABLE, &bkZW));
-	//HR(pDev->GetRenderState(D3DRS_CULLMODE, &bkCULL));
-
 	HR(pDev->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE));
 	HR(pDev->SetVertexDeclaration(pSketchpadDecl));
 		
@@ -486,77 +475,111 @@ bool D3D9Pad::Flush(HPOLY hPoly)
 	HR(FX->SetTechnique(eSketch));
 	HR(FX->Begin(&numPasses, D3DXFX_DONOTSAVESTATE));
 
-	if (vmode == ORTHO) {
-		HR(FX->BeginPass(0));
-	}
-	else {
-		HR(FX->BeginPass(1));
-	}
-
-	if (dwBlend == SKPBS_ALPHABLEND) {
-		pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0x7);
-		HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE));
-	}
-	else if (dwBlend == SKPBS_COPY) {
-		pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0xF);
-		HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE));
-	}
-	else if (dwBlend == SKPBS_COPY_ALPHA) {
-		pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0x8);
-		HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE));
-	}
-	else if (dwBlend == SKPBS_COPY_COLOR) {
-		pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0x7);
-		HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE));
-	}
-
-	if (dwFilter) {
-		if (dwFilter == SKPBS_FILTER_POINT) {
-			pDev->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
-			pDev->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
-		}
-	}
+	iPass = -1;
 
-	if (bDepthEnable && pDep) {
-		pDev->SetRenderState(D3DRS_ZENABLE, 1);
-		pDev->SetRenderState(D3DRS_ZWRITEENABLE, 1);
-	}
-	else {
-		pDev->SetRenderState(D3DRS_ZENABLE, 0);
-		pDev->SetRenderState(D3DRS_ZWRITEENABLE, 0);
-	}
+	// Play back the recorded commands, the pass is selected by SetState()
+	//
+	CmdBuf.Replay(this, Idx);
 
 	if (hPoly) {
-		assert(iI == 0);
+		SetState(State, SKPCHG_ALL);
+		HR(FX->CommitChanges());
 		D3D9PolyBase *pBase = static_cast<D3D9PolyBase *>(hPoly);
 		pBase->Draw(pDev);
 	}
-	else {
-		if (tCurrent == TRIANGLE) HR(pDev->DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, vI, iI / 3, Idx, D3DFMT_INDEX16, Vtx, sizeof(SkpVtx)));
-		if (tCurrent == LINE) HR(pDev->DrawIndexedPrimitiveUP(D3DPT_LINELIST, 0, vI, iI / 2, Idx, D3DFMT_INDEX16, Vtx, sizeof(SkpVtx)));
-	}
 
-	HR(FX->EndPass());
+	if (iPass >= 0) HR(FX->EndPass());
 	HR(FX->End());
 	
 	HR(pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0xF));
 	HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, bkALPHA));
-
-	//HR(pDev->SetRenderState(D3DRS_ZENABLE, bkZEN));
-	//HR(pDev->SetRenderState(D3DRS_ZWRITEENABLE, bkZW));
-	//HR(pDev->SetRenderState(D3DRS_CULLMODE, bkCULL));
-		
 	HR(pDev->SetRenderState(D3DRS_SCISSORTESTENABLE, 0));
 
-	if (dwFilter) {
+	if (bPointFilter) {
 		pDev->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
 		pDev->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+		bPointFilter = false;
 	}
-		
-	iI = vI = 0;
+
+	D3D9Stats.Sketch.Commands += CmdBuf.nCommands;
+	D3D9Stats.Sketch.Batches += CmdBuf.nBatches;
+	D3D9Stats.Sketch.StateChanges += CmdBuf.nStateChanges;
+	CmdBuf.ResetStats();
+
+	iI = vI = iCmd = 0;
+	iPass = -1;
 
 	return true;
-	
+}
+
+
+// ===============================================================================================
+// Record the pending index range as a command
+//
+void D3D9Pad::CloseCommand()
+{
+	if (iI == iCmd) return;
+
+	SKPCMD *pCmd = CmdBuf.Add();
+
+	pCmd->State = State;
+	pCmd->iFirst = iCmd;
+	pCmd->nIdx = iI - iCmd;
+
+	// Find out which state groups the vertices depend on, and the extents ----------------
+	//
+	bool bPen = (State.Pen.bDash != FALSE);	// Dashing applies to all fragments
+	bool bSide = false, bTex = false, bFnt = false;
+	float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+
+	for (WORD i = iCmd; i < iI; i++) {
+		const SkpVtx &v = Vtx[Idx[i]];
+		DWORD src = v.fnc & 0xFF;
+		DWORD spc = v.fnc & 0xFF00;
+		if (src == SKPSW_PENCOLOR) bPen = true;
+		if (src == SKPSW_TEXTURE || spc == SKPSW_COLORKEY) bTex = true;
+		if (spc == SKPSW_FONT) bFnt = true;
+		if ((v.fnc & 0xFF000000) != SKPSW_CENTER) bSide = true;
+		x0 = min(x0, v.x); x1 = max(x1, v.x);
+		y0 = min(y0, v.y); y1 = max(y1, v.y);
+	}
+
+	const D3DXMATRIX &W = State.Trans.mW;
+
+	if (State.Trans.bOrtho && W._14 == 0.0f && W._24 == 0.0f && W._44 == 1.0f) {
+
+		// Transform the rectangle into target pixels. Wide lines are extruded by the shader
+		//
+		float pad = bSide ? 2.0f + 1.5f * State.Pen.vWidth.x : 2.0f;
+		float cx[4] = { x0, x1, x0, x1 };
+		float cy[4] = { y0, y0, y1, y1 };
+
+		pCmd->x0 = pCmd->y0 = FLT_MAX;
+		pCmd->x1 = pCmd->y1 = -FLT_MAX;
+
+		for (int k = 0; k < 4; k++) {
+			float x = cx[k] * W._11 + cy[k] * W._21 + W._41;
+			float y = cx[k] * W._12 + cy[k] * W._22 + W._42;
+			pCmd->x0 = min(pCmd->x0, x - pad); pCmd->x1 = max(pCmd->x1, x + pad);
+			pCmd->y0 = min(pCmd->y0, y - pad); pCmd->y1 = max(pCmd->y1, y + pad);
+		}
+	}
+	else {
+		// Can't tell, covers everything
+		pCmd->x0 = pCmd->y0 = -FLT_MAX;
+		pCmd->x1 = pCmd->y1 = FLT_MAX;
+	}
+
+	// Clear unused state groups so that they don't prevent merging ------------------------
+	//
+	if (!bPen && !bSide) memset(&pCmd->State.Pen, 0, sizeof(SKPSTATE_PEN));
+	if (!bTex) {
+		memset(&pCmd->State.Tex, 0, sizeof(SKPSTATE_TEXTURE));
+		pCmd->State.Tex.vSize = D3DXVECTOR4(1, 1, 1, 1);
+	}
+	if (!bFnt) pCmd->State.hFont = NULL;
+
+	iCmd = iI;
 }
 
 
@@ -591,7 +614,7 @@ void D3D9Pad::SetupDevice(Topo tNew)
 
 	// If the queue is filling up, Flush it
 	//
-	if (iI > (nQueueMax >> 1)) Flush();
+	if (iI > (nQueueMax >> 1) || CmdBuf.IsFull()) Flush();
 
 
 	// Has something changed ?
@@ -599,9 +622,9 @@ void D3D9Pad::SetupDevice(Topo tNew)
 	if (!Change) return;
 
 
-	// Flush pending drawing instructions before changing a device state
+	// Close the pending command, the following ones are recorded with a new state
 	//
-	Flush();
+	CloseCommand();
 
 	tCurrent = tNew;
 
@@ -618,134 +641,231 @@ void D3D9Pad::SetupDevice(Topo tNew)
 	if (Change&SKPCHG_FONT)	strcat_s(buf, 512, "SKPCHG_FONT ");
 	if (Change&SKPCHG_DEPTH)	strcat_s(buf, 512, "SKPCHG_DEPTH ");
 	if (Change&SKPCHG_PATTERN)	strcat_s(buf, 512, "SKPCHG_PATTERN ");
+	if (Change&SKPCHG_BLEND)	strcat_s(buf, 512, "SKPCHG_BLEND ");
 	Log("StateChange = [%s]", buf);
 #endif
-	
 
-	// Apply a new setup -----------------------------------------------------------------
+	CaptureState();
+
+	// All Clear
+	Change = 0;
+}
+
+
+// ===============================================================================================
+// Take a snapshot of the pipeline state for the commands recorded next
+//
+void D3D9Pad::CaptureState()
+{
+	SKPSTATE s;
+	memset(&s, 0, sizeof(SKPSTATE));
+
+	// Transformations and clip cones -------------------------------------------------------
 	//
-	if (Change == SKPCHG_TOPOLOGY) {
-		HR(FX->SetBool(eWide, (tCurrent == TRIANGLE)));
-		Change = 0;
-		return;
+	s.Trans.mW = mW;
+	s.Trans.bOrtho = (vmode == ORTHO);
+
+	if (vmode == ORTHO) {
+		D3DXMatrixMultiply(&s.Trans.mWVP, &mW, &mO);
+		s.Trans.mVP = mO;
+	}
+	else {
+		float d = float(tgt_desc.Height) * mP._22;
+		s.Trans.fov = atan(1.0f / d) * 1.7f;
+		D3DXMatrixMultiply(&mVP, &mV, &mP);
+		s.Trans.mVP = mVP;
+		s.Trans.bCovEn = ClipData[0].bEnable || ClipData[1].bEnable;
+		if (s.Trans.bCovEn) {
+			s.Trans.vPos = D3DXVECTOR4(ClipData[0].uDir, 0.0f);
+			s.Trans.vPos2 = D3DXVECTOR4(ClipData[1].uDir, 0.0f);
+			s.Trans.vCov = D3DXVECTOR4(ClipData[0].ca, ClipData[0].dst, ClipData[1].ca, ClipData[1].dst);
+		}
 	}
 
+	// Pen ----------------------------------------------------------------------------------
+	//
+	float offset = 0.0f;
+	int w = int(ceil(GetPenWidth()));
+	if ((w & 1) == 0) offset = 0.5f;
+	s.Pen.cPen = pencolor.fclr;
+	s.Pen.bDash = IsDashed();
+	s.Pen.vWidth = D3DXVECTOR4(GetPenWidth(), pattern*0.13f, offset, 0.0f);
+
+	// Effects ------------------------------------------------------------------------------
+	//
+	if (Enable) {
+		memcpy(&s.Effects.mColor, &ColorMatrix, sizeof(D3DXMATRIX));
+		memcpy(&s.Effects.vNoise, &Noise, sizeof(D3DXVECTOR4));
+		memcpy(&s.Effects.vGamma, &Gamma, sizeof(D3DXVECTOR4));
+		s.Effects.bEnable = true;
+	}
 
-	// Apply a new setup -----------------------------------------------
+	// Texture and font ---------------------------------------------------------------------
 	//
-	if (Change & (SKPCHG_TRANSFORM | SKPCHG_CLIPCONE)) {
-
-		if (vmode == ORTHO) {
-			D3DXMATRIX mWVP;
-			D3DXMatrixMultiply(&mWVP, &mW, &mO);
-			HR(FX->SetMatrix(eWVP, &mWVP));
-			HR(FX->SetMatrix(eVP, &mO));
-			HR(FX->SetMatrix(eW, &mW));
-			HR(FX->SetBool(eCovEn, false));
-		}
+	s.Tex.vSize = D3DXVECTOR4(1, 1, 1, 1);
+
+	if (hTexture) {
+		if (hTexture == State.Tex.hTex) s.Tex.vSize = State.Tex.vSize;
 		else {
-			float d = float(tgt_desc.Height) * mP._22;
-			float f = atan(1.0f / d) * 1.7f;
-			D3DXMatrixMultiply(&mVP, &mV, &mP);
-			HR(FX->SetMatrix(eVP, &mVP));
-			HR(FX->SetMatrix(eW, &mW));
-			HR(FX->SetFloat(eFov, f));
-			HR(FX->SetBool(eCovEn, ClipData[0].bEnable || ClipData[1].bEnable));
+			D3DSURFACE_DESC desc;
+			hTexture->GetLevelDesc(0, &desc);
+			s.Tex.vSize = D3DXVECTOR4(1.0f / float(desc.Width), 1.0f / float(desc.Height), 1.0f, 1.0f);
 		}
+		s.Tex.hTex = hTexture;
+		s.Tex.bKey = bColorKey;
+		s.Tex.cKey = cColorKey;
 	}
 
+	s.hFont = hFontTex;
 
-	// Apply a new setup -----------------------------------------------------------------
+	// Scissor, topology, blending and depth ------------------------------------------------
 	//
-	if (Change & SKPCHG_PEN) {
-		float offset = 0.0f;
-		int w = int(ceil(GetPenWidth()));
-		if ((w & 1) == 0) offset = 0.5f;
-		HR(FX->SetValue(ePen, &pencolor.fclr, sizeof(D3DXCOLOR)));
-		HR(FX->SetBool(eDashEn, IsDashed()));
-		HR(FX->SetValue(eWidth, &D3DXVECTOR3(GetPenWidth(), pattern*0.13f, offset), sizeof(D3DXVECTOR3)));
+	if (bEnableScissor) {
+		s.Scissor.bEnable = true;
+		s.Scissor.rect = ScissorRect;
 	}
 
+	s.dwTopo = DWORD(tCurrent);
+	s.dwBlend = dwBlendState;
+	s.bDepth = (bDepthEnable && pDep);
 
-	// Apply a new setup -----------------------------------------------------------------
-	//
-	if (Change & SKPCHG_EFFECTS) {
-		HR(FX->SetValue(eNoiseColor, &Noise, sizeof(FVECTOR4)));
-		HR(FX->SetValue(eGamma, &Gamma, sizeof(FVECTOR4)));
-		HR(FX->SetTexture(eNoiseTex, pNoise));
-		HR(FX->SetValue(eColorMatrix, &ColorMatrix, sizeof(FMATRIX4)));
-		HR(FX->SetBool(eEffectsEn, Enable != 0));
-	}
+	State = s;
+}
 
 
-	// Apply a new setup -----------------------------------------------------------------
-	//
-	if (Change & SKPCHG_CLIPRECT) {
-		if (bEnableScissor) {
-			pDev->SetScissorRect(&ScissorRect);
-			pDev->SetRenderState(D3DRS_SCISSORTESTENABLE, 1);
+// ===============================================================================================
+// Set the effect parameters of a state
+//
+void D3D9Pad::SetEffectState(const SKPSTATE &s, DWORD dwChange)
+{
+	if (dwChange & (SKPCHG_TRANSFORM | SKPCHG_CLIPCONE)) {
+		if (s.Trans.bOrtho) {
+			HR(FX->SetMatrix(eWVP, &s.Trans.mWVP));
 		}
 		else {
-			pDev->SetRenderState(D3DRS_SCISSORTESTENABLE, 0);
+			HR(FX->SetFloat(eFov, s.Trans.fov));
+			HR(FX->SetValue(ePos, &s.Trans.vPos, sizeof(D3DXVECTOR3)));
+			HR(FX->SetValue(ePos2, &s.Trans.vPos2, sizeof(D3DXVECTOR3)));
+			HR(FX->SetVector(eCov, &s.Trans.vCov));
 		}
+		HR(FX->SetMatrix(eVP, &s.Trans.mVP));
+		HR(FX->SetMatrix(eW, &s.Trans.mW));
+		HR(FX->SetBool(eCovEn, s.Trans.bCovEn));
 	}
 
+	if (dwChange & SKPCHG_PEN) {
+		HR(FX->SetValue(ePen, &s.Pen.cPen, sizeof(D3DXCOLOR)));
+		HR(FX->SetBool(eDashEn, s.Pen.bDash));
+		HR(FX->SetValue(eWidth, &s.Pen.vWidth, sizeof(D3DXVECTOR3)));
+	}
 
-	// Apply a new setup -----------------------------------------------------------------
-	//
-	if (Change & SKPCHG_CLIPCONE) {
-		if (ClipData[0].bEnable || ClipData[1].bEnable) {
-			HR(FX->SetValue(ePos, &ClipData[0].uDir, sizeof(D3DXVECTOR3)));
-			HR(FX->SetValue(ePos2, &ClipData[1].uDir, sizeof(D3DXVECTOR3)));
-			HR(FX->SetValue(eCov, &D3DXVECTOR4(ClipData[0].ca, ClipData[0].dst, ClipData[1].ca, ClipData[1].dst), sizeof(D3DXVECTOR4)));
+	if (dwChange & SKPCHG_EFFECTS) {
+		if (s.Effects.bEnable) {
+			HR(FX->SetVector(eNoiseColor, &s.Effects.vNoise));
+			HR(FX->SetVector(eGamma, &s.Effects.vGamma));
+			HR(FX->SetTexture(eNoiseTex, pNoise));
+			HR(FX->SetMatrix(eColorMatrix, &s.Effects.mColor));
 		}
+		HR(FX->SetBool(eEffectsEn, s.Effects.bEnable));
 	}
 
+	if (dwChange & SKPCHG_TEXTURE) {
+		if (s.Tex.hTex) {
+			HR(FX->SetTexture(eTex0, s.Tex.hTex));
+			HR(FX->SetBool(eKeyEn, s.Tex.bKey));
+			HR(FX->SetValue(eKey, &s.Tex.cKey, sizeof(D3DXCOLOR)));
+		}
+		HR(FX->SetVector(eSize, &s.Tex.vSize));
+		HR(FX->SetBool(eTexEn, (s.Tex.hTex != NULL)));
+	}
 
-	// Apply a new setup -----------------------------------------------------------------
-	//
-	if (Change & (SKPCHG_TEXTURE | SKPCHG_FONT)) {
+	if (dwChange & SKPCHG_FONT) {
+		if (s.hFont) HR(FX->SetTexture(eFnt0, s.hFont));
+		HR(FX->SetBool(eFntEn, (s.hFont != NULL)));
+	}
 
-		float tw = 1.0f, th = 1.0f;
+	if (dwChange & SKPCHG_TOPOLOGY) {
+		HR(FX->SetBool(eWide, (s.dwTopo == TRIANGLE)));
+	}
+}
 
-		D3DSURFACE_DESC desc;
 
-		if (hTexture) {
+// ===============================================================================================
+// SkpBackend implementation, called by the command buffer during Flush()
+//
+void D3D9Pad::SetState(const SKPSTATE &s, DWORD dwChange)
+{
+	// Select the pass. BeginPass() will apply the render states of the technique
+	//
+	int pass = s.Trans.bOrtho ? 0 : 1;
 
-			hTexture->GetLevelDesc(0, &desc);
+	if (pass != iPass) {
+		if (iPass >= 0) HR(FX->EndPass());
+		HR(FX->BeginPass(pass));
+		iPass = pass;
+		dwChange |= SKPCHG_BLEND | SKPCHG_DEPTH | SKPCHG_CLIPRECT;
+	}
 
-			tw = 1.0f / float(desc.Width);
-			th = 1.0f / float(desc.Height);
+	SetEffectState(s, dwChange);
 
-			if (Change & SKPCHG_TEXTURE) {
-				HR(FX->SetTexture(eTex0, hTexture));
-				HR(FX->SetBool(eKeyEn, bColorKey));
-				HR(FX->SetValue(eKey, &cColorKey, sizeof(D3DXCOLOR)));
-			}
-		}
+	if (dwChange & SKPCHG_BLEND) {
 
-		if (hFontTex) {
-			if (Change & SKPCHG_FONT) {
-				HR(FX->SetTexture(eFnt0, hFontTex));
-			}
+		DWORD dwBlend = s.dwBlend & 0xF;
+		DWORD dwFilter = s.dwBlend & 0xF0;
+
+		if (dwBlend == SKPBS_ALPHABLEND) {
+			pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0x7);
+			HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE));
+		}
+		else if (dwBlend == SKPBS_COPY) {
+			pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0xF);
+			HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE));
+		}
+		else if (dwBlend == SKPBS_COPY_ALPHA) {
+			pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0x8);
+			HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE));
+		}
+		else if (dwBlend == SKPBS_COPY_COLOR) {
+			pDev->SetRenderState(D3DRS_COLORWRITEENABLE, 0x7);
+			HR(pDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE));
 		}
 
-		HR(FX->SetVector(eSize, &D3DXVECTOR4(tw, th, 1.0f, 1.0f)));
-		HR(FX->SetBool(eTexEn, (hTexture != NULL)));
-		HR(FX->SetBool(eFntEn, (hFontTex != NULL)));
+		if (dwFilter == SKPBS_FILTER_POINT) {
+			pDev->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+			pDev->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+			bPointFilter = true;
+		}
+		else if (bPointFilter) {
+			pDev->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+			pDev->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+			bPointFilter = false;
+		}
 	}
 
+	if (dwChange & SKPCHG_DEPTH) {
+		pDev->SetRenderState(D3DRS_ZENABLE, s.bDepth);
+		pDev->SetRenderState(D3DRS_ZWRITEENABLE, s.bDepth);
+	}
 
-	// Apply a new setup -----------------------------------------------------------------
-	//
-	if (Change & SKPCHG_TOPOLOGY) {
-		HR(FX->SetBool(eWide, (tCurrent == TRIANGLE)));
+	if (dwChange & SKPCHG_CLIPRECT) {
+		if (s.Scissor.bEnable) {
+			pDev->SetScissorRect(&s.Scissor.rect);
+			pDev->SetRenderState(D3DRS_SCISSORTESTENABLE, 1);
+		}
+		else {
+			pDev->SetRenderState(D3DRS_SCISSORTESTENABLE, 0);
+		}
 	}
+}
 
-	// All Clear
-	Change = 0;
 
-	return;
+// ===============================================================================================
+//
+void D3D9Pad::DrawIndexed(DWORD dwTopo, const WORD *pIdx, DWORD nIdx)
+{
+	HR(FX->CommitChanges());
+	if (dwTopo == TRIANGLE) HR(pDev->DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, vI, nIdx / 3, pIdx, D3DFMT_INDEX16, Vtx, sizeof(SkpVtx)));
+	if (dwTopo == LINE) HR(pDev->DrawIndexedPrimitiveUP(D3DPT_LINELIST, 0, vI, nIdx / 2, pIdx, D3DFMT_INDEX16, Vtx, sizeof(SkpVtx)));
 }
 
 
@@ -1020,29 +1140,8 @@ float D3D9Pad::GetPenWidth() const
 //
 void D3D9Pad::WrapOneLine (char* str, int len, int maxWidth)
 {
-	D3D9TextPtr pText = static_cast<D3D9PadFont *>(cfont)->pFont;
-	if (pText->Length2(str) > maxWidth) {
-		char *pStr = str, // sub-string start
-		     *it = pStr,  // 'iterator' char
-		     *pEnd = str + len, // <= point to terminating zero
-		     *pLastSpace = NULL;
-		float currentWidth = 0;
-		while (it < pEnd)
-		{
-			while (it < pEnd && currentWidth < maxWidth) {
-				if (*it == ' ') { pLastSpace = it; }
-				currentWidth = pText->Length2( pStr, int(it - pStr + 1) );
-				++it;
-			}
-			// only split if we have space for it AND we have to (avoids cutting the last word)
-			if (pLastSpace != NULL && currentWidth >= maxWidth) {
-				*pLastSpace = '\n';
-				pStr = pLastSpace + 1; // skip the space (now a newline)
-				currentWidth = 0;
-				pLastSpace = NULL;
-			}
-		}
-	}
+	// Break points are cached with the text run of the line
+	static_cast<D3D9PadFont *>(cfont)->pFont->WrapLine(str, len, float(maxWidth));
 }
 
 // ===============================================================================================
@@ -1345,12 +1444,9 @@ void D3D9Pad::DrawPoly (HPOLY hPoly, DWORD flags)
 
 		if ((PolyType == 0) && !HasPen()) return;
 
-		// Flush pending graphics before a use of different interface 
-		Flush();
-
 		if (Topology(TRIANGLE)) {
 
-			// Flush the poly object
+			// Flush pending graphics and the poly object
 			Flush(hPoly);
 		}
 	}
@@ -1782,6 +1878,7 @@ D3DXHANDLE   D3D9Pad::eGamma = 0;
 ID3DXEffect* D3D9Pad::FX = 0;
 D3D9Client * D3D9Pad::gc = 0;
 WORD * D3D9Pad::Idx = 0;
+SkpCmdBuffer D3D9Pad::CmdBuf;
 SkpVtx * D3D9Pad::Vtx = 0;
 LPD3DXVECTOR2 D3D9Pad::pSinCos[];
 LPDIRECT3DDEVICE9 D3D9PadFont::pDev = 0;
@@ -24,6 +24,7 @@
 #include "OrbiterAPI.h"
 #include "D3D9Client.h"
 #include "Sketchpad2.h"
+#include "SkpCmdBuffer.h"
 #include <d3d9.h>
 #include <d3dx9.h>
 #include <memory>
@@ -45,6 +46,7 @@ extern oapi::Pen  *defpen;
 #define SKPCHG_DEPTH		0x0100
 #define SKPCHG_TOPOLOGY		0x0200
 #define SKPCHG_PATTERN		0x0400
+#define SKPCHG_BLEND		0x0800
 
 
 #define SKETCHPAD_NONE		0x0000
@@ -193,7 +195,7 @@ template <typename Type> int CreatePolyIndexList(const Type *pt, short npt, WORD
  * \brief The D3D9Pad class defines the context for 2-D drawing using
  *  DirectX calls.
  */
-class D3D9Pad : public Sketchpad3
+class D3D9Pad : public Sketchpad3, private SkpBackend
 {
 	friend D3D9Text;
 
@@ -600,6 +602,11 @@ private:
 	const LPRECT CheckRectNative(LPDIRECT3DTEXTURE9 hSrc, const LPRECT s);
 	void SetFontTextureNative(LPDIRECT3DTEXTURE9 hNew);
 	void SetupDevice(Topo tNew);
+	void CaptureState();
+	void CloseCommand();
+	void SetEffectState(const SKPSTATE &s, DWORD dwChange);
+	void SetState(const SKPSTATE &s, DWORD dwChange);
+	void DrawIndexed(DWORD dwTopo, const WORD *pIdx, DWORD nIdx);
 	LPRECT CheckRect(SURFHANDLE hSrc, const LPRECT s);
 	void IsLineTopologyAllowed() const;
 	DWORD ColorComp(DWORD c) const;
@@ -635,6 +642,10 @@ private:
 
 
 	WORD vI, iI;
+	WORD iCmd;						///< First index of the command being recorded
+	int iPass;						///< Active effect pass during a replay, -1 if none
+	bool bPointFilter;
+	SKPSTATE State;					///< Pipeline state of the command being recorded
 	D3DXMATRIX mV, mP, mW, mO;
 	D3DXVECTOR4 vTarget;
 	DWORD bkmode;
@@ -679,6 +690,7 @@ private:
 	static CRITICAL_SECTION LogCrit;
 
 	static WORD *Idx;				// List of indices
+	static SkpCmdBuffer CmdBuf;		// Recorded draw commands
 	static SkpVtx *Vtx;		// List of vertices
 	static D3D9Client *gc;
 	static LPDIRECT3DDEVICE9 pDev;
@@ -517,8 +517,6 @@ void D3D9Pad::DepthEnable(bool bEnable)
 	Log("DepthEnable(%u)", DWORD(bEnable));
 #endif
 
-	Flush(); // Must Flush() here before a mode change
-
 	if (pDep) {
 		Change |= SKPCHG_DEPTH;
 		bDepthEnable = bEnable;
@@ -585,7 +583,7 @@ void D3D9Pad::SetViewMode(SkpView mode)
 #ifdef SKPDBG 
 	Log("SetViewMode(0x%X)", DWORD(mode));
 #endif
-	Flush();	// Must Flush() here before a mode change
+	Change |= SKPCHG_TRANSFORM;
 	vmode = mode;
 }
 
@@ -717,6 +715,8 @@ int D3D9Pad::DrawSketchMesh(SKETCHMESH _hMesh, DWORD grp, DWORD flags, SURFHANDL
 	// Flush Pending graphics ------------------------------------
 	//
 	SetupDevice(tCurrent);
+	Flush();
+	SetEffectState(State, SKPCHG_ALL);
 
 
 	// Initialize device for drawing a mesh ----------------------
@@ -790,6 +790,8 @@ int D3D9Pad::DrawMeshGroup(MESHHANDLE hMesh, DWORD grp, DWORD flags, SURFHANDLE
 	// Flush Pending graphics ------------------------------------
 	//
 	SetupDevice(tCurrent);
+	Flush();
+	SetEffectState(State, SKPCHG_ALL);
 
 
 	// Initialize device for drawing a mesh ----------------------
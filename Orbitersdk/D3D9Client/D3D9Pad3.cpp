@@ -147,8 +147,7 @@ void D3D9Pad::SetBlendState(DWORD dwState)
 #ifdef SKPDBG 
 	Log("SetBlendState(%u)", dwState);
 #endif
-	// Must Flush() here before a mode change
-	Flush();
+	if (dwState != dwBlendState) Change |= SKPCHG_BLEND;
 	dwBlendState = dwState;
 }
 
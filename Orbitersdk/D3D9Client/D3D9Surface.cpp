@@ -13,6 +13,10 @@
 #include "D3D9Catalog.h"
 #include "D3D9Util.h"
 #include "AABBUtil.h"
+#include "SoftBlit.h"
+#include "BlitScheduler.h"
+#include "DXTCodec.h"
+#include "TextureStreamer.h"
 #include "Log.h"
 
 using namespace oapi;
@@ -31,6 +35,7 @@ WORD *		 D3D9ClientSurface::Index = 0;
 GPUBLITVTX * D3D9ClientSurface::pGPUVtx = 0;
 WORD 		 D3D9ClientSurface::GPUBltIdx = 0;
 D3D9Client * D3D9ClientSurface::gc = 0;
+BlitScheduler * D3D9ClientSurface::pSched = 0;
 D3D9ClientSurface * D3D9ClientSurface::pPrevSrc = 0;
 
 
@@ -142,6 +147,13 @@ int D3D9ClientSurface::GetQueueSize()
 {
 	return GPUBltIdx>>2;
 }
+
+
+void D3D9ClientSurface::Sync(bool bWrite)
+{
+	if (!pSched) return;
+	if (bSchedTgt || (bWrite && nSchedSrc)) pSched->Flush(this);
+}
 // -----------------------------------------------------------------------------------------------
 //
 HRESULT D3D9ClientSurface::GPUCopyRect(D3D9ClientSurface *src, LPRECT s, LPRECT t)
@@ -183,6 +195,53 @@ HRESULT D3D9ClientSurface::GPUCopyRect(D3D9ClientSurface *src, LPRECT s, LPRECT
 	return S_OK;
 }
 
+// -----------------------------------------------------------------------------------------------
+// Software blit between system memory surfaces, same rules as the GPU techniques
+//
+bool D3D9ClientSurface::SoftCopyRect(D3D9ClientSurface *src, LPRECT s, LPRECT t)
+{
+	D3DLOCKED_RECT lt, ls;
+
+	if (pSurf->LockRect(&lt, NULL, 0)!=S_OK) return false;
+
+	if (src==this) ls = lt;
+	else if (src->pSurf->LockRect(&ls, NULL, D3DLOCK_READONLY)!=S_OK) {
+		pSurf->UnlockRect();
+		return false;
+	}
+
+	SBSURFACE tgt = { (BYTE *)lt.pBits, lt.Pitch, desc.Width, desc.Height, desc.Format };
+	SBSURFACE sur = { (BYTE *)ls.pBits, ls.Pitch, src->desc.Width, src->desc.Height, src->desc.Format };
+
+	DWORD flags = 0;
+	if (src->ColorKey) flags = SBLT_KEY | SBLT_OPAQUE;				// BlitTech
+	else if (src->desc.Format != desc.Format) flags = SBLT_OPAQUE;	// BlitTech, format conversion
+	else flags = SBLT_FILTER;										// StretchRect
+
+	bool bOk = SoftBlit::Copy(tgt, *t, sur, *s, flags, src->ColorKey);
+
+	if (src!=this) src->pSurf->UnlockRect();
+	pSurf->UnlockRect();
+
+	return bOk;
+}
+
+// -----------------------------------------------------------------------------------------------
+//
+bool D3D9ClientSurface::SoftFill(LPRECT r, DWORD c)
+{
+	if (!SoftBlit::IsSupported(desc.Format)) return false;
+
+	D3DLOCKED_RECT lr;
+	if (pSurf->LockRect(&lr, NULL, 0)!=S_OK) return false;
+
+	SBSURFACE tgt = { (BYTE *)lr.pBits, lr.Pitch, desc.Width, desc.Height, desc.Format };
+	bool bOk = SoftBlit::Fill(tgt, r, c);
+
+	pSurf->UnlockRect();
+	return bOk;
+}
+
 // -----------------------------------------------------------------------------------------------
 //
 void D3D9ClientSurface::SetupViewPort()
@@ -229,6 +288,7 @@ void D3D9ClientSurface::Clear()
 	pDCSub		= NULL;
 	hDefFont	= NULL;
 	pStencil	= NULL;
+	pMip		= NULL;
 	iBindCount  = 0;
 	Initial		= 0;
 	Active		= 0;
@@ -236,6 +296,8 @@ void D3D9ClientSurface::Clear()
 	SketchPad	= SKETCHPAD_NONE;
 	bDCOpen		= false;
 	bBltGroup   = false;
+	bSchedTgt	= false;
+	nSchedSrc	= 0;
 	bBackBuffer = false;
 	bLockable	= false;
 	bMainDC		= true;
@@ -256,6 +318,9 @@ D3D9ClientSurface::~D3D9ClientSurface()
 	// Notify client about a surface destruction
 	gc->clbkSurfaceDeleted(this);
 
+	if (pSched) pSched->Remove(this);
+
+	TextureStreamer::Remove(this);
 
 	if (SurfaceCatalog->Remove(this)==false) {
 		LogErr("Surface %s wasn't in the catalog", _PTR(this));
@@ -537,6 +602,8 @@ void D3D9ClientSurface::MakeBackBuffer(LPDIRECT3DSURFACE9 pBuf)
 //
 void D3D9ClientSurface::Decompress(DWORD Attr)
 {
+	TextureStreamer::Remove(this);
+
 	SAFE_RELEASE(pSurf);
 	SAFE_RELEASE(pTex);
 
@@ -583,6 +650,8 @@ bool D3D9ClientSurface::ConvertToPlain()
 	if (GetAttribs()&OAPISURFACE_TEXTURE) return false;
 	if (bBackBuffer) return false;
 
+	TextureStreamer::Restore(this);
+
 	LPDIRECT3DSURFACE9 pNew=NULL;
 	SAFE_RELEASE(pRTS);
 	SAFE_RELEASE(pDCSub);
@@ -631,7 +700,8 @@ bool D3D9ClientSurface::ConvertToRenderTargetTexture()
 	// Remove dynamic property, conflicts with rt
 	if (desc.Usage&D3DUSAGE_DYNAMIC) desc.Usage-=D3DUSAGE_DYNAMIC;
 
-	if (IsCompressed()) { Decompress();	return true; }
+	// A streamed texture may not have its top level, reload it
+	if (IsCompressed() || pMip) { Decompress();	return true; }
 
 	DWORD Usage = desc.Usage|D3DUSAGE_RENDERTARGET;
 	DWORD Mips = 1;
@@ -706,6 +776,8 @@ bool D3D9ClientSurface::ConvertToRenderTarget(bool bLock)
 	if (GetAttribs()&OAPISURFACE_TEXTURE) return false;
 	if ((bLockable==bLock) && (desc.Usage&D3DUSAGE_RENDERTARGET) && pTex==NULL) return true;
 
+	TextureStreamer::Restore(this);
+
 	if (pDevice->CreateRenderTarget(desc.Width, desc.Height, desc.Format, D3DMULTISAMPLE_NONE, 0, bLock, &pTgt, NULL)!=S_OK) {
 		LogErr("CreateRenderTarget Failed in ConvertToRenderTarget(%s) W=%u, H=%u, usage=0x%X, Format=0x%X", _PTR(this), desc.Width, desc.Height, desc.Usage, desc.Format);
 		LogSpecs("Surface");
@@ -771,6 +843,8 @@ bool D3D9ClientSurface::ConvertToTexture(bool bDynamic)
 	if (GetAttribs()&OAPISURFACE_SYSMEM) return false;
 	if (GetAttribs()&OAPISURFACE_RENDERTARGET) return false;
 
+	TextureStreamer::Restore(this);
+
 	LPDIRECT3DSURFACE9 pTgt=NULL;
 	LPDIRECT3DTEXTURE9 pNew=NULL;
 	SAFE_RELEASE(pRTS);
@@ -833,6 +907,9 @@ void D3D9ClientSurface::CopyRect(D3D9ClientSurface *src, LPRECT s, LPRECT t, UIN
 	_TRACE;
 	bool bRestart = true;
 
+	Sync();
+	src->Sync(false);
+
 	// Check failure and abort conditions -------------------------------------------------------
 	//
 	if (t->right > (long)desc.Width || t->bottom > (long)desc.Height) goto invalid_input;
@@ -884,6 +961,18 @@ void D3D9ClientSurface::CopyRect(D3D9ClientSurface *src, LPRECT s, LPRECT t, UIN
 	if (src->IsCompressed()) src->Decompress();
 
 
+	// =====================================================================================================
+	// System memory to system memory, no GPU involved
+	//
+	if (IsSystemMem() && src->IsSystemMem() && SoftBlit::IsSupported(desc.Format) && SoftBlit::IsSupported(src->desc.Format)) {
+		if (SoftCopyRect(src, s, t)) {
+			LogOk("Software Blitting %s (%s) -> %s (%s) (%u,%u)", _PTR(src), src->name, _PTR(this), name, Width, Height);
+			return;
+		}
+		LogWrn("Software Blitting Failed %s (%s) -> %s (%s), using GPU", _PTR(src), src->name, _PTR(this), name);
+	}
+
+
 	// =====================================================================================================
 	// ANOMALIUS CASE: If target is non-render target texture.. Convert.. 
 	//
@@ -1036,6 +1125,11 @@ invalid_input:
 //
 bool D3D9ClientSurface::Fill(LPRECT rect, DWORD c)
 {
+	Sync();
+
+	// System memory surfaces are filled in place
+	if (Exists() && IsSystemMem() && SoftFill(rect, c)) return true;
+
 	if (!Exists()) {
 		if (GetAttribs()&OAPISURFACE_TEXTURE) ConvertToRenderTargetTexture();
 		else ConvertToRenderTarget();
@@ -1100,6 +1194,13 @@ bool D3D9ClientSurface::Fill(LPRECT rect, DWORD c)
 //
 bool D3D9ClientSurface::Clear(DWORD c)
 {
+	// Scheduled blits into the surface are overwritten
+	if (pSched && bSchedTgt) pSched->Discard(this);
+	Sync();
+
+	// System memory surfaces are filled in place
+	if (Exists() && IsSystemMem() && SoftFill(NULL, c)) return true;
+
 	if (!Exists()) {
 		if (GetAttribs()&OAPISURFACE_TEXTURE) ConvertToRenderTargetTexture();
 		else ConvertToRenderTarget();
@@ -1198,6 +1299,8 @@ void D3D9ClientSurface::ReleaseDCHard(HDC hDC)
 //
 HDC	D3D9ClientSurface::GetDC()
 {
+	Sync();
+
 	bHard = false;
 
 	GetDCTime = 0.0;
@@ -1342,6 +1445,8 @@ void D3D9ClientSurface::Reload()
 {
 	bool bGoTex = true;
 
+	TextureStreamer::Remove(this);
+
 	//if (Initial&OAPISURFACE_SYSMEM) bGoTex = false;
 	//if (Initial&OAPISURFACE_UNCOMPRESS) bGoTex = false;
 	//if (Initial&OAPISURFACE_RENDERTARGET) bGoTex = false;
@@ -1461,7 +1566,8 @@ bool D3D9ClientSurface::LoadSurface(const char *fname, DWORD flags, bool bDecomp
 				HR(pDevice->CreateTexture(info.Width, info.Height, Mips, Usage, Format, Pool, &pTex, NULL));
 
 				if (pTex) {
-					HR(D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, 0, 0, Format, D3DPOOL_SYSTEMMEM, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pSys));
+					pSys = LoadUncompressed(path, &info, Format);
+					if (!pSys) HR(D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, 0, 0, Format, D3DPOOL_SYSTEMMEM, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pSys));
 					if (pSys) {
 						HR(pTex->GetSurfaceLevel(0, &pSurf));
 						HR(pSys->GetSurfaceLevel(0, &pTemp));
@@ -1480,16 +1586,20 @@ bool D3D9ClientSurface::LoadSurface(const char *fname, DWORD flags, bool bDecomp
 					}
 				}
 			}
-			else if (D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, Mips, Usage, Format, Pool, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pTex)==S_OK) {
-				SetName(fname);
-				HR(pTex->GetSurfaceLevel(0, &pSurf));
-				GetDesc(&desc);
-				if (!bDecompress) LogBlu("Surface %s found. Handle=%s, (%ux%u), MipMaps=%u, Flags=0x%X, Format=0x%X",fname, _PTR(this), desc.Width, desc.Height, pTex->GetLevelCount(), flags, DWORD(Format));
+			else {
+				if (Pool==D3DPOOL_SYSTEMMEM && Mips==1) pTex = LoadUncompressed(path, &info, Format);
+
+				if (pTex || D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, Mips, Usage, Format, Pool, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pTex)==S_OK) {
+					SetName(fname);
+					HR(pTex->GetSurfaceLevel(0, &pSurf));
+					GetDesc(&desc);
+					if (!bDecompress) LogBlu("Surface %s found. Handle=%s, (%ux%u), MipMaps=%u, Flags=0x%X, Format=0x%X",fname, _PTR(this), desc.Width, desc.Height, pTex->GetLevelCount(), flags, DWORD(Format));
 				
-				// Load special texture maps
-				LoadSpecials(fname);
+					// Load special texture maps
+					LoadSpecials(fname);
 
-				return true;
+					return true;
+				}
 			}
 
 			LogErr("Surface %s failed to load. InitialFlags=0x%X",fname,Initial);
@@ -1508,7 +1618,8 @@ bool D3D9ClientSurface::LoadSurface(const char *fname, DWORD flags, bool bDecomp
 			HR(pDevice->CreateRenderTarget(info.Width, info.Height, Format, D3DMULTISAMPLE_NONE, 0, bLockable, &pSurf, NULL));
 			
 			if (pSurf) {
-				if (D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, 1, 0, Format, D3DPOOL_SYSTEMMEM, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pTex)==S_OK) {
+				pTex = LoadUncompressed(path, &info, Format);
+				if (pTex || D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, 1, 0, Format, D3DPOOL_SYSTEMMEM, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pTex)==S_OK) {
 					SetName(fname);
 					LPDIRECT3DSURFACE9 pTemp;
 					if (pTex) {
@@ -1537,6 +1648,37 @@ bool D3D9ClientSurface::LoadSurface(const char *fname, DWORD flags, bool bDecomp
 }
 
 
+// LoadUncompressed -------------------------------------------------------------------------------------------------
+// Load the top level of a DXT compressed DDS file into a system memory texture of A8R8G8B8 or X8R8G8B8
+// format. The blocks are decoded by DXTCodec, returns NULL if the conversion isn't supported.
+//
+LPDIRECT3DTEXTURE9 D3D9ClientSurface::LoadUncompressed(const char *path, const D3DXIMAGE_INFO *info, D3DFORMAT Format)
+{
+	if (info->ImageFileFormat!=D3DXIFF_DDS || !DXTCodec::IsSupported(info->Format)) return NULL;
+	if (Format!=D3DFMT_A8R8G8B8 && Format!=D3DFMT_X8R8G8B8) return NULL;
+
+	LPDIRECT3DTEXTURE9 pBlocks = NULL, pOut = NULL;
+
+	if (D3DXCreateTextureFromFileExA(pDevice, path, info->Width, info->Height, 1, 0, D3DFMT_FROM_FILE, D3DPOOL_SYSTEMMEM, D3DX_FILTER_NONE, D3DX_FILTER_NONE, 0, NULL, NULL, &pBlocks)!=S_OK) return NULL;
+
+	if (pDevice->CreateTexture(info->Width, info->Height, 1, 0, Format, D3DPOOL_SYSTEMMEM, &pOut, NULL)==S_OK) {
+		D3DLOCKED_RECT src, dst;
+		bool bOk = false;
+		if (pBlocks->LockRect(0, &src, NULL, D3DLOCK_READONLY)==S_OK) {
+			if (pOut->LockRect(0, &dst, NULL, 0)==S_OK) {
+				bOk = DXTCodec::Decode(info->Format, (const BYTE *)src.pBits, src.Pitch, (BYTE *)dst.pBits, dst.Pitch, info->Width, info->Height, Format==D3DFMT_X8R8G8B8);
+				pOut->UnlockRect(0);
+			}
+			pBlocks->UnlockRect(0);
+		}
+		if (!bOk) SAFE_RELEASE(pOut);
+	}
+
+	SAFE_RELEASE(pBlocks);
+	return pOut;
+}
+
+
 // Load a special texture -------------------------------------------------------------------------------------------------
 //
 //
@@ -1599,6 +1741,13 @@ bool D3D9ClientSurface::LoadTexture(const char *fname)
 		if (Config->TextureMips == 2) Mips = 0;							 // Autogen all
 		if (Config->TextureMips == 1 && info.MipLevels == 1) Mips = 0;	 // Autogen missing
 
+		// Large textures with a full mip chain are streamed, only the coarse levels are loaded here
+		if (Mips == D3DFMT_FROM_FILE && Format == info.Format && TextureStreamer::Load(this, path)) {
+			LogBlu("Texture %s Streamed. Handle=%s, (%ux%u), MipMaps=%u, Format=0x%X", fname, _PTR(this), desc.Width, desc.Height, info.MipLevels, DWORD(Format));
+			LoadSpecials(fname);
+			return true;
+		}
+
 		if (D3DXCreateTextureFromFileExA(pDevice, path, info.Width, info.Height, Mips, 0, Format, D3DPOOL_DEFAULT, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL, &pTex) == S_OK) {
 			HR(pTex->GetSurfaceLevel(0, &pSurf));
 			GetDesc(&desc);
@@ -1774,6 +1923,14 @@ DWORD D3D9ClientSurface::GetMipMaps()
 }
 
 
+// -----------------------------------------------------------------------------------------------
+//
+void D3D9ClientSurface::RequestSize(float pixels)
+{
+	if (pMip) TextureStreamer::Request(pMip, pixels);
+}
+
+
 // -----------------------------------------------------------------------------------------------
 //
 bool D3D9ClientSurface::GetDesc(D3DSURFACE_DESC *pD)
@@ -1803,6 +1960,7 @@ bool D3D9ClientSurface::Release()
 //
 void D3D9ClientSurface::SetColorKey(DWORD ck)
 {
+	if (ck != ColorKey) Sync();
 	ColorKey = ck;
 	ClrKey = D3DXCOLOR(ColorKey);
 }
@@ -1951,6 +2109,8 @@ LPDIRECT3DTEXTURE9 D3D9ClientSurface::GetTexture()
 {
 	_TRACE;
 
+	Sync(false);
+
 	if (!Exists()) {
 		ConvertToTexture(true);
 		LogErr("Texture used without being initialized %s", _PTR(this));
@@ -2022,6 +2182,8 @@ DWORD D3D9ClientSurface::GetSizeInBytes()
 //
 D3D9Pad *D3D9ClientSurface::GetD3D9Pad()
 {
+	Sync();
+
 	if (!IsRenderTarget()) {
 		LogErr("Can't optain a Sketchpad to a non-render target surface %s", _PTR(this));
 		return NULL;
@@ -2037,6 +2199,7 @@ D3D9Pad *D3D9ClientSurface::GetD3D9Pad()
 //
 void D3D9ClientSurface::GlobalExit()
 {
+	SAFE_DELETE(pSched);
 	delete []Index;
 	delete []pGPUVtx;
 	SAFE_RELEASE(FX);
@@ -2050,6 +2213,8 @@ void D3D9ClientSurface::D3D9TechInit(D3D9Client *_gc, LPDIRECT3DDEVICE9 pDev, co
 
 	gc = _gc;
 
+	if (Config->BlitScheduler) pSched = new BlitScheduler();
+
 	char name[256];
 	sprintf_s(name,256,"Modules/%s/CKBlit.fx",folder);
 
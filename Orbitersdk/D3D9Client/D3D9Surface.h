@@ -39,6 +39,8 @@ class D3D9ClientSurface
 	friend class D3D9Client;
 	friend class D3D9Pad;
 	friend class GDIPad;
+	friend class BlitScheduler;
+	friend class TextureStreamer;
 
 public:
 						// Initialize global (shared) resources
@@ -116,8 +118,10 @@ public:
 	HRESULT				FlushQueue();
 	void				CopyRect(D3D9ClientSurface *src, LPRECT srcrect, LPRECT tgtrect, UINT ck=0);
 	HRESULT				GPUCopyRect(D3D9ClientSurface *src, LPRECT srcrect, LPRECT tgtrect);
+	bool				SoftCopyRect(D3D9ClientSurface *src, LPRECT srcrect, LPRECT tgtrect);
 
 	bool				Fill(LPRECT r, DWORD color);
+	bool				SoftFill(LPRECT r, DWORD color);
 	bool				Clear(DWORD color);
 
 	bool				BindGPU();
@@ -126,8 +130,15 @@ public:
 	void				EndBlitGroup();
 	int					GetQueueSize();
 
+						// Submit scheduled blits before the surface is read or written
+	void				Sync(bool bWrite = true);
+	static class BlitScheduler * GetBlitScheduler() { return pSched; }
+
 	void				PrintError(int err);
 
+						// Report the projected size of a mesh using this texture, for the mip streaming
+	void				RequestSize(float pixels);
+
 private:
 
 	bool				ConvertToRenderTargetTexture();
@@ -138,6 +149,7 @@ private:
 	void				CreateSubSurface();
 	bool				CreateName(char *out, int len, const char *fname, const char *id);
 	void				Decompress(DWORD Attribs=0);
+	LPDIRECT3DTEXTURE9	LoadUncompressed(const char *path, const D3DXIMAGE_INFO *info, D3DFORMAT Format);
 	DWORD				GetTextureSizeInBytes(LPDIRECT3DTEXTURE9 pT);
 	DWORD				GetSizeInBytes(D3DFORMAT Format, DWORD pixels);
 	HDC					GetDCHard();
@@ -158,12 +170,15 @@ private:
 	bool				bDCSys;
 	bool				bBltSys;
 	bool				bAdvanced;		// Additional textures maps has been loaded
+	bool				bSchedTgt;		// Target of scheduled blits
+	int					nSchedSrc;		// Number of scheduled blits using this surface as a source
 	int					Refs;
 	int					Initial;		// Initial creation Attributes flags
 	int					Active;			// Active Attribute flags
 	int					SketchPad;		// Currently Active Sketchpad 0=None, 1=GDI, 2=GPU
 	int					iBindCount;		// GPU Bind reference counter
 	int					ErrWrn;
+	struct MIPTEX *		pMip;			// Mip streaming state, NULL if the texture isn't streamed
 	D3DSURFACE_DESC		desc;
 	LPDIRECT3DSURFACE9	pStencil;
 	LPDIRECT3DSURFACE9	pSurf;		// This is a pointer to a plain surface or a pointer to the first level in a texture
@@ -186,6 +201,7 @@ private:
 	// Rendering pipeline configuration. Applies to every instance of this class
 	//
 	static D3D9Client * gc;
+	static class BlitScheduler * pSched;
 	static ID3DXEffect*	FX;
 	static D3DXHANDLE	eTech;
 	static D3DXHANDLE	eFlush;
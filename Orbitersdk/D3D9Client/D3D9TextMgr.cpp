@@ -28,6 +28,7 @@
 #include "D3D9Util.h"
 #include "D3D9Config.h"
 #include "D3D9Pad.h"
+#include <algorithm>
 
 #if defined(_MSC_VER) && (_MSC_VER <= 1700 ) // Microsoft Visual Studio Version 2012 and lower
 #define round(v) floor(v+0.5)
@@ -40,8 +41,6 @@ D3D9Text::D3D9Text(LPDIRECT3DDEVICE9 pDevice) :
 	green      (1.0),
 	blue       (1.0),
 	alpha      (1.0),
-	tex_w      (),
-	tex_h      (),
 	sharing    (),
 	spacing    (0.0f),
 	linespacing(),
@@ -52,10 +51,11 @@ D3D9Text::D3D9Text(LPDIRECT3DDEVICE9 pDevice) :
 	first      (32),
 	halign     (),
 	valign     (),
+	ascent     (),
 	pDev       (pDevice),
-	pTex       (NULL),
 	FontData   (NULL),
-	wfont      (NULL)
+	hFont      (NULL),
+	dwPurge    (0)
 {
 	ZeroMemory(&tm, sizeof(TEXTMETRIC));
 	ZeroMemory(&lf, sizeof(LOGFONT));	
@@ -66,9 +66,9 @@ D3D9Text::D3D9Text(LPDIRECT3DDEVICE9 pDevice) :
 //
 D3D9Text::~D3D9Text()
 {
+	if (pAtlas) pAtlas->Remove(this);
 	SAFE_DELETEA(FontData);
-	SAFE_RELEASE(pTex);
-	SAFE_RELEASE(wfont);
+	if (hFont) DeleteObject(hFont);
 }
 
 
@@ -127,175 +127,76 @@ int D3D9Text::GetLineSpace()
 
 // ----------------------------------------------------------------------------------------
 //
-bool D3D9Text::Init(HFONT hFont)
+bool D3D9Text::Init(HFONT hSrc)
 {
-	if (hFont==NULL) {
+	if (hSrc==NULL) {
 		LogErr("NULL Font in D3D9Text::Init()");
 		return false;
 	}
 
-	// Receive font attributes
-	GetObject(hFont, sizeof(LOGFONT), &lf);
+	// Receive font attributes, the glyphs are rasterized from a copy of the font when
+	// they are first used. The caller keeps the ownership of hSrc.
+	GetObject(hSrc, sizeof(LOGFONT), &lf);
+
+	hFont = CreateFontIndirect(&lf);
+
+	if (hFont==NULL) {
+		LogErr("D3D9Text::CreateFontIndirect Fail");
+		return false;
+	}
 
-	tex_w = 2048;	// Texture Width
-	tex_h = 32;
-	
 	// Allocate space for data
 	//
 	FontData = new D3D9FontData[256]();	// zero-initialized
 	
 	LogAlw("[NEW FONT] (%31s), Size=%d, Weight=%d Pitch&Family=%x", lf.lfFaceName, lf.lfHeight, lf.lfWeight, lf.lfPitchAndFamily);
 
-	bool bFirst = true;
-
-restart:
-
-	if (tex_h>=2048) {
-		LogErr("^^ Font is too large for pre-rendering");	
-		return false;
-	}
-
-	LPDIRECT3DTEXTURE9 pSrcTex = NULL;
-	LPDIRECT3DSURFACE9 pSurf = NULL;
-
-	if (pDev->CreateTexture(tex_w, tex_h, 1, 0, D3DFMT_R5G6B5, D3DPOOL_SYSTEMMEM, &pSrcTex, NULL)!=S_OK) {
-		LogErr("D3D9Text::CreateOffscreenPlainSurface Fail");
-		return false;
-	}
-
-	HR(pSrcTex->GetSurfaceLevel(0, &pSurf));
-
-	HDC hDC = NULL;
+	HDC hDC = hMeasureDC;
 
-	if (pSurf->GetDC(&hDC)!=S_OK) {
-		LogErr("D3D9Text::GetDC Fail");
-		return false;
-	}
-	
 	HFONT hOld = (HFONT)SelectObject(hDC, hFont);
 
 	if (hOld == NULL) { LogErr("SelectObject(hFont) FAIL"); return false; }
 
-	if (bFirst) {
-
-		// Get Text Metrics information
-		// 
-		memset((void *)&tm, 0, sizeof(TEXTMETRIC));
+	// Get Text Metrics information
+	// 
+	memset((void *)&tm, 0, sizeof(TEXTMETRIC));
 		
-		if (GetTextMetrics(hDC, &tm)==false) {
-			LogErr("GetTextMetrics() FAIL");
-			return false;
-		}
-		bFirst = false;
+	if (GetTextMetrics(hDC, &tm)==false) {
+		LogErr("GetTextMetrics() FAIL");
+		SelectObject(hDC, hOld);
+		return false;
 	}
 
-	// Draw Charters
+	// Measure Charters
 	//
-	
 	char text[] = "c";
 
-	int s = tm.tmMaxCharWidth;
 	int a = tm.tmAscent + 1;
 	int d = tm.tmDescent + 1;
 	int h = a+d;
-	int x = 5;
-	int y = 5 + h;
 	int c = first; // ANSI code of the First Charter
 	D3D9FontData *pData;
 
 	SIZE fnts;
 
-	SetTextAlign(hDC, TA_BASELINE | TA_LEFT);
-	SetTextColor(hDC, 0xFFFFFF);
-	SetBkColor(hDC, 0);
-	SetBkMode(hDC, TRANSPARENT);
+	ascent = a;
 
-	float tw = 1.0f / float(tex_w);
-	float th = 1.0f / float(tex_h);
-	
 	while ( c < 256 ) {
 		pData = Data(c);
 
 		text[0] = c;
 	
-		TextOutA(hDC, x, y, text, 1);
 		GetTextExtentPoint32(hDC, text, 1, &fnts);
 		
 		pData->sp  = float(fnts.cx);		// Char spacing
 		pData->w   = float(fnts.cx+3);		// Char Width
 		pData->h   = float(h);				// Char Height
 
-		pData->tx0 = float(x-1);
-		pData->tx1 = float(x-1 + fnts.cx+3);
-		
-		pData->ty0 = float(y - a);
-		pData->ty1 = float(y + d);
-		
-		pData->tx0 *= tw;
-		pData->tx1 *= tw;
-		pData->ty0 *= th;
-		pData->ty1 *= th;
-
 		c++;	// Next Charter
-
-		x += (fnts.cx + 4);		// --!!-- In order to increase spacing between charters increase this --!!--
-
-		if ((x+s) >= tex_w) {	// Start a New Line
-			x = 5;
-			y+= (h+5);
-		}
-
-		if ((y+h) >= tex_h) {
-			pSurf->ReleaseDC(hDC);
-			pSurf->Release();
-			pSrcTex->Release();
-			tex_h *= 2;
-			goto restart;
-		}
 	}
 
 	SelectObject(hDC, hOld);
 
-	pSurf->ReleaseDC(hDC);
-	pSurf->Release();
-
-	DeleteObject(hFont);
-
-	HR(pDev->CreateTexture(tex_w, tex_h, 0, D3DUSAGE_AUTOGENMIPMAP, D3DFMT_R5G6B5, D3DPOOL_DEFAULT, &pTex, NULL));
-
-	LogAlw("Font Video Memory Usage = %u kb",tex_w*tex_h*2/1024);
-
-
-	if (pDev->UpdateTexture(pSrcTex, pTex)!=S_OK) {
-		LogErr("D3D9TextMgr: Surface Update Failed");
-		return false;
-	}
-
-	pTex->GenerateMipSubLevels();
-
-#ifdef FNTDBG
-	char texname[256];
-	sprintf_s(texname, 256, "_%s_%d_0x%X.dds", lf.lfFaceName, lf.lfHeight, DWORD(this));
-	D3DXSaveSurfaceToFile(texname, D3DXIFF_DDS, pSurf, NULL, NULL);
-#endif 
-	pSrcTex->Release();
-
-	// Init WCHAR font
-	HR(D3DXCreateFont(
-		pDev,                 // D3D Device
-		lf.lfHeight,          // Font height
-		lf.lfWidth,           // Font width
-		lf.lfWeight,          // Font Weight
-		1,                    // MipLevels
-		lf.lfItalic,          // Italic
-		lf.lfCharSet,         // CharSet
-		lf.lfOutPrecision,    // OutputPrecision
-		lf.lfQuality,         // Quality
-		lf.lfPitchAndFamily,  // PitchAndFamily
-		lf.lfFaceName,        // pFacename,
-		&wfont                // ppFont
-	));
-
 	SetLineSpace(0);
 	SetTextShare(0);
 	SetTextSpace(0);
@@ -314,6 +215,96 @@ D3D9FontData *D3D9Text::Data (int c) {
 	return &FontData[c - first];
 }
 
+// ----------------------------------------------------------------------------------------
+// Find or lay out a string. Text of MFDs and HUDs is mostly the same from frame to frame,
+// so the advances, wrap breaks and glyph quads are kept until the run isn't used for a while.
+// Scaling, rotation, alignment and color are applied when the run is used.
+//
+D3D9TextRun *D3D9Text::GetRun(const char *_str, int len)
+{
+	const BYTE *str = (const BYTE *)_str;
+
+	int n = 0;
+	unsigned __int64 key = 14695981039346656037ULL;
+
+	while ((n < len || len <= 0) && str[n]) key = (key ^ str[n++]) * 1099511628211ULL;
+
+	DWORD sp = 0;
+	memcpy(&sp, &spacing, sizeof(DWORD));
+	key = (key ^ sp) * 1099511628211ULL;
+
+	D3D9Stats.Text.Runs++;
+
+	auto it = Runs.find(key);
+
+	if (it != Runs.end()) {
+		D3D9TextRun &run = it->second;
+		if (run.spacing == spacing && run.str.size() == size_t(n) && memcmp(run.str.data(), str, n) == 0) {
+			run.frame = dwFrame;
+			D3D9Stats.Text.Hits++;
+			return &run;
+		}
+	}
+
+	if (dwFrame - dwPurge >= TEXTRUN_AGE || Runs.size() >= TEXTRUN_MAX) PurgeRuns();
+
+	// Lay out the string -------------------------------------------------------------------
+	//
+	D3D9TextRun &run = Runs[key];
+
+	float xpos = 0.0f;
+
+	run.str.assign((const char *)str, n);
+	run.spacing = spacing;
+	run.bbox = 0.0f;
+	run.adv.resize(n + 1);
+	run.spaces.clear();
+	run.flat = n;
+	run.ordered = true;
+	run.quad.clear();
+	run.glyph.clear();
+	run.gen = 0;
+	run.touch = 0;
+	run.wrapWidth = -1.0f;
+	run.wrapScale = 0.0f;
+	run.breaks.clear();
+	run.frame = dwFrame;
+
+	// Glyphs are only needed for drawing, SetupQuads() finds them
+	//
+	for (int i = 0; i < n; i++) {
+
+		D3D9FontData *pData = Data(str[i]);
+
+		run.adv[i] = xpos;
+		run.bbox += ceil(pData->sp + spacing);
+		xpos += (pData->sp + spacing);
+
+		if (str[i] == ' ') run.spaces.push_back(i);
+		if (xpos < run.adv[i]) run.ordered = false;
+		else if (xpos == run.adv[i] && run.flat == n) run.flat = i;
+	}
+
+	run.adv[n] = xpos;
+
+	return &run;
+}
+
+// ----------------------------------------------------------------------------------------
+// Remove runs not used recently, or all of them if the cache is full of recent ones
+//
+void D3D9Text::PurgeRuns()
+{
+	dwPurge = dwFrame;
+
+	for (auto it = Runs.begin(); it != Runs.end();) {
+		if (dwFrame - it->second.frame >= TEXTRUN_AGE) it = Runs.erase(it);
+		else ++it;
+	}
+
+	if (Runs.size() >= TEXTRUN_MAX) Runs.clear();
+}
+
 // ----------------------------------------------------------------------------------------
 //
 void D3D9Text::SetColor(DWORD c)
@@ -364,21 +355,36 @@ void D3D9Text::SetScaling(float factor)
 //
 int	D3D9Text::GetIndex(const char *pText, float pos, int x)
 {
+	if (x == 0) return 0;
+
+	const D3D9TextRun *pRun = GetRun(pText, x);
+
 	float del = 1e6;
-	float len = 0.0f;
-	int i = 0;
 	int idx = 0;
+	int n = int(pRun->str.size());
+
+	// The end of the string is a valid position, but position 'x' isn't
+	if (n == x) n--;
 
-	const BYTE *str = (const BYTE *)pText; 
+	// The nearest pen position. The distance only decreases up to it,
+	// except that a character without advance ends the search early.
+	if (pRun->ordered && fabs(pos) < 65536.0f) {
 
-	while (i < x || x < 0) {	
-		if (fabs(pos - len) < del) {
-			del = fabs(pos - len);
+		const float *adv = pRun->adv.data();
+		int k = int(std::lower_bound(adv, adv + n + 1, pos) - adv);
+
+		if (pRun->flat < k - 1) return pRun->flat;
+		if (k > n) return n;
+		if (k == 0) return 0;
+		return (fabs(pos - adv[k]) < fabs(pos - adv[k - 1])) ? k : k - 1;
+	}
+
+	for (int i = 0; i <= n; i++) {
+		float d = fabs(pos - pRun->adv[i]);
+		if (d < del) {
+			del = d;
 			idx = i;
 		} else break;
-		if (str[i] == 0) break;
-		len += (Data(str[i])->sp + spacing);
-		i++;
 	}
 
 	return idx;
@@ -388,19 +394,90 @@ int	D3D9Text::GetIndex(const char *pText, float pos, int x)
 //
 float D3D9Text::Length2(const char *_str, int l)
 {
-	float len = 0;
-	int i = 0;
+	const D3D9TextRun *pRun = GetRun(_str, l);
+
+	float len = pRun->adv.back() - spacing;
+	if (len<0) len=0;
+	return len * scaling;
+}
+
+// ----------------------------------------------------------------------------------------
+// A line grows until a character makes it too wide and breaks at the last space so far.
+// A word wider than a line is kept whole, the line breaks at the first space after it.
+//
+void D3D9Text::FindBreaks(D3D9TextRun *pRun, float maxWidth)
+{
+	const std::vector<float> &adv = pRun->adv;
+	const std::vector<int> &spaces = pRun->spaces;
+	int n = int(pRun->str.size());
+	int start = 0, it = 0;
+
+	if (pRun->ordered && scaling >= 0.0f) {
+
+		// The width only grows with the line, binary search the first character too many
+		while (it < n) {
 
-	const BYTE *str = (const BYTE *)_str; // Negative index may occur without this
+			int lo = it, hi = n;
+			while (lo < hi) {
+				int mid = (lo + hi) >> 1;
+				if (max(0.0f, adv[mid + 1] - adv[start] - spacing) * scaling >= maxWidth) hi = mid;
+				else lo = mid + 1;
+			}
 
-	while ((i<l || l<=0) && str[i]) {
-		if (str[i] <= 255) len += (Data(str[i])->sp + spacing);
-		i++;
+			// Don't cut the last word
+			if (lo == n) break;
+
+			auto sp = std::upper_bound(spaces.begin(), spaces.end(), lo);
+
+			int last;
+			if (sp != spaces.begin() && sp[-1] >= start) last = sp[-1], it = lo + 1;
+			else if (sp != spaces.end()) last = *sp, it = last + 1;
+			else break;
+
+			pRun->breaks.push_back(last);
+			start = last + 1;
+		}
+		return;
 	}
 
-	len -= spacing;
-	if (len<0) len=0;
-	return len * scaling;
+	const char *s = pRun->str.data();
+	int last = -1;
+	float width = 0.0f;
+
+	while (it < n) {
+		// Grow the line until it's too wide
+		while (it < n && (width < maxWidth || last < 0)) {
+			if (s[it] == ' ') last = it;
+			width = max(0.0f, adv[it + 1] - adv[start] - spacing) * scaling;
+			++it;
+		}
+		// only split if we have space for it AND we have to (avoids cutting the last word)
+		if (last >= 0 && width >= maxWidth) {
+			pRun->breaks.push_back(last);
+			start = last + 1;
+			width = 0.0f;
+			last = -1;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------------------
+//
+void D3D9Text::WrapLine(char *str, int len, float maxWidth)
+{
+	D3D9TextRun *pRun = GetRun(str, len);
+
+	if (pRun->wrapWidth != maxWidth || pRun->wrapScale != scaling) {
+
+		pRun->wrapWidth = maxWidth;
+		pRun->wrapScale = scaling;
+		pRun->breaks.clear();
+
+		int n = int(pRun->str.size());
+		if ((pRun->adv[n] - spacing) * scaling > maxWidth) FindBreaks(pRun, maxWidth);
+	}
+
+	for (size_t i = 0; i < pRun->breaks.size(); i++) str[pRun->breaks[i]] = '\n';
 }
 
 
@@ -411,39 +488,198 @@ float D3D9Text::Length(BYTE c)
 	return (Data(c)->sp + spacing) * scaling;
 }
 
+// ----------------------------------------------------------------------------------------
+//
+bool D3D9Text::GlyphSize(DWORD code, int *w, int *h, float *adv)
+{
+	if ((code & GLYPH_WIDE) == 0) {
+		if (code < DWORD(first) || code > 255) return false;
+		D3D9FontData *pData = Data(code);
+		*w = int(pData->w);
+		*h = int(pData->h);
+		*adv = pData->sp;
+		return true;
+	}
+
+	WCHAR wc = WCHAR(code & 0xFFFF);
+	SIZE fnts;
+
+	HFONT hOld = (HFONT)SelectObject(hMeasureDC, hFont);
+	BOOL bOk = GetTextExtentPoint32W(hMeasureDC, &wc, 1, &fnts);
+	SelectObject(hMeasureDC, hOld);
+
+	if (!bOk) return false;
+
+	*w = fnts.cx + 3;
+	*h = int(FontData[0].h);
+	*adv = float(fnts.cx);
+	return true;
+}
+
+// ----------------------------------------------------------------------------------------
+// Same placement in the cell as the pre-rendered charter sets had: baseline at 'ascent'
+// and one pixel from the left edge
+//
+void D3D9Text::GlyphDraw(void *ctx, DWORD code, int x, int y)
+{
+	HDC hDC = (HDC)ctx;
+	if (hDC == NULL) return;
+
+	HFONT hOld = (HFONT)SelectObject(hDC, hFont);
+
+	if (code & GLYPH_WIDE) {
+		WCHAR wc = WCHAR(code & 0xFFFF);
+		TextOutW(hDC, x + 1, y + ascent, &wc, 1);
+	}
+	else {
+		char c = char(code);
+		TextOutA(hDC, x + 1, y + ascent, &c, 1);
+	}
+
+	SelectObject(hDC, hOld);
+}
+
+// ----------------------------------------------------------------------------------------
+// Find the glyphs of a run. Adding glyphs may grow the atlas or evict glyphs which moves
+// the ones already found, in which case they are looked up again.
+//
+void D3D9Text::SetupQuads(D3D9TextRun *pRun)
+{
+	int n = int(pRun->str.size());
+	DWORD frame = pAtlas->GetFrame();
+
+	if (pRun->gen == pAtlas->GetGeneration() && int(pRun->glyph.size()) == n) {
+		if (pRun->touch != frame) {
+			for (int i = 0; i < n; i++) if (pRun->glyph[i]) pRun->glyph[i]->frame = frame;
+			pRun->touch = frame;
+		}
+		return;
+	}
+
+	const BYTE *str = (const BYTE *)pRun->str.data();
+
+	pRun->glyph.resize(n);
+	pRun->quad.resize(n * 4);
+
+	for (int k = 0; k < 3; k++) {
+
+		DWORD gen = pAtlas->GetGeneration();
+
+		for (int i = 0; i < n; i++) {
+			GLYPH *pG = pAtlas->Get(this, str[i]);
+			D3D9TextRun::Vtx *pV = &pRun->quad[i * 4];
+
+			float xp = ceil(pRun->adv[i]) - 0.5f;
+			float w = 0.0f, h = 0.0f;
+			float tx0 = 0.0f, ty0 = 0.0f, tx1 = 0.0f, ty1 = 0.0f;
+
+			if (pG) {
+				w = float(pG->w), h = float(pG->h);
+				tx0 = pG->tx0, ty0 = pG->ty0, tx1 = pG->tx1, ty1 = pG->ty1;
+			}
+
+			pV[0].x = xp;		pV[0].y = -0.5f;		pV[0].tx = tx0;	pV[0].ty = ty0;
+			pV[1].x = xp;		pV[1].y = h - 0.5f;		pV[1].tx = tx0;	pV[1].ty = ty1;
+			pV[2].x = xp + w;	pV[2].y = h - 0.5f;		pV[2].tx = tx1;	pV[2].ty = ty1;
+			pV[3].x = xp + w;	pV[3].y = -0.5f;		pV[3].tx = tx1;	pV[3].ty = ty0;
+
+			pRun->glyph[i] = pG;
+		}
+
+		if (gen == pAtlas->GetGeneration()) break;
+	}
+
+	pRun->gen = pAtlas->GetGeneration();
+	pRun->touch = frame;
+}
+
 // ----------------------------------------------------------------------------------------
 //
 float D3D9Text::PrintSkp(D3D9Pad *pSkp, float xpos, float ypos, const char *_str, int len, bool bBox)
+{
+	D3D9TextRun *pRun = GetRun(_str, len);
+
+	SetupQuads(pRun);
+
+	pAtlas->Commit();
+
+	int n = int(pRun->str.size());
+	float width = max(0.0f, pRun->adv[n] - spacing) * scaling;
+
+	return Draw(pSkp, xpos, ypos, pRun->quad.data(), n, width, pRun->bbox, pRun->adv[n], bBox);
+}
+
+// ----------------------------------------------------------------------------------------
+// UTF-16 strings are drawn from the same atlas, characters outside of the basic
+// multilingual plane are not supported
+//
+float D3D9Text::PrintSkp (D3D9Pad *pSkp, float xpos, float ypos, LPCWSTR str, int len, bool bBox)
+{
+	if (len == -1) len = int(wcslen(str));
+
+	WideQuad.resize(len * 4);
+
+	float adv = 0.0f, bbox = 0.0f;
+
+	for (int k = 0; k < 3; k++) {
+
+		DWORD gen = pAtlas->GetGeneration();
+
+		adv = bbox = 0.0f;
+
+		for (int i = 0; i < len; i++) {
+			GLYPH *pG = pAtlas->Get(this, GLYPH_WIDE | str[i]);
+			D3D9TextRun::Vtx *pV = &WideQuad[i * 4];
+
+			float xp = ceil(adv) - 0.5f;
+			float w = 0.0f, h = 0.0f, sp = 0.0f;
+			float tx0 = 0.0f, ty0 = 0.0f, tx1 = 0.0f, ty1 = 0.0f;
+
+			if (pG) {
+				w = float(pG->w), h = float(pG->h), sp = pG->adv;
+				tx0 = pG->tx0, ty0 = pG->ty0, tx1 = pG->tx1, ty1 = pG->ty1;
+			}
+
+			pV[0].x = xp;		pV[0].y = -0.5f;		pV[0].tx = tx0;	pV[0].ty = ty0;
+			pV[1].x = xp;		pV[1].y = h - 0.5f;		pV[1].tx = tx0;	pV[1].ty = ty1;
+			pV[2].x = xp + w;	pV[2].y = h - 0.5f;		pV[2].tx = tx1;	pV[2].ty = ty1;
+			pV[3].x = xp + w;	pV[3].y = -0.5f;		pV[3].tx = tx1;	pV[3].ty = ty0;
+
+			bbox += ceil(sp + spacing);
+			adv += (sp + spacing);
+		}
+
+		if (gen == pAtlas->GetGeneration()) break;
+	}
+
+	pAtlas->Commit();
+
+	float width = max(0.0f, adv - spacing) * scaling;
+
+	return Draw(pSkp, xpos, ypos, WideQuad.data(), len, width, bbox, adv, bBox);
+}
+
+// ----------------------------------------------------------------------------------------
+//
+float D3D9Text::Draw(D3D9Pad *pSkp, float xpos, float ypos, const D3D9TextRun::Vtx *pQ, int n, float width, float bbox, float adv, bool bBox)
 {
 
-	pSkp->SetFontTextureNative(pTex);
+	pSkp->SetFontTextureNative(pAtlas->GetTexture());
 
-	if (halign == 1) xpos -= Length2(_str, len) * 0.5f;
-	if (halign == 2) xpos -= Length2(_str, len);
+	if (halign == 1) xpos -= width * 0.5f;
+	if (halign == 2) xpos -= width;
 	if (valign == 1) ypos -= tm.tmAscent;
 	if (valign == 2) ypos -= tm.tmHeight;
 
-	const BYTE *str = (const BYTE *)_str;
-
 	xpos = ceil(xpos);
 	ypos = ceil(ypos);
 	
-	float x_orig = xpos;
-
 	float h = FontData[0].h;
 
 	float bbox_l = xpos - 2;
 	float bbox_t = ypos + 1;
 	float bbox_b = ypos + h - 1;
-	float bbox_r = xpos + 2;
-
-	unsigned char c = str[0];
-	int idx = 1;
-
-	while (c && (idx<=len || len<=0)) {
-		bbox_r += ceil(Data(c)->sp + spacing);
-		c = str[idx++];
-	}
+	float bbox_r = xpos + 2 + bbox;
 
 	D3DXMATRIX rot, out, mBak;
 	bool bRestore = false;
@@ -464,10 +700,7 @@ float D3D9Text::PrintSkp(D3D9Pad *pSkp, float xpos, float ypos, const char *_str
 		pSkp->FillRect(int(bbox_l), int(bbox_t+2), int(bbox_r), int(bbox_b), pSkp->bkcolor);
 	}
 
-	idx = 1;
-	c = str[0];
-
-	// Feed data directly into a drawing queue
+	// Feed the cached quads directly into a drawing queue
 	//
 	if (pSkp->Topology(D3D9Pad::Topo::TRIANGLE)) {
 
@@ -479,9 +712,7 @@ float D3D9Text::PrintSkp(D3D9Pad *pSkp, float xpos, float ypos, const char *_str
 		DWORD flags = SKPSW_FONT | SKPSW_CENTER | SKPSW_FRAGMENT;
 		DWORD color = pSkp->textcolor.dclr;
 
-		while (c && (idx <= len || len <= 0)) {
-
-			D3D9FontData *pData = Data(c);
+		for (int i = 0; i < n; i++) {
 
 			pIdx[iI++] = vI;
 			pIdx[iI++] = vI + 1;
@@ -490,29 +721,22 @@ float D3D9Text::PrintSkp(D3D9Pad *pSkp, float xpos, float ypos, const char *_str
 			pIdx[iI++] = vI + 2;
 			pIdx[iI++] = vI + 3;
 
-			float w = pData->w;
-			float xp = ceil(xpos);
-			SkpVtxFF(pVtx[vI++], xp, ypos, pData->tx0, pData->ty0);
-			SkpVtxFF(pVtx[vI++], xp, ypos + h, pData->tx0, pData->ty1);
-			SkpVtxFF(pVtx[vI++], xp + w, ypos + h, pData->tx1, pData->ty1);
-			SkpVtxFF(pVtx[vI++], xp + w, ypos, pData->tx1, pData->ty0);
-
-			pVtx[vI - 1].fnc = flags;
-			pVtx[vI - 1].clr = color;
-			pVtx[vI - 2].fnc = flags;
-			pVtx[vI - 2].clr = color;
-			pVtx[vI - 3].fnc = flags;
-			pVtx[vI - 3].clr = color;
-			pVtx[vI - 4].fnc = flags;
-			pVtx[vI - 4].clr = color;
-
-			xpos += (pData->sp + spacing);
-
-			c = str[idx++];
+			for (int k = 0; k < 4; k++, pQ++) {
+				SkpVtx &v = pVtx[vI++];
+				v.x = pQ->x + xpos;
+				v.y = pQ->y + ypos;
+				v.nx = pQ->tx;
+				v.ny = pQ->ty;
+				v.l = 0.0f;
+				v.fnc = flags;
+				v.clr = color;
+			}
 		}
 
 		pSkp->vI = vI;
 		pSkp->iI = iI;
+
+		D3D9Stats.Text.Glyphs += n;
 	}
 	
 
@@ -520,64 +744,191 @@ float D3D9Text::PrintSkp(D3D9Pad *pSkp, float xpos, float ypos, const char *_str
 		memcpy(pSkp->WorldMatrix(), &mBak, sizeof(D3DXMATRIX));
 	}
 
-	float l = xpos - x_orig;
+	float l = adv;
 	if (l>max_len) max_len = l;
 	return l;
 }
 
-// ----------------------------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------------------------
 //
-float D3D9Text::PrintSkp (D3D9Pad *pSkp, float xpos, float ypos, LPCWSTR str, int len, bool bBox)
+void D3D9Text::D3D9TechInit(D3D9Client *_gc, LPDIRECT3DDEVICE9 pDev)
 {
+	Buffer = new char[512];
 
-	if (len == -1) len = int(wcslen(str));
+	D3DCAPS9 caps;
+	pDev->GetDeviceCaps(&caps);
+
+	hMeasureDC = CreateCompatibleDC(NULL);
+	pAtlas = new D3D9FontAtlas(pDev, 2048, 256, min(4096, int(caps.MaxTextureHeight)));
+}
 
-	LONG x = LONG(round(xpos)),
-	     y = LONG(round(ypos));
-	RECT rect = { x, y, 0, 0 };
-
-	// Must Flush() pending graphics before using ID3DXFont interface
-	pSkp->Flush();
-
-	wfont->DrawTextW(
-		NULL,                     // pSprite
-		str,                      // pString
-		len,                      // Count
-		&rect,                    // pRect
-		DT_CALCRECT | DT_NOCLIP,  // Format
-		pSkp->textcolor.dclr      // Color
-	);
-
-	if (bBox)
-	{
-		pSkp->FillRect(rect.left-2, rect.top+1, rect.right+2, rect.bottom-1, pSkp->bkcolor);
+void D3D9Text::GlobalExit()
+{
+	SAFE_DELETEA(Buffer);
+	SAFE_DELETE(pAtlas);
+	if (hMeasureDC) DeleteDC(hMeasureDC);
+	hMeasureDC = NULL;
+}
+
+void D3D9Text::NewFrame()
+{
+	dwFrame++;
+	if (pAtlas) {
+		pAtlas->NewFrame();
+		pAtlas->ReleaseGarbage();
 	}
+}
+
+char *		 D3D9Text::Buffer = 0;
+DWORD		 D3D9Text::dwFrame = 0;
+D3D9FontAtlas * D3D9Text::pAtlas = NULL;
+HDC			 D3D9Text::hMeasureDC = NULL;
+std::vector<D3D9TextRun::Vtx> D3D9Text::WideQuad;
+
 
-	// Must Flush() pending graphics before using ID3DXFont interface
-	pSkp->Flush();
 
-	wfont->DrawTextW(
-		NULL,                              // pSprite
-		str,                               // pString
-		len,                               // Count
-		&rect,                             // pRect
-		DT_VCENTER | DT_LEFT | DT_NOCLIP,  // Format
-		pSkp->textcolor.dclr               // Color
-	);
 
-	return float(rect.right - rect.left);
+// ===============================================================================================
+// Glyph atlas texture
+// ===============================================================================================
+
+D3D9FontAtlas::D3D9FontAtlas(LPDIRECT3DDEVICE9 _pDev, int _width, int _height, int maxheight) :
+	GlyphAtlas(_width, _height, maxheight),
+	pDev(_pDev),
+	pSys(NULL),
+	pTex(NULL),
+	pSurf(NULL),
+	width(_width),
+	height(_height),
+	bEmpty(true)
+{
+	if (!Create(height, &pSys, &pTex)) LogErr("D3D9FontAtlas: Failed to create a %dx%d atlas", width, height);
 }
 
-// -----------------------------------------------------------------------------------------------
+// ===============================================================================================
 //
-void D3D9Text::D3D9TechInit(D3D9Client *_gc, LPDIRECT3DDEVICE9 pDev)
+D3D9FontAtlas::~D3D9FontAtlas()
 {
-	Buffer = new char[512];
+	ReleaseGarbage();
+	SAFE_RELEASE(pSurf);
+	SAFE_RELEASE(pSys);
+	SAFE_RELEASE(pTex);
 }
 
-void D3D9Text::GlobalExit()
+// ===============================================================================================
+//
+bool D3D9FontAtlas::Create(int h, LPDIRECT3DTEXTURE9 *pSysTex, LPDIRECT3DTEXTURE9 *pDefTex)
 {
-	SAFE_DELETEA(Buffer);
+	if (pSysTex) {
+		if (pDev->CreateTexture(width, h, 1, 0, D3DFMT_R5G6B5, D3DPOOL_SYSTEMMEM, pSysTex, NULL) != S_OK) return false;
+	}
+	if (pDefTex) {
+		if (pDev->CreateTexture(width, h, 0, D3DUSAGE_AUTOGENMIPMAP, D3DFMT_R5G6B5, D3DPOOL_DEFAULT, pDefTex, NULL) != S_OK) {
+			if (pSysTex) SAFE_RELEASE(*pSysTex);
+			return false;
+		}
+	}
+	return true;
 }
 
-char *		 D3D9Text::Buffer = 0;
+// ===============================================================================================
+//
+void D3D9FontAtlas::ReleaseGarbage()
+{
+	for (size_t i = 0; i < Garbage.size(); i++) Garbage[i]->Release();
+	Garbage.clear();
+}
+
+// ===============================================================================================
+// Copy the glyphs into a taller texture. The old texture and its texture coordinates stay
+// valid for the draws already queued.
+//
+bool D3D9FontAtlas::Resize(int h)
+{
+	LPDIRECT3DTEXTURE9 pNewSys = NULL, pNewTex = NULL;
+
+	if (!pSys || !Create(h, &pNewSys, &pNewTex)) {
+		LogErr("D3D9FontAtlas: Failed to grow the atlas to %dx%d", width, h);
+		return false;
+	}
+
+	D3DLOCKED_RECT src, tgt;
+
+	if (pSys->LockRect(0, &src, NULL, D3DLOCK_READONLY) == S_OK) {
+		if (pNewSys->LockRect(0, &tgt, NULL, 0) == S_OK) {
+			for (int y = 0; y < h; y++) {
+				BYTE *pTgt = (BYTE *)tgt.pBits + y * tgt.Pitch;
+				if (y < height) memcpy(pTgt, (BYTE *)src.pBits + y * src.Pitch, width * 2);
+				else memset(pTgt, 0, width * 2);
+			}
+			pNewSys->UnlockRect(0);
+		}
+		pSys->UnlockRect(0);
+	}
+
+	pSys->Release();
+	pSys = pNewSys;
+
+	if (pTex) Garbage.push_back(pTex);
+	pTex = pNewTex;
+
+	HR(pDev->UpdateTexture(pSys, pTex));
+	pTex->GenerateMipSubLevels();
+
+	LogAlw("D3D9FontAtlas: Grown to %dx%d", width, h);
+
+	height = h;
+	return true;
+}
+
+// ===============================================================================================
+//
+void *D3D9FontAtlas::BeginDraw(bool bClear)
+{
+	if (!pSys) return NULL;
+
+	// Glyphs are packed again, draws already queued need the old texture
+	if (bClear && !bEmpty) {
+		LPDIRECT3DTEXTURE9 pNewTex = NULL;
+		if (Create(height, NULL, &pNewTex)) {
+			Garbage.push_back(pTex);
+			pTex = pNewTex;
+		}
+	}
+
+	HDC hDC = NULL;
+
+	HR(pSys->GetSurfaceLevel(0, &pSurf));
+
+	if (pSurf->GetDC(&hDC) != S_OK) {
+		LogErr("D3D9FontAtlas::GetDC Fail");
+		SAFE_RELEASE(pSurf);
+		return NULL;
+	}
+
+	if (bClear) PatBlt(hDC, 0, 0, width, height, BLACKNESS);
+
+	SetTextAlign(hDC, TA_BASELINE | TA_LEFT);
+	SetTextColor(hDC, 0xFFFFFF);
+	SetBkColor(hDC, 0);
+	SetBkMode(hDC, TRANSPARENT);
+
+	bEmpty = false;
+
+	return hDC;
+}
+
+// ===============================================================================================
+//
+void D3D9FontAtlas::EndDraw(void *ctx, const RECT &dirty)
+{
+	if (ctx) pSurf->ReleaseDC(HDC(ctx));
+	SAFE_RELEASE(pSurf);
+
+	if (!pTex) return;
+
+	HR(pSys->AddDirtyRect(&dirty));
+	HR(pDev->UpdateTexture(pSys, pTex));
+	pTex->GenerateMipSubLevels();
+}
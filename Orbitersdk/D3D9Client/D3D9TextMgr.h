@@ -27,23 +27,93 @@
 
 #include "D3D9Client.h"
 #include "AABBUtil.h"
+#include "GlyphAtlas.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
 
+#define TEXTRUN_MAX		1024	///< Number of cached text runs per font
+#define TEXTRUN_AGE		120		///< Number of frames an unused text run is kept
+
+#define GLYPH_WIDE		0x10000	///< Glyph code of a UTF-16 character, ANSI characters are used as is
 
 class D3D9ClientSurface;
 
 // ----------------------------------------------------------------------------------------
 //
 struct D3D9FontData {
-	float w, h;		// X,Y position of the charter baseline
+	float w, h;		// Size of the charter cell
 	float sp;
-	float tx0, ty0;
-	float tx1, ty1;
 };
 
 
 // ----------------------------------------------------------------------------------------
+// Laid out ANSI string. Quads are relative to the pen position of the first character,
+// advances are unscaled prefix sums: adv[i] is the pen position before character i.
+// Glyphs and quads are valid while the atlas generation matches.
+// Word wrap and hit testing binary search the advances when the run is 'ordered'.
+//
+struct D3D9TextRun {
+	struct Vtx { float x, y, tx, ty; };
+
+	std::string			str;		///< Characters of the run, to resolve hash collisions
+	float				spacing;	///< Text spacing the run was laid out with
+	float				bbox;		///< Width of the background box
+	std::vector<float>	adv;		///< Pen positions, one more than characters
+	std::vector<int>	spaces;		///< Break opportunities, positions of the spaces
+	int					flat;		///< First character without advance, number of characters if none
+	bool				ordered;	///< Pen positions never decrease (no negative text spacing)
+	std::vector<Vtx>	quad;		///< Four vertices per character
+	std::vector<GLYPH *> glyph;		///< Glyphs in the atlas
+	DWORD				gen;		///< Atlas generation of the glyphs
+	DWORD				touch;		///< Atlas frame the glyphs were last marked used
+	float				wrapWidth;	///< Width and scaling of the wrap breaks, negative if none
+	float				wrapScale;
+	std::vector<int>	breaks;		///< Spaces replaced with a line break when wrapped
+	DWORD				frame;		///< Frame the run was last used
+};
+
+
+// ----------------------------------------------------------------------------------------
+// Glyph atlas in a texture shared by all fonts
 //
-class D3D9Text {
+class D3D9FontAtlas : public GlyphAtlas {
+
+public:
+	D3D9FontAtlas(LPDIRECT3DDEVICE9 pDev, int width, int height, int maxheight);
+	~D3D9FontAtlas();
+
+	LPDIRECT3DTEXTURE9	GetTexture() const { return pTex; }
+
+	/**
+	 * \brief Release replaced textures, queued sketchpad draws may refer to them until the frame ends
+	 */
+	void		ReleaseGarbage();
+
+protected:
+
+	bool		Resize(int height);
+	void *		BeginDraw(bool bClear);
+	void		EndDraw(void *ctx, const RECT &dirty);
+
+private:
+
+	bool		Create(int height, LPDIRECT3DTEXTURE9 *pSysTex, LPDIRECT3DTEXTURE9 *pDefTex);
+
+	LPDIRECT3DDEVICE9	pDev;
+	LPDIRECT3DTEXTURE9	pSys;		///< Glyph images in system memory
+	LPDIRECT3DTEXTURE9	pTex;		///< Texture used for drawing
+	LPDIRECT3DSURFACE9	pSurf;		///< Surface with an open DC while drawing
+	std::vector<LPDIRECT3DTEXTURE9> Garbage;
+	int					width;
+	int					height;
+	bool				bEmpty;
+};
+
+
+// ----------------------------------------------------------------------------------------
+//
+class D3D9Text : public GlyphSource {
 
 public:
 	/**
@@ -64,13 +134,18 @@ public:
 	 */
 	static void GlobalExit();
 
+	/**
+	 * \brief Advance the frame counters used to age out text runs and glyphs
+	 */
+	static void NewFrame();
+
+	static const D3D9FontAtlas *GetAtlas() { return pAtlas; }
+
 	void		SetCharSet(int charset=ANSI_CHARSET);	// Must be set before Init
 
-				// Init Will Create Charters from "first" (32:space) to "last" (255 ???)
+				// Init measures charters from "first" (32:space) to 255, glyphs are rasterized when used
 	bool        Init(HFONT hFont);
 
-	LPDIRECT3DTEXTURE9	GetTexture() const { return pTex; }
-
 	void        SetLineSpace(int percent=10);
 	void		SetTextSpace(float space = 0.0f);
 	void		SetTextShare(int percent=0);	// Percent of average width (default=0)
@@ -88,6 +163,14 @@ public:
 	float		Length(BYTE c);
 	int			GetIndex(const char *pText, float pos, int len = -1);
 
+	/**
+	 * \brief Word wrap a single line by replacing spaces with '\n'
+	 * \param str Line to wrap, modified in place
+	 * \param len Number of characters in the line
+	 * \param maxWidth Maximum width of a line in pixels
+	 */
+	void		WrapLine(char *str, int len, float maxWidth);
+
 	void		SetTextHAlign(int x); // 0-left, 1=center, 2=right
 	void		SetTextVAlign(int x); // 0-top, 1=base, 2=bottom
 
@@ -96,12 +179,14 @@ public:
 
     void		GetD3D9TextMetrics(TEXTMETRIC *t) { memcpy(t, &tm, sizeof(TEXTMETRIC)); }
 
+	// GlyphSource
+	bool		GlyphSize(DWORD code, int *w, int *h, float *adv);
+	void		GlyphDraw(void *ctx, DWORD code, int x, int y);
+
 private:
 
 	float	red, green, blue, alpha;
 
-	int     tex_w;
-	int     tex_h;
 	int		sharing;
 	float	spacing;
 	int		linespacing;
@@ -111,17 +196,30 @@ private:
 	int		charset;
 	int     first;            ///< ANSI code of the first charter (FontData[0])
 	int		halign,valign;
+	int		ascent;           ///< Baseline from the top of a charter cell
 
 	D3D9FontData *Data (int c); ///< Returns FontData reference of a character
 
+	D3D9TextRun *GetRun(const char *str, int len);	///< Returns a cached layout of a string
+	void		PurgeRuns();
+	void		FindBreaks(D3D9TextRun *pRun, float maxWidth);	///< Find the wrap breaks of a run
+	void		SetupQuads(D3D9TextRun *pRun);		///< Find the glyphs of a run in the atlas
+	float		Draw(class D3D9Pad *pSkp, float x, float y, const D3D9TextRun::Vtx *pQuad, int n, float width, float bbox, float adv, bool bBox);
+
 	LPDIRECT3DDEVICE9	pDev;
-	LPDIRECT3DTEXTURE9	pTex;
 	D3D9FontData		*FontData;  ///< Array of font data information ( [c - first] )
 	TEXTMETRIC			tm;         ///< Font attributes
 	LOGFONT             lf;         ///< Font attributes
-	ID3DXFont           *wfont;     ///< WCHAR font
+	HFONT				hFont;      ///< Copy of the font for rasterizing glyphs
+
+	std::unordered_map<unsigned __int64, D3D9TextRun> Runs;	///< Text run cache
+	DWORD				dwPurge;	///< Frame of the last purge
 
 	// Rendering pipeline configuration
 	//
 	static char *		Buffer;
+	static DWORD		dwFrame;
+	static D3D9FontAtlas *pAtlas;
+	static HDC			hMeasureDC;	///< Memory DC for measuring charters
+	static std::vector<D3D9TextRun::Vtx> WideQuad;
 };
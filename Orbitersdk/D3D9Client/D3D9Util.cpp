@@ -1208,6 +1208,26 @@ float D3D9Light::GetIlluminance(D3DXVECTOR3 &_pos, float r) const
 	return intensity / (Attenuation.x + Attenuation.y*d + Attenuation.z*d2);
 }
 
+// ============================================================================
+// Bounding sphere enclosing the lit volume, returns false for inactive lights
+//
+bool D3D9Light::GetBoundingSphere(D3DXVECTOR3 *pCnt, float *pRad) const
+{
+	if (intensity < 0) return false;
+
+	// A cone narrower than 120deg fits in a sphere passing through the apex
+	if ((Type == 1) && (cosp > 0.5f)) {
+		float r = range / (2.0f * cosp);
+		*pCnt = Position + Direction * r;
+		*pRad = r;
+		return true;
+	}
+
+	*pCnt = Position;
+	*pRad = range;
+	return true;
+}
+
 // ============================================================================
 //
 const LightEmitter *D3D9Light::GetEmitter() const
@@ -90,6 +90,19 @@ const D3DVERTEXELEMENT9 MeshVertexDecl[] = {
 	D3DDECL_END()
 };
 
+// Mesh vertex with a world matrix per instance in stream 1
+const D3DVERTEXELEMENT9 InstVertexDecl[] = {
+	{0, 0,  D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
+	{0, 12, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0},
+	{0, 24, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TANGENT, 0},
+	{0, 36, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0},
+	{1, 0,  D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1},
+	{1, 16, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 2},
+	{1, 32, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 3},
+	{1, 48, D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 4},
+	D3DDECL_END()
+};
+
 const D3DVERTEXELEMENT9 PatchVertexDecl[] = {
 	{0, 0,  D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0},
 	{0, 12, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_NORMAL, 0},
@@ -185,6 +198,12 @@ public : _LightStruct () :	Type(0),
 } LightStruct;
 
 
+struct _LightList {
+	int		idx;
+	float	illuminace;
+};
+
+
 class D3D9Light : public LightStruct
 {
 public:
@@ -193,6 +212,7 @@ public:
 				~D3D9Light();
 
 		float	GetIlluminance(D3DXVECTOR3 &pos, float r) const;
+		bool	GetBoundingSphere(D3DXVECTOR3 *pCnt, float *pRad) const;
 		void	UpdateLight(const LightEmitter *le, const class vObject *vo);
 		void	Reset();
 		const   LightEmitter *GetEmitter() const;
@@ -280,6 +300,7 @@ typedef struct {
 #define D3D9LPhi 3
 
 extern IDirect3DVertexDeclaration9	*pMeshVertexDecl;
+extern IDirect3DVertexDeclaration9	*pInstVertexDecl;
 extern IDirect3DVertexDeclaration9	*pHazeVertexDecl;
 extern IDirect3DVertexDeclaration9	*pNTVertexDecl;
 extern IDirect3DVertexDeclaration9	*pBAVertexDecl;
@@ -0,0 +1,153 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "DDSFile.h"
+#include <stdio.h>
+
+#define DDS_MAGIC			0x20534444	// "DDS "
+#define DDSD_MIPMAPCOUNT	0x00020000
+#define DDPF_ALPHAPIXELS	0x00000001
+#define DDPF_FOURCC			0x00000004
+#define DDPF_RGB			0x00000040
+#define DDSCAPS2_CUBEMAP	0x00000200
+#define DDSCAPS2_VOLUME		0x00200000
+
+#pragma pack(push, 1)
+struct DDS_PIXELFORMAT {
+	DWORD	dwSize;
+	DWORD	dwFlags;
+	DWORD	dwFourCC;
+	DWORD	dwRGBBitCount;
+	DWORD	dwRBitMask, dwGBitMask, dwBBitMask, dwABitMask;
+};
+
+struct DDS_HEADER {
+	DWORD	dwSize;
+	DWORD	dwFlags;
+	DWORD	dwHeight;
+	DWORD	dwWidth;
+	DWORD	dwPitchOrLinearSize;
+	DWORD	dwDepth;
+	DWORD	dwMipMapCount;
+	DWORD	dwReserved1[11];
+	DDS_PIXELFORMAT ddspf;
+	DWORD	dwCaps, dwCaps2, dwCaps3, dwCaps4;
+	DWORD	dwReserved2;
+};
+#pragma pack(pop)
+
+// ===========================================================================================
+//
+DDSFile::DDSFile() :
+	fmt(D3DFMT_UNKNOWN),
+	width(0),
+	height(0),
+	levels(0),
+	bs(0)
+{
+	memset(offset, 0, sizeof(offset));
+}
+
+// ===========================================================================================
+//
+DWORD DDSFile::LevelPitch(int lvl) const
+{
+	if (bs) return max(DWORD(1), (LevelWidth(lvl) + 3) >> 2) * bs;
+	return LevelWidth(lvl) * 4;
+}
+
+// ===========================================================================================
+//
+DWORD DDSFile::LevelRows(int lvl) const
+{
+	if (bs) return max(DWORD(1), (LevelHeight(lvl) + 3) >> 2);
+	return LevelHeight(lvl);
+}
+
+// ===========================================================================================
+//
+DWORD DDSFile::RangeSize(int first, int last) const
+{
+	DWORD size = 0;
+	for (int i = first; i <= last; i++) size += LevelSize(i);
+	return size;
+}
+
+// ===========================================================================================
+//
+bool DDSFile::ReadHeader(const char *_path)
+{
+	FILE *f = NULL;
+	DWORD magic = 0;
+	DDS_HEADER hdr;
+
+	levels = 0;
+
+	if (fopen_s(&f, _path, "rb") || !f) return false;
+
+	bool bOk = (fread(&magic, sizeof(magic), 1, f) == 1) && (fread(&hdr, sizeof(hdr), 1, f) == 1);
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+
+	if (!bOk || magic != DDS_MAGIC || hdr.dwSize != sizeof(DDS_HEADER)) return false;
+	if (hdr.dwCaps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) return false;
+	if (hdr.dwWidth == 0 || hdr.dwHeight == 0) return false;
+
+	const DDS_PIXELFORMAT &pf = hdr.ddspf;
+
+	if (pf.dwFlags & DDPF_FOURCC) {
+		switch (pf.dwFourCC) {
+		case MAKEFOURCC('D', 'X', 'T', '1'): fmt = D3DFMT_DXT1; bs = 8;  break;
+		case MAKEFOURCC('D', 'X', 'T', '3'): fmt = D3DFMT_DXT3; bs = 16; break;
+		case MAKEFOURCC('D', 'X', 'T', '5'): fmt = D3DFMT_DXT5; bs = 16; break;
+		default: return false;
+		}
+	}
+	else if ((pf.dwFlags & DDPF_RGB) && pf.dwRGBBitCount == 32 && pf.dwRBitMask == 0xFF0000 && pf.dwGBitMask == 0xFF00 && pf.dwBBitMask == 0xFF) {
+		fmt = ((pf.dwFlags & DDPF_ALPHAPIXELS) && pf.dwABitMask == 0xFF000000) ? D3DFMT_A8R8G8B8 : D3DFMT_X8R8G8B8;
+		bs = 0;
+	}
+	else return false;
+
+	width = hdr.dwWidth;
+	height = hdr.dwHeight;
+
+	// The chain ends at 1x1
+	int chain = 1;
+	while ((max(width, height) >> chain) > 0) chain++;
+
+	int n = 1;
+	if ((hdr.dwFlags & DDSD_MIPMAPCOUNT) && hdr.dwMipMapCount > 0) n = int(hdr.dwMipMapCount);
+	n = min(n, min(chain, DDS_MAXLEVELS));
+
+	DWORD pos = sizeof(magic) + sizeof(DDS_HEADER);
+	for (int i = 0; i < n; i++) {
+		offset[i] = pos;
+		pos += LevelSize(i);
+	}
+
+	if (pos > DWORD(size)) return false;
+
+	path = _path;
+	levels = n;
+	return true;
+}
+
+// ===========================================================================================
+//
+bool DDSFile::ReadLevels(int first, int last, BYTE *pOut) const
+{
+	if (first < 0 || last >= levels || first > last) return false;
+
+	FILE *f = NULL;
+	if (fopen_s(&f, path.c_str(), "rb") || !f) return false;
+
+	DWORD size = RangeSize(first, last);
+	bool bOk = (fseek(f, long(offset[first]), SEEK_SET) == 0) && (fread(pOut, 1, size, f) == size);
+
+	fclose(f);
+	return bOk;
+}
@@ -0,0 +1,81 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class DDSFile (interface)
+//
+// Reader of the mip levels of a DDS texture file. The header is
+// parsed once, after that any range of levels can be read with a
+// single seek and read, the levels of a DDS file being stored
+// finest first one after another.
+//
+// Plain 2D textures in DXT1, DXT3, DXT5, A8R8G8B8 and X8R8G8B8
+// format are supported. The file isn't kept open between reads.
+// The reader doesn't depend on the device.
+// ==============================================================
+
+#ifndef __DDSFILE_H
+#define __DDSFILE_H
+
+#include <windows.h>
+#include <d3d9.h>
+#include <string>
+
+#define DDS_MAXLEVELS		16
+
+class DDSFile
+{
+
+public:
+
+	DDSFile();
+
+	/**
+	 * \brief Read and check the header of a file
+	 * \return false if the file can't be read or its format isn't supported
+	 */
+	bool		ReadHeader(const char *path);
+
+	/**
+	 * \brief Read a range of levels
+	 * \param first, last Finest and coarsest level to read
+	 * \param pOut Receives the levels one after another, RangeSize(first, last) bytes
+	 */
+	bool		ReadLevels(int first, int last, BYTE *pOut) const;
+
+	D3DFORMAT	Format() const { return fmt; }
+	DWORD		Width() const { return width; }
+	DWORD		Height() const { return height; }
+	int			Levels() const { return levels; }
+	const char *Path() const { return path.c_str(); }
+	bool		IsCompressed() const { return bs != 0; }
+
+	DWORD		LevelWidth(int lvl) const { return max(DWORD(1), width >> lvl); }
+	DWORD		LevelHeight(int lvl) const { return max(DWORD(1), height >> lvl); }
+
+	/**
+	 * \brief Bytes per row of pixels, or per row of 4x4 blocks of a compressed format
+	 */
+	DWORD		LevelPitch(int lvl) const;
+
+	/**
+	 * \brief Rows of pixels, or rows of 4x4 blocks of a compressed format
+	 */
+	DWORD		LevelRows(int lvl) const;
+
+	DWORD		LevelSize(int lvl) const { return LevelPitch(lvl) * LevelRows(lvl); }
+	DWORD		RangeSize(int first, int last) const;
+
+private:
+
+	std::string path;
+	D3DFORMAT	fmt;
+	DWORD		width, height;
+	int			levels;
+	int			bs;							///< Bytes per 4x4 block, 0 = uncompressed
+	DWORD		offset[DDS_MAXLEVELS];		///< File offset of each level
+};
+
+#endif // !__DDSFILE_H
@@ -0,0 +1,541 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "DXTCodec.h"
+#include "Log.h"
+#include <math.h>
+#include <limits.h>
+
+HANDLE DXTCodec::hThread[DXT_MAXTHREADS] = { 0 };
+HANDLE DXTCodec::hStart[DXT_MAXTHREADS] = { 0 };
+HANDLE DXTCodec::hDone[DXT_MAXTHREADS] = { 0 };
+int DXTCodec::nThreads = -1;
+DXTCodec::JOB * DXTCodec::pCurrent = NULL;
+volatile bool DXTCodec::bExit = false;
+volatile LONG DXTCodec::bBusy = 0;
+
+// ===========================================================================================
+// 565 to 888 by bit replication
+//
+static inline void Unpack565(WORD c, int *rgb)
+{
+	int r = (c >> 11) & 0x1F, g = (c >> 5) & 0x3F, b = c & 0x1F;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+static inline WORD Pack565(const int *rgb)
+{
+	return WORD((((rgb[0] * 31 + 127) / 255) << 11) | (((rgb[1] * 63 + 127) / 255) << 5) | ((rgb[2] * 31 + 127) / 255));
+}
+
+static inline DWORD MakeColor(int a, const int *rgb)
+{
+	return (DWORD(a) << 24) | (DWORD(rgb[0]) << 16) | (DWORD(rgb[1]) << 8) | DWORD(rgb[2]);
+}
+
+// ===========================================================================================
+// Colour palette of the endpoints c0, c1. DXT1 is in the three colour mode if c0 <= c1,
+// the fourth entry is then transparent black.
+//
+static void ColorPalette(WORD c0, WORD c1, bool bFour, DWORD *pal)
+{
+	int e0[3], e1[3], m[3];
+
+	Unpack565(c0, e0);
+	Unpack565(c1, e1);
+
+	pal[0] = MakeColor(255, e0);
+	pal[1] = MakeColor(255, e1);
+
+	if (bFour || c0 > c1) {
+		for (int i = 0; i < 3; i++) m[i] = (2*e0[i] + e1[i] + 1) / 3;
+		pal[2] = MakeColor(255, m);
+		for (int i = 0; i < 3; i++) m[i] = (e0[i] + 2*e1[i] + 1) / 3;
+		pal[3] = MakeColor(255, m);
+	}
+	else {
+		for (int i = 0; i < 3; i++) m[i] = (e0[i] + e1[i] + 1) >> 1;
+		pal[2] = MakeColor(255, m);
+		pal[3] = 0;
+	}
+}
+
+static inline DWORD Indices(const BYTE *b)
+{
+	return DWORD(b[0]) | (DWORD(b[1]) << 8) | (DWORD(b[2]) << 16) | (DWORD(b[3]) << 24);
+}
+
+// ===========================================================================================
+//
+bool DXTCodec::IsSupported(D3DFORMAT fmt)
+{
+	return BlockSize(fmt) != 0;
+}
+
+// ===========================================================================================
+//
+int DXTCodec::BlockSize(D3DFORMAT fmt)
+{
+	switch (fmt) {
+	case D3DFMT_DXT1: return 8;
+	case D3DFMT_DXT3: return 16;
+	case D3DFMT_DXT5: return 16;
+	}
+	return 0;
+}
+
+// ===========================================================================================
+//
+void DXTCodec::AlphaPalette(const BYTE *b, DWORD *a)
+{
+	a[0] = b[0];
+	a[1] = b[1];
+	if (a[0] > a[1]) {
+		for (int i = 1; i < 7; i++) a[i+1] = ((7-i)*a[0] + i*a[1] + 3) / 7;
+	}
+	else {
+		for (int i = 1; i < 5; i++) a[i+1] = ((5-i)*a[0] + i*a[1] + 2) / 5;
+		a[6] = 0;
+		a[7] = 255;
+	}
+}
+
+// ===========================================================================================
+//
+void DXTCodec::DecodeBlock(D3DFORMAT fmt, const BYTE *pBlock, DWORD *pDst, int pitch, bool bOpaque)
+{
+	DWORD pal[4];
+	const BYTE *pColor = (fmt == D3DFMT_DXT1 ? pBlock : pBlock + 8);
+
+	ColorPalette(WORD(pColor[0] | (pColor[1] << 8)), WORD(pColor[2] | (pColor[3] << 8)), fmt != D3DFMT_DXT1, pal);
+
+	DWORD bits = Indices(pColor + 4);
+
+	if (fmt == D3DFMT_DXT1 || bOpaque) {
+		DWORD amask = (bOpaque ? 0xFF000000 : 0);
+		for (int y = 0; y < 4; y++, pDst += pitch) {
+			for (int x = 0; x < 4; x++, bits >>= 2) pDst[x] = pal[bits & 3] | amask;
+		}
+		return;
+	}
+
+	for (int i = 0; i < 4; i++) pal[i] &= 0x00FFFFFF;
+
+	if (fmt == D3DFMT_DXT3) {
+		for (int y = 0; y < 4; y++, pDst += pitch) {
+			DWORD a = pBlock[y*2] | (pBlock[y*2+1] << 8);
+			for (int x = 0; x < 4; x++, bits >>= 2, a >>= 4) pDst[x] = pal[bits & 3] | (((a & 0xF) * 17) << 24);
+		}
+		return;
+	}
+
+	DWORD apal[8];
+	AlphaPalette(pBlock, apal);
+	for (int i = 0; i < 8; i++) apal[i] <<= 24;
+
+	for (int h = 0; h < 2; h++) {
+		// Eight 3-bit alpha indices per half of the block
+		DWORD a = pBlock[2+h*3] | (pBlock[3+h*3] << 8) | (pBlock[4+h*3] << 16);
+		for (int y = 0; y < 2; y++, pDst += pitch) {
+			for (int x = 0; x < 4; x++, bits >>= 2, a >>= 3) pDst[x] = pal[bits & 3] | apal[a & 7];
+		}
+	}
+}
+
+// ===========================================================================================
+// Select the palette entry of each pixel, returns the squared error
+//
+static DWORD FitIndices(const int (*px)[3], DWORD tmask, WORD c0, WORD c1, bool bFour, DWORD *pBits)
+{
+	DWORD pal[4];
+	ColorPalette(c0, c1, bFour, pal);
+
+	int n = (bFour || c0 > c1) ? 4 : 3;
+	int p[4][3];
+	for (int i = 0; i < 4; i++) {
+		p[i][0] = (pal[i] >> 16) & 0xFF;
+		p[i][1] = (pal[i] >> 8) & 0xFF;
+		p[i][2] = pal[i] & 0xFF;
+	}
+
+	DWORD bits = 0, err = 0;
+
+	for (int i = 15; i >= 0; i--) {
+		bits <<= 2;
+		if (tmask & (1 << i)) {
+			bits |= 3;
+			continue;
+		}
+		int best = 0, dmin = INT_MAX;
+		for (int k = 0; k < n; k++) {
+			int dr = px[i][0] - p[k][0], dg = px[i][1] - p[k][1], db = px[i][2] - p[k][2];
+			int d = dr*dr + dg*dg + db*db;
+			if (d < dmin) dmin = d, best = k;
+		}
+		bits |= best;
+		err += dmin;
+	}
+
+	*pBits = bits;
+	return err;
+}
+
+// ===========================================================================================
+// Quantize the endpoints, the order selects the mode of a DXT1 block
+//
+static DWORD FitEndpoints(const int (*px)[3], DWORD tmask, bool bFour, const int *e0, const int *e1, WORD *pc0, WORD *pc1, DWORD *pBits)
+{
+	WORD c0 = Pack565(e0), c1 = Pack565(e1);
+
+	// Transparent pixels need the three colour mode, c0 <= c1
+	if (tmask ? (c0 > c1) : (c0 < c1)) {
+		WORD t = c0; c0 = c1; c1 = t;
+	}
+
+	*pc0 = c0;
+	*pc1 = c1;
+	return FitIndices(px, tmask, c0, c1, bFour, pBits);
+}
+
+// ===========================================================================================
+// Endpoints from the extremes along the principal axis, then one least squares refinement
+// of the endpoints for the selected indices
+//
+static void EncodeColor(const DWORD *pSrc, int pitch, DWORD tmask, bool bFour, BYTE *b)
+{
+	int px[16][3];
+	float mean[3] = { 0, 0, 0 };
+	int n = 0;
+
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 4; x++) {
+			DWORD c = pSrc[y*pitch + x];
+			int *p = px[y*4 + x];
+			p[0] = (c >> 16) & 0xFF;
+			p[1] = (c >> 8) & 0xFF;
+			p[2] = c & 0xFF;
+			if (tmask & (1 << (y*4 + x))) continue;
+			for (int i = 0; i < 3; i++) mean[i] += float(p[i]);
+			n++;
+		}
+	}
+
+	if (n == 0) {
+		// All transparent
+		b[0] = b[1] = b[2] = b[3] = 0;
+		b[4] = b[5] = b[6] = b[7] = 0xFF;
+		return;
+	}
+
+	for (int i = 0; i < 3; i++) mean[i] /= float(n);
+
+	// Covariance
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int j = 0; j < 16; j++) {
+		if (tmask & (1 << j)) continue;
+		float r = px[j][0] - mean[0], g = px[j][1] - mean[1], bl = px[j][2] - mean[2];
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*bl;
+		cov[3] += g*g; cov[4] += g*bl; cov[5] += bl*bl;
+	}
+
+	// Principal axis by power iteration, starting from the column of the largest variance
+	float v[3];
+	if (cov[0] >= cov[3] && cov[0] >= cov[5]) v[0] = cov[0], v[1] = cov[1], v[2] = cov[2];
+	else if (cov[3] >= cov[5]) v[0] = cov[1], v[1] = cov[3], v[2] = cov[4];
+	else v[0] = cov[2], v[1] = cov[4], v[2] = cov[5];
+	for (int k = 0; k < 4; k++) {
+		float x = cov[0]*v[0] + cov[1]*v[1] + cov[2]*v[2];
+		float y = cov[1]*v[0] + cov[3]*v[1] + cov[4]*v[2];
+		float z = cov[2]*v[0] + cov[4]*v[1] + cov[5]*v[2];
+		float m = max(fabs(x), max(fabs(y), fabs(z)));
+		if (m < 1e-6f) break;
+		v[0] = x / m; v[1] = y / m; v[2] = z / m;
+	}
+
+	int imin = -1, imax = -1;
+	float dmin = 0, dmax = 0;
+	for (int j = 0; j < 16; j++) {
+		if (tmask & (1 << j)) continue;
+		float d = px[j][0]*v[0] + px[j][1]*v[1] + px[j][2]*v[2];
+		if (imin < 0 || d < dmin) dmin = d, imin = j;
+		if (imax < 0 || d > dmax) dmax = d, imax = j;
+	}
+
+	WORD c0, c1;
+	DWORD bits;
+	DWORD err = FitEndpoints(px, tmask, bFour, px[imax], px[imin], &c0, &c1, &bits);
+
+	if (err && c0 != c1) {
+
+		// Weights of the endpoints for each index
+		bool b4 = bFour || c0 > c1;
+		static const float w4[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f };
+		static const float w3[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+		const float *w = b4 ? w4 : w3;
+
+		float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+		DWORD s = bits;
+		for (int j = 0; j < 16; j++, s >>= 2) {
+			if (tmask & (1 << j)) continue;
+			float a = w[s & 3], c = 1.0f - a;
+			aa += a*a; ab += a*c; bb += c*c;
+			for (int i = 0; i < 3; i++) ax[i] += a * px[j][i], bx[i] += c * px[j][i];
+		}
+
+		float det = aa*bb - ab*ab;
+
+		if (fabs(det) > 1e-6f) {
+			int e0[3], e1[3];
+			for (int i = 0; i < 3; i++) {
+				e0[i] = max(0, min(255, int((bb*ax[i] - ab*bx[i]) / det + 0.5f)));
+				e1[i] = max(0, min(255, int((aa*bx[i] - ab*ax[i]) / det + 0.5f)));
+			}
+			WORD r0, r1;
+			DWORD rbits;
+			if (FitEndpoints(px, tmask, bFour, e0, e1, &r0, &r1, &rbits) < err) c0 = r0, c1 = r1, bits = rbits;
+		}
+	}
+
+	b[0] = BYTE(c0); b[1] = BYTE(c0 >> 8);
+	b[2] = BYTE(c1); b[3] = BYTE(c1 >> 8);
+	b[4] = BYTE(bits); b[5] = BYTE(bits >> 8); b[6] = BYTE(bits >> 16); b[7] = BYTE(bits >> 24);
+}
+
+// ===========================================================================================
+//
+static void EncodeAlphaDXT5(const DWORD *pSrc, int pitch, BYTE *b)
+{
+	DWORD a[16], amin = 255, amax = 0;
+
+	for (int j = 0; j < 16; j++) {
+		a[j] = pSrc[(j >> 2)*pitch + (j & 3)] >> 24;
+		amin = min(amin, a[j]);
+		amax = max(amax, a[j]);
+	}
+
+	b[0] = BYTE(amax);
+	b[1] = BYTE(amin);
+	memset(b + 2, 0, 6);
+
+	// Constant alpha, index 0 in the six value mode
+	if (amax == amin) return;
+
+	DWORD pal[8];
+	DXTCodec::AlphaPalette(b, pal);
+
+	for (int h = 0; h < 2; h++) {
+		DWORD bits = 0;
+		for (int j = 7; j >= 0; j--) {
+			DWORD v = a[h*8 + j], best = 0, dmin = 256;
+			for (DWORD k = 0; k < 8; k++) {
+				DWORD d = (v > pal[k] ? v - pal[k] : pal[k] - v);
+				if (d < dmin) dmin = d, best = k;
+			}
+			bits = (bits << 3) | best;
+		}
+		b[2+h*3] = BYTE(bits);
+		b[3+h*3] = BYTE(bits >> 8);
+		b[4+h*3] = BYTE(bits >> 16);
+	}
+}
+
+// ===========================================================================================
+//
+void DXTCodec::EncodeBlock(D3DFORMAT fmt, const DWORD *pSrc, int pitch, BYTE *pBlock, bool bOpaque)
+{
+	if (fmt == D3DFMT_DXT1) {
+		DWORD tmask = 0;
+		if (!bOpaque) {
+			for (int j = 0; j < 16; j++) if ((pSrc[(j >> 2)*pitch + (j & 3)] >> 24) < 128) tmask |= 1 << j;
+		}
+		EncodeColor(pSrc, pitch, tmask, false, pBlock);
+		return;
+	}
+
+	EncodeColor(pSrc, pitch, 0, true, pBlock + 8);
+
+	if (bOpaque) {
+		if (fmt == D3DFMT_DXT3) memset(pBlock, 0xFF, 8);
+		else {
+			pBlock[0] = pBlock[1] = 0xFF;
+			memset(pBlock + 2, 0, 6);
+		}
+		return;
+	}
+
+	if (fmt == D3DFMT_DXT3) {
+		for (int j = 0; j < 8; j++) {
+			DWORD a0 = pSrc[((2*j) >> 2)*pitch + ((2*j) & 3)] >> 24;
+			DWORD a1 = pSrc[((2*j+1) >> 2)*pitch + ((2*j+1) & 3)] >> 24;
+			pBlock[j] = BYTE(((a0 + 8) / 17) | (((a1 + 8) / 17) << 4));
+		}
+		return;
+	}
+
+	EncodeAlphaDXT5(pSrc, pitch, pBlock);
+}
+
+// ===========================================================================================
+//
+void DXTCodec::DecodeRow(const JOB *pJob, int row)
+{
+	int bs = BlockSize(pJob->fmt);
+	int bw = (pJob->w + 3) >> 2;
+	int ny = min(4, pJob->h - (row << 2));
+	int pitch = pJob->dstPitch >> 2;
+	const BYTE *pBlock = pJob->pSrc + size_t(row) * pJob->srcPitch;
+	DWORD *pOut = (DWORD *)(pJob->pDst + size_t(row << 2) * pJob->dstPitch);
+
+	for (int bx = 0; bx < bw; bx++, pBlock += bs) {
+		int x = bx << 2, nx = min(4, pJob->w - x);
+		if (nx == 4 && ny == 4) DecodeBlock(pJob->fmt, pBlock, pOut + x, pitch, pJob->bOpaque);
+		else {
+			DWORD tmp[16];
+			DecodeBlock(pJob->fmt, pBlock, tmp, 4, pJob->bOpaque);
+			for (int y = 0; y < ny; y++) memcpy(pOut + y*pitch + x, tmp + y*4, nx*4);
+		}
+	}
+}
+
+// ===========================================================================================
+// Partial blocks at the edges repeat the last row and column
+//
+void DXTCodec::EncodeRow(const JOB *pJob, int row)
+{
+	int bs = BlockSize(pJob->fmt);
+	int bw = (pJob->w + 3) >> 2;
+	int ny = min(4, pJob->h - (row << 2));
+	int pitch = pJob->srcPitch >> 2;
+	const DWORD *pIn = (const DWORD *)(pJob->pSrc + size_t(row << 2) * pJob->srcPitch);
+	BYTE *pBlock = pJob->pDst + size_t(row) * pJob->dstPitch;
+
+	for (int bx = 0; bx < bw; bx++, pBlock += bs) {
+		int x = bx << 2, nx = min(4, pJob->w - x);
+		if (nx == 4 && ny == 4) EncodeBlock(pJob->fmt, pIn + x, pitch, pBlock, pJob->bOpaque);
+		else {
+			DWORD tmp[16];
+			for (int j = 0; j < 16; j++) tmp[j] = pIn[min(j >> 2, ny - 1)*pitch + x + min(j & 3, nx - 1)];
+			EncodeBlock(pJob->fmt, tmp, 4, pBlock, pJob->bOpaque);
+		}
+	}
+}
+
+// ===========================================================================================
+//
+void DXTCodec::ProcessRows(JOB *pJob)
+{
+	LONG rows = (pJob->h + 3) >> 2;
+	LONG row;
+
+	while ((row = InterlockedIncrement(&pJob->next) - 1) < rows) {
+		if (pJob->bEncode) EncodeRow(pJob, row);
+		else DecodeRow(pJob, row);
+	}
+}
+
+// ===========================================================================================
+//
+DWORD WINAPI DXTCodec::WorkerProc(void *pParam)
+{
+	int i = int(INT_PTR(pParam));
+
+	while (WaitForSingleObject(hStart[i], INFINITE) == WAIT_OBJECT_0 && !bExit) {
+		ProcessRows(pCurrent);
+		SetEvent(hDone[i]);
+	}
+	return 0;
+}
+
+// ===========================================================================================
+// The calling thread takes part in the work. If another job is running, the caller
+// processes its job alone.
+//
+void DXTCodec::Run(JOB *pJob)
+{
+	pJob->next = 0;
+
+	if (pJob->w * pJob->h < DXT_MINPARALLEL || InterlockedCompareExchange(&bBusy, 1, 0) != 0) {
+		ProcessRows(pJob);
+		return;
+	}
+
+	if (nThreads < 0) {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		int n = min(DXT_MAXTHREADS, int(si.dwNumberOfProcessors) - 1);
+		nThreads = 0;
+		for (int i = 0; i < n; i++) {
+			hStart[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+			hDone[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+			hThread[i] = CreateThread(NULL, 32768, WorkerProc, (void *)INT_PTR(i), 0, NULL);
+			if (!hThread[i]) {
+				CloseHandle(hStart[i]);
+				CloseHandle(hDone[i]);
+				LogErr("DXTCodec: Failed to create a worker thread");
+				break;
+			}
+			nThreads++;
+		}
+		LogAlw("DXTCodec: %d worker threads", nThreads);
+	}
+
+	int n = min(nThreads, ((pJob->h + 3) >> 2) - 1);
+
+	pCurrent = pJob;
+	for (int i = 0; i < n; i++) SetEvent(hStart[i]);
+	ProcessRows(pJob);
+	if (n > 0) WaitForMultipleObjects(n, hDone, TRUE, INFINITE);
+	pCurrent = NULL;
+
+	InterlockedExchange(&bBusy, 0);
+}
+
+// ===========================================================================================
+//
+bool DXTCodec::Decode(D3DFORMAT fmt, const BYTE *pSrc, int srcPitch, BYTE *pDst, int dstPitch, int w, int h, bool bOpaque)
+{
+	if (!IsSupported(fmt) || w <= 0 || h <= 0) return false;
+
+	JOB job = { fmt, pSrc, pDst, srcPitch, dstPitch, w, h, bOpaque, false, 0 };
+	Run(&job);
+	return true;
+}
+
+// ===========================================================================================
+//
+bool DXTCodec::Encode(D3DFORMAT fmt, const BYTE *pSrc, int srcPitch, BYTE *pDst, int dstPitch, int w, int h, bool bOpaque)
+{
+	if (!IsSupported(fmt) || w <= 0 || h <= 0) return false;
+
+	JOB job = { fmt, pSrc, pDst, srcPitch, dstPitch, w, h, bOpaque, true, 0 };
+	Run(&job);
+	return true;
+}
+
+// ===========================================================================================
+//
+void DXTCodec::GlobalExit()
+{
+	if (nThreads <= 0) {
+		nThreads = -1;
+		return;
+	}
+
+	bExit = true;
+	for (int i = 0; i < nThreads; i++) SetEvent(hStart[i]);
+	WaitForMultipleObjects(nThreads, hThread, TRUE, INFINITE);
+
+	for (int i = 0; i < nThreads; i++) {
+		CloseHandle(hThread[i]);
+		CloseHandle(hStart[i]);
+		CloseHandle(hDone[i]);
+		hThread[i] = hStart[i] = hDone[i] = NULL;
+	}
+
+	nThreads = -1;
+	bExit = false;
+}
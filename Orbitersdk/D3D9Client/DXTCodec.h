@@ -0,0 +1,129 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class DXTCodec (interface)
+//
+// Decoder and encoder of the DXT1, DXT3 and DXT5 block formats
+// (BC1-BC3) from and to 32-bit A8R8G8B8 pixels. Used in place of
+// D3DX for the format conversions of system memory surfaces.
+//
+// The decoder expands the 565 endpoints by bit replication and
+// rounds the interpolated colours and alphas to nearest. DXT3 and
+// DXT5 blocks always use the four colour mode.
+//
+// The encoder fits the colour endpoints along the principal axis
+// of the block and picks the nearest palette entry for each pixel.
+// DXT1 blocks with pixels of alpha < 128 are encoded in the three
+// colour mode with the transparent index.
+//
+// Images large enough are split into rows of blocks processed by
+// a small set of worker threads. The codec doesn't depend on the
+// device.
+// ==============================================================
+
+#ifndef __DXTCODEC_H
+#define __DXTCODEC_H
+
+#include <windows.h>
+#include <d3d9.h>
+
+#define DXT_MAXTHREADS		8			// Worker threads at most
+#define DXT_MINPARALLEL		(256*256)	// Pixels in an image before the workers are used
+
+class DXTCodec
+{
+
+public:
+
+	/**
+	 * \brief Check if a block format is supported, DXT1, DXT3 or DXT5
+	 */
+	static bool		IsSupported(D3DFORMAT fmt);
+
+	/**
+	 * \brief Size of a 4x4 block in bytes, 0 if the format isn't supported
+	 */
+	static int		BlockSize(D3DFORMAT fmt);
+
+	/**
+	 * \brief Alpha palette of a DXT5 alpha block
+	 * \param pBlock First byte of the alpha block
+	 * \param pAlpha Receives the eight alpha values
+	 */
+	static void		AlphaPalette(const BYTE *pBlock, DWORD *pAlpha);
+
+	/**
+	 * \brief Decode one block into 4x4 pixels
+	 * \param pDst First pixel of the block
+	 * \param pitch Pitch of the destination in pixels
+	 * \param bOpaque If true the alpha is set to 0xFF (X8R8G8B8)
+	 */
+	static void		DecodeBlock(D3DFORMAT fmt, const BYTE *pBlock, DWORD *pDst, int pitch, bool bOpaque);
+
+	/**
+	 * \brief Encode 4x4 pixels into one block
+	 * \param pSrc First pixel of the block
+	 * \param pitch Pitch of the source in pixels
+	 * \param bOpaque If true the alpha of the source is ignored (X8R8G8B8)
+	 */
+	static void		EncodeBlock(D3DFORMAT fmt, const DWORD *pSrc, int pitch, BYTE *pBlock, bool bOpaque);
+
+	/**
+	 * \brief Decode an image
+	 * \param fmt Format of the source
+	 * \param pSrc, srcPitch Source blocks, pitch in bytes per row of blocks
+	 * \param pDst, dstPitch Destination A8R8G8B8 pixels, pitch in bytes
+	 * \param w, h Size of the image in pixels, need not be a multiple of four
+	 * \param bOpaque If true the alpha is set to 0xFF (X8R8G8B8)
+	 * \return false if the format isn't supported
+	 */
+	static bool		Decode(D3DFORMAT fmt, const BYTE *pSrc, int srcPitch, BYTE *pDst, int dstPitch, int w, int h, bool bOpaque);
+
+	/**
+	 * \brief Encode an image
+	 * \param fmt Format of the destination
+	 * \param pSrc, srcPitch Source A8R8G8B8 pixels, pitch in bytes
+	 * \param pDst, dstPitch Destination blocks, pitch in bytes per row of blocks
+	 * \param w, h Size of the image in pixels, need not be a multiple of four
+	 * \param bOpaque If true the alpha of the source is ignored (X8R8G8B8)
+	 * \return false if the format isn't supported
+	 */
+	static bool		Encode(D3DFORMAT fmt, const BYTE *pSrc, int srcPitch, BYTE *pDst, int dstPitch, int w, int h, bool bOpaque);
+
+	/**
+	 * \brief Stop the worker threads
+	 */
+	static void		GlobalExit();
+
+private:
+
+	struct JOB {
+		D3DFORMAT	fmt;
+		const BYTE *pSrc;
+		BYTE *		pDst;
+		int			srcPitch, dstPitch;
+		int			w, h;
+		bool		bOpaque;
+		bool		bEncode;
+		volatile LONG next;		///< Next row of blocks to process
+	};
+
+	static void		Run(JOB *pJob);
+	static void		ProcessRows(JOB *pJob);
+	static void		DecodeRow(const JOB *pJob, int row);
+	static void		EncodeRow(const JOB *pJob, int row);
+	static DWORD WINAPI WorkerProc(void *pParam);
+
+	static HANDLE	hThread[DXT_MAXTHREADS];
+	static HANDLE	hStart[DXT_MAXTHREADS];		///< Auto reset, set when a job is posted
+	static HANDLE	hDone[DXT_MAXTHREADS];		///< Auto reset, set when a worker is out of rows
+	static int		nThreads;
+	static JOB *	pCurrent;
+	static volatile bool bExit;
+	static volatile LONG bBusy;					///< One job at a time, other callers work alone
+};
+
+#endif // !__DXTCODEC_H
@@ -17,17 +17,31 @@
 
 extern oapi::D3D9Client *g_client;
 
+#define PARSECACHE_FILE "Modules/D3D9Client/ParseCache.bin"
+
 // ===========================================================================================
 //
 FileParser::FileParser (const std::string &scenario) :
 	system(),
 	context(),
-  mjd(oapiGetSimMJD())
+  mjd(oapiGetSimMJD()),
+	pCache(NULL),
+	nFiles(0),
+	nDiffs(0)
 {
 	_TRACE;
 
 	LogAlw("==== Scanning Configuration Files ====");
 
+	LARGE_INTEGER qpf, t0, t1;
+	QueryPerformanceFrequency(&qpf);
+	QueryPerformanceCounter(&t0);
+
+	if (Config->ConfigCache) {
+		pCache = new ParseCache(PARSECACHE_FILE);
+		pCache->Load();
+	}
+
 	ParseScenario(scenario);
 
 	if (HasMissingObjects()) {
@@ -51,6 +65,19 @@ FileParser::FileParser (const std::string &scenario) :
 			}
 		}
 	}
+
+	QueryPerformanceCounter(&t1);
+	double ms = double(t1.QuadPart - t0.QuadPart) * 1000.0 / double(qpf.QuadPart);
+
+	if (pCache) {
+		LogAlw("Configuration files: %u, cached %u, parsed %u, %.1fms", nFiles, pCache->GetHits(), nFiles - pCache->GetHits(), ms);
+		if (Config->ConfigCache == 2) LogAlw("Cache validation: %u of %u cached files differ", nDiffs, pCache->GetHits());
+		pCache->Save();
+		SAFE_DELETE(pCache);
+	}
+	else {
+		LogAlw("Configuration files: %u, parsed %u, %.1fms", nFiles, nFiles, ms);
+	}
 }
 
 // ===========================================================================================
@@ -150,6 +177,93 @@ void FileParser::LogContent ()
 	}
 }
 
+// ===========================================================================================
+// Read a configuration file keeping only the lines the parsers look at. The result doesn't
+// depend on the simulation state, so it can be cached across sessions.
+//
+bool FileParser::ReadFresh (const std::string &path, FileType type, LINELIST &lines)
+{
+	std::ifstream fs(path);
+	if (fs.fail()) return false;
+
+	std::string line; // One file line
+	bool bBlock = false;
+
+	lines.clear();
+
+	while (std::getline(fs, line))
+	{
+		line = trim(line);
+		// skip empty lines and comments
+		if (!line.length() || line[0] == ';') {
+			continue;
+		}
+
+		switch (type) {
+
+		case FT_SYSTEM:
+			// "Name = Sol" isn't a planet
+			if (!startsWith(line, "Name")) lines.push_back(line);
+			break;
+
+		case FT_PLANET:
+			// Inside a BEGIN_SURFBASE block only DIR lines matter
+			if (startsWith(line, "BEGIN_SURFBASE")) bBlock = true;
+			else if (startsWith(line, "END_SURFBASE")) bBlock = false;
+			else if (bBlock) {
+				if (!startsWith(line, "DIR")) break;
+			}
+			else if (!startsWith(line, "Name") && !startsWith(line, "AlbedoRGB")) break;
+			lines.push_back(line);
+			break;
+
+		case FT_BASE:
+			// Nothing past the first name is used
+			if (startsWith(line, "BASE")) lines.push_back(line);
+			else if (startsWith(line, "Name")) {
+				lines.push_back(line);
+				return true;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+// ===========================================================================================
+//
+bool FileParser::ReadLines (const std::string &path, FileType type, LINELIST &lines, const ParseCache::STAMP *pStamp)
+{
+	nFiles++;
+
+	if (!pCache) return ReadFresh(path, type, lines);
+
+	ParseCache::STAMP stamp;
+	if (pStamp) stamp = *pStamp;
+	else if (!ParseCache::GetStamp(path.c_str(), &stamp)) return false;
+
+	const LINELIST *pCached = pCache->Find(path, stamp);
+
+	if (pCached && Config->ConfigCache == 1) {
+		lines = *pCached;
+		return true;
+	}
+
+	if (!ReadFresh(path, type, lines)) return false;
+
+	// Validation mode, the fresh parse is used in either case
+	if (pCached) {
+		if (*pCached != lines) {
+			LogWrn("Cached content of '%s' differs from the file", path.c_str());
+			nDiffs++;
+			pCache->Store(path, stamp, lines);
+		}
+	}
+	else pCache->Store(path, stamp, lines);
+
+	return true;
+}
+
 // ===========================================================================================
 //
 bool FileParser::ParseScenario (const std::string &name)
@@ -256,22 +370,16 @@ bool FileParser::ParseSystem (const std::string &_name)
 	std::string name;
 	name = OapiExtension::GetConfigDir() + _name + ".cfg";
 
-	std::ifstream fs(name);
+	LINELIST lines;
 
-	if (fs.fail()) {
+	if (!ReadLines(name, FT_SYSTEM, lines)) {
 		LogErr("Could not open a solar system file '%s'", name.c_str());
 		return false;
 	}
 
-	std::string line; // One file line
-
-	while (std::getline(fs, line))
+	for (size_t i = 0; i < lines.size(); i++)
 	{
-		line = trim(line);
-		// skip empty lines, comments and the "Name = Sol" lines
-		if (!line.length() || line[0] == ';' || startsWith(line, "Name")) {
-			continue;
-		}
+		const std::string &line = lines[i];
 
 		// <PlanetX> = <string>
 		auto ass = splitAssignment(line);
@@ -296,22 +404,19 @@ bool FileParser::ParsePlanet (const std::string &_name)
 	path = OapiExtension::GetConfigDir() + name; // e.g. ".\Config\Earth.cfg"
 	def  = _name + "\\Base";                     // e.g. "Earth\Base"
 
-	std::ifstream fs(path);
-	if (fs.fail()) {
+	LINELIST lines;
+
+	if (!ReadLines(path, FT_PLANET, lines)) {
 		LogErr("Could not open a planet configuration file '%s'", name.c_str());
 		return false;
 	}
 
 	OBJHANDLE hPlanet = NULL;
-	std::string line; // One file line
+	size_t i = 0;
 
-	while (std::getline(fs, line))
+	while (i < lines.size())
 	{
-		line = trim(line);
-		// skip empty lines and comments
-		if (!line.length() || line[0] == ';') {
-			continue;
-		}
+		const std::string &line = lines[i++];
 
 		// Name = <string>
 		if (startsWith(line, "Name"))
@@ -356,9 +461,9 @@ bool FileParser::ParsePlanet (const std::string &_name)
 			double mjd0 = DBL_MIN;// was: 0.0;
 			double mjd1 = DBL_MAX;// was: 1e6;
 
-			while (std::getline(fs, line))
+			while (i < lines.size())
 			{
-				line = trim(line);
+				const std::string &line = lines[i++];
 
 				if (startsWith(line, "END_SURFBASE")) break;
 
@@ -401,26 +506,21 @@ bool FileParser::ParsePlanet (const std::string &_name)
 
 // ===========================================================================================
 //
-OBJHANDLE FileParser::ParseBase (OBJHANDLE hPlanet, const char *name, OBJHANDLE hBase)
+OBJHANDLE FileParser::ParseBase (OBJHANDLE hPlanet, const char *name, OBJHANDLE hBase, const ParseCache::STAMP *pStamp)
 {
-	std::ifstream fs(name);
+	LINELIST lines;
 
-	if (fs.fail()) {
+	if (!ReadLines(name, FT_BASE, lines, pStamp)) {
 		LogErr("Could not open a base configuration file '%s'", name);
 		return NULL;
 	}
 
-	std::string line; // One file line
 	char cbuf[512];   // big enough (for objectName)?
 	bool bBase = false;
 
-	while (std::getline(fs, line))
+	for (size_t i = 0; i < lines.size(); i++)
 	{
-		line = trim(line);
-		// skip empty lines and comments
-		if (!line.length() || line[0] == ';') {
-			continue;
-		}
+		const std::string &line = lines[i];
 
 		// BASE (start of block)
 		if (startsWith(line, "BASE")) {
@@ -521,7 +621,8 @@ bool FileParser::ScanBases (OBJHANDLE hPlanet, const std::string &dir, OBJHANDLE
 
 					if (!strcmp(strExtension.c_str(), "cfg"))
 					{
-						OBJHANDLE hB = ParseBase(hPlanet, strFilePath.c_str(), hBase);
+						ParseCache::STAMP stamp = ParseCache::GetStamp(&FileInformation);
+						OBJHANDLE hB = ParseBase(hPlanet, strFilePath.c_str(), hBase, &stamp);
 						if (hBase==hB && hBase!=NULL) return true;
 					}
 				}
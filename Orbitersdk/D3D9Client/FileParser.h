@@ -10,6 +10,7 @@
 #include <map>
 #include "OrbiterAPI.h"
 #include "D3D9Util.h"
+#include "ParseCache.h"
 
 
 /**
@@ -39,14 +40,28 @@ private:
 	bool      ParseScenario (const std::string &file);
 	bool      ParseSystem (const std::string &_name);
 	bool      ParsePlanet (const std::string &_name);
-	OBJHANDLE ParseBase (OBJHANDLE hPlanet, const char *file, OBJHANDLE hBase=NULL);
+	OBJHANDLE ParseBase (OBJHANDLE hPlanet, const char *file, OBJHANDLE hBase=NULL, const ParseCache::STAMP *pStamp=NULL);
 	bool      ScanBases (OBJHANDLE hPlanet, const std::string &dir, OBJHANDLE hBase=NULL, bool bDeep=false);
 	ObjEntry *GetEntry (OBJHANDLE hObj, bool create = false);
 
+	/// Kind of a configuration file, selects the lines kept by ReadLines()
+	enum FileType { FT_SYSTEM, FT_PLANET, FT_BASE };
+
+	/**
+	 * \brief Get the significant lines of a configuration file, from the cache if the file is unchanged
+	 * \param pStamp Size and time of the file if already known, NULL to query it
+	 * \return false if the file can't be opened
+	 */
+	bool      ReadLines (const std::string &path, FileType type, LINELIST &lines, const ParseCache::STAMP *pStamp = NULL);
+	static bool ReadFresh (const std::string &path, FileType type, LINELIST &lines);
+
 	double      mjd;                        ///< Scenario MJD
 	std::string system;                     ///< Name of the planetary system (e.g. "Sol")
 	std::string context;                    ///< Optional Scenario context
 	std::map<OBJHANDLE, ObjEntry*> entries; ///< OBJHANDLE to ObjEntry mapping
+	ParseCache *pCache;                     ///< Parsed file cache, NULL if disabled
+	DWORD       nFiles;                     ///< Configuration files read
+	DWORD       nDiffs;                     ///< Cached files found different in validation mode
 };
 
 #endif // !__FILEPARSER_H
\ No newline at end of file
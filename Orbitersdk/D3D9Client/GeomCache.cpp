@@ -0,0 +1,207 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "GeomCache.h"
+#include "Log.h"
+
+std::map<GeomCache::KEY, VTXLIST> GeomCache::Lists;
+std::map<GeomCache::KEY, std::weak_ptr<D3D9Mesh>> GeomCache::Meshes;
+
+// ===========================================================================================
+//
+bool GeomCache::KEY::operator<(const KEY &k) const
+{
+	if (type != k.type) return type < k.type;
+	if (a != k.a) return a < k.a;
+	if (b != k.b) return b < k.b;
+	if (c != k.c) return c < k.c;
+	return d < k.d;
+}
+
+// ===========================================================================================
+// The rotation is carried in double precision, after a few thousand steps the error is still
+// far below the float resolution of the output
+//
+void GeomCache::SinCos(int n, double a0, double da, float *pSin, float *pCos)
+{
+	double s = sin(a0), c = cos(a0);
+	double sd = sin(da), cd = cos(da);
+
+	for (int i = 0; i < n; i++) {
+		pSin[i] = float(s);
+		pCos[i] = float(c);
+		double t = c * cd - s * sd;
+		s = s * cd + c * sd;
+		c = t;
+	}
+}
+
+// ===========================================================================================
+//
+const VTXLIST * GeomCache::Skydome(int xseg, int yseg)
+{
+	KEY key = { GEOM_SKYDOME, xseg, yseg, 0.0, 0.0 };
+
+	auto it = Lists.find(key);
+	if (it != Lists.end()) return &it->second;
+
+	VTXLIST &list = Lists[key];
+	list.reserve(xseg*yseg*2);
+
+	double sa = 0.0, ca = 1.0;
+	double db = 1.0/double(yseg);
+	double dc = (1.0-cos(15.0*RAD))/double(xseg-1);
+	double ds = sin(15.0*RAD)/double(xseg-1);
+	double b  = 0.0;
+
+	for (int s=0;s<yseg;s++) {
+		for (int i=0;i<xseg;i++) {
+			list.push_back(D3DXVECTOR3(float(sa), float(b),    float(ca)));
+			list.push_back(D3DXVECTOR3(float(sa), float(b+db), float(ca)));
+			sa += ds; ca -= dc;
+		}
+		ds = -ds; dc = -dc;	sa += ds; ca -= dc;	b += db;
+	}
+
+	return &list;
+}
+
+// ===========================================================================================
+// The ring is closed with nseg-1 steps and a strip advances one step per segment, the angle
+// keeps running from one ring to the next. The angles therefore repeat with a period of
+// nseg-1 steps.
+//
+const VTXLIST * GeomCache::HorizonRing(int nseg, int nring)
+{
+	KEY key = { GEOM_HORIZONRING, nseg, nring, 0.0, 0.0 };
+
+	auto it = Lists.find(key);
+	if (it != Lists.end()) return &it->second;
+
+	VTXLIST &list = Lists[key];
+	list.reserve(nseg*2*nring);
+
+	int period = nseg - 1;
+	std::vector<float> vSin(period), vCos(period);
+	SinCos(period, 0.0, PI2/double(period), &vSin[0], &vCos[0]);
+
+	float d = 1.0f/float(nring);
+	float y = 0.0f;
+	int n = 0;
+
+	for (int k=0;k<nring;k++) {
+		for (int i=0;i<nseg;i++) {
+			list.push_back(D3DXVECTOR3(vCos[n], y, vSin[n]));
+			if (++n == period) n = 0;
+			list.push_back(D3DXVECTOR3(vCos[n], y+d, vSin[n]));
+		}
+		y+=d;
+	}
+
+	return &list;
+}
+
+// ===========================================================================================
+//
+std::shared_ptr<D3D9Mesh> GeomCache::PlanetRing(double irad, double orad, int nsect)
+{
+	KEY key = { GEOM_PLANETRING, nsect, 0, irad, orad };
+
+	std::shared_ptr<D3D9Mesh> mesh = Meshes[key].lock();
+	if (mesh) return mesh;
+
+	mesh.reset(CreatePlanetRing(irad, orad, nsect));
+	Meshes[key] = mesh;
+	return mesh;
+}
+
+// ===========================================================================================
+// Creates mesh for rendering planetary ring system. Creates a ring
+// with nsect quadrilaterals. Smoothing the corners of the mesh is
+// left to texture transparency. Nsect should be an even number.
+// Disc is in xz-plane centered at origin facing up. Size is such that
+// a ring of inner radius irad (>=1) and outer radius orad (>irad)
+// can be rendered on it.
+//
+D3D9Mesh * GeomCache::CreatePlanetRing(double irad, double orad, int nsect)
+{
+	int i, j;
+
+	MESHGROUPEX *grp = new MESHGROUPEX;
+
+	memset(grp,0,sizeof(MESHGROUPEX));
+
+	int count = nsect/2 + 1;
+	grp->nVtx = 2*count;
+	grp->nIdx = 6*(count-1);
+	grp->Idx = new WORD[grp->nIdx+12];
+	grp->Vtx = new NTVERTEX[grp->nVtx+4];
+	grp->TexIdx = 1;
+
+	NTVERTEX *Vtx = grp->Vtx;
+	WORD *Idx = grp->Idx;
+
+	double alpha = PI/(double)nsect;
+	float nrad = (float)(orad/cos(alpha)); // distance for outer nodes
+	float ir = (float)irad;
+	float fo = (float)(0.5*(1.0-orad/nrad));
+	float fi = (float)(0.5*(1.0-irad/nrad));
+
+	std::vector<float> vSin(count), vCos(count);
+	SinCos(count, 0.0, 2.0*alpha, &vSin[0], &vCos[0]);
+
+	for (i = j = 0; i < count; i++) {
+		float cosp = vCos[i], sinp = vSin[i];
+		Vtx[i*2].x = nrad*cosp;  Vtx[i*2+1].x = ir*cosp;
+		Vtx[i*2].z = nrad*sinp;  Vtx[i*2+1].z = ir*sinp;
+		Vtx[i*2].y = Vtx[i*2+1].y = 0.0;
+		Vtx[i*2].nx = Vtx[i*2+1].nx = Vtx[i*2].nz = Vtx[i*2+1].nz = 0.0;
+		Vtx[i*2].ny = Vtx[i*2+1].ny = 1.0;
+
+		if (!(i&1)) Vtx[i*2].tu = fo,  Vtx[i*2+1].tu = fi;
+		else        Vtx[i*2].tu = 1.0f-fo,  Vtx[i*2+1].tu = 1.0f-fi;
+
+		Vtx[i*2].tv = 0.0f, Vtx[i*2+1].tv = 1.00f;
+
+		if ((DWORD)j<=grp->nIdx-6) {
+			Idx[j++] = i*2;
+			Idx[j++] = i*2+1;
+			Idx[j++] = i*2+2;
+			Idx[j++] = i*2+3;
+			Idx[j++] = i*2+2;
+			Idx[j++] = i*2+1;
+		}
+	}
+
+	MATERIAL mat = {{1,1,1,1},{0,0,0,1},{0,0,0,1},{0,0,0,0},20.0f};
+
+	D3D9Mesh *msh = new D3D9Mesh(grp, &mat, NULL);
+
+	delete []grp->Idx;
+	delete []grp->Vtx;
+	delete grp;
+	return msh;
+}
+
+// ===========================================================================================
+//
+LPDIRECT3DVERTEXBUFFER9 GeomCache::CreateBuffer(LPDIRECT3DDEVICE9 pDev, const VTXLIST *pList)
+{
+	LPDIRECT3DVERTEXBUFFER9 pVB = NULL;
+	D3DXVECTOR3 *pBuf = NULL;
+	UINT size = UINT(pList->size() * sizeof(D3DXVECTOR3));
+
+	if (pDev->CreateVertexBuffer(size, 0, 0, D3DPOOL_DEFAULT, &pVB, NULL) != S_OK) {
+		LogErr("GeomCache: Failed to create a vertex buffer (%u bytes)", size);
+		return NULL;
+	}
+
+	if (pVB->Lock(0, 0, (void **)&pBuf, 0) == S_OK) {
+		memcpy(pBuf, &(*pList)[0], size);
+		pVB->Unlock();
+	}
+
+	return pVB;
+}
@@ -0,0 +1,86 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class GeomCache (interface)
+//
+// Cache of the parametric geometry used by the atmospheric haze
+// and the planetary rings. Each object is generated once for a set
+// of parameters and shared by all planets using the same
+// parameters.
+//
+// Vertex lists are kept in system memory for the lifetime of the
+// module, a new render window only copies them into new vertex
+// buffers. Ring meshes own device buffers, they are shared while
+// in use and released with the last planet using them.
+// ==============================================================
+
+#ifndef __GEOMCACHE_H
+#define __GEOMCACHE_H
+
+#include "D3D9Client.h"
+#include "Mesh.h"
+#include <vector>
+#include <map>
+#include <memory>
+
+typedef std::vector<D3DXVECTOR3> VTXLIST;
+
+class GeomCache
+{
+
+public:
+
+	/**
+	 * \brief Triangle strip of a sky dome segment used by HazeManager2
+	 * \param xseg Vertices across the segment
+	 * \param yseg Strips along the segment
+	 */
+	static const VTXLIST *	Skydome(int xseg, int yseg);
+
+	/**
+	 * \brief Triangle strip of the horizon haze ring used by HazeManager2
+	 * \param nseg Segments around the ring
+	 * \param nring Number of stacked rings
+	 */
+	static const VTXLIST *	HorizonRing(int nseg, int nring);
+
+	/**
+	 * \brief Disc mesh for a planetary ring system
+	 * \param irad Inner radius of the ring (>=1)
+	 * \param orad Outer radius of the ring (>irad)
+	 * \param nsect Number of quadrilaterals, an even number
+	 */
+	static std::shared_ptr<D3D9Mesh> PlanetRing(double irad, double orad, int nsect);
+
+	/**
+	 * \brief Copy a vertex list into a new vertex buffer in the default pool
+	 * \return NULL on failure
+	 */
+	static LPDIRECT3DVERTEXBUFFER9 CreateBuffer(LPDIRECT3DDEVICE9 pDev, const VTXLIST *pList);
+
+	/**
+	 * \brief Sine and cosine of n angles a0 + i*da with a rotation recurrence
+	 */
+	static void		SinCos(int n, double a0, double da, float *pSin, float *pCos);
+
+private:
+
+	struct KEY {
+		int type;
+		int a, b;
+		double c, d;
+		bool operator<(const KEY &k) const;
+	};
+
+	enum { GEOM_SKYDOME, GEOM_HORIZONRING, GEOM_PLANETRING };
+
+	static D3D9Mesh *	CreatePlanetRing(double irad, double orad, int nsect);
+
+	static std::map<KEY, VTXLIST> Lists;
+	static std::map<KEY, std::weak_ptr<D3D9Mesh>> Meshes;
+};
+
+#endif // !__GEOMCACHE_H
@@ -0,0 +1,290 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "GlyphAtlas.h"
+#include <algorithm>
+
+// ===========================================================================================
+//
+SkylinePacker::SkylinePacker(int w, int h)
+{
+	Reset(w, h);
+}
+
+// ===========================================================================================
+//
+void SkylinePacker::Reset(int w, int h)
+{
+	W = w;
+	H = h;
+	area = 0;
+	Sky.clear();
+	NODE n = { 0, 0, w };
+	if (w > 0) Sky.push_back(n);
+}
+
+// ===========================================================================================
+//
+void SkylinePacker::Grow(int h)
+{
+	if (h > H) H = h;
+}
+
+// ===========================================================================================
+// Lowest position for a rectangle with its left edge at node 'i', -1 if it doesn't fit
+//
+int SkylinePacker::Fit(size_t i, int w, int h) const
+{
+	if (Sky[i].x + w > W) return -1;
+
+	int y = Sky[i].y;
+	int left = w;
+
+	while (left > 0 && i < Sky.size()) {
+		if (Sky[i].y > y) y = Sky[i].y;
+		if (y + h > H) return -1;
+		left -= Sky[i].w;
+		i++;
+	}
+
+	return y;
+}
+
+// ===========================================================================================
+//
+bool SkylinePacker::Insert(int w, int h, int *x, int *y)
+{
+	if (w <= 0 || h <= 0) return false;
+
+	int best = -1;
+	int bestTop = 0x7FFFFFFF;
+	int bestW = 0x7FFFFFFF;
+	int bestY = 0;
+
+	// Lowest top edge, then the narrowest node ----------------------------------------------
+	//
+	for (size_t i = 0; i < Sky.size(); i++) {
+		int py = Fit(i, w, h);
+		if (py < 0) continue;
+		if (py + h < bestTop || (py + h == bestTop && Sky[i].w < bestW)) {
+			best = int(i);
+			bestTop = py + h;
+			bestW = Sky[i].w;
+			bestY = py;
+		}
+	}
+
+	if (best < 0) return false;
+
+	*x = Sky[best].x;
+	*y = bestY;
+
+	// Raise the skyline under the rectangle --------------------------------------------------
+	//
+	NODE n = { *x, bestY + h, w };
+	Sky.insert(Sky.begin() + best, n);
+
+	for (int i = best + 1; i < int(Sky.size()); i++) {
+		int shrink = Sky[i - 1].x + Sky[i - 1].w - Sky[i].x;
+		if (shrink <= 0) break;
+		Sky[i].x += shrink;
+		Sky[i].w -= shrink;
+		if (Sky[i].w > 0) break;
+		Sky.erase(Sky.begin() + i);
+		i--;
+	}
+
+	for (int i = 0; i < int(Sky.size()) - 1; i++) {
+		if (Sky[i].y == Sky[i + 1].y) {
+			Sky[i].w += Sky[i + 1].w;
+			Sky.erase(Sky.begin() + i + 1);
+			i--;
+		}
+	}
+
+	area += __int64(w) * __int64(h);
+	return true;
+}
+
+
+
+
+// ===========================================================================================
+//
+GlyphAtlas::GlyphAtlas(int width, int height, int maxheight) :
+	Packer(width, height),
+	MaxHeight(max(height, maxheight)),
+	dwFrame(0),
+	dwGen(0),
+	bClear(true)
+{
+
+}
+
+// ===========================================================================================
+//
+GlyphAtlas::~GlyphAtlas()
+{
+
+}
+
+// ===========================================================================================
+//
+void GlyphAtlas::SetTexCoords(GLYPH &g)
+{
+	float iw = 1.0f / float(Packer.GetWidth());
+	float ih = 1.0f / float(Packer.GetHeight());
+	g.tx0 = float(g.x) * iw;
+	g.tx1 = float(g.x + g.w) * iw;
+	g.ty0 = float(g.y) * ih;
+	g.ty1 = float(g.y + g.h) * ih;
+}
+
+// ===========================================================================================
+// Glyphs are kept one pixel apart from each other, mipmaps would bleed otherwise
+//
+bool GlyphAtlas::Place(GLYPH &g)
+{
+	int x, y;
+	if (!Packer.Insert(g.w + 2, g.h + 2, &x, &y)) return false;
+	g.x = x + 1;
+	g.y = y + 1;
+	SetTexCoords(g);
+	return true;
+}
+
+// ===========================================================================================
+// Drop the glyphs not used within 'age' frames and pack the rest again
+//
+bool GlyphAtlas::Evict(DWORD age)
+{
+	std::vector<GLYPH *> keep;
+
+	for (auto it = Glyphs.begin(); it != Glyphs.end();) {
+		if (dwFrame - it->second.frame > age) it = Glyphs.erase(it);
+		else {
+			keep.push_back(&it->second);
+			++it;
+		}
+	}
+
+	// Tallest first packs tighter
+	std::sort(keep.begin(), keep.end(), [](const GLYPH *a, const GLYPH *b) { return a->h > b->h; });
+
+	Packer.Reset(Packer.GetWidth(), Packer.GetHeight());
+	Pending.clear();
+	bClear = true;
+	dwGen++;
+
+	bool bAll = true;
+
+	for (size_t i = 0; i < keep.size(); i++) {
+		if (Place(*keep[i])) Pending.push_back(keep[i]);
+		else {
+			KEY k = { keep[i]->src, keep[i]->code };
+			Glyphs.erase(k);
+			bAll = false;
+		}
+	}
+
+	return bAll;
+}
+
+// ===========================================================================================
+//
+GLYPH *GlyphAtlas::Get(GlyphSource *src, DWORD code)
+{
+	KEY key = { src, code };
+
+	auto it = Glyphs.find(key);
+
+	if (it != Glyphs.end()) {
+		it->second.frame = dwFrame;
+		return &it->second;
+	}
+
+	GLYPH g;
+	memset(&g, 0, sizeof(GLYPH));
+	g.src = src;
+	g.code = code;
+	g.frame = dwFrame;
+
+	if (!src->GlyphSize(code, &g.w, &g.h, &g.adv)) return NULL;
+
+	bool bPlaced = Place(g);
+
+	// Grow the atlas, texture coordinates of all glyphs change with the height
+	//
+	while (!bPlaced && Packer.GetHeight() < MaxHeight) {
+		int h = min(Packer.GetHeight() * 2, MaxHeight);
+		if (!Resize(h)) break;
+		Packer.Grow(h);
+		for (auto &x : Glyphs) SetTexCoords(x.second);
+		dwGen++;
+		bPlaced = Place(g);
+	}
+
+	// Evict unused glyphs, then all but the ones of this frame
+	//
+	if (!bPlaced) {
+		Evict(GATLAS_AGE);
+		bPlaced = Place(g);
+	}
+
+	if (!bPlaced) {
+		Evict(0);
+		bPlaced = Place(g);
+	}
+
+	if (!bPlaced) return NULL;
+
+	GLYPH *pG = &(Glyphs[key] = g);
+	Pending.push_back(pG);
+	return pG;
+}
+
+// ===========================================================================================
+//
+void GlyphAtlas::Remove(GlyphSource *src)
+{
+	size_t k = 0;
+	for (size_t i = 0; i < Pending.size(); i++) if (Pending[i]->src != src) Pending[k++] = Pending[i];
+	Pending.resize(k);
+
+	for (auto it = Glyphs.begin(); it != Glyphs.end();) {
+		if (it->second.src == src) it = Glyphs.erase(it);
+		else ++it;
+	}
+}
+
+// ===========================================================================================
+//
+void GlyphAtlas::Commit()
+{
+	if (Pending.empty() && !bClear) return;
+
+	RECT dirty = { Packer.GetWidth(), Packer.GetHeight(), 0, 0 };
+
+	if (bClear) dirty = { 0, 0, Packer.GetWidth(), Packer.GetHeight() };
+
+	for (size_t i = 0; i < Pending.size(); i++) {
+		const GLYPH *g = Pending[i];
+		dirty.left = min(dirty.left, long(g->x - 1));
+		dirty.top = min(dirty.top, long(g->y - 1));
+		dirty.right = max(dirty.right, long(g->x + g->w + 1));
+		dirty.bottom = max(dirty.bottom, long(g->y + g->h + 1));
+	}
+
+	void *ctx = BeginDraw(bClear);
+
+	for (size_t i = 0; i < Pending.size(); i++) {
+		Pending[i]->src->GlyphDraw(ctx, Pending[i]->code, Pending[i]->x, Pending[i]->y);
+	}
+
+	EndDraw(ctx, dirty);
+
+	Pending.clear();
+	bClear = false;
+}
@@ -0,0 +1,186 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class GlyphAtlas (interface)
+//
+// Shared glyph cache for all fonts. Glyphs are rasterized on demand
+// by their GlyphSource and packed into a single atlas with a skyline
+// bottom-left packer. The atlas grows in height up to a limit, after
+// that the glyphs not used recently are evicted and the rest are
+// packed again. Every change that moves glyphs increments the
+// generation, users holding texture coordinates must refresh them.
+//
+// The class does not touch any graphics API, the storage is provided
+// by a derived class through Resize(), BeginDraw() and EndDraw().
+// ==============================================================
+
+#ifndef __GLYPHATLAS_H
+#define __GLYPHATLAS_H
+
+#include <windows.h>
+#include <vector>
+#include <unordered_map>
+
+#define GATLAS_AGE		60		///< Frames an unused glyph survives an eviction
+
+class GlyphSource;
+
+/**
+ * \brief Skyline bottom-left rectangle packer
+ */
+class SkylinePacker
+{
+
+public:
+
+	SkylinePacker(int w = 0, int h = 0);
+
+	void	Reset(int w, int h);
+
+	/**
+	 * \brief Extend the bin height, placed rectangles remain valid
+	 */
+	void	Grow(int h);
+
+	/**
+	 * \brief Place a rectangle
+	 * \return false if it doesn't fit
+	 */
+	bool	Insert(int w, int h, int *x, int *y);
+
+	int		GetWidth() const { return W; }
+	int		GetHeight() const { return H; }
+	double	GetOccupancy() const { return (W*H) ? double(area) / double(W*H) : 0.0; }
+
+private:
+
+	struct NODE {
+		int x, y, w;
+	};
+
+	int		Fit(size_t i, int w, int h) const;
+
+	std::vector<NODE> Sky;
+	int		W, H;
+	__int64	area;
+};
+
+
+/**
+ * \brief Glyph in the atlas
+ */
+struct GLYPH {
+	float	tx0, ty0, tx1, ty1;	///< Texture coordinates
+	float	adv;				///< Advance in pixels
+	int		x, y, w, h;			///< Rectangle in the atlas
+	DWORD	frame;				///< Last frame used
+	GlyphSource *src;
+	DWORD	code;
+};
+
+
+/**
+ * \brief Provider of glyph images, usually a font
+ */
+class GlyphSource
+{
+
+public:
+
+	/**
+	 * \brief Size of the glyph image and the advance
+	 * \return false if the code isn't supported
+	 */
+	virtual bool	GlyphSize(DWORD code, int *w, int *h, float *adv) = 0;
+
+	/**
+	 * \brief Draw the glyph image
+	 * \param ctx Drawing context returned by GlyphAtlas::BeginDraw()
+	 * \param x,y Top-left corner of the glyph rectangle
+	 */
+	virtual void	GlyphDraw(void *ctx, DWORD code, int x, int y) = 0;
+};
+
+
+class GlyphAtlas
+{
+
+public:
+
+	/**
+	 * \param width Atlas width
+	 * \param height Initial height
+	 * \param maxheight Height the atlas may grow to
+	 */
+	GlyphAtlas(int width, int height, int maxheight);
+	virtual ~GlyphAtlas();
+
+	/**
+	 * \brief Find a glyph and mark it used, add it if it isn't in the atlas
+	 * \return NULL if the source can't provide it or it's larger than the atlas
+	 * \note Adding a glyph may evict others, pointers from an earlier generation are invalid
+	 */
+	GLYPH *		Get(GlyphSource *src, DWORD code);
+
+	/**
+	 * \brief Drop all glyphs of a source, the space is reclaimed on the next eviction
+	 */
+	void		Remove(GlyphSource *src);
+
+	/**
+	 * \brief Draw the glyphs added since the last commit into the storage
+	 */
+	void		Commit();
+
+	void		NewFrame() { dwFrame++; }
+
+	DWORD		GetGeneration() const { return dwGen; }
+	DWORD		GetFrame() const { return dwFrame; }
+	DWORD		GetGlyphCount() const { return DWORD(Glyphs.size()); }
+	int			GetWidth() const { return Packer.GetWidth(); }
+	int			GetHeight() const { return Packer.GetHeight(); }
+	double		GetOccupancy() const { return Packer.GetOccupancy(); }
+
+protected:
+
+	/**
+	 * \brief Grow the storage to a new height keeping the content
+	 */
+	virtual bool	Resize(int height) { return true; }
+
+	/**
+	 * \brief Start drawing glyphs
+	 * \param bClear Clear the whole storage first
+	 */
+	virtual void *	BeginDraw(bool bClear) { return NULL; }
+	virtual void	EndDraw(void *ctx, const RECT &dirty) { }
+
+private:
+
+	struct KEY {
+		GlyphSource *src;
+		DWORD code;
+		bool operator==(const KEY &k) const { return src == k.src && code == k.code; }
+	};
+
+	struct KEYHASH {
+		size_t operator()(const KEY &k) const { return std::hash<void *>()(k.src) ^ (size_t(k.code) * 2654435761U); }
+	};
+
+	bool		Place(GLYPH &g);
+	void		SetTexCoords(GLYPH &g);
+	bool		Evict(DWORD age);
+
+	std::unordered_map<KEY, GLYPH, KEYHASH> Glyphs;
+	std::vector<GLYPH *> Pending;
+	SkylinePacker	Packer;
+	int			MaxHeight;
+	DWORD		dwFrame;
+	DWORD		dwGen;
+	bool		bClear;
+};
+
+#endif // !__GLYPHATLAS_H
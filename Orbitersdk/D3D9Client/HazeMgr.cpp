@@ -21,6 +21,7 @@
 #include "VectorHelpers.h"
 #include "D3D9Effect.h"
 #include "D3D9Config.h"
+#include "GeomCache.h"
 
 using namespace oapi;
 
@@ -330,6 +331,8 @@ void HazeManager2::RenderSky(VECTOR3 cpos, VECTOR3 cdir, double rad, double apr)
 
 void HazeManager2::RenderSkySegment(D3DXMATRIX &wmat, double rad, double dmin, double dmax, int index)
 {
+	if (!pSkyVB[index]) return;
+
 	float r1 =  float(rad * sin(dmin));
 	float h1 = -float(rad * cos(dmin));
 	float r2 =  float(rad * sin(dmax));
@@ -360,6 +363,8 @@ void HazeManager2::RenderSkySegment(D3DXMATRIX &wmat, double rad, double dmin, d
 
 void HazeManager2::RenderRing(VECTOR3 cpos, VECTOR3 cdir, double rad, double hralt)
 {
+	if (!pRingVB) return;
+
 	cpos = -cpos;
 	double cr = length(cpos);
 	double hd = sqrt(cr*cr - rad*rad);
@@ -417,74 +422,16 @@ void HazeManager2::RenderRing(VECTOR3 cpos, VECTOR3 cdir, double rad, double hra
 
 void HazeManager2::CreateRingBuffers()
 {
-	int v = 0;
-	int nvrt = HORIZON2_NSEG * 2 * HORIZON2_NRING + 2;
-
-	D3DXVECTOR3 *pVrt = new D3DXVECTOR3[nvrt];
-	D3DXVECTOR3 *pBuf = NULL;
-
-	float d = 1.0f/float(HORIZON2_NRING);
-	double phi = 0.0;
-	double dphi = PI2/double(HORIZON2_NSEG-1);
-	float x = float(cos(phi));
-	float z = float(sin(phi));
-	float y = 0.0f;
-
-	for (int k=0;k<HORIZON2_NRING;k++) {
-		for (int i=0;i<HORIZON2_NSEG;i++) {
-			pVrt[v++] = D3DXVECTOR3(x, y, z);
-			phi+=dphi;
-			x = float(cos(phi));
-			z = float(sin(phi));
-			pVrt[v++] = D3DXVECTOR3(x, y+d, z);
-		}
-		y+=d;
-	}
-
-	HR(Dev()->CreateVertexBuffer(v*sizeof(D3DXVECTOR3), 0, 0, D3DPOOL_DEFAULT, &pRingVB, NULL));
-
-	if (pRingVB->Lock(0, 0, (void **)&pBuf,0)==S_OK) {
-		memcpy(pBuf, pVrt, v*sizeof(D3DXVECTOR3));
-		pRingVB->Unlock();
-	}
-
-	delete []pVrt;
+	pRingVB = GeomCache::CreateBuffer(Dev(), GeomCache::HorizonRing(HORIZON2_NSEG, HORIZON2_NRING));
 }
 
 // -----------------------------------------------------------------------
 void HazeManager2::CreateSkydomeBuffers(int index)
 {
-	int k = 0;
-
 	int xseg = (Config->LODBias<-0.5 ? xlreslvl[index] : xreslvl[index]);
 	int yseg = (Config->LODBias<-0.5 ? ylreslvl[index] : yreslvl[index]);
 
-	D3DXVECTOR3 *pVrt = new D3DXVECTOR3[xseg*yseg*2+2];
-	D3DXVECTOR3 *pBuf = NULL;
-
-	double sa = 0.0, ca = 1.0;
-	double db = 1.0/double(yseg);
-	double dc = (1.0-cos(15.0*RAD))/double(xseg-1);
-	double ds = sin(15.0*RAD)/double(xseg-1);
-	double b  = 0.0;
-	
-	for (int s=0;s<yseg;s++) {
-		for (int i=0;i<xseg;i++) {
-			pVrt[k++]=D3DXVECTOR3(float(sa), float(b),    float(ca));
-			pVrt[k++]=D3DXVECTOR3(float(sa), float(b+db), float(ca));
-			sa += ds; ca -= dc;
-		}
-		ds = -ds; dc = -dc;	sa += ds; ca -= dc;	b += db;
-	}
-
-	HR(Dev()->CreateVertexBuffer(k*sizeof(D3DXVECTOR3), 0, 0, D3DPOOL_DEFAULT, &pSkyVB[index], NULL));
-
-	if (pSkyVB[index]->Lock(0, 0, (void **)&pBuf,0)==S_OK) {
-		memcpy(pBuf, pVrt, k*sizeof(D3DXVECTOR3));
-		pSkyVB[index]->Unlock();
-	}
-
-	delete []pVrt;
+	pSkyVB[index] = GeomCache::CreateBuffer(Dev(), GeomCache::Skydome(xseg, yseg));
 }
 
 // -----------------------------------------------------------------------
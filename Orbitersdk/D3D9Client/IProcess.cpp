@@ -484,7 +484,10 @@ void ImageProcessing::SetOutput(int id, SURFHANDLE hTex)
 	if (id<0) id=0;
 	if (id>3) id=3;
 
-	if (hTex) pRtg[id] = SURFACE(hTex)->GetSurface();
+	if (hTex) {
+		SURFACE(hTex)->Sync();
+		pRtg[id] = SURFACE(hTex)->GetSurface();
+	}
 	else 	  pRtg[id] = NULL;
 }
 
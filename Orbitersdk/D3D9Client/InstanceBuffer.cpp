@@ -0,0 +1,329 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "InstanceBuffer.h"
+#include "Log.h"
+#include <algorithm>
+
+// ===========================================================================================
+//
+InstanceBuffer::InstanceBuffer() :
+	MeshBS(0, 0, 0, 0),
+	VisBounds(0, 0, 0, 0),
+	pVB(NULL),
+	nVBSize(0),
+	bBounds(false),
+	bTree(false)
+{
+
+}
+
+// ===========================================================================================
+//
+InstanceBuffer::~InstanceBuffer()
+{
+	Release();
+}
+
+// ===========================================================================================
+//
+void InstanceBuffer::Release()
+{
+	SAFE_RELEASE(pVB);
+	nVBSize = 0;
+}
+
+// ===========================================================================================
+//
+void InstanceBuffer::Update(const D3DXMATRIX *pData, DWORD n)
+{
+	Inst.assign(pData, pData + n);
+	Visible.clear();
+	bBounds = false;
+	bTree = false;
+}
+
+// ===========================================================================================
+//
+void InstanceBuffer::SetBounds(const D3DXVECTOR4 &bs)
+{
+	if (bs == MeshBS) return;
+	MeshBS = bs;
+	bBounds = false;
+	bTree = false;
+}
+
+// ===========================================================================================
+//
+void InstanceBuffer::UpdateBounds()
+{
+	if (bBounds) return;
+
+	DWORD n = GetCount();
+	Bounds.resize(n);
+	Dist.resize(n);
+
+	D3DXVECTOR3 bc = D3DXVECTOR3f4(MeshBS);
+
+	for (DWORD i = 0; i < n; i++) {
+		D3DXVECTOR3 c;
+		D3DXVec3TransformCoord(&c, &bc, &Inst[i]);
+		Bounds[i] = D3DXVECTOR4(c.x, c.y, c.z, MeshBS.w * D3DMAT_BSScaleFactor(&Inst[i]));
+	}
+
+	bBounds = true;
+}
+
+// ===========================================================================================
+//
+DWORD InstanceBuffer::Cull(const D3DXPLANE *pPlanes, int nPlanes)
+{
+	UpdateBounds();
+
+	DWORD n = GetCount();
+	Visible.clear();
+
+	D3DXVECTOR3 vmin(FLT_MAX, FLT_MAX, FLT_MAX);
+	D3DXVECTOR3 vmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	// Test and compact ----------------------------------------------------------------------
+	//
+	for (DWORD i = 0; i < n; i++) {
+
+		const D3DXVECTOR4 &b = Bounds[i];
+
+		// All planes without early out, the branch would be mispredicted at random
+		bool bIn = true;
+		for (int p = 0; p < nPlanes; p++) {
+			bIn &= (pPlanes[p].a*b.x + pPlanes[p].b*b.y + pPlanes[p].c*b.z + pPlanes[p].d >= -b.w);
+		}
+		if (!bIn) continue;
+
+		Visible.push_back(i);
+		Dist[i] = b.x*b.x + b.y*b.y + b.z*b.z;
+
+		vmin.x = min(vmin.x, b.x - b.w); vmax.x = max(vmax.x, b.x + b.w);
+		vmin.y = min(vmin.y, b.y - b.w); vmax.y = max(vmax.y, b.y + b.w);
+		vmin.z = min(vmin.z, b.z - b.w); vmax.z = max(vmax.z, b.z + b.w);
+	}
+
+	// Near to far, the reverse is used for transparent groups --------------------------------
+	//
+	const float *pDist = Dist.empty() ? NULL : &Dist[0];
+	std::sort(Visible.begin(), Visible.end(), [pDist](DWORD a, DWORD b) { return pDist[a] < pDist[b]; });
+
+	if (Visible.empty()) VisBounds = D3DXVECTOR4(0, 0, 0, 0);
+	else {
+		D3DXVECTOR3 c = (vmin + vmax) * 0.5f;
+		VisBounds = D3DXVECTOR4(c.x, c.y, c.z, D3DXVec3Length(&(vmax - c)));
+	}
+
+	return GetVisibleCount();
+}
+
+// ===========================================================================================
+//
+void InstanceBuffer::Build()
+{
+	UpdateBounds();
+
+	DWORD n = GetCount();
+
+	Order.resize(n);
+	for (DWORD i = 0; i < n; i++) Order[i] = i;
+
+	Nodes.clear();
+	Nodes.reserve(2 * (n / INSTBUF_LEAF) + 2);
+
+	if (n) {
+		Nodes.push_back(NODE());
+		Split(0, 0, n);
+	}
+
+	bTree = true;
+}
+
+// ===========================================================================================
+// Fill in node 'idx' covering Order[first, first+count) and split it at the median of the
+// longest axis
+//
+void InstanceBuffer::Split(DWORD idx, DWORD first, DWORD count)
+{
+	D3DXVECTOR3 bmin(FLT_MAX, FLT_MAX, FLT_MAX), bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	D3DXVECTOR3 cmin = bmin, cmax = bmax;
+
+	for (DWORD i = first; i < first + count; i++) {
+		const D3DXVECTOR4 &b = Bounds[Order[i]];
+		bmin.x = min(bmin.x, b.x - b.w); bmax.x = max(bmax.x, b.x + b.w);
+		bmin.y = min(bmin.y, b.y - b.w); bmax.y = max(bmax.y, b.y + b.w);
+		bmin.z = min(bmin.z, b.z - b.w); bmax.z = max(bmax.z, b.z + b.w);
+		cmin.x = min(cmin.x, b.x); cmax.x = max(cmax.x, b.x);
+		cmin.y = min(cmin.y, b.y); cmax.y = max(cmax.y, b.y);
+		cmin.z = min(cmin.z, b.z); cmax.z = max(cmax.z, b.z);
+	}
+
+	Nodes[idx].bmin = bmin;
+	Nodes[idx].bmax = bmax;
+
+	if (count <= INSTBUF_LEAF) {
+		Nodes[idx].first = first;
+		Nodes[idx].count = count;
+		return;
+	}
+
+	D3DXVECTOR3 ext = cmax - cmin;
+	int axis = 0;
+	if (ext.y > ext.x) axis = 1;
+	if (ext.z > ((const float *)&ext)[axis]) axis = 2;
+
+	DWORD half = count / 2;
+	const D3DXVECTOR4 *pB = &Bounds[0];
+	std::nth_element(Order.begin() + first, Order.begin() + first + half, Order.begin() + first + count,
+		[pB, axis](DWORD a, DWORD b) { return ((const float *)&pB[a])[axis] < ((const float *)&pB[b])[axis]; });
+
+	DWORD child = DWORD(Nodes.size());
+	Nodes.push_back(NODE());
+	Nodes.push_back(NODE());
+
+	Nodes[idx].first = child;
+	Nodes[idx].count = 0;
+
+	Split(child, first, half);
+	Split(child + 1, first + half, count - half);
+}
+
+// ===========================================================================================
+// Slab test for a ray starting from the camera
+//
+bool InstanceBuffer::RayBox(const NODE &n, const D3DXVECTOR3 &dir, const D3DXVECTOR3 &inv, float *tmin)
+{
+	float t0 = 0.0f, t1 = FLT_MAX;
+
+	for (int a = 0; a < 3; a++) {
+		float bmin = ((const float *)&n.bmin)[a];
+		float bmax = ((const float *)&n.bmax)[a];
+		if (((const float *)&dir)[a] == 0.0f) {
+			if (bmin > 0.0f || bmax < 0.0f) return false;
+			continue;
+		}
+		float ta = bmin * ((const float *)&inv)[a];
+		float tb = bmax * ((const float *)&inv)[a];
+		if (ta > tb) std::swap(ta, tb);
+		t0 = max(t0, ta);
+		t1 = min(t1, tb);
+		if (t0 > t1) return false;
+	}
+
+	*tmin = t0;
+	return true;
+}
+
+// ===========================================================================================
+//
+int InstanceBuffer::Pick(const D3DXVECTOR3 *vDir, float *pDist, INSTPICKFUNC fnHit, void *pUser)
+{
+	if (!bTree) Build();
+	if (Nodes.empty()) return -1;
+
+	D3DXVECTOR3 inv(1.0f / vDir->x, 1.0f / vDir->y, 1.0f / vDir->z);
+
+	int result = -1;
+	float best = *pDist;
+
+	struct ENTRY { DWORD node; float t; };
+	ENTRY stack[64];
+	int sp = 0;
+
+	float t;
+	if (!RayBox(Nodes[0], *vDir, inv, &t)) return -1;
+	stack[sp].node = 0; stack[sp++].t = t;
+
+	std::vector<ENTRY> hits;
+
+	while (sp > 0) {
+
+		ENTRY e = stack[--sp];
+		if (e.t >= best) continue;
+
+		const NODE &nd = Nodes[e.node];
+
+		// Inner node, visit the nearer child first ------------------------------------------
+		//
+		if (nd.count == 0) {
+			float ta, tb;
+			bool ha = RayBox(Nodes[nd.first], *vDir, inv, &ta);
+			bool hb = RayBox(Nodes[nd.first + 1], *vDir, inv, &tb);
+			if (ha && hb && ta < tb) {
+				stack[sp].node = nd.first + 1; stack[sp++].t = tb;
+				stack[sp].node = nd.first; stack[sp++].t = ta;
+			}
+			else {
+				if (ha) { stack[sp].node = nd.first; stack[sp++].t = ta; }
+				if (hb) { stack[sp].node = nd.first + 1; stack[sp++].t = tb; }
+			}
+			continue;
+		}
+
+		// Leaf, test the instance spheres and then the geometry nearest first -----------------
+		//
+		hits.clear();
+
+		for (DWORD i = nd.first; i < nd.first + nd.count; i++) {
+			const D3DXVECTOR4 &b = Bounds[Order[i]];
+			float dst = b.x*vDir->x + b.y*vDir->y + b.z*vDir->z;
+			if (dst < -b.w) continue;
+			// Distance from the ray, len2 - dst*dst would cancel out at long range
+			D3DXVECTOR3 p(b.x - vDir->x*dst, b.y - vDir->y*dst, b.z - vDir->z*dst);
+			float q = b.w*b.w - (p.x*p.x + p.y*p.y + p.z*p.z);
+			if (q < 0.0f) continue;
+			ENTRY h = { Order[i], max(0.0f, dst - sqrt(q)) };
+			if (h.t < best) hits.push_back(h);
+		}
+
+		std::sort(hits.begin(), hits.end(), [](const ENTRY &a, const ENTRY &b) { return a.t < b.t; });
+
+		for (size_t k = 0; k < hits.size(); k++) {
+			if (hits[k].t >= best) break;
+			float d = fnHit(hits[k].node, pUser);
+			if (d >= 0.0f && d < best) {
+				best = d;
+				result = int(hits[k].node);
+			}
+		}
+	}
+
+	if (result >= 0) *pDist = best;
+	return result;
+}
+
+// ===========================================================================================
+//
+LPDIRECT3DVERTEXBUFFER9 InstanceBuffer::Upload(LPDIRECT3DDEVICE9 pDev)
+{
+	DWORD n = GetVisibleCount();
+	if (n == 0) return NULL;
+
+	if (n > nVBSize) {
+		SAFE_RELEASE(pVB);
+		nVBSize = max(n, nVBSize * 2);
+		if (pDev->CreateVertexBuffer(2 * nVBSize * sizeof(D3DXMATRIX), D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &pVB, NULL) != S_OK) {
+			LogErr("InstanceBuffer: Failed to create a vertex buffer for %u instances", nVBSize);
+			pVB = NULL;
+			nVBSize = 0;
+			return NULL;
+		}
+	}
+
+	D3DXMATRIX *pData;
+	if (pVB->Lock(0, 2 * n * sizeof(D3DXMATRIX), (void **)&pData, D3DLOCK_DISCARD) != S_OK) return NULL;
+
+	for (DWORD i = 0; i < n; i++) {
+		pData[i] = Inst[Visible[i]];
+		pData[2 * n - 1 - i] = Inst[Visible[i]];
+	}
+
+	pVB->Unlock();
+	return pVB;
+}
@@ -0,0 +1,124 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class InstanceBuffer (interface)
+//
+// World matrices of a crowd of identical meshes rendered with a
+// single draw per mesh group through gcCore::RenderMesh(). The
+// matrices are camera centric like all world matrices in the client.
+//
+// Each frame the instances are culled against the view frustum
+// with bounding spheres derived from the mesh bounding sphere, and
+// the visible ones are compacted into a list sorted by distance.
+// The list is uploaded to a dynamic vertex buffer twice, near to
+// far for opaque groups and far to near for transparent ones.
+//
+// Picking uses a bounding volume hierarchy over the instance
+// bounds, only the instances whose bounds are hit by the ray are
+// tested against the mesh geometry, nearest first.
+// ==============================================================
+
+#ifndef __INSTANCEBUFFER_H
+#define __INSTANCEBUFFER_H
+
+#include "D3D9Util.h"
+#include <vector>
+
+#define INSTBUF_LEAF		4		// Instances per BVH leaf
+
+/**
+ * \brief Exact hit test of an instance
+ * \param idx Instance index
+ * \param pUser User data passed to InstanceBuffer::Pick()
+ * \return Distance to the hit point, negative if missed
+ */
+typedef float (*INSTPICKFUNC)(DWORD idx, void *pUser);
+
+class InstanceBuffer
+{
+
+public:
+
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	/**
+	 * \brief Replace the instance data
+	 * \param pData Array of world matrices
+	 * \param n Number of instances
+	 */
+	void	Update(const D3DXMATRIX *pData, DWORD n);
+
+	/**
+	 * \brief Set the bounding sphere of the mesh in mesh coordinates
+	 * \note Instance bounds are updated only if the sphere changed
+	 */
+	void	SetBounds(const D3DXVECTOR4 &bs);
+
+	/**
+	 * \brief Cull the instances and compact the visible ones sorted near to far
+	 * \param pPlanes Frustum planes, normals pointing inside
+	 * \param nPlanes Number of planes
+	 * \return Number of visible instances
+	 */
+	DWORD	Cull(const D3DXPLANE *pPlanes, int nPlanes);
+
+	/**
+	 * \brief Find the nearest instance hit by a ray from the camera
+	 * \param vDir Unit direction of the ray
+	 * \param pDist Distance limit on input, distance to the hit on output
+	 * \param fnHit Exact hit test, called only for instances whose bounds are nearer than the best hit
+	 * \return Instance index or -1
+	 */
+	int		Pick(const D3DXVECTOR3 *vDir, float *pDist, INSTPICKFUNC fnHit, void *pUser);
+
+	/**
+	 * \brief Upload the visible instances to the vertex buffer
+	 * \return Vertex buffer holding the near to far list followed by the far to near list
+	 */
+	LPDIRECT3DVERTEXBUFFER9 Upload(LPDIRECT3DDEVICE9 pDev);
+
+	void	Release();
+
+	DWORD	GetCount() const { return DWORD(Inst.size()); }
+	DWORD	GetVisibleCount() const { return DWORD(Visible.size()); }
+	const DWORD * GetVisible() const { return Visible.empty() ? NULL : &Visible[0]; }
+	const D3DXMATRIX * GetInstance(DWORD i) const { return &Inst[i]; }
+	const D3DXVECTOR4 * GetInstanceBounds(DWORD i) const { return &Bounds[i]; }
+
+	/**
+	 * \brief Bounding sphere of the visible instances
+	 */
+	const D3DXVECTOR4 & GetVisibleBounds() const { return VisBounds; }
+
+private:
+
+	struct NODE {
+		D3DXVECTOR3	bmin, bmax;
+		DWORD		first;			// First child or first entry in Order
+		DWORD		count;			// Number of instances in a leaf, zero for inner nodes
+	};
+
+	void	UpdateBounds();
+	void	Build();
+	void	Split(DWORD idx, DWORD first, DWORD count);
+	static bool	RayBox(const NODE &n, const D3DXVECTOR3 &dir, const D3DXVECTOR3 &inv, float *tmin);
+
+	std::vector<D3DXMATRIX>		Inst;
+	std::vector<D3DXVECTOR4>	Bounds;		// World bounding sphere of each instance
+	std::vector<DWORD>			Visible;
+	std::vector<float>			Dist;		// Sort keys, indexed like Inst
+	std::vector<NODE>			Nodes;
+	std::vector<DWORD>			Order;		// Instances in BVH leaf order
+	D3DXVECTOR4		MeshBS;
+	D3DXVECTOR4		VisBounds;
+	LPDIRECT3DVERTEXBUFFER9 pVB;
+	DWORD			nVBSize;			// Capacity of pVB in instances
+	bool			bBounds;			// Bounds valid
+	bool			bTree;				// BVH valid
+};
+
+#endif // !__INSTANCEBUFFER_H
@@ -0,0 +1,232 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "LightCluster.h"
+#include <algorithm>
+
+// ===========================================================================================
+//
+LightCluster::LightCluster() :
+	dwStamp(0),
+	cx(1, 0, 0), cy(0, 1, 0), cz(0, 0, 1),
+	tanx(1.0f), tany(1.0f),
+	maxdst2(0.0f),
+	bValid(false)
+{
+	slice_scale = float(LCL_SLICES - 2) / log(LCL_ZFAR / LCL_ZNEAR);
+	memset(Cluster, 0, sizeof(Cluster));
+	Lights.reserve(256);
+}
+
+// ===========================================================================================
+//
+LightCluster::~LightCluster()
+{
+
+}
+
+// ===========================================================================================
+//
+void LightCluster::Clear()
+{
+	Lights.clear();
+	Index.clear();
+	maxdst2 = 0.0f;
+	bValid = false;
+}
+
+// ===========================================================================================
+//
+bool LightCluster::AddLight(const D3D9Light &lght)
+{
+	D3DXVECTOR3 cnt; float rad;
+	if (!lght.GetBoundingSphere(&cnt, &rad)) return false;
+
+	bValid = false;
+
+	if (Lights.size() < MAX_CLUSTER_LIGHTS) {
+		Lights.push_back(lght);
+		if (lght.Dst2 > maxdst2) maxdst2 = lght.Dst2;
+		return true;
+	}
+
+	// Pool is full, replace the most distant light -----------------------------------------
+	//
+	if (lght.Dst2 >= maxdst2) return false;
+
+	size_t imax = 0;
+	for (size_t i = 0; i < Lights.size(); i++) if (Lights[i].Dst2 > Lights[imax].Dst2) imax = i;
+	Lights[imax] = lght;
+
+	maxdst2 = 0.0f;
+	for (size_t i = 0; i < Lights.size(); i++) if (Lights[i].Dst2 > maxdst2) maxdst2 = Lights[i].Dst2;
+	return true;
+}
+
+// ===========================================================================================
+//
+int LightCluster::Slice(float z) const
+{
+	if (z < LCL_ZNEAR) return 0;
+	int s = 1 + int(log(z / LCL_ZNEAR) * slice_scale);
+	return min(s, LCL_SLICES - 1);
+}
+
+// ===========================================================================================
+//
+int LightCluster::Tile(float t, float tanv, int n) const
+{
+	float f = (t / tanv + 1.0f) * 0.5f * float(n);
+	if (f <= 0.0f) return 0;
+	if (f >= float(n - 1)) return n - 1;
+	return int(f);
+}
+
+// ===========================================================================================
+// Compute a froxel range covering a sphere, returns false if the sphere is outside the frustum
+//
+bool LightCluster::ClusterRange(const D3DXVECTOR3 &pos, float rad, RANGE *pRng) const
+{
+	float z = D3DXVec3Dot(&pos, &cz);
+	float z1 = z + rad;
+
+	if (z1 < 0.0f) return false; // Behind the camera
+
+	float z0 = z - rad;
+	float zn = max(z0, 1e-3f);
+
+	// Project the corners of the bounding box, take the extremes
+	//
+	float x = D3DXVec3Dot(&pos, &cx);
+	float a = x - rad, b = x + rad;
+	float xmin = a >= 0.0f ? a / z1 : a / zn;
+	float xmax = b >= 0.0f ? b / zn : b / z1;
+
+	if (xmax < -tanx || xmin > tanx) return false;
+
+	float y = D3DXVec3Dot(&pos, &cy);
+	a = y - rad, b = y + rad;
+	float ymin = a >= 0.0f ? a / z1 : a / zn;
+	float ymax = b >= 0.0f ? b / zn : b / z1;
+
+	if (ymax < -tany || ymin > tany) return false;
+
+	pRng->x0 = WORD(Tile(xmin, tanx, LCL_TILES_X));
+	pRng->x1 = WORD(Tile(xmax, tanx, LCL_TILES_X));
+	pRng->y0 = WORD(Tile(ymin, tany, LCL_TILES_Y));
+	pRng->y1 = WORD(Tile(ymax, tany, LCL_TILES_Y));
+	pRng->z0 = WORD(Slice(max(z0, 0.0f)));
+	pRng->z1 = WORD(Slice(z1));
+	return true;
+}
+
+// ===========================================================================================
+//
+void LightCluster::Build(const D3DXVECTOR3 &x, const D3DXVECTOR3 &y, const D3DXVECTOR3 &z, float _tanx, float _tany)
+{
+	cx = x; cy = y; cz = z;
+	tanx = _tanx;
+	tany = _tany;
+
+	DWORD nLights = DWORD(Lights.size());
+
+	memset(Cluster, 0, sizeof(Cluster));
+	Ranges.resize(nLights);
+	Index.clear();
+
+	// Count lights per froxel ------------------------------------------------------------
+	//
+	for (DWORD i = 0; i < nLights; i++) {
+		D3DXVECTOR3 cnt; float rad;
+		RANGE &r = Ranges[i];
+		if (!Lights[i].GetBoundingSphere(&cnt, &rad) || !ClusterRange(cnt, rad, &r)) {
+			r.z0 = 1; r.z1 = 0;	// Empty range
+			continue;
+		}
+		for (int k = r.z0; k <= r.z1; k++)
+			for (int j = r.y0; j <= r.y1; j++)
+				for (int m = r.x0; m <= r.x1; m++) Cluster[(k*LCL_TILES_Y + j)*LCL_TILES_X + m].count++;
+	}
+
+	// Allocate index ranges -------------------------------------------------------------
+	//
+	DWORD total = 0;
+	for (int i = 0; i < LCL_CLUSTERS; i++) {
+		Cluster[i].first = total;
+		total += Cluster[i].count;
+		Cluster[i].count = 0;
+	}
+
+	Index.resize(total);
+
+	// Fill the index lists --------------------------------------------------------------
+	//
+	for (DWORD i = 0; i < nLights; i++) {
+		const RANGE &r = Ranges[i];
+		for (int k = r.z0; k <= r.z1; k++) {
+			for (int j = r.y0; j <= r.y1; j++) {
+				for (int m = r.x0; m <= r.x1; m++) {
+					LCLUSTER &c = Cluster[(k*LCL_TILES_Y + j)*LCL_TILES_X + m];
+					Index[c.first + c.count++] = WORD(i);
+				}
+			}
+		}
+	}
+
+	Stamp.assign(nLights, 0);
+	dwStamp = 0;
+	bValid = true;
+}
+
+// ===========================================================================================
+//
+int LightCluster::GetLights(const D3DXVECTOR3 &pos, float rad, _LightList *pList, int nMax, float minIl) const
+{
+	if (!bValid || Lights.empty() || nMax <= 0) return 0;
+
+	RANGE r;
+	if (!ClusterRange(pos, rad, &r)) return 0;
+
+	// Stamp is used to evaluate each light only once
+	if (++dwStamp == 0) {
+		std::fill(Stamp.begin(), Stamp.end(), 0);
+		dwStamp = 1;
+	}
+
+	D3DXVECTOR3 p = pos;
+	int n = 0;
+
+	for (int k = r.z0; k <= r.z1; k++) {
+		for (int j = r.y0; j <= r.y1; j++) {
+			for (int m = r.x0; m <= r.x1; m++) {
+
+				const LCLUSTER &c = Cluster[(k*LCL_TILES_Y + j)*LCL_TILES_X + m];
+
+				for (DWORD q = 0; q < c.count; q++) {
+
+					WORD idx = Index[c.first + q];
+					if (Stamp[idx] == dwStamp) continue;
+					Stamp[idx] = dwStamp;
+
+					float il = Lights[idx].GetIlluminance(p, rad);
+					if (il <= minIl) continue;
+					if (n == nMax && il <= pList[n - 1].illuminace) continue;
+
+					// Insert into the sorted list ------------------------------------------
+					//
+					int e = (n < nMax) ? n++ : n - 1;
+					while (e > 0 && pList[e - 1].illuminace < il) {
+						pList[e] = pList[e - 1];
+						e--;
+					}
+					pList[e].idx = idx;
+					pList[e].illuminace = il;
+				}
+			}
+		}
+	}
+
+	return n;
+}
@@ -0,0 +1,116 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class LightCluster (interface)
+//
+// Bins the camera frustum into a grid of froxels (screen tiles
+// split into exponential depth slices) and assigns the local light
+// emitters into them by their bounding spheres. Each froxel holds
+// a compact list of light indices, so that a mesh needs to evaluate
+// only the lights overlapping the froxels it occupies instead of
+// the whole scene light list.
+// ==============================================================
+
+#ifndef __LIGHTCLUSTER_H
+#define __LIGHTCLUSTER_H
+
+#include "D3D9Util.h"
+#include <vector>
+
+#define LCL_TILES_X			16
+#define LCL_TILES_Y			8
+#define LCL_SLICES			24
+#define LCL_CLUSTERS		(LCL_TILES_X * LCL_TILES_Y * LCL_SLICES)
+#define LCL_ZNEAR			1.0f		// Far end of the first depth slice [m]
+#define LCL_ZFAR			50e3f		// Near end of the last depth slice [m]
+#define MAX_CLUSTER_LIGHTS	4096
+
+
+/**
+ * \brief Froxel record, a range in the light index list
+ */
+typedef struct {
+	DWORD	first;		///< Index of the first entry in the light index list
+	DWORD	count;		///< Number of lights assigned in the froxel
+} LCLUSTER;
+
+
+class LightCluster
+{
+
+public:
+
+	LightCluster();
+	~LightCluster();
+
+	/**
+	 * \brief Remove all lights and invalidate the cluster grid
+	 */
+	void				Clear();
+
+	/**
+	 * \brief Add a light in the light pool. Will be assigned to froxels by the next Build() call.
+	 * \return false if the light is inactive or didn't fit in the pool.
+	 */
+	bool				AddLight(const D3D9Light &lght);
+
+	/**
+	 * \brief Assign the lights into froxels.
+	 * \param x Camera x-axis (right) in camera centric world frame
+	 * \param y Camera y-axis (up)
+	 * \param z Camera z-axis (forward)
+	 * \param tanx Tangent of the horizontal half aperture
+	 * \param tany Tangent of the vertical half aperture
+	 */
+	void				Build(const D3DXVECTOR3 &x, const D3DXVECTOR3 &y, const D3DXVECTOR3 &z, float tanx, float tany);
+
+	/**
+	 * \brief Collect lights illuminating a bounding sphere
+	 * \param pos Center of the bounding sphere in camera centric world frame
+	 * \param rad Radius of the bounding sphere
+	 * \param pList Output list sorted by illuminance, strongest first. Indices refer to GetLights()
+	 * \param nMax Size of the output list
+	 * \param minIl Lights with illuminance up to this are skipped
+	 * \return Number of lights written in pList
+	 */
+	int					GetLights(const D3DXVECTOR3 &pos, float rad, _LightList *pList, int nMax, float minIl = 0.005f) const;
+
+	bool				IsValid() const { return bValid; }
+	const D3D9Light *	GetLights() const { return Lights.size() ? &Lights[0] : NULL; }
+	DWORD				GetLightCount() const { return DWORD(Lights.size()); }
+
+	/**
+	 * \brief Access to the froxel grid. Froxel (x,y,z) is at index (z*LCL_TILES_Y + y)*LCL_TILES_X + x
+	 */
+	const LCLUSTER *	GetClusters() const { return Cluster; }
+	const WORD *		GetIndexList() const { return Index.size() ? &Index[0] : NULL; }
+	DWORD				GetIndexCount() const { return DWORD(Index.size()); }
+
+private:
+
+	struct RANGE {
+		WORD x0, x1, y0, y1, z0, z1;
+	};
+
+	bool				ClusterRange(const D3DXVECTOR3 &pos, float rad, RANGE *pRng) const;
+	int					Slice(float z) const;
+	int					Tile(float t, float tanv, int n) const;
+
+	std::vector<D3D9Light>	Lights;
+	std::vector<RANGE>		Ranges;
+	std::vector<WORD>		Index;
+	mutable std::vector<DWORD> Stamp;
+	mutable DWORD		dwStamp;
+
+	LCLUSTER			Cluster[LCL_CLUSTERS];
+	D3DXVECTOR3			cx, cy, cz;
+	float				tanx, tany;
+	float				slice_scale;
+	float				maxdst2;
+	bool				bValid;
+};
+
+#endif // !__LIGHTCLUSTER_H
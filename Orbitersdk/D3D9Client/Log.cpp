@@ -18,6 +18,9 @@
 
 #include <Windows.h>
 #include <Psapi.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 #include "Log.h"
 #include "D3D9Util.h"
 
@@ -28,7 +31,10 @@ FILE *d3d9client_log = NULL;
 #define OPRBUF 512
 #define TIMEBUF 63
 
-char ErrBuf[ERRBUF+1];
+#define LOG_RING_SIZE	0x40000		// Bytes per thread, must be power of two
+#define LOG_MAX_THREADS	64
+#define LOG_REC_PAD		0x80000000	// Record is a padding up to the end of the ring
+
 char OprBuf[OPRBUF+1];
 char TimeBuf[TIMEBUF+1];
 
@@ -44,8 +50,277 @@ __int64 qpcStart = 0;   // Performance counter start value ("zero")
 
 std::queue<std::string> D3D9DebugQueue;
 
-CRITICAL_SECTION LogCrit;
+CRITICAL_SECTION LogCrit;	// Serializes oapiWriteLogV calls
+
+
+// Asynchronous log ==========================================================================
+//
+// Every thread formats its messages into a private single-producer/single-consumer
+// ring buffer. A writer thread drains the rings, merges the messages by time stamp and
+// writes them into the file in batches. A caller never waits for the disk or for other
+// threads, if a ring is full the message is dropped and counted instead.
+// Errors are the exception, LogErr drains the rings itself so that nothing queued before
+// an error is lost if the process goes down. The ring of an exited thread is taken over
+// by the next new thread.
+
+struct LogRecord {
+	DWORD	size;		// Record size in bytes including the header, multiple of 8
+	DWORD	tid;		// Thread id
+	__int64	qpc;		// Time stamp
+	// Followed by "color\0prefix\0message\0"
+};
+
+struct LogRing {
+	std::atomic<DWORD> head;	// Written by the owner thread
+	std::atomic<DWORD> tail;	// Written by the draining thread
+	std::atomic<DWORD> dropped;
+	std::atomic<LONG> owned;	// Nonzero while a thread posts into the ring
+	char buf[LOG_RING_SIZE];
+};
+
+// Thread's ring, given up when the thread exits
+struct LogRingOwner {
+	LogRing *pRing = NULL;
+	DWORD dwGen = 0;
+	~LogRingOwner();
+};
+
+std::atomic<LogRing *> LogRings[LOG_MAX_THREADS];
+std::atomic<LONG> nLogRings(0);
+std::atomic<DWORD> LogDropped(0);	// Messages dropped without a ring
+std::atomic<DWORD> LogGeneration(0);
+std::atomic<bool> bLogExit(false);
+HANDLE hLogThread = NULL;
+HANDLE hLogEvent = NULL;
+CRITICAL_SECTION LogDrainCrit;	// Serializes draining, by the writer thread or LogErr
+
+thread_local LogRingOwner ThreadRing;
+thread_local char ErrBuf[ERRBUF+1];
+
+void LogFlush();
+
+//-------------------------------------------------------------------------------------------
+// Rings of a closed log are already gone
+//
+LogRingOwner::~LogRingOwner()
+{
+	if (pRing && dwGen == LogGeneration.load()) pRing->owned.store(0, std::memory_order_release);
+}
+
+//-------------------------------------------------------------------------------------------
+// Get the ring of the calling thread, take over a released one or allocate one on the first call
+//
+LogRing *GetThreadRing()
+{
+	LogRingOwner &own = ThreadRing;
+	DWORD gen = LogGeneration.load(std::memory_order_relaxed);
+
+	if (own.pRing && own.dwGen == gen) return own.pRing;
+
+	own.pRing = NULL;
+	own.dwGen = gen;
+
+	// The messages left by the previous owner are drained before the new ones
+	LONG n = min(nLogRings.load(), LOG_MAX_THREADS);
+	for (LONG i = 0; i < n; i++) {
+		LogRing *pRing = LogRings[i].load(std::memory_order_acquire);
+		LONG free = 0;
+		if (pRing && pRing->owned.compare_exchange_strong(free, 1, std::memory_order_acquire)) return own.pRing = pRing;
+	}
 
+	LONG idx = nLogRings.fetch_add(1);
+	if (idx >= LOG_MAX_THREADS) {
+		nLogRings.fetch_sub(1);
+		return NULL;
+	}
+
+	LogRing *pRing = new LogRing;
+	pRing->head = 0;
+	pRing->tail = 0;
+	pRing->dropped = 0;
+	pRing->owned = 1;
+	LogRings[idx].store(pRing, std::memory_order_release);
+	return own.pRing = pRing;
+}
+
+//-------------------------------------------------------------------------------------------
+// Copy a message into the ring of the calling thread
+//
+void LogPost(const char *color, const char *prefix, const char *msg, bool bFlush)
+{
+	__int64 qpc;
+	QueryPerformanceCounter((LARGE_INTEGER*)&qpc);
+
+	LogRing *pRing = GetThreadRing();
+	if (!pRing) { LogDropped++; return; }
+
+	size_t lc = strlen(color) + 1;
+	size_t lp = strlen(prefix) + 1;
+	size_t lm = strlen(msg) + 1;
+	DWORD need = DWORD((sizeof(LogRecord) + lc + lp + lm + 7) & ~7);
+
+	DWORD head = pRing->head.load(std::memory_order_relaxed);
+	DWORD tail = pRing->tail.load(std::memory_order_acquire);
+	DWORD pos = head & (LOG_RING_SIZE - 1);
+	DWORD contiguous = LOG_RING_SIZE - pos;
+	DWORD pad = need > contiguous ? contiguous : 0;
+
+	// An error makes room rather than being dropped
+	if (bFlush && need + pad > LOG_RING_SIZE - (head - tail)) {
+		LogFlush();
+		tail = pRing->tail.load(std::memory_order_acquire);
+	}
+
+	if (need + pad > LOG_RING_SIZE - (head - tail)) {
+		pRing->dropped++;
+		return;
+	}
+
+	if (pad) {
+		((LogRecord *)&pRing->buf[pos])->size = pad | LOG_REC_PAD;
+		head += pad;
+		pos = 0;
+	}
+
+	LogRecord *pRec = (LogRecord *)&pRing->buf[pos];
+	pRec->size = need;
+	pRec->tid = GetCurrentThreadId();
+	pRec->qpc = qpc;
+	char *pTxt = (char *)(pRec + 1);
+	memcpy(pTxt, color, lc);
+	memcpy(pTxt + lc, prefix, lp);
+	memcpy(pTxt + lc + lp, msg, lm);
+
+	pRing->head.store(head + need, std::memory_order_release);
+
+	if (bFlush) LogFlush();
+}
+
+//-------------------------------------------------------------------------------------------
+//
+void escape_ErrBuf (std::string &buf) {
+	replace_all(buf, "&", "&amp;");
+	replace_all(buf, "<", "&lt;");
+	replace_all(buf, ">", "&gt;");
+}
+
+//-------------------------------------------------------------------------------------------
+//
+char *my_ctime(__int64 qpcCurrent)
+{
+	double time = double(qpcCurrent-qpcRef) * 1e3 / double(qpcFrq);
+	double start = double(qpcCurrent-qpcStart) / double(qpcFrq);
+	sprintf_s(OprBuf,OPRBUF,"%d: %.1fs %05.2fms", iLine++, start, time);
+	qpcRef = qpcCurrent;
+	return OprBuf;
+}
+
+//-------------------------------------------------------------------------------------------
+// Drain all rings and write the messages in time order. Called under LogDrainCrit only
+//
+void LogDrain()
+{
+	struct Msg {
+		__int64 qpc;
+		DWORD tid;
+		std::string color, prefix, text;
+	};
+
+	static std::vector<Msg> batch;
+
+	batch.clear();
+
+	LONG n = min(nLogRings.load(), LOG_MAX_THREADS);
+
+	for (LONG i = 0; i < n; i++) {
+
+		LogRing *pRing = LogRings[i].load(std::memory_order_acquire);
+		if (!pRing) continue;
+
+		DWORD tail = pRing->tail.load(std::memory_order_relaxed);
+		DWORD head = pRing->head.load(std::memory_order_acquire);
+
+		while (tail != head) {
+			const LogRecord *pRec = (const LogRecord *)&pRing->buf[tail & (LOG_RING_SIZE - 1)];
+			if ((pRec->size & LOG_REC_PAD) == 0) {
+				const char *pTxt = (const char *)(pRec + 1);
+				Msg m;
+				m.qpc = pRec->qpc;
+				m.tid = pRec->tid;
+				m.color = pTxt; pTxt += m.color.size() + 1;
+				m.prefix = pTxt; pTxt += m.prefix.size() + 1;
+				m.text = pTxt;
+				batch.push_back(std::move(m));
+			}
+			tail += pRec->size & ~LOG_REC_PAD;
+		}
+
+		pRing->tail.store(tail, std::memory_order_release);
+
+		DWORD dropped = pRing->dropped.exchange(0);
+		if (dropped) {
+			Msg m;
+			m.qpc = batch.size() ? batch.back().qpc : qpcRef;
+			m.tid = 0;
+			m.color = "Red";
+			m.prefix = "[ERROR] ";
+			m.text = std::to_string(dropped) + " log messages dropped, log buffer full";
+			batch.push_back(std::move(m));
+		}
+	}
+
+	if (batch.empty() || !d3d9client_log) return;
+
+	std::stable_sort(batch.begin(), batch.end(), [](const Msg &a, const Msg &b) { return a.qpc < b.qpc; });
+
+	for (auto &m : batch) {
+		if (iLine>LOG_MAX_LINES) break;
+		escape_ErrBuf(m.text);
+		fprintf(d3d9client_log, "<font color=Gray>(%s)(0x%lX)</font><font color=%s> %s", my_ctime(m.qpc), m.tid, m.color.c_str(), m.prefix.c_str());
+		fputs(m.text.c_str(), d3d9client_log);
+		fputs("</font><br>\n", d3d9client_log);
+	}
+
+	fflush(d3d9client_log);
+}
+
+//-------------------------------------------------------------------------------------------
+// Write everything queued so far, returns when it's in the file
+//
+void LogFlush()
+{
+	EnterCriticalSection(&LogDrainCrit);
+	LogDrain();
+	LeaveCriticalSection(&LogDrainCrit);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+DWORD WINAPI LogThreadProc(void *)
+{
+	while (!bLogExit.load()) {
+		WaitForSingleObject(hLogEvent, 100);
+		LogFlush();
+	}
+	LogFlush();
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------
+// Format a message on the calling thread and queue it for the writer
+//
+void LogPostV(const char *color, const char *prefix, const char *oapi, bool bFlush, const char *format, va_list args)
+{
+	_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
+
+	if (oapi) {
+		EnterCriticalSection(&LogCrit);
+		oapiWriteLogV(oapi, ErrBuf);
+		LeaveCriticalSection(&LogCrit);
+	}
+
+	LogPost(color, prefix, ErrBuf, bFlush);
+}
 
 //-------------------------------------------------------------------------------------------
 //
@@ -132,9 +407,18 @@ void D3D9InitLog(char *file)
 	else {
 		QueryPerformanceCounter((LARGE_INTEGER*)&qpcRef);
 		InitializeCriticalSectionAndSpinCount(&LogCrit, 256);
+		InitializeCriticalSectionAndSpinCount(&LogDrainCrit, 256);
 		fprintf_s(d3d9client_log,"<!DOCTYPE html><html><head><title>D3D9Client Log</title></head><body bgcolor=black text=white>");
 		fprintf_s(d3d9client_log,"<center><h2>D3D9Client Log</h2><br>");
 		fprintf_s(d3d9client_log,"</center><hr><br><br>");
+
+		for (int i = 0; i < LOG_MAX_THREADS; i++) LogRings[i] = NULL;
+		nLogRings = 0;
+		LogDropped = 0;
+		LogGeneration++;
+		bLogExit = false;
+		hLogEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		hLogThread = CreateThread(NULL, 0, LogThreadProc, NULL, 0, NULL);
 	}
 }
 
@@ -143,10 +427,30 @@ void D3D9InitLog(char *file)
 void D3D9CloseLog()
 {
 	if (d3d9client_log) {
+
+		// Stop the writer, it will drain all rings before exit
+		bLogExit = true;
+		if (hLogThread) {
+			SetEvent(hLogEvent);
+			WaitForSingleObject(hLogThread, INFINITE);
+			CloseHandle(hLogThread);
+		}
+		if (hLogEvent) CloseHandle(hLogEvent);
+		hLogThread = NULL;
+		hLogEvent = NULL;
+
+		if (LogDropped) fprintf(d3d9client_log, "<font color=Red>[ERROR] %u log messages dropped, too many threads</font><br>\n", DWORD(LogDropped));
+
 		fprintf(d3d9client_log,"</body></html>");
 		fclose(d3d9client_log);
 		d3d9client_log = NULL;
 		DeleteCriticalSection(&LogCrit);
+		DeleteCriticalSection(&LogDrainCrit);
+
+		LONG n = min(nLogRings.load(), LOG_MAX_THREADS);
+		nLogRings = 0;
+		LogGeneration++;
+		for (LONG i = 0; i < n; i++) delete LogRings[i].exchange(NULL);
 	}
 }
 
@@ -171,32 +475,6 @@ void D3D9SetTime(D3D9Time &inout, double ref)
 	inout.peak = max((time - ref), inout.peak);
 }
 
-//-------------------------------------------------------------------------------------------
-//
-char *my_ctime()
-{
-	__int64 qpcCurrent;
-	QueryPerformanceCounter((LARGE_INTEGER*)&qpcCurrent);
-	double time = double(qpcCurrent-qpcRef) * 1e3 / double(qpcFrq);
-	double start = double(qpcCurrent-qpcStart) / double(qpcFrq);
-	sprintf_s(OprBuf,OPRBUF,"%d: %.1fs %05.2fms", iLine++, start, time);
-	qpcRef = qpcCurrent;
-	return OprBuf;
-}
-
-//-------------------------------------------------------------------------------------------
-//
-void escape_ErrBuf () {
-	std::string buf(ErrBuf);
-	size_t n = 0;
-	n += replace_all(buf, "&", "&amp;");
-	n += replace_all(buf, "<", "&lt;");
-	n += replace_all(buf, ">", "&gt;");
-	if (n) {
-		strcpy_s(ErrBuf, ARRAYSIZE(ErrBuf), buf.c_str());
-	}
-}
-
 //-------------------------------------------------------------------------------------------
 //
 void LogTrace(const char *format, ...)
@@ -204,20 +482,10 @@ void LogTrace(const char *format, ...)
 	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>3) {
-		EnterCriticalSection(&LogCrit);
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log, "<font color=Gray>(%s)(0x%lX)</font><font color=DarkGrey> ", my_ctime(), th);
-
 		va_list args;
 		va_start(args, format);
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
+		LogPostV("DarkGrey", "", NULL, false, format, args);
 		va_end(args);
-
-		escape_ErrBuf();
-		fputs(ErrBuf,d3d9client_log);
-		fputs("</font><br>\n",d3d9client_log);
-		fflush(d3d9client_log);
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -228,22 +496,10 @@ void LogAlw(const char *format, ...)
 	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>0) {
-		EnterCriticalSection(&LogCrit);
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log, "<font color=Gray>(%s)(0x%lX)</font><font color=Olive> ", my_ctime(), th);
-
 		va_list args;
 		va_start(args, format);
-
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
-
+		LogPostV("Olive", "", NULL, false, format, args);
 		va_end(args);
-
-		escape_ErrBuf();
-		fputs(ErrBuf,d3d9client_log);
-		fputs("</font><br>\n",d3d9client_log);
-		fflush(d3d9client_log);
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -251,27 +507,13 @@ void LogAlw(const char *format, ...)
 //
 void LogDbg(const char *color, const char *format, ...)
 {
-	if (d3d9client_log == NULL) return;
+	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>2) {
-		EnterCriticalSection(&LogCrit);
-
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log, "<font color=Gray>(%s)(0x%lX)</font><font color=%s> ", my_ctime(), th, color);
-
 		va_list args;
 		va_start(args, format);
-
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
-
+		LogPostV(color, "", NULL, false, format, args);
 		va_end(args);
-
-		escape_ErrBuf();
-		fputs(ErrBuf, d3d9client_log);
-		fputs("</font><br>\n", d3d9client_log);
-		fflush(d3d9client_log);
-
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -279,27 +521,13 @@ void LogDbg(const char *color, const char *format, ...)
 //
 void LogClr(const char *color, const char *format, ...)
 {
-	if (d3d9client_log == NULL) return;
+	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>1) {
-		EnterCriticalSection(&LogCrit);
-
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log, "<font color=Gray>(%s)(0x%lX)</font><font color=%s> ", my_ctime(), th, color);
-
 		va_list args;
 		va_start(args, format);
-
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
-
+		LogPostV(color, "", NULL, false, format, args);
 		va_end(args);
-
-		escape_ErrBuf();
-		fputs(ErrBuf, d3d9client_log);
-		fputs("</font><br>\n", d3d9client_log);
-		fflush(d3d9client_log);
-
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -307,26 +535,13 @@ void LogClr(const char *color, const char *format, ...)
 //
 void LogOapi(const char *format, ...)
 {
-
 	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>0) {
-		EnterCriticalSection(&LogCrit);
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log, "<font color=Gray>(%s)(0x%lX)</font><font color=Olive> ", my_ctime(), th);
-
 		va_list args;
 		va_start(args, format);
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
+		LogPostV("Olive", "", "D3D9: %s", false, format, args);
 		va_end(args);
-
-		oapiWriteLogV("D3D9: %s", ErrBuf);
-
-		escape_ErrBuf();
-		fputs(ErrBuf,d3d9client_log);
-		fputs("</font><br>\n",d3d9client_log);
-		fflush(d3d9client_log);
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -337,22 +552,10 @@ void LogErr(const char *format, ...)
 	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>0) {
-		EnterCriticalSection(&LogCrit);
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log,"<font color=Gray>(%s)(0x%lX)</font><font color=Red> [ERROR] ", my_ctime(), th);
-
 		va_list args;
 		va_start(args, format);
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
+		LogPostV("Red", "[ERROR] ", "D3D9: ERROR: %s", true, format, args);
 		va_end(args);
-
-		oapiWriteLogV("D3D9: ERROR: %s", ErrBuf);
-
-		escape_ErrBuf();
-		fputs(ErrBuf,d3d9client_log);
-		fputs("</font><br>\n",d3d9client_log);
-		fflush(d3d9client_log);
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -363,20 +566,10 @@ void LogBlu(const char *format, ...)
 	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>1) {
-		EnterCriticalSection(&LogCrit);
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log,"<font color=Gray>(%s)(0x%lX)</font><font color=#1E90FF> ", my_ctime(), th);
-
 		va_list args;
 		va_start(args, format);
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
+		LogPostV("#1E90FF", "", NULL, false, format, args);
 		va_end(args);
-
-		escape_ErrBuf();
-		fputs(ErrBuf,d3d9client_log);
-		fputs("</font><br>\n",d3d9client_log);
-		fflush(d3d9client_log);
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -387,21 +580,10 @@ void LogWrn(const char *format, ...)
 	if (d3d9client_log==NULL) return;
 	if (iLine>LOG_MAX_LINES) return;
 	if (uEnableLog>1) {
-		EnterCriticalSection(&LogCrit);
-		DWORD th = GetCurrentThreadId();
-		fprintf(d3d9client_log,"<font color=Gray>(%s)(0x%lX)</font><font color=Yellow> [WARNING] ", my_ctime(), th);
-
 		va_list args;
 		va_start(args, format);
-		_vsnprintf_s(ErrBuf, ERRBUF, ERRBUF, format, args);
+		LogPostV("Yellow", "[WARNING] ", "D3D9: WARNING: %s", false, format, args);
 		va_end(args);
-
-		escape_ErrBuf();
-		fputs(ErrBuf,d3d9client_log);
-		fputs("</font><br>\n",d3d9client_log);
-		fflush(d3d9client_log);
-		oapiWriteLogV("D3D9: WARNING: %s", ErrBuf);
-		LeaveCriticalSection(&LogCrit);
 	}
 }
 
@@ -11,6 +11,9 @@
 #include "vVessel.h"
 
 
+std::map<string, std::shared_ptr<MatMgr::CLASSCONFIG>> MatMgr::ClassCache;
+bool MatMgr::bCacheLoaded = false;
+bool MatMgr::bCacheDirty = false;
 
 // ===========================================================================================
 //
@@ -23,6 +26,9 @@ MatMgr::MatMgr(class vObject *v, class D3D9Client *_gc)
 
 	ResetCamera(0);
 
+	pConfig = std::make_shared<CLASSCONFIG>();
+	pConfig->stamp.size = pConfig->stamp.time = 0;
+
 	Shaders.push_back(SHADER("PBR-Old",SHADER_NULL));
 	Shaders.push_back(SHADER("Metalness", SHADER_METALNESS));
 }
@@ -32,7 +38,7 @@ MatMgr::MatMgr(class vObject *v, class D3D9Client *_gc)
 //
 MatMgr::~MatMgr()
 {
-	MeshConfig.clear();
+	pConfig.reset();
 
 	if (pCamera) {
 		if (pCamera[0].pOmitAttc) delete[] pCamera[0].pOmitAttc;
@@ -77,7 +83,7 @@ void MatMgr::ResetCamera(DWORD idx)
 void MatMgr::RegisterMaterialChange(D3D9Mesh *pMesh, DWORD midx, const D3D9MatExt *pM)
 {
 	if (!pMesh || !pM) return;
-	MeshConfig[pMesh->GetName()].material[midx] = *pM;
+	Modify()[pMesh->GetName()].material[midx] = *pM;
 }
 
 // ===========================================================================================
@@ -86,7 +92,7 @@ void MatMgr::RegisterShaderChange(D3D9Mesh *pMesh, WORD id)
 {
 	if (!pMesh) return;
 	for (auto y : Shaders) if (y.id == id) {
-		MeshConfig[pMesh->GetName()].shader = id;
+		Modify()[pMesh->GetName()].shader = id;
 		break;
 	}
 }
@@ -102,21 +108,21 @@ void MatMgr::ApplyConfiguration(D3D9Mesh *pMesh)
 
 	LogAlw("Applying custom configuration to a mesh (%s)",name);
 
-	if (MeshConfig.count(name)) 
+	auto it = pConfig->MeshConfig.find(name);
+
+	if (it != pConfig->MeshConfig.end())
 	{
-		pMesh->SetDefaultShader(MeshConfig[name].shader);
+		pMesh->SetDefaultShader(it->second.shader);
 
-		for (auto x : MeshConfig[name].material) 
+		for (auto &x : it->second.material)
 		{
-			auto rec = x.second;
-			
 			if (x.first >= int(pMesh->GetMaterialCount())) {
 				LogErr("MatMgr::ApplyConfiguration: Matrial Idx out of range [%s.msh]", name);
 				continue;
 			}
 
 			D3D9MatExt Mat;
-			auto RecMat = x.second;
+			const D3D9MatExt &RecMat = x.second;
 			DWORD flags = RecMat.ModFlags;
 
 			if (!pMesh->GetMaterial(&Mat, x.first)) continue;
@@ -144,10 +150,19 @@ void MatMgr::ApplyConfiguration(D3D9Mesh *pMesh)
 //
 bool MatMgr::HasMesh(const char *name)
 {
-	if (MeshConfig.count(name)) return true;
+	if (pConfig->MeshConfig.count(name)) return true;
 	return false;
 }
 
+// ===========================================================================================
+//
+MatMgr::MESHCONFIG & MatMgr::Modify()
+{
+	// Shared with the class cache or other vessels, edit a private copy
+	if (pConfig.use_count() > 1) pConfig = std::make_shared<CLASSCONFIG>(*pConfig);
+	return pConfig->MeshConfig;
+}
+
 // ===========================================================================================
 //
 void parse_vessel_classname(char *lbl)
@@ -162,11 +177,8 @@ bool MatMgr::LoadConfiguration(bool bAppend)
 {
 	_TRACE;
 
-	char cbuf[256];
 	char path[256];
 	char classname[256];
-	char meshname[64];
-	char shadername[64];
 
 	OBJHANDLE hObj = vObj->GetObjectA();
 
@@ -178,20 +190,71 @@ bool MatMgr::LoadConfiguration(bool bAppend)
 	strcpy_s(classname, 256, vessel->GetClassNameA());
 	parse_vessel_classname(classname);
 
-	AutoFile file;
+	sprintf_s(path, 256, "%sGC\\%s.cfg", cfgdir, classname);
 
-	if (file.IsInvalid()) {
-		sprintf_s(path, 256, "%sGC\\%s.cfg", cfgdir, classname);
-		fopen_s(&file.pFile, path, "r");	
+	std::shared_ptr<CLASSCONFIG> pClass = GetClassConfig(path);
+
+	if (!pClass) return true;
+
+	LogAlw("Using a custom configuration file for a vessel %s (%s)", vessel->GetName(), vessel->GetClassNameA());
+
+	if (!bAppend) {
+		pConfig = pClass;
+		return true;
 	}
 
-	if (file.IsInvalid()) return true;
+	// Meshes loaded already keep their current configuration
+	MESHCONFIG &cfg = Modify();
+	for (auto &x : pClass->MeshConfig) if (cfg.count(x.first) == 0) cfg[x.first] = x.second;
+
+	return true;
+}
+
+
+// ===========================================================================================
+// Compiled configurations are reused as long as the size and time of the file match
+//
+std::shared_ptr<MatMgr::CLASSCONFIG> MatMgr::GetClassConfig(const char *path)
+{
+	if (!bCacheLoaded) LoadCache();
+
+	ParseCache::STAMP stamp;
+	if (!ParseCache::GetStamp(path, &stamp)) return NULL;
+
+	auto it = ClassCache.find(path);
+	if (it != ClassCache.end() && it->second->stamp == stamp) return it->second;
+
+	std::shared_ptr<CLASSCONFIG> pClass = std::make_shared<CLASSCONFIG>();
+	pClass->stamp = stamp;
+
+	if (!ParseFile(path, pClass->MeshConfig)) return NULL;
+
+	ClassCache[path] = pClass;
+	bCacheDirty = true;
+	return pClass;
+}
+
+
+// ===========================================================================================
+//
+bool MatMgr::ParseFile(const char *path, MESHCONFIG &MeshConfig)
+{
+	char cbuf[256];
+	char meshname[64];
+	char shadername[64];
+
+	AutoFile file;
+
+	fopen_s(&file.pFile, path, "r");
+
+	if (file.IsInvalid()) return false;
 
-	LogAlw("Reading a custom configuration file for a vessel %s (%s)", vessel->GetName(), vessel->GetClassNameA());
+	LogAlw("Reading a custom configuration file %s", path);
 	
-	DWORD n = 0;
 	int mat_idx = -1;
 
+	meshname[0] = 0;
+
 	while (fgets2(cbuf, 256, file.pFile, 0x0A)>=0) 
 	{	
 		float a, b, c, d;
@@ -201,7 +264,6 @@ bool MatMgr::LoadConfiguration(bool bAppend)
 			mat_idx = -1;
 			if (sscanf_s(cbuf, "MESH %s", meshname, 64)!=1) LogErr("Invalid Line in (%s): %s", path, cbuf);
 			if (strncmp(meshname, "???", 3) == 0) meshname[0] = 0;
-			if (HasMesh(meshname) && bAppend) meshname[0] = 0; // Mesh is loaded already skip all entries related to it.
 			continue;
 		}
 
@@ -358,7 +420,7 @@ bool MatMgr::SaveConfiguration()
 
 	fprintf(file.pFile, "CONFIG_VERSION 3\n");
 
-	for (auto x : MeshConfig) 
+	for (auto &x : pConfig->MeshConfig) 
 	{		
 		string current = x.first;
 
@@ -392,6 +454,125 @@ bool MatMgr::SaveConfiguration()
 }
 
 
+// ===========================================================================================
+// Image layout: magic, version, size of D3D9MatExt, class count. For each class the path,
+// file size and time, mesh count and the meshes. For each mesh the name, shader, material
+// count and the materials as index and raw D3D9MatExt.
+//
+void MatMgr::LoadCache()
+{
+	bCacheLoaded = true;
+
+	AutoFile file;
+	fopen_s(&file.pFile, MATCACHE_FILE, "rb");
+	if (file.IsInvalid()) return;
+
+	FILE *fp = file.pFile;
+	DWORD hdr[4];
+
+	if (fread(hdr, sizeof(DWORD), 4, fp) != 4 || hdr[0] != MATCACHE_MAGIC || hdr[1] != MATCACHE_VERSION || hdr[2] != sizeof(D3D9MatExt)) {
+		LogWrn("MatMgr: Ignoring incompatible cache [%s]", MATCACHE_FILE);
+		return;
+	}
+
+	bool bOk = true;
+
+	for (DWORD i = 0; i < hdr[3] && bOk; i++) {
+
+		string path;
+		DWORD nMesh = 0;
+		std::shared_ptr<CLASSCONFIG> pClass = std::make_shared<CLASSCONFIG>();
+
+		bOk = ParseCache::ReadString(fp, path)
+			&& fread(&pClass->stamp.size, sizeof(pClass->stamp.size), 1, fp) == 1
+			&& fread(&pClass->stamp.time, sizeof(pClass->stamp.time), 1, fp) == 1
+			&& fread(&nMesh, sizeof(DWORD), 1, fp) == 1;
+
+		for (DWORD m = 0; m < nMesh && bOk; m++) {
+			string name;
+			DWORD nMat = 0;
+			WORD shader = 0;
+			bOk = ParseCache::ReadString(fp, name)
+				&& fread(&shader, sizeof(WORD), 1, fp) == 1
+				&& fread(&nMat, sizeof(DWORD), 1, fp) == 1;
+			if (!bOk) break;
+			MESHREC &rec = pClass->MeshConfig[name];
+			rec.shader = shader;
+			for (DWORD k = 0; k < nMat && bOk; k++) {
+				int idx;
+				D3D9MatExt mat;
+				bOk = fread(&idx, sizeof(int), 1, fp) == 1 && fread(&mat, sizeof(D3D9MatExt), 1, fp) == 1;
+				if (bOk) rec.material[idx] = mat;
+			}
+		}
+
+		if (bOk) ClassCache[path] = pClass;
+	}
+
+	if (!bOk) {
+		LogWrn("MatMgr: Cache [%s] is truncated, discarded", MATCACHE_FILE);
+		ClassCache.clear();
+	}
+}
+
+
+// ===========================================================================================
+//
+void MatMgr::SaveCache()
+{
+	if (!bCacheDirty) return;
+
+	AutoFile file;
+	fopen_s(&file.pFile, MATCACHE_FILE, "wb");
+
+	if (file.IsInvalid()) {
+		LogErr("MatMgr: Failed to write [%s]", MATCACHE_FILE);
+		return;
+	}
+
+	FILE *fp = file.pFile;
+	DWORD hdr[4] = { MATCACHE_MAGIC, MATCACHE_VERSION, sizeof(D3D9MatExt), DWORD(ClassCache.size()) };
+	bool bOk = fwrite(hdr, sizeof(DWORD), 4, fp) == 4;
+
+	for (auto &x : ClassCache) {
+		const CLASSCONFIG *pClass = x.second.get();
+		DWORD nMesh = DWORD(pClass->MeshConfig.size());
+		bOk = bOk && ParseCache::WriteString(fp, x.first)
+			&& fwrite(&pClass->stamp.size, sizeof(pClass->stamp.size), 1, fp) == 1
+			&& fwrite(&pClass->stamp.time, sizeof(pClass->stamp.time), 1, fp) == 1
+			&& fwrite(&nMesh, sizeof(DWORD), 1, fp) == 1;
+
+		for (auto &m : pClass->MeshConfig) {
+			DWORD nMat = DWORD(m.second.material.size());
+			bOk = bOk && ParseCache::WriteString(fp, m.first)
+				&& fwrite(&m.second.shader, sizeof(WORD), 1, fp) == 1
+				&& fwrite(&nMat, sizeof(DWORD), 1, fp) == 1;
+			for (auto &k : m.second.material) {
+				bOk = bOk && fwrite(&k.first, sizeof(int), 1, fp) == 1 && fwrite(&k.second, sizeof(D3D9MatExt), 1, fp) == 1;
+			}
+		}
+	}
+
+	if (!bOk) {
+		LogErr("MatMgr: Failed to write [%s]", MATCACHE_FILE);
+		file.ForceClose();
+		remove(MATCACHE_FILE);
+	}
+
+	bCacheDirty = false;
+}
+
+
+// ===========================================================================================
+//
+void MatMgr::GlobalExit()
+{
+	SaveCache();
+	ClassCache.clear();
+	bCacheLoaded = false;
+}
+
+
 // ===========================================================================================
 //
 bool MatMgr::LoadCameraConfig()
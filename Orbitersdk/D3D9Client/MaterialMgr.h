@@ -15,11 +15,17 @@
 #include "D3D9Client.h"
 #include "D3D9Util.h"
 #include "vObject.h"
+#include "ParseCache.h"
+#include <memory>
 
 #define ENVCAM_OMIT_ATTC		0x0001
 #define ENVCAM_OMIT_DOCKS		0x0002
 #define ENVCAM_FOCUS			0x0004
 
+#define MATCACHE_FILE			"Modules/D3D9Client/MatCache.bin"
+#define MATCACHE_MAGIC			0x434D3944		// "D9MC"
+#define MATCACHE_VERSION		1
+
 
 /**
  * \brief Storage structure to keep environmental camera information.
@@ -61,6 +67,11 @@ public:
 	ENVCAMREC *		GetCamera(DWORD idx);
 	DWORD			CameraCount();
 
+	/**
+	 * \brief Write the compiled class configurations and release them
+	 */
+	static void		GlobalExit();
+
 private:
 
 	vObject			*vObj;
@@ -80,9 +91,31 @@ private:
 		map<int, D3D9MatExt> material;
 	};
 
-	std::map<string, MESHREC> MeshConfig;
+	typedef std::map<string, MESHREC> MESHCONFIG;
+
+	/**
+	 * \brief Compiled configuration file of a vessel class. Shared by all vessels of
+	 * the class, a vessel makes a private copy when its configuration is edited.
+	 */
+	struct CLASSCONFIG {
+		ParseCache::STAMP stamp;	///< Size and time of the source file
+		MESHCONFIG MeshConfig;
+	};
+
+	bool			ParseFile(const char *path, MESHCONFIG &cfg);
+	std::shared_ptr<CLASSCONFIG> GetClassConfig(const char *path);
+	MESHCONFIG &	Modify();
+
+	static void		LoadCache();
+	static void		SaveCache();
+
+	std::shared_ptr<CLASSCONFIG> pConfig;
 	std::list<SHADER> Shaders;
 
+	static std::map<string, std::shared_ptr<CLASSCONFIG>> ClassCache;	///< Compiled files by path
+	static bool bCacheLoaded;
+	static bool bCacheDirty;
+
 	ENVCAMREC *pCamera;
 };
 
@@ -16,6 +16,7 @@
 #include "D3D9Config.h"
 #include "DebugControls.h"
 #include "VectorHelpers.h"
+#include "InstanceBuffer.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4838)
@@ -164,9 +165,12 @@ void D3D9Mesh::Null(const char *meshName /* = NULL */)
 	pTune = NULL;
 	nMtrl = 0;
 	pBuf = NULL;
+	pInstRef = NULL;
 	Mtrl = NULL;
 	pGrpTF = NULL;
 	sunLight = NULL;
+	pInst = NULL;
+	pInstVB = NULL;
 	cAmbient = 0;
 	MaxFace  = 0;
 	MaxVert  = 0;
@@ -212,6 +216,7 @@ D3D9Mesh::D3D9Mesh(MESHHANDLE hMesh, bool asTemplate, D3DXVECTOR3 *reorig, float
 	Null(meshName);
 	LoadMeshFromHandle(hMesh, reorig, scale);
 	bIsTemplate = asTemplate;
+	if (bIsTemplate) pInstRef = new LONG(1);
 	MeshCatalog->Add(this);
 	pBuf->Map(pDev);
 }
@@ -303,6 +308,10 @@ D3D9Mesh::D3D9Mesh(MESHHANDLE hMesh, const D3D9Mesh &hTemp)
 	// Confirm the source is global template
 	assert(hTemp.bIsTemplate == true);
 
+	// Keep the template alive while the buffers are shared
+	pInstRef = hTemp.pInstRef;
+	if (pInstRef) InterlockedIncrement(pInstRef);
+
 	nGrp = oapiMeshGroupCount(hMesh); assert(nGrp == hTemp.nGrp);
 
 	if (nGrp == 0) return;
@@ -357,6 +366,8 @@ D3D9Mesh::~D3D9Mesh()
 
 	Release();
 
+	if (pInstRef) if (InterlockedDecrement(pInstRef) == 0) delete pInstRef;
+
 	LogOk("Mesh %s Deleted successfully -------------------------------", _PTR(this));
 }
 
@@ -1478,45 +1489,29 @@ void D3D9Mesh::Render(const LPD3DXMATRIX pW, int iTech, LPDIRECT3DCUBETEXTURE9 *
 
 	TexFlow FC;	reset(FC);
 
-	const D3D9Light *pLights = gc->GetScene()->GetLights();
-	int nSceneLights = gc->GetScene()->GetLightCount();
-
 	for (int i = 0; i < Config->MaxLights(); i++) memcpy(&Locals[i], &null_light, sizeof(LightStruct));
 
-	int nMeshLights = 0;
-
-	if (pLights && nSceneLights>0) {
-
-		D3DXVECTOR3 pos;
-		D3DXVec3TransformCoord(&pos, &D3DXVECTOR3f4(BBox.bs), pW);
-
-		// Find all local lights effecting this mesh ------------------------------------------
-		//
-		for (int i = 0; i < nSceneLights; i++) {
-			float il = pLights[i].GetIlluminance(pos, BBox.bs.w);
-			if (il > 0.005f) {
-				LightList[nMeshLights].illuminace = il;
-				LightList[nMeshLights++].idx = i;
-			}
-		}
+	D3DXVECTOR3 pos;
+	float rad = BBox.bs.w;
+	D3DXVec3TransformCoord(&pos, &D3DXVECTOR3f4(BBox.bs), pW);
 
-		if (nMeshLights > 0) {
+	if (scn->GetRenderPass() == RENDERPASS_MAINSCENE) RequestTextures(pos, rad);
 
-			FX->SetBool(eLightsEnabled, true);
+	// Find N most effective local lights effecting this mesh ---------------------------------
+	//
+	const D3D9Light *pLights = NULL;
+	int nMeshLights = gc->GetScene()->GetLocalLights(pos, rad, LightList, Config->MaxLights(), &pLights);
 
-			// If any, Sort the list based on illuminance -------------------------------------------
-			qsort(LightList, nMeshLights, sizeof(_LightList), compare_lights);
+	if (nMeshLights > 0) {
 
-			nMeshLights = min(nMeshLights, Config->MaxLights());
+		FX->SetBool(eLightsEnabled, true);
 
-			// Create a list of N most effective lights ---------------------------------------------
-			for (int i = 0; i < nMeshLights; i++) {
-				memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
+		for (int i = 0; i < nMeshLights; i++) {
+			memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
 
-				// Override application configuration to prevent oversaturation of lights at point plank range. 
-				if (scn->GetRenderPass() == RENDERPASS_MAINSCENE)
-					Locals[i].Attenuation.x = max(Locals[i].Attenuation.x, float(Config->GFXLocalMax));
-			}
+			// Override application configuration to prevent oversaturation of lights at point plank range. 
+			if (scn->GetRenderPass() == RENDERPASS_MAINSCENE)
+				Locals[i].Attenuation.x = max(Locals[i].Attenuation.x, float(Config->GFXLocalMax));
 		}
 	}
 
@@ -1915,11 +1910,12 @@ void D3D9Mesh::RenderSimplified(const LPD3DXMATRIX pW, LPDIRECT3DCUBETEXTURE9 *p
 	LPD3D9CLIENTSURFACE old_tex = NULL;
 	TexFlow FC;	reset(FC);
 
-	pDev->SetVertexDeclaration(pMeshVertexDecl);
+	if (pInst) pDev->SetVertexDeclaration(pInstVertexDecl);
+	else pDev->SetVertexDeclaration(pMeshVertexDecl);
 	pDev->SetStreamSource(0, pBuf->pVB, 0, sizeof(NMVERTEX));
 	pDev->SetIndices(pBuf->pIB);
 
-	FX->SetTechnique(eVesselTech);
+	FX->SetTechnique(pInst ? eInstancedTech : eVesselTech);
 	FX->SetBool(eFresnel, false);
 	FX->SetBool(eEnvMapEnable, false);
 	FX->SetBool(eTuneEnabled, false);
@@ -1931,39 +1927,28 @@ void D3D9Mesh::RenderSimplified(const LPD3DXMATRIX pW, LPDIRECT3DCUBETEXTURE9 *p
 
 	// Process Local Light Sources ------------------------------------------------------------
 	//
-	const D3D9Light *pLights = gc->GetScene()->GetLights();
-	int nSceneLights = gc->GetScene()->GetLightCount();
-
 	for (int i = 0; i < Config->MaxLights(); i++) memcpy(&Locals[i], &null_light, sizeof(LightStruct));
 
-	if (pLights && nSceneLights>0) {
+	D3DXVECTOR3 pos;
+	float rad = BBox.bs.w;
+	D3DXVec3TransformCoord(&pos, &D3DXVECTOR3f4(BBox.bs), pW);
 
-		int nMeshLights = 0;
-		D3DXVECTOR3 pos;
-		D3DXVec3TransformCoord(&pos, &D3DXVECTOR3f4(BBox.bs), pW);
-
-		// Find all local lights effecting this mesh ------------------------------------------
-		//
-		for (int i = 0; i < nSceneLights; i++) {
-			float il = pLights[i].GetIlluminance(pos, BBox.bs.w);
-			if (il > 0.005f) {
-				LightList[nMeshLights].illuminace = il;
-				LightList[nMeshLights++].idx = i;
-			}
-		}
-
-		if (nMeshLights > 0) {
-
-			FX->SetBool(eLightsEnabled, true);
+	// Instances share the lights effecting all of the visible ones
+	if (pInst) {
+		pos = D3DXVECTOR3f4(pInst->GetVisibleBounds());
+		rad = pInst->GetVisibleBounds().w;
+	}
 
-			// If any, Sort the list based on illuminance -------------------------------------------
-			qsort(LightList, nMeshLights, sizeof(_LightList), compare_lights);
+	if (scn->GetRenderPass() == RENDERPASS_MAINSCENE) RequestTextures(pos, rad);
 
-			nMeshLights = min(nMeshLights, Config->MaxLights());
+	// Find N most effective local lights effecting this mesh ---------------------------------
+	//
+	const D3D9Light *pLights = NULL;
+	int nMeshLights = gc->GetScene()->GetLocalLights(pos, rad, LightList, Config->MaxLights(), &pLights);
 
-			// Create a list of N most effective lights ---------------------------------------------
-			for (int i = 0; i < nMeshLights; i++) memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
-		}
+	if (nMeshLights > 0) {
+		FX->SetBool(eLightsEnabled, true);
+		for (int i = 0; i < nMeshLights; i++) memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
 	}
 
 	FX->SetValue(eLights, Locals, sizeof(LightStruct) * Config->MaxLights());
@@ -2108,6 +2093,14 @@ void D3D9Mesh::RenderSimplified(const LPD3DXMATRIX pW, LPDIRECT3DCUBETEXTURE9 *p
 			}
 		}
 
+		// Opaque groups draw the instances near to far, transparent ones far to near ---------------------------------
+		//
+		if (pInst) {
+			UINT offset = IsTransparent(g) ? pInst->GetVisibleCount() * sizeof(D3DXMATRIX) : 0;
+			pDev->SetStreamSource(1, pInstVB, offset, sizeof(D3DXMATRIX));
+			D3D9Stats.Inst.Draws++;
+		}
+
 		// Start rendering -------------------------------------------------------------------------------------------
 		//
 		FX->CommitChanges();
@@ -2120,6 +2113,77 @@ void D3D9Mesh::RenderSimplified(const LPD3DXMATRIX pW, LPDIRECT3DCUBETEXTURE9 *p
 }
 
 
+// ================================================================================================
+// Render without animations, the world matrices come from the instance buffer
+//
+void D3D9Mesh::RenderInstanced(InstanceBuffer *pI)
+{
+	if (!IsOK() || pI->GetVisibleCount() == 0) return;
+
+	pInstVB = pI->Upload(pDev);
+	if (!pInstVB) return;
+
+	pInst = pI;
+
+	pDev->SetStreamSourceFreq(0, D3DSTREAMSOURCE_INDEXEDDATA | pI->GetVisibleCount());
+	pDev->SetStreamSourceFreq(1, D3DSTREAMSOURCE_INSTANCEDATA | 1);
+
+	D3DXMATRIX mIdent;
+	D3DXMatrixIdentity(&mIdent);
+	RenderSimplified(&mIdent);
+
+	pDev->SetStreamSourceFreq(0, 1);
+	pDev->SetStreamSourceFreq(1, 1);
+	pDev->SetStreamSource(1, NULL, 0, 0);
+
+	pInst = NULL;
+	pInstVB = NULL;
+}
+
+
+// ================================================================================================
+// Group needs back to front ordering, material alpha or a texture with an alpha channel
+//
+bool D3D9Mesh::IsTransparent(DWORD g) const
+{
+	const D3D9MatExt *mat = (Grp[g].MtrlIdx == SPEC_DEFAULT) ? &defmat : &Mtrl[Grp[g].MtrlIdx];
+	if (mat->Diffuse.w < 1.0f) return true;
+
+	LPD3D9CLIENTSURFACE pTex = Tex[Grp[g].TexIdx];
+	if (pTex == NULL) return false;
+
+	D3DSURFACE_DESC desc;
+	if (!pTex->GetDesc(&desc)) return false;
+
+	switch (desc.Format) {
+		case D3DFMT_A8R8G8B8:
+		case D3DFMT_A4R4G4B4:
+		case D3DFMT_A1R5G5B5:
+		case D3DFMT_A8:
+		case D3DFMT_DXT2:
+		case D3DFMT_DXT3:
+		case D3DFMT_DXT4:
+		case D3DFMT_DXT5:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+// ================================================================================================
+// Report the projected diameter of the mesh to the streamed textures
+//
+void D3D9Mesh::RequestTextures(const D3DXVECTOR3 &pos, float rad)
+{
+	Scene *scn = gc->GetScene();
+	float dist = max(D3DXVec3Length(&pos), rad);
+	float pixels = rad * float(scn->ViewH()) / (dist * float(scn->GetTanAp()));
+
+	for (DWORD i = 0; i < nTex; i++) if (Tex[i]) Tex[i]->RequestSize(pixels);
+}
+
+
 // ================================================================================================
 // Render a legacy orbiter mesh without any additional textures
 //
@@ -2222,40 +2286,21 @@ void D3D9Mesh::RenderFast(const LPD3DXMATRIX pW, int iTech)
 
 	TexFlow FC;	reset(FC);
 
-	const D3D9Light *pLights = gc->GetScene()->GetLights();
-	int nSceneLights = gc->GetScene()->GetLightCount();
-
 	for (int i = 0; i < Config->MaxLights(); i++) memcpy(&Locals[i], &null_light, sizeof(LightStruct));
 
-	if (pLights && nSceneLights>0) {
+	D3DXVECTOR3 pos;
+	D3DXVec3TransformCoord(&pos, &D3DXVECTOR3f4(BBox.bs), pW);
 
-		int nMeshLights = 0;
-		D3DXVECTOR3 pos;
-		D3DXVec3TransformCoord(&pos, &D3DXVECTOR3f4(BBox.bs), pW);
+	if (scn->GetRenderPass() == RENDERPASS_MAINSCENE) RequestTextures(pos, BBox.bs.w);
 
-		// Find all local lights effecting this mesh ------------------------------------------
-		//
-		for (int i = 0; i < nSceneLights; i++) {
-			float il = pLights[i].GetIlluminance(pos, BBox.bs.w);
-			if (il > 0.0) {
-				LightList[nMeshLights].illuminace = il;
-				LightList[nMeshLights++].idx = i;
-			}
-		}
-
-		if (nMeshLights > 0) {
-
-			FX->SetBool(eLightsEnabled, true);
-
-			// If any, Sort the list based on illuminance -------------------------------------------
-			qsort(LightList, nMeshLights, sizeof(_LightList), compare_lights);
-
-			nMeshLights = min(nMeshLights, Config->MaxLights());
+	// Find N most effective local lights effecting this mesh ---------------------------------
+	//
+	const D3D9Light *pLights = NULL;
+	int nMeshLights = gc->GetScene()->GetLocalLights(pos, BBox.bs.w, LightList, Config->MaxLights(), &pLights, 0.0f);
 
-			// Create a list of N most effective lights ---------------------------------------------
-			int i;
-			for (i = 0; i < nMeshLights; i++) memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
-		}
+	if (nMeshLights > 0) {
+		FX->SetBool(eLightsEnabled, true);
+		for (int i = 0; i < nMeshLights; i++) memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
 	}
 
 	FX->SetValue(eLights, Locals, sizeof(LightStruct) * Config->MaxLights());
@@ -24,6 +24,8 @@
 #include <d3dx9.h>
 #include <vector>
 
+class InstanceBuffer;
+
 const DWORD SPEC_DEFAULT = (DWORD)(-1); // "default" material/texture flag
 const DWORD SPEC_INHERIT = (DWORD)(-2); // "inherit" material/texture flag
 
@@ -57,12 +59,6 @@ const DWORD SPEC_INHERIT = (DWORD)(-2); // "inherit" material/texture flag
 #define MAPMODE_DYNAMIC		3
 
 
-struct _LightList {
-	int		idx;
-	float	illuminace;
-};
-
-
 
 
 
@@ -212,6 +208,7 @@ public:
 	DWORD			GetTextureCount() const { return nTex; }
 	DWORD			GetVertexCount(int grp=-1) const;
 	DWORD			GetIndexCount(int grp=-1) const;
+	LONG			GetInstanceCount() const { return pInstRef ? *pInstRef - 1 : 0; }
 	bool			IsGroupRendered(DWORD grp) const;
 
 	DWORD			GetMeshGroupMaterialIdx(DWORD grp) const;
@@ -250,6 +247,11 @@ public:
 	void			RenderRings2(const LPD3DXMATRIX pW, LPDIRECT3DTEXTURE9 pTex, float irad, float orad);
 	void			RenderAxisVector(LPD3DXMATRIX pW, const LPD3DXCOLOR pColor, float len);
 	void			RenderSimplified(const LPD3DXMATRIX pW, LPDIRECT3DCUBETEXTURE9 *pEnv = NULL, int nEnv = 0, bool bSP = false);
+
+	/**
+	 * \brief Render the visible instances of a culled instance buffer with one draw per group
+	 */
+	void			RenderInstanced(InstanceBuffer *pInst);
 	void			CheckMeshStatus();
 	void			ResetTransformations();
 	void			TransformGroup(DWORD n, const D3DXMATRIX *m);
@@ -287,9 +289,12 @@ private:
 	bool			CopyVertices(GROUPREC *grp, const MESHGROUPEX *mg, D3DXVECTOR3 *reorig = NULL, float *scale = NULL);
 	void			SetGroupRec(DWORD i, const MESHGROUPEX *mg);
 	void			Null(const char *meshName = NULL);
+	bool			IsTransparent(DWORD grp) const;
+	void			RequestTextures(const D3DXVECTOR3 &pos, float rad);
 
 
 	WORD	DefShader;
+	volatile LONG *pInstRef;	// Reference count shared by a template and its instances
 	DWORD	MaxVert;
 	DWORD	MaxFace;
 	GROUPREC *Grp;              // list of mesh groups
@@ -306,6 +311,8 @@ private:
 	const D3D9Sun *sunLight;
 	D3DCOLOR cAmbient;
 	LightStruct null_light;
+	InstanceBuffer *pInst;		// Instance buffer being rendered by RenderSimplified()
+	LPDIRECT3DVERTEXBUFFER9 pInstVB;
 
 	_LightList LightList[MAX_SCENE_LIGHTS];
 	LightStruct *Locals;
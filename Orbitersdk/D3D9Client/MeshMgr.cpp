@@ -11,29 +11,35 @@
 // ==============================================================
 
 #include "Meshmgr.h"
+#include "D3D9Config.h"
+#include <vector>
+#include <algorithm>
 
 using namespace oapi;
 
 MeshManager::MeshManager(D3D9Client *gclient)
 {
 	gc = gclient;
-	mlist = NULL;
-	nmlist = nmlistbuf = 0;
+	memsize = 0;
+	nmesh = 0;
+	mlist.reserve(256);
+	InitializeCriticalSection(&cs);
 }
 
 MeshManager::~MeshManager()
 {
 	DeleteAll();
+	DeleteCriticalSection(&cs);
 }
 
 void MeshManager::DeleteAll()
-{	
-	int i;
-	for (i=0;i<nmlist;i++) delete mlist[i].mesh;
-	if (nmlistbuf) {
-		delete []mlist;
-		nmlist = nmlistbuf = 0;
-	}
+{
+	EnterCriticalSection(&cs);
+	for (auto it = mlist.begin(); it != mlist.end(); ++it) delete it->second.mesh;
+	mlist.clear();
+	memsize = 0;
+	nmesh = 0;
+	LeaveCriticalSection(&cs);
 }
 
 int MeshManager::StoreMesh(MESHHANDLE hMesh, const char *name)
@@ -43,36 +49,135 @@ int MeshManager::StoreMesh(MESHHANDLE hMesh, const char *name)
 		return -1;
 	}
 
-	if (GetMesh(hMesh)) return -1; // mesh already stored
+	EnterCriticalSection(&cs);
 
-	if (nmlist==nmlistbuf) { // need to allocate buffer
-		MeshBuffer *tmp = new MeshBuffer[nmlistbuf += 32];
-		if (nmlist) {
-			memcpy (tmp, mlist, nmlist*sizeof(MeshBuffer));
-			delete []mlist;
-		}
-		mlist = tmp;
+	MeshEntry &e = mlist[hMesh];
+
+	if (e.mesh) { // mesh already stored
+		LeaveCriticalSection(&cs);
+		return -1;
 	}
-	mlist[nmlist].hMesh = hMesh;
-	mlist[nmlist].mesh = new D3D9Mesh(hMesh, true);
-	mlist[nmlist].mesh->SetName(name);
-	nmlist++;
 
+	Load(hMesh, e, name);
+
+	int idx = -1;
 	float lim = 1e3;
-	DWORD count = mlist[nmlist-1].mesh->GetGroupCount();
+	DWORD count = e.mesh->GetGroupCount();
 
 	for (DWORD i=0;i<count;i++) {
-		D3DXVECTOR3 s = mlist[nmlist-1].mesh->GetGroupSize(i);
-		if (fabs(s.x)>lim || fabs(s.y)>lim || fabs(s.z)>lim) return i;
+		D3DXVECTOR3 s = e.mesh->GetGroupSize(i);
+		if (fabs(s.x)>lim || fabs(s.y)>lim || fabs(s.z)>lim) { idx = i; break; }
+	}
+
+	LeaveCriticalSection(&cs);
+
+	if (Config->MeshCacheBudget) Trim(size_t(Config->MeshCacheBudget) << 20);
+
+	return idx;
+}
+
+// ==============================================================
+
+D3D9Mesh *MeshManager::CreateInstance (MESHHANDLE hMesh, const char *name)
+{
+	if (hMesh==NULL) {
+		LogErr("NULL Mesh in MeshManager::CreateInstance()");
+		return NULL;
+	}
+
+	// Entries are never erased, GetInstance() finds this one
+	EnterCriticalSection(&cs);
+	MeshEntry &e = mlist[hMesh];
+	if (e.name.empty() && name) e.name = name;
+	LeaveCriticalSection(&cs);
+
+	return GetInstance(hMesh);
+}
+
+// ==============================================================
+// The instance takes its reference on the template before the
+// lock is released, Trim() never sees a template on its way to
+// an instance.
+
+D3D9Mesh *MeshManager::GetInstance (MESHHANDLE hMesh)
+{
+	if (hMesh==NULL) return NULL;
+
+	EnterCriticalSection(&cs);
+
+	auto it = mlist.find(hMesh);
+	if (it == mlist.end()) {
+		LeaveCriticalSection(&cs);
+		return NULL;
 	}
 
-	return -1;
+	MeshEntry &e = it->second;
+	bool bStored = (e.mesh == NULL);
+
+	if (bStored) Load(hMesh, e, NULL);
+
+	e.used = GetTickCount();
+	D3D9Mesh *mesh = new D3D9Mesh(hMesh, *e.mesh);
+
+	LeaveCriticalSection(&cs);
+
+	if (bStored && Config->MeshCacheBudget) Trim(size_t(Config->MeshCacheBudget) << 20);
+
+	return mesh;
 }
 
-const D3D9Mesh *MeshManager::GetMesh (MESHHANDLE hMesh)
+// ==============================================================
+// Create the template of an entry, called within the lock
+
+void MeshManager::Load (MESHHANDLE hMesh, MeshEntry &e, const char *name)
 {
-	int i;
-	for (i=0;i<nmlist;i++) if (mlist[i].hMesh==hMesh) return mlist[i].mesh;
-	// Should we store the mesh here ??
-	return NULL;
-}
\ No newline at end of file
+	// An evicted template keeps the name it was stored with
+	if (e.name.empty() && name) e.name = name;
+
+	D3D9Mesh *mesh = new D3D9Mesh(hMesh, true);
+	if (!e.name.empty()) mesh->SetName(e.name.c_str());
+
+	const MeshBuffer *pBuf = mesh->pBuf;
+	e.size = pBuf ? 2 * (pBuf->nVtx * (sizeof(NMVERTEX) + sizeof(D3DXVECTOR4)) + pBuf->nIdx * sizeof(WORD)) : 0; // system and device copies
+	e.used = GetTickCount();
+	e.mesh = mesh;
+
+	memsize += e.size;
+	nmesh++;
+}
+
+// ==============================================================
+// Templates referenced by instances are kept. The references are
+// taken within the lock, see CreateInstance().
+
+DWORD MeshManager::Trim(size_t budget)
+{
+	EnterCriticalSection(&cs);
+
+	size_t unused = 0;
+	std::vector<MeshEntry *> list;
+
+	for (auto it = mlist.begin(); it != mlist.end(); ++it) {
+		MeshEntry &e = it->second;
+		if (e.mesh == NULL || e.mesh->GetInstanceCount() != 0) continue;
+		unused += e.size;
+		list.push_back(&e);
+	}
+
+	DWORD count = 0;
+
+	if (unused > budget) {
+		std::sort(list.begin(), list.end(), [](const MeshEntry *a, const MeshEntry *b) { return a->used < b->used; });
+		for (size_t i = 0; i < list.size() && unused > budget; i++) {
+			LogAlw("Evicting an unused mesh template %s (%s, %u kB)", _PTR(list[i]->mesh), list[i]->name.c_str(), DWORD(list[i]->size >> 10));
+			SAFE_DELETE(list[i]->mesh);
+			unused -= list[i]->size;
+			memsize -= list[i]->size;
+			nmesh--;
+			count++;
+		}
+	}
+
+	LeaveCriticalSection(&cs);
+	return count;
+}
@@ -10,12 +10,20 @@
 
 #include "D3D9Client.h"
 #include "Mesh.h"
+#include <string>
+#include <unordered_map>
 
 // ==============================================================
 // class MeshManager (interface)
 // ==============================================================
 /**
  * \brief Simple management of persistent mesh templates
+ *
+ * Templates are indexed by the mesh handle. Templates without instances
+ * can be evicted under a memory budget, least recently used first. An
+ * evicted template keeps its entry, it's created again by the next
+ * StoreMesh() or CreateInstance() call. All functions can be called
+ * from any thread.
  */
 
 class MeshManager {
@@ -24,15 +32,43 @@ public:
 	~MeshManager();
 	void DeleteAll();
 	int StoreMesh (MESHHANDLE hMesh, const char *name);
-	const D3D9Mesh *GetMesh (MESHHANDLE hMesh);
+
+	/**
+	 * \brief Create an instance of a template, the template is stored first if needed
+	 * \param name Name of the template if it's stored here
+	 */
+	D3D9Mesh *CreateInstance (MESHHANDLE hMesh, const char *name);
+
+	/**
+	 * \brief Create an instance of a stored template, an evicted template is created again
+	 * \return NULL if the mesh has never been stored
+	 */
+	D3D9Mesh *GetInstance (MESHHANDLE hMesh);
+
+	/**
+	 * \brief Delete templates without instances, least recently used first
+	 * \param budget Memory the remaining templates without instances may use, in bytes
+	 * \return Number of templates deleted
+	 */
+	DWORD Trim (size_t budget);
+
+	size_t GetMemSize() const { return memsize; }
+	DWORD GetCount() const { return nmesh; }
 
 private:
 	oapi::D3D9Client *gc;
-	struct MeshBuffer {
-		MESHHANDLE hMesh;
-		D3D9Mesh *mesh;
-	} *mlist;
-	int nmlist, nmlistbuf;
+	struct MeshEntry {
+		D3D9Mesh *mesh;          // NULL if evicted
+		std::string name;
+		size_t size;             // memory used by the buffers
+		DWORD used;              // time of the last instance
+	};
+	void Load (MESHHANDLE hMesh, MeshEntry &e, const char *name);
+
+	std::unordered_map<MESHHANDLE, MeshEntry> mlist;
+	size_t memsize;              // memory used by all templates
+	DWORD nmesh;                 // templates in memory
+	CRITICAL_SECTION cs;
 };
 
-#endif // !__MESHMGR_H
\ No newline at end of file
+#endif // !__MESHMGR_H
@@ -0,0 +1,212 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "MipResidency.h"
+#include <algorithm>
+
+// ===========================================================================================
+//
+MipResidency::MipResidency(size_t _budget, DWORD _maxloads, float _bias, DWORD _hold) :
+	budget(_budget),
+	used(0),
+	maxloads(_maxloads),
+	nLoading(0),
+	hold(_hold),
+	frame(0),
+	bias(_bias)
+{
+	memset(&stats, 0, sizeof(STATS));
+}
+
+// ===========================================================================================
+//
+MipResidency::~MipResidency()
+{
+	for (size_t i = 0; i < Tex.size(); i++) delete Tex[i];
+}
+
+// ===========================================================================================
+//
+size_t MipResidency::Bytes(const MIPTEX *pTex, int lvl)
+{
+	size_t size = 0;
+	for (int i = lvl; i < pTex->levels; i++) size += pTex->bytes[i];
+	return size;
+}
+
+// ===========================================================================================
+//
+int MipResidency::LevelFor(const MIPTEX *pTex, float pixels) const
+{
+	float need = pixels * bias;
+	int lvl = 0;
+	while (lvl < pTex->base && float(pTex->size >> (lvl + 1)) >= need) lvl++;
+	return lvl;
+}
+
+// ===========================================================================================
+//
+MIPTEX * MipResidency::Add(DWORD size, int levels, const size_t *bytes, DWORD basesize, void *pUser)
+{
+	MIPTEX *pTex = new MIPTEX;
+	memset(pTex, 0, sizeof(MIPTEX));
+
+	pTex->size = size;
+	pTex->levels = min(levels, MIPRES_MAXLEVELS);
+	for (int i = 0; i < pTex->levels; i++) pTex->bytes[i] = bytes[i];
+
+	int base = 0;
+	while (base < pTex->levels - 1 && (size >> base) > basesize) base++;
+
+	pTex->base = pTex->resident = pTex->want = base;
+	pTex->loading = -1;
+	pTex->seen = frame;
+	pTex->pUser = pUser;
+
+	used += Bytes(pTex, base);
+	Tex.push_back(pTex);
+	return pTex;
+}
+
+// ===========================================================================================
+//
+void MipResidency::Remove(MIPTEX *pTex)
+{
+	if (pTex->loading >= 0) {
+		used -= Bytes(pTex, min(pTex->resident, pTex->loading));
+		nLoading--;
+	}
+	else used -= Bytes(pTex, pTex->resident);
+
+	Tex.erase(std::remove(Tex.begin(), Tex.end(), pTex), Tex.end());
+	delete pTex;
+}
+
+// ===========================================================================================
+//
+void MipResidency::Loaded(MIPTEX *pTex, bool bOk)
+{
+	if (pTex->loading < 0) return;
+
+	// Released levels are accounted for when the release is issued
+	if (pTex->loading < pTex->resident) {
+		if (bOk) pTex->resident = pTex->loading;
+		else used -= Bytes(pTex, pTex->loading) - Bytes(pTex, pTex->resident);
+	}
+
+	pTex->loading = -1;
+	nLoading--;
+}
+
+// ===========================================================================================
+// Release levels finer than wanted, least recently seen textures first
+//
+size_t MipResidency::Evict(size_t amount, const MIPTEX *pKeep, std::vector<ACTION> &actions)
+{
+	std::vector<MIPTEX *> list;
+
+	for (size_t i = 0; i < Tex.size(); i++) {
+		MIPTEX *pTex = Tex[i];
+		if (pTex != pKeep && pTex->loading < 0 && pTex->resident < pTex->want) list.push_back(pTex);
+	}
+
+	std::sort(list.begin(), list.end(), [](const MIPTEX *a, const MIPTEX *b) { return a->seen < b->seen; });
+
+	size_t freed = 0;
+
+	for (size_t i = 0; i < list.size() && freed < amount; i++) {
+		MIPTEX *pTex = list[i];
+		int lvl = pTex->resident;
+		while (lvl < pTex->want && freed < amount) freed += pTex->bytes[lvl++];
+
+		used -= Bytes(pTex, pTex->resident) - Bytes(pTex, lvl);
+		pTex->resident = pTex->loading = lvl;
+		nLoading++;
+		stats.Drops++;
+
+		ACTION a = { pTex, lvl, false };
+		actions.push_back(a);
+	}
+
+	return freed;
+}
+
+// ===========================================================================================
+//
+void MipResidency::Update(std::vector<ACTION> &actions)
+{
+	std::vector<MIPTEX *> list;
+
+	for (size_t i = 0; i < Tex.size(); i++) {
+		MIPTEX *pTex = Tex[i];
+		if (pTex->seen == frame) {
+			pTex->need = pTex->pixels * bias;
+			pTex->want = LevelFor(pTex, pTex->pixels);
+		}
+		else if (frame - pTex->seen > hold) pTex->want = pTex->base;
+		pTex->pixels = 0.0f;
+		if (pTex->loading < 0 && pTex->want < pTex->resident) list.push_back(pTex);
+	}
+
+	// Most undersampled first, need / size of the resident level
+	std::sort(list.begin(), list.end(), [](const MIPTEX *a, const MIPTEX *b) {
+		return a->need * float(b->size >> b->resident) > b->need * float(a->size >> a->resident);
+	});
+
+	for (size_t i = 0; i < list.size(); i++) {
+
+		MIPTEX *pTex = list[i];
+
+		if (maxloads && nLoading >= maxloads) {
+			stats.Deferred += DWORD(list.size() - i);
+			break;
+		}
+
+		int lvl = pTex->want;
+		size_t add = Bytes(pTex, lvl) - Bytes(pTex, pTex->resident);
+
+		if (budget && used + add > budget) {
+			Evict(used + add - budget, pTex, actions);
+			// Load the levels that fit
+			while (lvl < pTex->resident && used + Bytes(pTex, lvl) - Bytes(pTex, pTex->resident) > budget) lvl++;
+			if (lvl == pTex->resident) {
+				stats.Deferred++;
+				continue;
+			}
+			add = Bytes(pTex, lvl) - Bytes(pTex, pTex->resident);
+		}
+
+		pTex->loading = lvl;
+		used += add;
+		nLoading++;
+		stats.Loads++;
+
+		ACTION a = { pTex, lvl, true };
+		actions.push_back(a);
+	}
+
+	if (budget && used > budget) Evict(used - budget, NULL, actions);
+
+	frame++;
+}
+
+// ===========================================================================================
+//
+void MipResidency::SetLimits(size_t _budget, DWORD _maxloads)
+{
+	budget = _budget;
+	maxloads = _maxloads;
+}
+
+// ===========================================================================================
+//
+MipResidency::STATS MipResidency::GetStats(bool bReset)
+{
+	stats.Textures = DWORD(Tex.size());
+	stats.Bytes = used;
+	STATS s = stats;
+	if (bReset) stats.Loads = stats.Drops = stats.Deferred = 0;
+	return s;
+}
@@ -0,0 +1,148 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class MipResidency (interface)
+//
+// Residency policy of streamed textures. The coarse levels of a
+// texture, up to the base size, are always resident. The renderer
+// reports the projected size of each texture every frame and the
+// policy decides which finer levels to load and which to release.
+//
+// Loads go to the level matching the projected size, the most
+// undersampled textures first, with a limit on the loads in
+// flight. The memory of the resident levels and of the loads in
+// flight is kept under the budget by releasing levels finer than
+// wanted, textures seen least recently first. If that isn't
+// enough, a load is reduced to the levels that fit.
+//
+// A texture not seen for 'hold' updates falls back to its base
+// level, its finer levels are released when the memory is needed.
+//
+// The policy only keeps the bookkeeping, the loading and release
+// of the levels is up to the caller. It doesn't depend on the
+// device and has no threads.
+// ==============================================================
+
+#ifndef __MIPRESIDENCY_H
+#define __MIPRESIDENCY_H
+
+#include <windows.h>
+#include <vector>
+
+#define MIPRES_MAXLEVELS	16
+
+struct MIPTEX {
+	DWORD	size;						///< Largest dimension of level 0 [pixels]
+	int		levels;						///< Levels of the texture
+	int		base;						///< Finest level that is always resident
+	size_t	bytes[MIPRES_MAXLEVELS];	///< Memory of each level
+	int		resident;					///< Finest resident level
+	int		loading;					///< Finest level of the load in flight, -1 = none
+	int		want;						///< Level matching the projected size
+	float	pixels;						///< Largest projected size reported since the last update [pixels]
+	float	need;						///< Texture size needed when last seen [pixels]
+	DWORD	seen;						///< Update count when last seen
+	void *	pUser;
+};
+
+class MipResidency
+{
+
+public:
+
+	struct ACTION {
+		MIPTEX *pTex;
+		int		level;		///< New finest level
+		bool	bLoad;		///< Load levels level..resident-1, else release levels finer than 'level'
+	};
+
+	struct STATS {
+		DWORD	Textures;	///< Textures in the policy
+		DWORD	Loads;		///< Loads issued
+		DWORD	Drops;		///< Releases issued
+		DWORD	Deferred;	///< Loads that didn't fit the budget
+		size_t	Bytes;		///< Memory of the resident levels and of the loads in flight
+	};
+
+	/**
+	 * \param budget Memory of all streamed textures in bytes
+	 * \param maxloads Loads in flight at most
+	 * \param bias Texture size needed per projected pixel
+	 * \param hold Updates a texture keeps its level when not seen
+	 */
+	MipResidency(size_t budget, DWORD maxloads, float bias, DWORD hold);
+	~MipResidency();
+
+	/**
+	 * \brief Add a texture with levels base..levels-1 resident
+	 * \param size Largest dimension of level 0
+	 * \param bytes Memory of each level
+	 * \param basesize Largest dimension of the always resident levels
+	 */
+	MIPTEX *	Add(DWORD size, int levels, const size_t *bytes, DWORD basesize, void *pUser);
+
+	/**
+	 * \brief Remove a texture, it must not have a load in flight
+	 */
+	void		Remove(MIPTEX *pTex);
+
+	/**
+	 * \brief Report the projected size of a texture in this frame
+	 * \param pixels Size of the object the texture is mapped on [pixels]
+	 */
+	void		Request(MIPTEX *pTex, float pixels)
+	{
+		if (pixels > pTex->pixels) pTex->pixels = pixels;
+		pTex->seen = frame;
+	}
+
+	/**
+	 * \brief Run the policy once per frame
+	 * \param actions Receives the loads to start and the levels to release, in order of priority
+	 */
+	void		Update(std::vector<ACTION> &actions);
+
+	/**
+	 * \brief A load has completed
+	 * \param bOk false if it failed, the levels stay as they were
+	 */
+	void		Loaded(MIPTEX *pTex, bool bOk);
+
+	void		SetLimits(size_t budget, DWORD maxloads);
+
+	/**
+	 * \brief Level of a texture for a projected size
+	 */
+	int			LevelFor(const MIPTEX *pTex, float pixels) const;
+
+	/**
+	 * \brief Memory of the levels lvl..levels-1
+	 */
+	static size_t Bytes(const MIPTEX *pTex, int lvl);
+
+	/**
+	 * \brief Counters since the last call, the sizes are current
+	 */
+	STATS		GetStats(bool bReset);
+
+	const std::vector<MIPTEX *> & GetTextures() const { return Tex; }
+
+private:
+
+	size_t		Evict(size_t amount, const MIPTEX *pKeep, std::vector<ACTION> &actions);
+
+	std::vector<MIPTEX *> Tex;
+	STATS		stats;
+	size_t		budget;
+	size_t		used;		///< Memory of the resident levels and of the loads in flight
+	DWORD		maxloads;
+	DWORD		nLoading;
+	DWORD		hold;
+	DWORD		frame;
+	float		bias;
+};
+
+#endif // !__MIPRESIDENCY_H
@@ -0,0 +1,200 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "ParseCache.h"
+#include "Log.h"
+#include <stdio.h>
+#include <algorithm>
+
+// ===========================================================================================
+//
+ParseCache::ParseCache(const char *_file) :
+	file(_file),
+	nHits(0),
+	nMisses(0),
+	bDirty(false)
+{
+
+}
+
+// ===========================================================================================
+//
+ParseCache::~ParseCache()
+{
+
+}
+
+// ===========================================================================================
+//
+std::string ParseCache::Key(const std::string &path)
+{
+	std::string k(path);
+	for (size_t i = 0; i < k.size(); i++) {
+		char c = k[i];
+		if (c == '/') c = '\\';
+		else if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+		k[i] = c;
+	}
+	return k;
+}
+
+// ===========================================================================================
+//
+bool ParseCache::GetStamp(const char *path, STAMP *stamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA fa;
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &fa)) return false;
+	stamp->size = (((unsigned __int64)fa.nFileSizeHigh) << 32) | fa.nFileSizeLow;
+	stamp->time = (((unsigned __int64)fa.ftLastWriteTime.dwHighDateTime) << 32) | fa.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+// ===========================================================================================
+//
+ParseCache::STAMP ParseCache::GetStamp(const WIN32_FIND_DATA *fd)
+{
+	STAMP s;
+	s.size = (((unsigned __int64)fd->nFileSizeHigh) << 32) | fd->nFileSizeLow;
+	s.time = (((unsigned __int64)fd->ftLastWriteTime.dwHighDateTime) << 32) | fd->ftLastWriteTime.dwLowDateTime;
+	return s;
+}
+
+// ===========================================================================================
+//
+const LINELIST * ParseCache::Find(const std::string &path, const STAMP &stamp)
+{
+	auto it = Entries.find(Key(path));
+
+	if (it == Entries.end() || !(it->second.stamp == stamp)) {
+		nMisses++;
+		return NULL;
+	}
+
+	nHits++;
+	it->second.bUsed = true;
+	return &it->second.lines;
+}
+
+// ===========================================================================================
+//
+void ParseCache::Store(const std::string &path, const STAMP &stamp, const LINELIST &lines)
+{
+	ENTRY &e = Entries[Key(path)];
+	e.stamp = stamp;
+	e.lines = lines;
+	e.bUsed = true;
+	bDirty = true;
+}
+
+// ===========================================================================================
+// Image layout: magic, version, entry count, then for each entry the key, size, time,
+// line count and the lines. Strings are stored with a WORD length.
+//
+bool ParseCache::ReadString(FILE *fp, std::string &s)
+{
+	WORD len;
+	if (fread(&len, sizeof(WORD), 1, fp) != 1) return false;
+	s.resize(len);
+	if (len && fread(&s[0], 1, len, fp) != len) return false;
+	return true;
+}
+
+bool ParseCache::WriteString(FILE *fp, const std::string &s)
+{
+	WORD len = WORD(min(s.size(), size_t(0xFFFF)));
+	if (fwrite(&len, sizeof(WORD), 1, fp) != 1) return false;
+	if (len && fwrite(s.data(), 1, len, fp) != len) return false;
+	return true;
+}
+
+// ===========================================================================================
+//
+bool ParseCache::Load()
+{
+	FILE *fp = NULL;
+	if (fopen_s(&fp, file.c_str(), "rb") != 0 || !fp) return false;
+
+	DWORD hdr[3];
+	if (fread(hdr, sizeof(DWORD), 3, fp) != 3 || hdr[0] != PCACHE_MAGIC || hdr[1] != PCACHE_VERSION) {
+		LogWrn("ParseCache: Ignoring incompatible cache [%s]", file.c_str());
+		fclose(fp);
+		return false;
+	}
+
+	bool bOk = true;
+
+	for (DWORD i = 0; i < hdr[2] && bOk; i++) {
+		std::string key;
+		ENTRY e;
+		DWORD nLines;
+		bOk = ReadString(fp, key)
+			&& fread(&e.stamp.size, sizeof(e.stamp.size), 1, fp) == 1
+			&& fread(&e.stamp.time, sizeof(e.stamp.time), 1, fp) == 1
+			&& fread(&nLines, sizeof(DWORD), 1, fp) == 1;
+		if (!bOk) break;
+		e.lines.resize(nLines);
+		for (DWORD k = 0; k < nLines && bOk; k++) bOk = ReadString(fp, e.lines[k]);
+		e.bUsed = false;
+		if (bOk) Entries[key] = std::move(e);
+	}
+
+	fclose(fp);
+
+	if (!bOk) {
+		LogWrn("ParseCache: Cache [%s] is truncated, discarded", file.c_str());
+		Entries.clear();
+		return false;
+	}
+
+	return true;
+}
+
+// ===========================================================================================
+//
+bool ParseCache::Save()
+{
+	// Forget the files that are gone
+	//
+	for (auto it = Entries.begin(); it != Entries.end();) {
+		STAMP s;
+		if (!it->second.bUsed && !GetStamp(it->first.c_str(), &s)) {
+			it = Entries.erase(it);
+			bDirty = true;
+		}
+		else ++it;
+	}
+
+	if (!bDirty) return true;
+
+	FILE *fp = NULL;
+	if (fopen_s(&fp, file.c_str(), "wb") != 0 || !fp) {
+		LogErr("ParseCache: Failed to write [%s]", file.c_str());
+		return false;
+	}
+
+	DWORD hdr[3] = { PCACHE_MAGIC, PCACHE_VERSION, DWORD(Entries.size()) };
+	bool bOk = fwrite(hdr, sizeof(DWORD), 3, fp) == 3;
+
+	for (auto it = Entries.begin(); it != Entries.end() && bOk; ++it) {
+		const ENTRY &e = it->second;
+		DWORD nLines = DWORD(e.lines.size());
+		bOk = WriteString(fp, it->first)
+			&& fwrite(&e.stamp.size, sizeof(e.stamp.size), 1, fp) == 1
+			&& fwrite(&e.stamp.time, sizeof(e.stamp.time), 1, fp) == 1
+			&& fwrite(&nLines, sizeof(DWORD), 1, fp) == 1;
+		for (DWORD k = 0; k < nLines && bOk; k++) bOk = WriteString(fp, e.lines[k]);
+	}
+
+	fclose(fp);
+
+	if (!bOk) {
+		LogErr("ParseCache: Failed to write [%s]", file.c_str());
+		remove(file.c_str());
+		return false;
+	}
+
+	bDirty = false;
+	return true;
+}
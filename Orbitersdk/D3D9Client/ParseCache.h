@@ -0,0 +1,96 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class ParseCache (interface)
+//
+// On-disk cache of the lines FileParser extracts from planetary
+// system, planet and base configuration files. Entries are keyed
+// by the file path and stamped with the file size and last write
+// time, an unchanged file is not opened at all on the next start.
+//
+// The cache stores text, not object handles, handles are resolved
+// by FileParser in every session. The image is written back only
+// if something changed.
+// ==============================================================
+
+#ifndef __PARSECACHE_H
+#define __PARSECACHE_H
+
+#include <windows.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#define PCACHE_MAGIC		0x43503944		// "D9PC"
+#define PCACHE_VERSION		1
+
+typedef std::vector<std::string> LINELIST;
+
+class ParseCache
+{
+
+public:
+
+	struct STAMP {
+		unsigned __int64 size;
+		unsigned __int64 time;
+		bool operator==(const STAMP &s) const { return size == s.size && time == s.time; }
+	};
+
+	explicit ParseCache(const char *file);
+	~ParseCache();
+
+	/**
+	 * \brief Read the cache image, an invalid image is ignored
+	 */
+	bool	Load();
+
+	/**
+	 * \brief Write the cache image if modified. Entries not used in this session are
+	 * kept as long as their file exists.
+	 */
+	bool	Save();
+
+	/**
+	 * \brief Find the lines of a file
+	 * \return NULL if the file isn't cached or has changed
+	 */
+	const LINELIST * Find(const std::string &path, const STAMP &stamp);
+
+	void	Store(const std::string &path, const STAMP &stamp, const LINELIST &lines);
+
+	static bool		GetStamp(const char *path, STAMP *stamp);
+	static STAMP	GetStamp(const WIN32_FIND_DATA *fd);
+
+	/**
+	 * \brief Binary string I/O used by the cache images, the length is stored as a WORD
+	 */
+	static bool		ReadString(FILE *fp, std::string &s);
+	static bool		WriteString(FILE *fp, const std::string &s);
+
+	DWORD	GetHits() const { return nHits; }
+	DWORD	GetMisses() const { return nMisses; }
+	DWORD	GetCount() const { return DWORD(Entries.size()); }
+
+private:
+
+	struct ENTRY {
+		STAMP		stamp;
+		LINELIST	lines;
+		bool		bUsed;
+	};
+
+	static std::string Key(const std::string &path);
+
+	std::unordered_map<std::string, ENTRY> Entries;
+	std::string	file;
+	DWORD		nHits;
+	DWORD		nMisses;
+	bool		bDirty;
+};
+
+#endif // !__PARSECACHE_H
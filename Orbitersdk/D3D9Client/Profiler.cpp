@@ -0,0 +1,378 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "Profiler.h"
+#include "Log.h"
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <string>
+
+// Single producer (the owner thread), single consumer (the render thread) event ring
+//
+struct PrfRing {
+	std::atomic<DWORD>	head;		// Written by the owner thread
+	std::atomic<DWORD>	tail;		// Written by the render thread
+	DWORD				tid;
+	DWORD				dropped;
+	char				name[32];
+	PRFEVENT			ev[PROFILER_RING_SIZE];
+};
+
+struct PrfFrame {
+	__int64					t0, t1;
+	std::vector<PRFEVENT>	Events;
+};
+
+std::atomic<bool> D3D9Profiler::bEnabled(false);
+
+std::atomic<PrfRing *> PrfRings[PROFILER_MAX_THREADS];
+std::atomic<LONG> nPrfRings(0);
+std::atomic<DWORD> PrfGeneration(0);
+std::atomic<bool> bPrfOverflow(false);
+
+thread_local PrfRing *pPrfRing = NULL;
+thread_local bool bPrfRingSet = false;
+thread_local DWORD dwPrfRingGen = 0;
+thread_local DWORD dwPrfDepth = 0;
+thread_local char szPrfThread[32] = "";
+
+PrfFrame PrfFrames[PROFILER_FRAMES];
+DWORD iPrfFrame = 0;
+DWORD nPrfFrames = 0;
+DWORD PrfRenderTid = 0;
+__int64 qpcPrfFrame = 0;
+__int64 qpcPrfFrq = 1;
+
+
+// ===========================================================================================
+//
+static PrfRing *GetPrfRing()
+{
+	DWORD gen = PrfGeneration.load(std::memory_order_relaxed);
+	if (bPrfRingSet && dwPrfRingGen == gen) return pPrfRing;
+
+	// A thread without a slot doesn't try again until the rings are released
+	pPrfRing = NULL;
+	bPrfRingSet = true;
+	dwPrfRingGen = gen;
+
+	LONG i = nPrfRings.load();
+	do {
+		if (i >= PROFILER_MAX_THREADS) {
+			bPrfOverflow = true;
+			return NULL;
+		}
+	} while (!nPrfRings.compare_exchange_weak(i, i + 1));
+
+	PrfRing *pRing = new PrfRing;
+	pRing->head = 0;
+	pRing->tail = 0;
+	pRing->tid = GetCurrentThreadId();
+	pRing->dropped = 0;
+	if (szPrfThread[0]) strcpy_s(pRing->name, sizeof(pRing->name), szPrfThread);
+	else sprintf_s(pRing->name, sizeof(pRing->name), "Thread %u", pRing->tid);
+
+	PrfRings[i].store(pRing, std::memory_order_release);
+	pPrfRing = pRing;
+	return pRing;
+}
+
+// ===========================================================================================
+//
+static void DrainPrfRings(std::vector<PRFEVENT> &out)
+{
+	LONG n = nPrfRings.load();
+
+	for (LONG i = 0; i < n; i++) {
+		PrfRing *pRing = PrfRings[i].load(std::memory_order_acquire);
+		if (!pRing) continue;
+		DWORD t = pRing->tail.load(std::memory_order_relaxed);
+		DWORD h = pRing->head.load(std::memory_order_acquire);
+		for (; t != h; t++) out.push_back(pRing->ev[t & (PROFILER_RING_SIZE - 1)]);
+		pRing->tail.store(t, std::memory_order_release);
+	}
+}
+
+// ===========================================================================================
+//
+static inline double PrfMs(__int64 dt)
+{
+	return double(dt) * 1e3 / double(qpcPrfFrq);
+}
+
+// ===========================================================================================
+//
+__int64 D3D9Profiler::Begin()
+{
+	__int64 qpc;
+	dwPrfDepth++;
+	QueryPerformanceCounter((LARGE_INTEGER*)&qpc);
+	return qpc;
+}
+
+// ===========================================================================================
+//
+void D3D9Profiler::End(const char *name, __int64 t0)
+{
+	__int64 t1;
+	QueryPerformanceCounter((LARGE_INTEGER*)&t1);
+	dwPrfDepth--;
+
+	PrfRing *pRing = GetPrfRing();
+	if (!pRing) return;
+
+	DWORD h = pRing->head.load(std::memory_order_relaxed);
+	if (h - pRing->tail.load(std::memory_order_acquire) >= PROFILER_RING_SIZE) {
+		pRing->dropped++;
+		return;
+	}
+
+	PRFEVENT &e = pRing->ev[h & (PROFILER_RING_SIZE - 1)];
+	e.name = name;
+	e.t0 = t0;
+	e.t1 = t1;
+	e.tid = pRing->tid;
+	e.depth = dwPrfDepth;
+
+	pRing->head.store(h + 1, std::memory_order_release);
+}
+
+// ===========================================================================================
+//
+void D3D9Profiler::SetThreadName(const char *name)
+{
+	strncpy_s(szPrfThread, sizeof(szPrfThread), name, _TRUNCATE);
+
+	if (bPrfRingSet && pPrfRing && dwPrfRingGen == PrfGeneration.load()) {
+		strcpy_s(pPrfRing->name, sizeof(pPrfRing->name), szPrfThread);
+	}
+}
+
+// ===========================================================================================
+//
+void D3D9Profiler::Enable(bool bEnable)
+{
+	if (bEnable && !bEnabled) {
+		std::vector<PRFEVENT> discard;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&qpcPrfFrq);
+		DrainPrfRings(discard);
+		iPrfFrame = 0;
+		nPrfFrames = 0;
+		qpcPrfFrame = 0;
+	}
+	bEnabled = bEnable;
+}
+
+// ===========================================================================================
+// Frames are delimited by consecutive calls. Events of other threads are stored in the frame
+// during which they were completed.
+//
+void D3D9Profiler::EndFrame()
+{
+	if (!bEnabled) return;
+
+	__int64 qpc;
+	QueryPerformanceCounter((LARGE_INTEGER*)&qpc);
+
+	PrfRenderTid = GetCurrentThreadId();
+
+	PrfFrame &f = PrfFrames[iPrfFrame];
+	f.t0 = qpcPrfFrame;
+	f.t1 = qpc;
+	f.Events.clear();
+	DrainPrfRings(f.Events);
+
+	if (qpcPrfFrame != 0) {
+		iPrfFrame = (iPrfFrame + 1) % PROFILER_FRAMES;
+		nPrfFrames = min(nPrfFrames + 1, PROFILER_FRAMES);
+	}
+
+	qpcPrfFrame = qpc;
+}
+
+// ===========================================================================================
+//
+void D3D9Profiler::GetStats(std::vector<PRFSTAT> &out)
+{
+	struct ZONE {
+		const char *name;
+		DWORD depth, calls, stamp;
+		double cur;
+		std::vector<double> samples;
+	};
+
+	std::vector<ZONE> zones(1);
+	std::map<std::string, size_t> lookup;
+	std::vector<size_t> touched;
+
+	zones[0].name = "Frame";
+	zones[0].depth = 0;
+	zones[0].calls = 0;
+
+	for (DWORD k = 0; k < nPrfFrames; k++) {
+
+		const PrfFrame &f = PrfFrames[(iPrfFrame + PROFILER_FRAMES - nPrfFrames + k) % PROFILER_FRAMES];
+
+		zones[0].samples.push_back(PrfMs(f.t1 - f.t0));
+		zones[0].calls++;
+
+		touched.clear();
+
+		for (size_t i = 0; i < f.Events.size(); i++) {
+
+			const PRFEVENT &e = f.Events[i];
+
+			auto it = lookup.find(e.name);
+			if (it == lookup.end()) {
+				ZONE z;
+				z.name = e.name;
+				z.depth = e.depth;
+				z.calls = 0;
+				z.stamp = 0;
+				z.cur = 0.0;
+				it = lookup.insert(std::make_pair(std::string(e.name), zones.size())).first;
+				zones.push_back(z);
+			}
+
+			ZONE &z = zones[it->second];
+			if (z.stamp != k + 1) {
+				z.stamp = k + 1;
+				z.cur = 0.0;
+				touched.push_back(it->second);
+			}
+			z.cur += PrfMs(e.t1 - e.t0);
+			z.calls++;
+			z.depth = min(z.depth, e.depth);
+		}
+
+		for (size_t i = 0; i < touched.size(); i++) zones[touched[i]].samples.push_back(zones[touched[i]].cur);
+	}
+
+	out.clear();
+	if (nPrfFrames == 0) return;
+
+	for (size_t i = 0; i < zones.size(); i++) {
+
+		std::vector<double> &s = zones[i].samples;
+		std::sort(s.begin(), s.end());
+
+		size_t n = s.size();
+		PRFSTAT st;
+		st.name = zones[i].name;
+		st.depth = zones[i].depth;
+		st.frames = DWORD(n);
+		st.calls = double(zones[i].calls) / double(nPrfFrames);
+		st.p50 = s[size_t(0.50 * double(n - 1) + 0.5)];
+		st.p95 = s[size_t(0.95 * double(n - 1) + 0.5)];
+		st.p99 = s[size_t(0.99 * double(n - 1) + 0.5)];
+		st.peak = s[n - 1];
+		out.push_back(st);
+	}
+
+	std::sort(out.begin() + 1, out.end(), [](const PRFSTAT &a, const PRFSTAT &b) {
+		if (a.depth != b.depth) return a.depth < b.depth;
+		return a.p50 > b.p50;
+	});
+}
+
+// ===========================================================================================
+//
+bool D3D9Profiler::ExportTrace(const char *file)
+{
+	if (nPrfFrames == 0) return false;
+
+	FILE *fp = NULL;
+	if (fopen_s(&fp, file, "w") || fp == NULL) {
+		LogErr("D3D9Profiler: Failed to create [%s]", file);
+		return false;
+	}
+
+	DWORD first = (iPrfFrame + PROFILER_FRAMES - nPrfFrames) % PROFILER_FRAMES;
+
+	// Time base, events of other threads may predate the first frame
+	//
+	__int64 base = PrfFrames[first].t0;
+	for (DWORD k = 0; k < nPrfFrames; k++) {
+		const PrfFrame &f = PrfFrames[(first + k) % PROFILER_FRAMES];
+		for (size_t i = 0; i < f.Events.size(); i++) base = min(base, f.Events[i].t0);
+	}
+
+	double scale = 1e6 / double(qpcPrfFrq);
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	LONG n = nPrfRings.load();
+	for (LONG i = 0; i < n; i++) {
+		PrfRing *pRing = PrfRings[i].load(std::memory_order_acquire);
+		if (!pRing) continue;
+		fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", pRing->tid, pRing->name);
+	}
+
+	for (DWORD k = 0; k < nPrfFrames; k++) {
+
+		const PrfFrame &f = PrfFrames[(first + k) % PROFILER_FRAMES];
+
+		fprintf(fp, "{\"name\":\"Frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"frame\":%u}}",
+			double(f.t0 - base) * scale, double(f.t1 - f.t0) * scale, PrfRenderTid, k);
+
+		for (size_t i = 0; i < f.Events.size(); i++) {
+			const PRFEVENT &e = f.Events[i];
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+				e.name, double(e.t0 - base) * scale, double(e.t1 - e.t0) * scale, e.tid);
+		}
+
+		fprintf(fp, k + 1 < nPrfFrames ? ",\n" : "\n");
+	}
+
+	fprintf(fp, "]}\n");
+	fclose(fp);
+
+	LogAlw("D3D9Profiler: %u frames written in [%s]", nPrfFrames, file);
+	return true;
+}
+
+// ===========================================================================================
+//
+void D3D9Profiler::LogSummary()
+{
+	std::vector<PRFSTAT> stats;
+	GetStats(stats);
+
+	if (stats.empty()) return;
+
+	LogAlw("D3D9Profiler: Zone times over %u frames [ms/frame]", nPrfFrames);
+	LogAlw("%-32s %8s %8s %8s %8s %8s %6s", "Zone", "Calls", "p50", "p95", "p99", "Peak", "Frames");
+
+	for (size_t i = 0; i < stats.size(); i++) {
+		const PRFSTAT &s = stats[i];
+		LogAlw("%*s%-*s %8.1f %8.3f %8.3f %8.3f %8.3f %6u", s.depth * 2, "", 32 - s.depth * 2, s.name,
+			s.calls, s.p50, s.p95, s.p99, s.peak, s.frames);
+	}
+
+	LONG n = nPrfRings.load();
+	for (LONG i = 0; i < n; i++) {
+		PrfRing *pRing = PrfRings[i].load(std::memory_order_acquire);
+		if (pRing && pRing->dropped) LogWrn("D3D9Profiler: %u events dropped by [%s]", pRing->dropped, pRing->name);
+	}
+	if (bPrfOverflow) LogWrn("D3D9Profiler: Too many threads, some were not recorded");
+}
+
+// ===========================================================================================
+//
+void D3D9Profiler::Release()
+{
+	bEnabled = false;
+
+	LONG n = nPrfRings.load();
+	for (LONG i = 0; i < n; i++) delete PrfRings[i].exchange(NULL);
+	nPrfRings = 0;
+	bPrfOverflow = false;
+	PrfGeneration++;
+
+	for (int i = 0; i < PROFILER_FRAMES; i++) std::vector<PRFEVENT>().swap(PrfFrames[i].Events);
+	iPrfFrame = 0;
+	nPrfFrames = 0;
+}
@@ -0,0 +1,122 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class D3D9Profiler (interface)
+//
+// Scoped CPU timing zones for the render thread and the loader
+// threads. Each thread records completed zones into a private
+// lock-free ring which the render thread drains once per frame
+// into a frame history. The history provides percentile statistics
+// per zone and can be exported in Chrome trace-event format
+// (chrome://tracing, ui.perfetto.dev).
+// When disabled a zone costs a single flag test.
+// ==============================================================
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include "D3D9Util.h"
+#include <vector>
+#include <atomic>
+
+#define PROFILER_MAX_THREADS	32
+#define PROFILER_RING_SIZE		8192	// Events per thread, must be a power of two
+#define PROFILER_FRAMES			256		// Length of the frame history
+
+/**
+ * \brief Completed timing zone
+ */
+typedef struct {
+	const char *	name;		///< Zone name, must be a string literal
+	__int64			t0, t1;		///< Begin and end time [qpc ticks]
+	DWORD			tid;		///< Thread ID
+	DWORD			depth;		///< Nesting depth within the thread
+} PRFEVENT;
+
+/**
+ * \brief Zone statistics over the frame history. Times are in milliseconds per frame.
+ */
+typedef struct {
+	const char *	name;
+	DWORD			depth;		///< Smallest nesting depth seen
+	DWORD			frames;		///< Number of frames the zone was present in
+	double			calls;		///< Average number of calls per frame
+	double			p50, p95, p99, peak;
+} PRFSTAT;
+
+
+class D3D9Profiler
+{
+
+public:
+
+	/**
+	 * \brief Enable or disable recording. Enabling clears the frame history.
+	 */
+	static void		Enable(bool bEnable);
+	static bool		IsEnabled() { return bEnabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * \brief Name the calling thread on the trace timeline. The thread gets its ring
+	 * when it first records a zone.
+	 */
+	static void		SetThreadName(const char *name);
+
+	/**
+	 * \brief Close the current frame. Must be called once per frame from the render thread.
+	 */
+	static void		EndFrame();
+
+	/**
+	 * \brief Compute per zone statistics, sorted by depth and p50
+	 * \param out Receives the statistics. The first entry is the whole frame.
+	 */
+	static void		GetStats(std::vector<PRFSTAT> &out);
+
+	/**
+	 * \brief Write the frame history in Chrome trace-event JSON format
+	 * \return false if the file couldn't be created
+	 */
+	static bool		ExportTrace(const char *file);
+	static void		LogSummary();
+
+	/**
+	 * \brief Release the thread rings. Must not be called while other threads may record zones.
+	 */
+	static void		Release();
+
+	static __int64	Begin();
+	static void		End(const char *name, __int64 t0);
+
+private:
+
+	static std::atomic<bool> bEnabled;
+};
+
+
+/**
+ * \brief Scoped timing zone, use through the _PROFILE_ZONE macro
+ */
+class D3D9ProfileZone
+{
+public:
+	explicit D3D9ProfileZone(const char *name) : pName(NULL), t0(0)
+	{
+		if (D3D9Profiler::IsEnabled()) { pName = name; t0 = D3D9Profiler::Begin(); }
+	}
+	~D3D9ProfileZone()
+	{
+		if (pName) D3D9Profiler::End(pName, t0);
+	}
+
+private:
+	const char *	pName;
+	__int64			t0;
+};
+
+#define _PROFILE_ZONE(name) D3D9ProfileZone prf_zone_(name)
+
+#endif // !__PROFILER_H
@@ -12,6 +12,8 @@
 #ifndef __QTREE_H
 #define __QTREE_H
 
+#define QTNBR(dlat, dlng)	(((dlat)+1)*3 + (dlng)+1)	// Neighbour link index, dlat and dlng in -1..1
+
 template<typename T>
 class QuadTreeNode {
 public:
@@ -50,10 +52,17 @@ public:
 	// Delete all children and their subtrees. False indicates that a node in the subtree
 	// was locked and not the entire subtree could be deleted.
 
+	inline QuadTreeNode *Neighbour (int idx) const { return nbr[idx]; }
+	inline void SetNeighbour (int idx, QuadTreeNode *node) { nbr[idx] = node; }
+	// Links to the neighbouring nodes, see QTNBR(). A link points to the finest active node at
+	// the same or a lower level covering the adjacent cell, or is NULL. The links are kept up to
+	// date by the render engine for the active part of the tree only.
+
 private:
 	T *entry;
 	QuadTreeNode *parent;
 	QuadTreeNode *child[4];
+	QuadTreeNode *nbr[9];
 };
 
 template<typename T>
@@ -63,6 +72,9 @@ parent(_parent), entry(_entry)
 	for (int i = 0; i < 4; ++i) {
 		child[i] = NULL;
 	}
+	for (int i = 0; i < 9; ++i) {
+		nbr[i] = NULL;
+	}
 	if (entry) {
 		entry->SetNode (this);
 	}
@@ -11,6 +11,7 @@
 #include "D3D9Client.h"
 #include "VPlanet.h"
 #include "Mesh.h"
+#include <memory>
 
 #define MAXRINGRES 3
 
@@ -49,13 +50,12 @@ public:
 	bool Render (LPDIRECT3DDEVICE9 dev, D3DXMATRIX &mWorld, bool zenable);
 
 protected:
-	D3D9Mesh *CreateRing (double irad, double orad, int nsect);
 	DWORD LoadTextures ();
 
 private:
 	static oapi::D3D9Client *gc;
 	const vPlanet *vp;
-	D3D9Mesh *mesh[MAXRINGRES];
+	std::shared_ptr<D3D9Mesh> mesh[MAXRINGRES];	// Shared with the planets using the same radii
 	LPDIRECT3DTEXTURE9 tex[MAXRINGRES];
 	LPDIRECT3DTEXTURE9 pTex;
 	DWORD rres, tres, ntex;
@@ -16,6 +16,7 @@
 #include "BeaconArray.h"
 #include "D3D9Config.h"
 #include "D3D9Util.h"
+#include "BeaconCache.h"
 #include "vBase.h"
 #include <vector>
 
@@ -132,31 +133,74 @@ void RunwayLights::AddVASI(VECTOR3 pos, DWORD end)
 }
 
 
-void RunwayLights::Init()
+void RunwayLights::Compile(BeaconList list[RWYL_ARRAYS])
 {
 	_TRACE;
 	
-	beacons1 = BuildLights(end1, end2, td_disp);
+	BuildLights(end1, end2, td_disp, list[0]);
 
 	if (!bSingleEnded) {
-		if (bDisp2) beacons2 = BuildLights(end2, end1, td_disp2);
-		else		beacons2 = BuildLights(end2, end1, td_disp);
+		if (bDisp2) BuildLights(end2, end1, td_disp2, list[1]);
+		else		BuildLights(end2, end1, td_disp, list[1]);
 	}
 
 	for (DWORD i=0;i<nVASI;i++) {
-		if (VASI_end[i]==0) vasi[i] = BuildVASI(end1, end2, i);
-		if (VASI_end[i]==1) vasi[i] = BuildVASI(end2, end1, i);
+		if (VASI_end[i]==0) BuildVASI(end1, end2, i, list[2+i]);
+		if (VASI_end[i]==1) BuildVASI(end2, end1, i, list[2+i]);
 	}
 
 	for (DWORD i=0;i<nPAPI;i++) {
-		if (PAPI_end[i]==0) papi[i] = BuildPAPI(end1, end2, i);
-		if (PAPI_end[i]==1)	papi[i] = BuildPAPI(end2, end1, i);
+		if (PAPI_end[i]==0) BuildPAPI(end1, end2, i, list[4+i]);
+		if (PAPI_end[i]==1)	BuildPAPI(end2, end1, i, list[4+i]);
 	}
 }
 
 
+void RunwayLights::Init(const BeaconArrayEntry *const pEnt[RWYL_ARRAYS], const DWORD nEnt[RWYL_ARRAYS])
+{
+	_TRACE;
+
+	if (nEnt[0]) beacons1 = new BeaconArray(pEnt[0], nEnt[0], vB);
+	if (nEnt[1]) beacons2 = new BeaconArray(pEnt[1], nEnt[1], vB);
+
+	for (int i=0;i<2;i++) if (nEnt[2+i]) vasi[i] = new BeaconArray(pEnt[2+i], nEnt[2+i]);
+	for (int i=0;i<12;i++) if (nEnt[4+i]) papi[i] = new BeaconArray(pEnt[4+i], nEnt[4+i]);
+}
+
+
+void RunwayLights::Save(BeaconCache &c, const BeaconList list[RWYL_ARRAYS]) const
+{
+	c.Put(end1); c.Put(end2);
+	c.Put(width); c.Put(td_disp); c.Put(td_disp2); c.Put(td_length); c.Put(apr_length); c.Put(apr_start);
+	c.Put(bSingleEnded); c.Put(bDisp2); c.Put(iCategory);
+	c.Put(nPAPI); c.Put(PAPI_pos); c.Put(PAPI_disp); c.Put(PAPI_end);
+	c.Put(nVASI); c.Put(VASI); c.Put(VASI_end);
+
+	for (int i=0;i<RWYL_ARRAYS;i++) c.PutEntries(list[i]);
+}
+
+
+bool RunwayLights::Load(BeaconCache &c, const BeaconArrayEntry *pEnt[RWYL_ARRAYS], DWORD nEnt[RWYL_ARRAYS])
+{
+	bool bOk = c.Get(end1) && c.Get(end2)
+		&& c.Get(width) && c.Get(td_disp) && c.Get(td_disp2) && c.Get(td_length) && c.Get(apr_length) && c.Get(apr_start)
+		&& c.Get(bSingleEnded) && c.Get(bDisp2) && c.Get(iCategory)
+		&& c.Get(nPAPI) && c.Get(PAPI_pos) && c.Get(PAPI_disp) && c.Get(PAPI_end)
+		&& c.Get(nVASI) && c.Get(VASI) && c.Get(VASI_end);
+
+	if (!bOk || nPAPI>12 || nVASI>2) return false;
+
+	for (int i=0;i<RWYL_ARRAYS;i++) {
+		if (!c.Get(nEnt[i])) return false;
+		pEnt[i] = c.GetEntries(nEnt[i]);
+		if (pEnt[i]==NULL) return false;
+	}
+	return true;
+}
 
-BeaconArray *RunwayLights::BuildLights(VECTOR3 _start, VECTOR3 _end, double disp)
+
+
+void RunwayLights::BuildLights(VECTOR3 _start, VECTOR3 _end, double disp, BeaconList &out)
 {
 	_TRACE;
 	const float lightSize = 4.0f;
@@ -183,7 +227,7 @@ BeaconArray *RunwayLights::BuildLights(VECTOR3 _start, VECTOR3 _end, double disp
 
 	if (numLightsApproach<0) numLightsApproach = 0;
 
-	if (iCategory==3) return NULL;
+	if (iCategory==3) return;
 	if (iCategory==0) {
 		if (width>59.0) iCategory = 2;
 		else			iCategory = 1;
@@ -201,7 +245,8 @@ BeaconArray *RunwayLights::BuildLights(VECTOR3 _start, VECTOR3 _end, double disp
 	VECTOR3 _shift;
 	VECTOR3 _widthDir = unit(crossp(_dir, _V(0, 1, 0))); // used to calculate the edge lights
 
-	BeaconArrayEntry* beaconsEntry1 = new BeaconArrayEntry[numLights];
+	out.resize(numLights);
+	BeaconArrayEntry* beaconsEntry1 = out.data();
 	
 	int i=0, k=0;
 
@@ -512,13 +557,11 @@ BeaconArray *RunwayLights::BuildLights(VECTOR3 _start, VECTOR3 _end, double disp
 
 	for (int k=0;k<i;k++) beaconsEntry1[k].dir = _V(-beaconsEntry1[k].dir.x, beaconsEntry1[k].dir.y, -beaconsEntry1[k].dir.z);
 
-	BeaconArray *beacons = new BeaconArray(beaconsEntry1, i, vB);
-	delete[] beaconsEntry1;
-	return beacons;
+	out.resize(i);
 }
 
 
-BeaconArray * RunwayLights::BuildPAPI(VECTOR3 start, VECTOR3 end, DWORD i)
+void RunwayLights::BuildPAPI(VECTOR3 start, VECTOR3 end, DWORD i, BeaconList &out)
 {
 
 	// PAPI lights
@@ -545,7 +588,8 @@ BeaconArray * RunwayLights::BuildPAPI(VECTOR3 start, VECTOR3 end, DWORD i)
 	papiLight.color = 0;
 	papiLight.dir = dir*cos(upAngle*RAD) + _V(0, 1, 0)*sin(upAngle*RAD);
 
-	BeaconArrayEntry entryPAPI[4];
+	out.resize(4);
+	BeaconArrayEntry *entryPAPI = out.data();
 
 	for(int j=0; j<4; j++)
 	{
@@ -553,13 +597,10 @@ BeaconArray * RunwayLights::BuildPAPI(VECTOR3 start, VECTOR3 end, DWORD i)
 		entryPAPI[j].dir = _V(-entryPAPI[j].dir.x, entryPAPI[j].dir.y, -entryPAPI[j].dir.z);
 		entryPAPI[j].pos = start + dir*PAPI_pos[i].z + widthDir*disp + widthDir*j*papi_separation - widthDir*papi_separation*1.5;
 	}
-
-	BeaconArray *beacons = new BeaconArray(entryPAPI, 4);
-	return beacons;
 }
 
 
-BeaconArray *RunwayLights::BuildVASI(VECTOR3 _start, VECTOR3 _end, DWORD idx)
+void RunwayLights::BuildVASI(VECTOR3 _start, VECTOR3 _end, DWORD idx, BeaconList &out)
 {
 	_TRACE;
 	const float lightSize = 4.0f;
@@ -586,7 +627,8 @@ BeaconArray *RunwayLights::BuildVASI(VECTOR3 _start, VECTOR3 _end, DWORD idx)
 	VECTOR3 _widthDir = crossp(_direction, _V(0, 1, 0)); // used to calculate the edge lights
 	normalise(_widthDir);
 
-	BeaconArrayEntry* beaconsEntry1 = new BeaconArrayEntry[30];
+	out.resize(30);
+	BeaconArrayEntry* beaconsEntry1 = out.data();
 	
 	int i=0, k=0;
 
@@ -635,9 +677,7 @@ BeaconArray *RunwayLights::BuildVASI(VECTOR3 _start, VECTOR3 _end, DWORD idx)
 		beaconsEntry1[k].pos.y -= (dif-0.2);
 	}
 
-	BeaconArray *beacons = new BeaconArray(beaconsEntry1, i);
-	delete[] beaconsEntry1;
-	return beacons;
+	out.resize(i);
 }
 	
 
@@ -688,8 +728,8 @@ void RunwayLights::SetPAPIColors(BeaconArray *pPAPI, LPD3DXMATRIX world, int i)
 
 void RunwayLights::Update(class vPlanet *vP)
 {
-	if (beacons1) beacons1->Update(50, vP);
-	if (beacons2) beacons2->Update(50, vP);
+	if (beacons1) beacons1->Update(vP);
+	if (beacons2) beacons2->Update(vP);
 }
 
 
@@ -746,6 +786,40 @@ int RunwayLights::CreateRunwayLights(class vBase *vB, const class Scene *scn, co
 	int numRunwayLights = 0;
 	std::vector<RunwayLights*> lights;
 	char cbuf[256];
+
+	double time = D3D9GetTime();
+
+	// The generated lights depend on the configuration and on the planet size
+	//
+	double prm[3] = { Config->RwyLightAngle, Config->RwyBrightness, oapiGetSize(oapiGetBasePlanet(vB->GetObjectA())) };
+
+	BeaconCache cache(filename, "rwy", prm, 3);
+
+	if (cache.Open()) {
+
+		DWORD count = 0;
+		bool bOk = cache.Get(count);
+
+		for (DWORD i=0; bOk && i<count; i++) {
+			const BeaconArrayEntry *pEnt[RWYL_ARRAYS];
+			DWORD nEnt[RWYL_ARRAYS];
+			lights.push_back(new RunwayLights(vB, scn));
+			bOk = lights.back()->Load(cache, pEnt, nEnt);
+			if (bOk) lights.back()->Init(pEnt, nEnt);
+		}
+
+		if (bOk) {
+			out = new RunwayLights*[count];
+			for (DWORD i=0; i<count; i++) out[i] = lights[i];
+			LogAlw("Runway Lights loaded from cache for %s, %u runways in %.2fms", filename, count, (D3D9GetTime() - time) * 1e-3);
+			return int(count);
+		}
+
+		LogWrn("Runway Lights cache for %s is corrupt", filename);
+		for (size_t i=0; i<lights.size(); i++) delete lights[i];
+		lights.clear();
+		cache.Close();
+	}
 	
 	FILE* file = NULL;
 	fopen_s(&file, filename, "r");
@@ -889,13 +963,31 @@ int RunwayLights::CreateRunwayLights(class vBase *vB, const class Scene *scn, co
 
 	out = new RunwayLights*[numRunwayLights];
 
+	cache.Put(DWORD(numRunwayLights));
+
 	int i;
 	for(i=0; i<numRunwayLights; i++)
 	{
+		BeaconList list[RWYL_ARRAYS];
+		const BeaconArrayEntry *pEnt[RWYL_ARRAYS];
+		DWORD nEnt[RWYL_ARRAYS];
+
 		out[i] = lights[i];
-		out[i]->Init();
+		out[i]->Compile(list);
+		out[i]->Save(cache, list);
+
+		for (int k=0; k<RWYL_ARRAYS; k++) {
+			pEnt[k] = list[k].data();
+			nEnt[k] = DWORD(list[k].size());
+		}
+
+		out[i]->Init(pEnt, nEnt);
 	}
 
+	cache.Save();
+
+	LogAlw("Runway Lights compiled for %s, %d runways in %.2fms", filename, numRunwayLights, (D3D9GetTime() - time) * 1e-3);
+
 	return numRunwayLights;
 }
 
@@ -952,7 +1044,7 @@ void TaxiLights::SetColor(VECTOR3 clr)
 }
 
 
-void TaxiLights::Init()
+void TaxiLights::Compile(BeaconList &list)
 {
 	_TRACE;
 	// Helping vectors
@@ -961,7 +1053,8 @@ void TaxiLights::Init()
 	normalise(dir);
 	double len = length(direction); // Length of the runway
 
-	BeaconArrayEntry* beaconsEntry1 = new BeaconArrayEntry[count];
+	list.resize(max(0, count));
+	BeaconArrayEntry* beaconsEntry1 = list.data();
 	BeaconArrayEntry taxiLight;
 
 	taxiLight.angle = 360.0f;
@@ -984,15 +1077,34 @@ void TaxiLights::Init()
 		beaconsEntry1[i].pos = current;
 		current += space;
 	} 
+}
+
+
+void TaxiLights::Init(const BeaconArrayEntry *pEnt, DWORD nEnt)
+{
+	if (nEnt) beacons1 = new BeaconArray(pEnt, nEnt);
+}
+
+
+void TaxiLights::Save(BeaconCache &c, const BeaconList &list) const
+{
+	c.Put(end1); c.Put(end2); c.Put(color); c.Put(size); c.Put(count);
+	c.PutEntries(list);
+}
+
 
-	beacons1 = new BeaconArray(beaconsEntry1, count);
-	delete[] beaconsEntry1;
+bool TaxiLights::Load(BeaconCache &c, const BeaconArrayEntry **pEnt, DWORD *nEnt)
+{
+	if (!(c.Get(end1) && c.Get(end2) && c.Get(color) && c.Get(size) && c.Get(count))) return false;
+	if (!c.Get(*nEnt)) return false;
+	*pEnt = c.GetEntries(*nEnt);
+	return (*pEnt != NULL);
 }
 
 
 void TaxiLights::Render(LPDIRECT3DDEVICE9 dev, LPD3DXMATRIX world, bool night)
 {
-	if (night) beacons1->Render(dev, world, 0.5f);
+	if (night && beacons1) beacons1->Render(dev, world, 0.5f);
 }
 
 int TaxiLights::CreateTaxiLights(OBJHANDLE base, const class Scene *scn, const char *filename, TaxiLights**& out)
@@ -1000,6 +1112,33 @@ int TaxiLights::CreateTaxiLights(OBJHANDLE base, const class Scene *scn, const c
 	int numTaxiLights = 0;
 	std::vector<TaxiLights*> lights;
 	char cbuf[256];
+
+	BeaconCache cache(filename, "txl", NULL, 0);
+
+	if (cache.Open()) {
+
+		DWORD count = 0;
+		bool bOk = cache.Get(count);
+
+		for (DWORD i=0; bOk && i<count; i++) {
+			const BeaconArrayEntry *pEnt;
+			DWORD nEnt;
+			lights.push_back(new TaxiLights(base, scn));
+			bOk = lights.back()->Load(cache, &pEnt, &nEnt);
+			if (bOk) lights.back()->Init(pEnt, nEnt);
+		}
+
+		if (bOk) {
+			out = new TaxiLights*[count];
+			for (DWORD i=0; i<count; i++) out[i] = lights[i];
+			return int(count);
+		}
+
+		LogWrn("Taxi Lights cache for %s is corrupt", filename);
+		for (size_t i=0; i<lights.size(); i++) delete lights[i];
+		lights.clear();
+		cache.Close();
+	}
 	
 	FILE* file = NULL;
 	fopen_s(&file, filename, "r");
@@ -1067,12 +1206,19 @@ int TaxiLights::CreateTaxiLights(OBJHANDLE base, const class Scene *scn, const c
 
 	out = new TaxiLights*[numTaxiLights];
 
+	cache.Put(DWORD(numTaxiLights));
+
 	int i;
 	for(i=0; i<numTaxiLights; i++)
 	{
+		BeaconList list;
 		out[i] = lights[i];
-		out[i]->Init();
+		out[i]->Compile(list);
+		out[i]->Save(cache, list);
+		out[i]->Init(list.data(), DWORD(list.size()));
 	}
 
+	cache.Save();
+
 	return numTaxiLights;
 }
\ No newline at end of file
@@ -16,10 +16,15 @@
 #define __RUNWAYLIGHTS_H
 
 #include "OrbiterAPI.h"
+#include "BeaconArray.h"
 #include <d3d9.h>
 #include <d3dx9.h>
+#include <vector>
 
-class BeaconArray;
+#define RWYL_ARRAYS		16		// Beacon arrays per runway: 2 edge, 2 VASI, 12 PAPI
+
+class BeaconCache;
+typedef std::vector<BeaconArrayEntry> BeaconList;
 
 class RunwayLights
 {
@@ -40,7 +45,19 @@ public:
 	void SetSignleEnded(bool bSingleEnded);
 	void SetCategory(int cat);
 
-	void Init();
+	/**
+	 * \brief Generate the beacons of the runway
+	 * \param list Receives the entries of the RWYL_ARRAYS beacon arrays
+	 */
+	void Compile(BeaconList list[RWYL_ARRAYS]);
+
+	/**
+	 * \brief Create the beacon arrays. Arrays with no entries are skipped.
+	 */
+	void Init(const BeaconArrayEntry *const pEnt[RWYL_ARRAYS], const DWORD nEnt[RWYL_ARRAYS]);
+	void Save(BeaconCache &cache, const BeaconList list[RWYL_ARRAYS]) const;
+	bool Load(BeaconCache &cache, const BeaconArrayEntry *pEnt[RWYL_ARRAYS], DWORD nEnt[RWYL_ARRAYS]);
+
 	void Render(LPDIRECT3DDEVICE9 dev, LPD3DXMATRIX world, bool night);
 	void Update(class vPlanet *vP);
 
@@ -52,9 +69,9 @@ protected:
 
 	void			   SetPAPIColors(BeaconArray *pPAPI, LPD3DXMATRIX world, int idx);
 
-	class BeaconArray *BuildLights(VECTOR3 start, VECTOR3 end, double disp);
-	class BeaconArray *BuildVASI(VECTOR3 start, VECTOR3 end, DWORD idx);
-	class BeaconArray *BuildPAPI(VECTOR3 start, VECTOR3 end, DWORD idx);
+	void BuildLights(VECTOR3 start, VECTOR3 end, double disp, BeaconList &out);
+	void BuildVASI(VECTOR3 start, VECTOR3 end, DWORD idx, BeaconList &out);
+	void BuildPAPI(VECTOR3 start, VECTOR3 end, DWORD idx, BeaconList &out);
 
 	VECTOR3 end1;
 	VECTOR3 end2;
@@ -104,7 +121,11 @@ public:
 	void SetCount(int count);
 	void SetColor(VECTOR3 color);
 
-	void Init();
+	void Compile(BeaconList &list);
+	void Init(const BeaconArrayEntry *pEnt, DWORD nEnt);
+	void Save(BeaconCache &cache, const BeaconList &list) const;
+	bool Load(BeaconCache &cache, const BeaconArrayEntry **pEnt, DWORD *nEnt);
+
 	void Render(LPDIRECT3DDEVICE9 dev, LPD3DXMATRIX world, bool night);
 
 	static int CreateTaxiLights(OBJHANDLE base, const class Scene *scn, const char *file, TaxiLights**& out);
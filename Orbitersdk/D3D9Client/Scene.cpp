@@ -21,6 +21,9 @@
 #include "OapiExtension.h"
 #include "DebugControls.h"
 #include "IProcess.h"
+#include "LightCluster.h"
+#include "Profiler.h"
+#include "InstanceBuffer.h"
 #include <sstream>
 
 #define saturate(x)	max(min(x, 1.0f), 0.0f)
@@ -107,6 +110,7 @@ Scene::Scene(D3D9Client *_gc, DWORD w, DWORD h)
 
 	csphere = new CelestialSphere(gc);
 	Lights = new D3D9Light[MAX_SCENE_LIGHTS];
+	pLightCluster = new LightCluster();
 
 	bLocalLight = *(bool*)gc->GetConfigParam(CFGPRM_LOCALLIGHT);
 	
@@ -293,6 +297,7 @@ Scene::~Scene ()
 	for (int i = 0; i < ARRAYSIZE(pBlrTemp); i++) SAFE_RELEASE(pBlrTemp[i]);
 
 	if (Lights) delete []Lights;
+	if (pLightCluster) delete pLightCluster;
 	if (cspheremgr) delete cspheremgr;
 
 	// Particle Streams
@@ -902,6 +907,7 @@ float Scene::ComputeNearClipPlane()
 
 void Scene::UpdateCamVis()
 {
+	_PROFILE_ZONE("CamVis");
 	dwFrameId++;				// Advance to a next frame
 
 	// Update camera parameters --------------------------------------
@@ -954,6 +960,13 @@ void Scene::UpdateCamVis()
 				}
 			}
 		}
+
+		// Assign the lights into camera froxels ----------------------------
+		//
+		_PROFILE_ZONE("LightCluster");
+		double cluster_time = D3D9GetTime();
+		pLightCluster->Build(Camera.x, Camera.y, Camera.z, Camera.vw, Camera.vh);
+		D3D9SetTime(D3D9Stats.Timer.LightCluster, cluster_time);
 	}
 
 
@@ -986,6 +999,8 @@ void Scene::ClearLocalLights()
 	nLights  = 0;
 	lmaxdst2 = 0.0f;
 
+	pLightCluster->Clear();
+
 	// Clear active local lisghts list -------------------------------
 	for (int i = 0; i < MAX_SCENE_LIGHTS; i++) Lights[i].Reset();
 }
@@ -1001,6 +1016,8 @@ void Scene::AddLocalLight(const LightEmitter *le, const vObject *vo)
 
 	D3D9Light lght(le, vo);
 
+	pLightCluster->AddLight(lght);
+
 	// -----------------------------------------------------------------------------
 	// Replace or Add
 	//
@@ -1019,11 +1036,46 @@ void Scene::AddLocalLight(const LightEmitter *le, const vObject *vo)
 }
 
 
+// ===========================================================================================
+//
+int Scene::GetLocalLights(const D3DXVECTOR3 &pos, float rad, _LightList *pList, int nMax, const D3D9Light **ppLights, float minIl) const
+{
+	if (pLightCluster->IsValid()) {
+		*ppLights = pLightCluster->GetLights();
+		return pLightCluster->GetLights(pos, rad, pList, nMax, minIl);
+	}
+
+	*ppLights = Lights;
+
+	if (Lights == NULL) return 0;
+
+	_LightList List[MAX_SCENE_LIGHTS];
+	D3DXVECTOR3 p = pos;
+	int n = 0;
+
+	for (DWORD i = 0; i < nLights; i++) {
+		float il = Lights[i].GetIlluminance(p, rad);
+		if (il > minIl) {
+			List[n].illuminace = il;
+			List[n++].idx = i;
+		}
+	}
+
+	int compare_lights(const void * a, const void * b);
+
+	if (n > 1) qsort(List, n, sizeof(_LightList), compare_lights);
+
+	n = min(n, nMax);
+	memcpy(pList, List, n * sizeof(_LightList));
+	return n;
+}
+
 // ===========================================================================================
 //
 void Scene::RenderMainScene()
 {
 	_TRACE;
+	_PROFILE_ZONE("MainScene");
 
 	double scene_time = D3D9GetTime();
 	D3D9SetTime(D3D9Stats.Timer.CamVis, scene_time);
@@ -2848,6 +2900,44 @@ void Scene::RenderMesh(DEVMESHHANDLE hMesh, const oapi::FMATRIX4 *pWorld)
 }
 
 
+// ===========================================================================================
+//
+void Scene::RenderMesh(DEVMESHHANDLE hMesh, InstanceBuffer *pInst)
+{
+	D3D9Mesh *pMesh = (D3D9Mesh *)hMesh;
+
+	D3DXVECTOR3 bc = pMesh->GetBoundingSpherePos();
+	pInst->SetBounds(D3DXVECTOR4(bc.x, bc.y, bc.z, pMesh->GetBoundingSphereRadius()));
+
+	D3DXPLANE fr[6];
+	GetCameraFrustum(fr);
+
+	D3D9Stats.Inst.Instances += pInst->GetCount();
+	D3D9Stats.Inst.Visible += pInst->Cull(fr, 6);
+
+	if (pInst->GetVisibleCount() == 0) return;
+
+	const Scene::SHADOWMAPPARAM *shd = GetSMapData();
+
+	float s = float(shd->size);
+	float sr = 2.0f * shd->rad / s;
+
+	HR(D3D9Effect::FX->SetMatrix(D3D9Effect::eLVP, &shd->mViewProj));
+
+	if (shd->pShadowMap) {
+		HR(D3D9Effect::FX->SetTexture(D3D9Effect::eShadowMap, shd->pShadowMap));
+		HR(D3D9Effect::FX->SetVector(D3D9Effect::eSHD, &D3DXVECTOR4(sr, 1.0f / s, float(oapiRand()), 1.0f / shd->depth)));
+		HR(D3D9Effect::FX->SetBool(D3D9Effect::eShadowToggle, true));
+	}
+	else {
+		HR(D3D9Effect::FX->SetBool(D3D9Effect::eShadowToggle, false));
+	}
+
+	pMesh->SetSunLight(&sunLight);
+	pMesh->RenderInstanced(pInst);
+}
+
+
 // ===========================================================================================
 //
 bool Scene::WorldToScreenSpace(const VECTOR3 &wpos, oapi::IVECTOR2 *pt, D3DXMATRIX *pVP, float clip)
@@ -3161,6 +3251,48 @@ D3D9Pick Scene::PickMesh(DEVMESHHANDLE hMesh, const LPD3DXMATRIX pW, short xpos,
 	return pMesh->Pick(pW, NULL, &GetPickingRay(xpos, ypos));
 }
 
+// ===========================================================================================
+//
+struct INSTPICK {
+	D3D9Mesh *pMesh;
+	InstanceBuffer *pInst;
+	D3DXVECTOR3 vDir;
+	D3D9Pick pick;
+};
+
+static float PickInstance(DWORD idx, void *pUser)
+{
+	INSTPICK *ip = (INSTPICK *)pUser;
+	D3D9Pick pk = ip->pMesh->Pick((const LPD3DXMATRIX)ip->pInst->GetInstance(idx), NULL, &ip->vDir);
+	if (pk.group < 0) return -1.0f;
+	if (pk.dist < ip->pick.dist) ip->pick = pk;
+	return pk.dist;
+}
+
+// ===========================================================================================
+//
+D3D9Pick Scene::PickMesh(DEVMESHHANDLE hMesh, InstanceBuffer *pInst, short xpos, short ypos, int *pIdx)
+{
+	D3D9Mesh *pMesh = (D3D9Mesh *)hMesh;
+
+	D3DXVECTOR3 bc = pMesh->GetBoundingSpherePos();
+	pInst->SetBounds(D3DXVECTOR4(bc.x, bc.y, bc.z, pMesh->GetBoundingSphereRadius()));
+
+	INSTPICK ip;
+	ip.pMesh = pMesh;
+	ip.pInst = pInst;
+	ip.vDir = GetPickingRay(xpos, ypos);
+	memset(&ip.pick, 0, sizeof(D3D9Pick));
+	ip.pick.dist = 1e30f;
+	ip.pick.group = -1;
+
+	float dist = 1e30f;
+	*pIdx = pInst->Pick(&ip.vDir, &dist, PickInstance, &ip);
+	if (*pIdx < 0) ip.pick.group = -1;
+
+	return ip.pick;
+}
+
 // ===========================================================================================
 //
 void Scene::GetAdjProjViewMatrix(LPD3DXMATRIX pMP, float znear, float zfar)
@@ -3447,6 +3579,8 @@ void Scene::RenderCustomCameraView(CAMREC *cCur)
 	DWORD w = SURFACE(cCur->hSurface)->GetWidth();
 	DWORD h = SURFACE(cCur->hSurface)->GetHeight();
 
+	SURFACE(cCur->hSurface)->Sync();
+
 	LPDIRECT3DSURFACE9 pSrf = SURFACE(cCur->hSurface)->GetSurface();
 	LPDIRECT3DSURFACE9 pDSs = SURFACE(cCur->hSurface)->GetDepthStencil();
 
@@ -3510,6 +3644,26 @@ bool Scene::IsVisibleInCamera(D3DXVECTOR3 *pCnt, float radius)
 	return true;
 }
 
+// ===========================================================================================
+//
+void Scene::GetCameraFrustum(D3DXPLANE *pPlanes) const
+{
+	D3DXVECTOR3 n[4] = {
+		Camera.z * Camera.vw - Camera.x,
+		Camera.z * Camera.vw + Camera.x,
+		Camera.z * Camera.vh - Camera.y,
+		Camera.z * Camera.vh + Camera.y
+	};
+
+	for (int i = 0; i < 4; i++) {
+		D3DXVec3Normalize(&n[i], &n[i]);
+		pPlanes[i] = D3DXPLANE(n[i].x, n[i].y, n[i].z, 0.0f);
+	}
+
+	pPlanes[4] = D3DXPLANE(Camera.z.x, Camera.z.y, Camera.z.z, -Camera.nearplane);
+	pPlanes[5] = D3DXPLANE(-Camera.z.x, -Camera.z.y, -Camera.z.z, Camera.farplane);
+}
+
 // ===========================================================================================
 //
 bool Scene::CameraDirection2Viewport(const VECTOR3 &dir, int &x, int &y)
@@ -32,6 +32,7 @@ class D3D9ParticleStream;
 class CSphereManager;
 class D3D9Text;
 class D3D9Pad;
+class InstanceBuffer;
 
 #define GBUF_COLOR				0
 #define GBUF_BLUR				1
@@ -171,6 +172,20 @@ public:
 	const D3D9Light *GetLight(int index) const;
 	const D3D9Light *GetLights() const { return Lights; }
 	DWORD GetLightCount() const { return nLights; }
+	const class LightCluster *GetLightCluster() const { return pLightCluster; }
+
+	/**
+	 * \brief Collect local lights illuminating a bounding sphere, strongest first.
+	 * Uses the froxel cluster of the main scene when available and the scene light list otherwise.
+	 * \param pos Center of the bounding sphere in camera centric world frame
+	 * \param rad Radius of the bounding sphere
+	 * \param pList Output list, indices refer to *ppLights
+	 * \param nMax Size of the output list
+	 * \param ppLights Receives the light array the indices refer to
+	 * \param minIl Lights with illuminance up to this are skipped
+	 * \return Number of lights in pList
+	 */
+	int GetLocalLights(const D3DXVECTOR3 &pos, float rad, _LightList *pList, int nMax, const D3D9Light **ppLights, float minIl = 0.005f) const;
 
 
 	DWORD GetRenderPass() const;
@@ -226,6 +241,7 @@ public:
 	bool IntegrateIrradiance(vVessel *vV, LPDIRECT3DCUBETEXTURE9 pSrc, LPDIRECT3DTEXTURE9 pOut);
 	bool RenderBlurredMap(LPDIRECT3DDEVICE9 pDev, LPDIRECT3DCUBETEXTURE9 pSrc);
 	void RenderMesh(DEVMESHHANDLE hMesh, const oapi::FMATRIX4 *pWorld);
+	void RenderMesh(DEVMESHHANDLE hMesh, InstanceBuffer *pInst);
 
 	LPDIRECT3DSURFACE9 GetIrradianceDepthStencil() const { return pIrradDS; }
 	LPDIRECT3DSURFACE9 GetEnvDepthStencil() const { return pEnvDS; }
@@ -279,6 +295,12 @@ public:
 	TILEPICK		PickSurface(short xpos, short ypos);
 	D3D9Pick		PickMesh(DEVMESHHANDLE hMesh, const LPD3DXMATRIX pW, short xpos, short ypos);
 
+	/**
+	 * \brief Pick the nearest instance of a mesh
+	 * \param pIdx Receives the instance index, -1 if nothing was hit
+	 */
+	D3D9Pick		PickMesh(DEVMESHHANDLE hMesh, InstanceBuffer *pInst, short xpos, short ypos, int *pIdx);
+
 	void			ClearOmitFlags();
 	bool			IsRendering() const { return bRendering; }
 
@@ -317,6 +339,12 @@ public:
 
 					// Check if a sphere located in pCnt (relative to cam) with a specified radius is visible in a camera
 	bool			IsVisibleInCamera(D3DXVECTOR3 *pCnt, float radius);
+
+	/**
+	 * \brief Frustum planes of the current camera, normals pointing inside
+	 * \param pPlanes Array of 6 planes, sides first then near and far
+	 */
+	void			GetCameraFrustum(D3DXPLANE *pPlanes) const;
 	bool			IsProxyMesh();
 	bool            CameraDirection2Viewport(const VECTOR3 &dir, int &x, int &y);
 	double			GetTanAp() const { return tan(Camera.aperture); }
@@ -454,6 +482,7 @@ private:
 	CAMERA		Camera;
 	D3D9Light*	Lights;
 	D3D9Sun	    sunLight;
+	class LightCluster *pLightCluster;
 
 	VECTOR3		sky_color;
 
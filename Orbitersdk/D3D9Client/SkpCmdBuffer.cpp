@@ -0,0 +1,156 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "SkpCmdBuffer.h"
+#include "D3D9Pad.h"
+
+#define SKPCMD_NONE		0xFFFFFFFF
+
+// ===========================================================================================
+//
+SkpCmdBuffer::SkpCmdBuffer() :
+	nCommands(0),
+	nBatches(0),
+	nStateChanges(0)
+{
+	Cmds.reserve(SKPCMD_MAX);
+	Groups.reserve(SKPCMD_MAX);
+	Next.reserve(SKPCMD_MAX);
+}
+
+// ===========================================================================================
+//
+SkpCmdBuffer::~SkpCmdBuffer()
+{
+
+}
+
+// ===========================================================================================
+//
+SKPCMD *SkpCmdBuffer::Add()
+{
+	Cmds.resize(Cmds.size() + 1);
+	nCommands++;
+	return &Cmds.back();
+}
+
+// ===========================================================================================
+//
+void SkpCmdBuffer::Clear()
+{
+	Cmds.clear();
+}
+
+// ===========================================================================================
+//
+DWORD SkpCmdBuffer::Diff(const SKPSTATE &a, const SKPSTATE &b)
+{
+	DWORD d = 0;
+	if (memcmp(&a.Trans, &b.Trans, sizeof(a.Trans))) d |= SKPCHG_TRANSFORM | SKPCHG_CLIPCONE;
+	if (memcmp(&a.Pen, &b.Pen, sizeof(a.Pen))) d |= SKPCHG_PEN;
+	if (memcmp(&a.Effects, &b.Effects, sizeof(a.Effects))) d |= SKPCHG_EFFECTS;
+	if (memcmp(&a.Tex, &b.Tex, sizeof(a.Tex))) d |= SKPCHG_TEXTURE;
+	if (memcmp(&a.Scissor, &b.Scissor, sizeof(a.Scissor))) d |= SKPCHG_CLIPRECT;
+	if (a.hFont != b.hFont) d |= SKPCHG_FONT;
+	if (a.dwTopo != b.dwTopo) d |= SKPCHG_TOPOLOGY;
+	if (a.dwBlend != b.dwBlend) d |= SKPCHG_BLEND;
+	if (a.bDepth != b.bDepth) d |= SKPCHG_DEPTH;
+	return d;
+}
+
+// ===========================================================================================
+// FNV-1a over the state, used to reject unequal states before memcmp
+//
+DWORD SkpCmdBuffer::Hash(const SKPSTATE &s)
+{
+	const BYTE *p = (const BYTE *)&s;
+	DWORD h = 2166136261;
+	for (size_t i = 0; i < sizeof(SKPSTATE); i++) h = (h ^ p[i]) * 16777619;
+	return h;
+}
+
+// ===========================================================================================
+//
+bool SkpCmdBuffer::Overlap(const GROUP &g, const SKPCMD &c)
+{
+	return !(c.x1 < g.x0 || c.x0 > g.x1 || c.y1 < g.y0 || c.y0 > g.y1);
+}
+
+// ===========================================================================================
+//
+void SkpCmdBuffer::Replay(SkpBackend *pBE, const WORD *pIdx)
+{
+	DWORD nCmds = DWORD(Cmds.size());
+
+	if (nCmds == 0) return;
+
+	Groups.clear();
+	Next.assign(nCmds, SKPCMD_NONE);
+
+	// Merge each command into the latest group with an identical state, unless a group
+	// drawn in between overlaps it ---------------------------------------------------------
+	//
+	for (DWORD i = 0; i < nCmds; i++) {
+
+		SKPCMD &c = Cmds[i];
+		c.dwHash = Hash(c.State);
+
+		int target = -1;
+
+		for (int g = int(Groups.size()) - 1; g >= 0; g--) {
+			const SKPCMD &gc = Cmds[Groups[g].iCmd];
+			if (gc.dwHash == c.dwHash && memcmp(&gc.State, &c.State, sizeof(SKPSTATE)) == 0) {
+				target = g;
+				break;
+			}
+			if (Overlap(Groups[g], c)) break;
+		}
+
+		if (target >= 0) {
+			GROUP &g = Groups[target];
+			Next[g.iLast] = i;
+			g.iLast = i;
+			g.x0 = min(g.x0, c.x0);	g.y0 = min(g.y0, c.y0);
+			g.x1 = max(g.x1, c.x1);	g.y1 = max(g.y1, c.y1);
+		}
+		else {
+			GROUP g = { i, i, c.x0, c.y0, c.x1, c.y1 };
+			Groups.push_back(g);
+		}
+	}
+
+	// Play back the groups ----------------------------------------------------------------
+	//
+	const SKPSTATE *pPrev = NULL;
+
+	for (size_t g = 0; g < Groups.size(); g++) {
+
+		const SKPCMD &first = Cmds[Groups[g].iCmd];
+
+		DWORD dwChange = pPrev ? Diff(*pPrev, first.State) : SKPCHG_ALL;
+
+		if (dwChange) {
+			pBE->SetState(first.State, dwChange);
+			for (DWORD b = dwChange & SKPCHG_ALL; b; b &= b - 1) nStateChanges++;
+		}
+
+		pPrev = &first.State;
+
+		if (Next[Groups[g].iCmd] == SKPCMD_NONE) {
+			pBE->DrawIndexed(first.State.dwTopo, pIdx + first.iFirst, first.nIdx);
+		}
+		else {
+			Merged.clear();
+			for (DWORD k = Groups[g].iCmd; k != SKPCMD_NONE; k = Next[k]) {
+				Merged.insert(Merged.end(), pIdx + Cmds[k].iFirst, pIdx + Cmds[k].iFirst + Cmds[k].nIdx);
+			}
+			pBE->DrawIndexed(first.State.dwTopo, &Merged[0], DWORD(Merged.size()));
+		}
+
+		nBatches++;
+	}
+
+	Cmds.clear();
+}
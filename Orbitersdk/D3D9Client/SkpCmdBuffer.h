@@ -0,0 +1,155 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class SkpCmdBuffer (interface)
+//
+// Retained command buffer for Sketchpad drawing. A command is a
+// range in the Sketchpad index queue together with a snapshot of
+// the pipeline state it was recorded with and its bounding rectangle
+// in the render target. On replay commands sharing the same state
+// are merged into a single draw whenever the reordering is invisible
+// (no overlap with any command drawn in between), and the state
+// is applied to a backend one changed group at a time.
+// ==============================================================
+
+#ifndef __SKPCMDBUFFER_H
+#define __SKPCMDBUFFER_H
+
+#include "D3D9Util.h"
+#include <vector>
+
+#define SKPCMD_MAX			256		// Max number of commands before a forced replay
+
+// Sketchpad state groups, a group is applied as a whole on change
+//
+typedef struct {
+	D3DXMATRIX	mWVP, mVP, mW;
+	D3DXVECTOR4 vPos, vPos2, vCov;	// Clip cones
+	float		fov;
+	BOOL		bOrtho, bCovEn;
+} SKPSTATE_TRANSFORM;
+
+typedef struct {
+	D3DXCOLOR	cPen;
+	D3DXVECTOR4 vWidth;				// Width, pattern scale, pixel offset
+	BOOL		bDash;
+} SKPSTATE_PEN;
+
+typedef struct {
+	D3DXMATRIX	mColor;
+	D3DXVECTOR4 vNoise, vGamma;
+	BOOL		bEnable;
+} SKPSTATE_EFFECTS;
+
+typedef struct {
+	LPDIRECT3DTEXTURE9 hTex;
+	D3DXCOLOR	cKey;
+	D3DXVECTOR4 vSize;				// Inverse texture size
+	BOOL		bKey;
+} SKPSTATE_TEXTURE;
+
+typedef struct {
+	RECT		rect;
+	BOOL		bEnable;
+} SKPSTATE_SCISSOR;
+
+/**
+ * \brief Complete Sketchpad pipeline state. Must be memset to zero before filling,
+ * states are compared with memcmp.
+ */
+typedef struct {
+	SKPSTATE_TRANSFORM	Trans;		///< SKPCHG_TRANSFORM | SKPCHG_CLIPCONE
+	SKPSTATE_PEN		Pen;		///< SKPCHG_PEN
+	SKPSTATE_EFFECTS	Effects;	///< SKPCHG_EFFECTS
+	SKPSTATE_TEXTURE	Tex;		///< SKPCHG_TEXTURE
+	SKPSTATE_SCISSOR	Scissor;	///< SKPCHG_CLIPRECT
+	LPDIRECT3DTEXTURE9	hFont;		///< SKPCHG_FONT
+	DWORD				dwTopo;		///< SKPCHG_TOPOLOGY
+	DWORD				dwBlend;	///< SKPCHG_BLEND
+	BOOL				bDepth;		///< SKPCHG_DEPTH
+} SKPSTATE;
+
+/**
+ * \brief Recorded draw command
+ */
+typedef struct {
+	SKPSTATE	State;
+	DWORD		iFirst;				///< First entry in the index queue
+	DWORD		nIdx;				///< Number of indices
+	float		x0, y0, x1, y1;		///< Bounding rectangle in render target pixels
+	DWORD		dwHash;				///< State hash, computed by Replay()
+} SKPCMD;
+
+
+/**
+ * \brief Receives the replayed state changes and draws
+ */
+class SkpBackend
+{
+public:
+	/**
+	 * \brief Apply a state
+	 * \param dwChange SKPCHG_ flags of the state groups that differ from the previous call
+	 */
+	virtual void	SetState(const SKPSTATE &State, DWORD dwChange) = 0;
+	virtual void	DrawIndexed(DWORD dwTopo, const WORD *pIdx, DWORD nIdx) = 0;
+};
+
+
+class SkpCmdBuffer
+{
+
+public:
+
+	SkpCmdBuffer();
+	~SkpCmdBuffer();
+
+	/**
+	 * \brief Get a command slot to fill. SKPCMD_MAX is a soft limit, the caller
+	 * should replay the buffer once IsFull() returns true.
+	 */
+	SKPCMD *		Add();
+	bool			IsFull() const { return Cmds.size() >= SKPCMD_MAX; }
+	bool			IsEmpty() const { return Cmds.empty(); }
+
+	/**
+	 * \brief Merge the commands and play them back, clears the buffer
+	 * \param pBE Backend receiving the states and draws
+	 * \param pIdx Index queue the commands refer to
+	 */
+	void			Replay(SkpBackend *pBE, const WORD *pIdx);
+	void			Clear();
+
+	/**
+	 * \brief Compare states
+	 * \return SKPCHG_ flags of the groups that differ
+	 */
+	static DWORD	Diff(const SKPSTATE &a, const SKPSTATE &b);
+
+	void			ResetStats() { nCommands = nBatches = nStateChanges = 0; }
+
+	DWORD			nCommands;		///< Commands recorded since the statistics were reset
+	DWORD			nBatches;		///< Draws issued
+	DWORD			nStateChanges;	///< State groups applied
+
+private:
+
+	struct GROUP {
+		DWORD		iCmd;			// First command, defines the state
+		DWORD		iLast;			// Last command merged in
+		float		x0, y0, x1, y1;
+	};
+
+	static bool		Overlap(const GROUP &g, const SKPCMD &c);
+	static DWORD	Hash(const SKPSTATE &s);
+
+	std::vector<SKPCMD>	Cmds;
+	std::vector<GROUP>	Groups;
+	std::vector<DWORD>	Next;		// Linked list of commands merged in a group
+	std::vector<WORD>	Merged;
+};
+
+#endif // !__SKPCMDBUFFER_H
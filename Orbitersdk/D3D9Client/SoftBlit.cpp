@@ -0,0 +1,296 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "SoftBlit.h"
+#include <emmintrin.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#define SBLT_TOLERANCE	2		// Color key tolerance per channel, 0.01 in CKBlit.fx
+
+// ===========================================================================================
+//
+bool SoftBlit::IsSupported(D3DFORMAT fmt)
+{
+	switch (fmt) {
+		case D3DFMT_A8R8G8B8:
+		case D3DFMT_X8R8G8B8:
+		case D3DFMT_R5G6B5:
+		case D3DFMT_X1R5G5B5:
+		case D3DFMT_A1R5G5B5:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// ===========================================================================================
+//
+int SoftBlit::BytesPerPixel(D3DFORMAT fmt)
+{
+	return (fmt == D3DFMT_A8R8G8B8 || fmt == D3DFMT_X8R8G8B8) ? 4 : 2;
+}
+
+// ===========================================================================================
+// Expand to A8R8G8B8, low bits are filled by replicating the high bits
+//
+DWORD SoftBlit::ToARGB(const BYTE *p, D3DFORMAT fmt)
+{
+	switch (fmt) {
+
+		case D3DFMT_A8R8G8B8:
+			return *(const DWORD *)p;
+
+		case D3DFMT_X8R8G8B8:
+			return *(const DWORD *)p | 0xFF000000;
+
+		case D3DFMT_R5G6B5:
+		{
+			DWORD c = *(const WORD *)p;
+			DWORD r = (c >> 11) & 0x1F, g = (c >> 5) & 0x3F, b = c & 0x1F;
+			r = (r << 3) | (r >> 2); g = (g << 2) | (g >> 4); b = (b << 3) | (b >> 2);
+			return 0xFF000000 | (r << 16) | (g << 8) | b;
+		}
+
+		default:
+		{
+			DWORD c = *(const WORD *)p;
+			DWORD r = (c >> 10) & 0x1F, g = (c >> 5) & 0x1F, b = c & 0x1F;
+			r = (r << 3) | (r >> 2); g = (g << 3) | (g >> 2); b = (b << 3) | (b >> 2);
+			DWORD a = (fmt == D3DFMT_X1R5G5B5 || (c & 0x8000)) ? 0xFF000000 : 0;
+			return a | (r << 16) | (g << 8) | b;
+		}
+	}
+}
+
+// ===========================================================================================
+//
+void SoftBlit::FromARGB(BYTE *p, D3DFORMAT fmt, DWORD c)
+{
+	switch (fmt) {
+
+		case D3DFMT_A8R8G8B8:
+			*(DWORD *)p = c;
+			break;
+
+		case D3DFMT_X8R8G8B8:
+			*(DWORD *)p = c | 0xFF000000;
+			break;
+
+		case D3DFMT_R5G6B5:
+			*(WORD *)p = WORD(((c >> 8) & 0xF800) | ((c >> 5) & 0x07E0) | ((c >> 3) & 0x001F));
+			break;
+
+		default:
+		{
+			WORD a = (fmt == D3DFMT_X1R5G5B5 || (c & 0x80000000)) ? 0x8000 : 0;
+			*(WORD *)p = WORD(a | ((c >> 9) & 0x7C00) | ((c >> 6) & 0x03E0) | ((c >> 3) & 0x001F));
+			break;
+		}
+	}
+}
+
+// ===========================================================================================
+//
+DWORD SoftBlit::ReadPixel(const SBSURFACE &s, DWORD x, DWORD y)
+{
+	return ToARGB(s.pData + y * s.pitch + x * BytesPerPixel(s.fmt), s.fmt);
+}
+
+// ===========================================================================================
+//
+bool SoftBlit::IsKey(DWORD c, DWORD key)
+{
+	for (int sh = 0; sh < 24; sh += 8) {
+		int d = int((c >> sh) & 0xFF) - int((key >> sh) & 0xFF);
+		if (d > SBLT_TOLERANCE || d < -SBLT_TOLERANCE) return false;
+	}
+	return true;
+}
+
+// ===========================================================================================
+// Color keyed 32-bit row, four pixels at a time
+//
+void SoftBlit::CopyRow32Key(DWORD *pTgt, const DWORD *pSrc, DWORD n, DWORD key, DWORD alpha)
+{
+	const __m128i k = _mm_set1_epi32(int(key));
+	const __m128i tol = _mm_set1_epi8(SBLT_TOLERANCE);
+	const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i a = _mm_set1_epi32(int(alpha));
+	const __m128i zero = _mm_setzero_si128();
+
+	DWORD i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(pSrc + i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(pTgt + i));
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(s, k), _mm_subs_epu8(k, s));
+		__m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(_mm_subs_epu8(diff, tol), rgb), zero);
+		s = _mm_or_si128(s, a);
+		_mm_storeu_si128((__m128i *)(pTgt + i), _mm_or_si128(_mm_and_si128(keyed, d), _mm_andnot_si128(keyed, s)));
+	}
+
+	for (; i < n; i++) if (!IsKey(pSrc[i], key)) pTgt[i] = pSrc[i] | alpha;
+}
+
+// ===========================================================================================
+//
+bool SoftBlit::Copy(const SBSURFACE &tgt, const RECT &t, const SBSURFACE &src, const RECT &s, DWORD flags, DWORD key)
+{
+	if (!IsSupported(tgt.fmt) || !IsSupported(src.fmt)) return false;
+
+	if (s.left < 0 || s.top < 0 || s.right > long(src.width) || s.bottom > long(src.height)) return false;
+	if (t.left < 0 || t.top < 0 || t.right > long(tgt.width) || t.bottom > long(tgt.height)) return false;
+	if (s.left >= s.right || s.top >= s.bottom || t.left >= t.right || t.top >= t.bottom) return false;
+
+	DWORD sw = s.right - s.left, sh = s.bottom - s.top;
+	DWORD tw = t.right - t.left, th = t.bottom - t.top;
+	int sb = BytesPerPixel(src.fmt);
+	int tb = BytesPerPixel(tgt.fmt);
+
+	// Blit within a surface, stage the source rectangle -----------------------------------------
+	//
+	if (src.pData == tgt.pData) {
+		std::vector<BYTE> tmp(sw * sh * sb);
+		for (DWORD y = 0; y < sh; y++) memcpy(&tmp[y * sw * sb], src.pData + (s.top + y) * src.pitch + s.left * sb, sw * sb);
+		SBSURFACE st = { tmp.data(), int(sw * sb), sw, sh, src.fmt };
+		RECT rs = { 0, 0, long(sw), long(sh) };
+		return Copy(tgt, t, st, rs, flags, key);
+	}
+
+	bool bKey = (flags & SBLT_KEY) != 0;
+	DWORD alpha = (flags & SBLT_OPAQUE) ? 0xFF000000 : 0;
+
+	if (sw == tw && sh == th) {
+
+		// Plain row copy --------------------------------------------------------------------------
+		//
+		bool bAlpha = (tgt.fmt == D3DFMT_A8R8G8B8 || tgt.fmt == D3DFMT_A1R5G5B5);
+
+		if (src.fmt == tgt.fmt && !bKey && (alpha == 0 || !bAlpha)) {
+			for (DWORD y = 0; y < th; y++) {
+				memcpy(tgt.pData + (t.top + y) * tgt.pitch + t.left * tb, src.pData + (s.top + y) * src.pitch + s.left * sb, tw * tb);
+			}
+			return true;
+		}
+
+		// Color keyed 32-bit copy -----------------------------------------------------------------
+		//
+		if (bKey && sb == 4 && tb == 4) {
+			if (src.fmt == D3DFMT_X8R8G8B8 || tgt.fmt == D3DFMT_X8R8G8B8) alpha = 0xFF000000;
+			for (DWORD y = 0; y < th; y++) {
+				DWORD *pT = (DWORD *)(tgt.pData + (t.top + y) * tgt.pitch) + t.left;
+				const DWORD *pS = (const DWORD *)(src.pData + (s.top + y) * src.pitch) + s.left;
+				CopyRow32Key(pT, pS, tw, key, alpha);
+			}
+			return true;
+		}
+	}
+
+	// Generic path with conversion and stretching ---------------------------------------------------
+	//
+	bool bFilter = (flags & SBLT_FILTER) && (sw != tw || sh != th);
+
+	// Source columns and weights for each target column. Point sampling picks the source pixel
+	// containing the target pixel centre, the filter interpolates between neighbour centres.
+	//
+	std::vector<int> col0(tw), col1(tw), wcol(tw);
+
+	for (DWORD x = 0; x < tw; x++) {
+		if (bFilter) {
+			__int64 u = ((__int64(2 * x + 1) * sw) << 16) / (2 * tw) - 0x8000;
+			int i = int(u >> 16);
+			wcol[x] = int((u >> 8) & 0xFF);
+			col0[x] = s.left + max(0, min(int(sw) - 1, i));
+			col1[x] = s.left + max(0, min(int(sw) - 1, i + 1));
+		}
+		else {
+			col0[x] = col1[x] = s.left + int((__int64(2 * x + 1) * sw) / (2 * tw));
+			wcol[x] = 0;
+		}
+	}
+
+	for (DWORD y = 0; y < th; y++) {
+
+		int r0, r1, wrow;
+
+		if (bFilter) {
+			__int64 v = ((__int64(2 * y + 1) * sh) << 16) / (2 * th) - 0x8000;
+			int j = int(v >> 16);
+			wrow = int((v >> 8) & 0xFF);
+			r0 = s.top + max(0, min(int(sh) - 1, j));
+			r1 = s.top + max(0, min(int(sh) - 1, j + 1));
+		}
+		else {
+			r0 = r1 = s.top + int((__int64(2 * y + 1) * sh) / (2 * th));
+			wrow = 0;
+		}
+
+		const BYTE *pS0 = src.pData + r0 * src.pitch;
+		const BYTE *pS1 = src.pData + r1 * src.pitch;
+		BYTE *pT = tgt.pData + (t.top + y) * tgt.pitch + t.left * tb;
+
+		for (DWORD x = 0; x < tw; x++, pT += tb) {
+
+			DWORD c;
+
+			if (bFilter) {
+				DWORD c00 = ToARGB(pS0 + col0[x] * sb, src.fmt), c01 = ToARGB(pS0 + col1[x] * sb, src.fmt);
+				DWORD c10 = ToARGB(pS1 + col0[x] * sb, src.fmt), c11 = ToARGB(pS1 + col1[x] * sb, src.fmt);
+				int wx = wcol[x];
+				c = 0;
+				for (int sh8 = 0; sh8 < 32; sh8 += 8) {
+					int a = ((c00 >> sh8) & 0xFF) * (256 - wx) + ((c01 >> sh8) & 0xFF) * wx;
+					int b = ((c10 >> sh8) & 0xFF) * (256 - wx) + ((c11 >> sh8) & 0xFF) * wx;
+					int v = (a * (256 - wrow) + b * wrow + 0x8000) >> 16;
+					c |= DWORD(min(255, v)) << sh8;
+				}
+			}
+			else c = ToARGB(pS0 + col0[x] * sb, src.fmt);
+
+			if (bKey && IsKey(c, key)) continue;
+
+			FromARGB(pT, tgt.fmt, c | alpha);
+		}
+	}
+
+	return true;
+}
+
+// ===========================================================================================
+//
+bool SoftBlit::Fill(const SBSURFACE &tgt, const RECT *r, DWORD color)
+{
+	if (!IsSupported(tgt.fmt)) return false;
+
+	RECT rf = { 0, 0, long(tgt.width), long(tgt.height) };
+	if (r) rf = *r;
+
+	if (rf.left < 0 || rf.top < 0 || rf.right > long(tgt.width) || rf.bottom > long(tgt.height)) return false;
+	if (rf.left >= rf.right || rf.top >= rf.bottom) return true;
+
+	int tb = BytesPerPixel(tgt.fmt);
+	DWORD w = rf.right - rf.left;
+
+	// Fill the first row, replicate it to the rest --------------------------------------------------
+	//
+	BYTE *pFirst = tgt.pData + rf.top * tgt.pitch + rf.left * tb;
+
+	if (tb == 4) {
+		DWORD c;
+		FromARGB((BYTE *)&c, tgt.fmt, color);
+		std::fill_n((DWORD *)pFirst, w, c);
+	}
+	else {
+		WORD c;
+		FromARGB((BYTE *)&c, tgt.fmt, color);
+		std::fill_n((WORD *)pFirst, w, c);
+	}
+
+	for (long y = rf.top + 1; y < rf.bottom; y++) memcpy(tgt.pData + y * tgt.pitch + rf.left * tb, pFirst, w * tb);
+
+	return true;
+}
@@ -0,0 +1,80 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class SoftBlit (interface)
+//
+// Software implementation of the D3D9ClientSurface blitting rules
+// over locked memory surfaces. Used for blits between system memory
+// surfaces which have no GPU path, and as a reference for the GPU
+// techniques:
+//
+// - Color key (SBLT_KEY) discards a source pixel if each of its RGB
+//   channels is within 2/255 of the key, as BlitTech/FlushTech in
+//   CKBlit.fx do.
+// - Unfiltered stretch samples the source at target pixel centres
+//   (point filtering), SBLT_FILTER samples bilinearly like
+//   StretchRect(D3DTEXF_LINEAR), clamped to the source rectangle.
+// - Conversion between the supported formats goes through A8R8G8B8.
+// ==============================================================
+
+#ifndef __SOFTBLIT_H
+#define __SOFTBLIT_H
+
+#include <d3d9.h>
+
+#define SBLT_KEY		0x0001		// Discard pixels matching the color key
+#define SBLT_OPAQUE		0x0002		// Write alpha as one (BlitTech)
+#define SBLT_FILTER		0x0004		// Bilinear filtering when stretching
+
+/**
+ * \brief Locked memory surface
+ */
+typedef struct {
+	BYTE *		pData;		///< First pixel of the first row
+	int			pitch;		///< Row pitch in bytes
+	DWORD		width;
+	DWORD		height;
+	D3DFORMAT	fmt;
+} SBSURFACE;
+
+
+class SoftBlit
+{
+
+public:
+
+	/**
+	 * \brief Check if the blitter can read and write a format
+	 */
+	static bool		IsSupported(D3DFORMAT fmt);
+
+	/**
+	 * \brief Copy a rectangle. Rectangles must be within the surfaces,
+	 * the source and target may be the same surface.
+	 * \param flags Combination of SBLT_ flags
+	 * \param key Color key in A8R8G8B8, used with SBLT_KEY
+	 * \return false if a format is not supported or a rectangle is invalid
+	 */
+	static bool		Copy(const SBSURFACE &tgt, const RECT &t, const SBSURFACE &src, const RECT &s, DWORD flags = 0, DWORD key = 0);
+
+	/**
+	 * \brief Fill a rectangle with an A8R8G8B8 color, converted to the target format
+	 * \param r Rectangle or NULL for the whole surface
+	 */
+	static bool		Fill(const SBSURFACE &tgt, const RECT *r, DWORD color);
+
+	static DWORD	ReadPixel(const SBSURFACE &s, DWORD x, DWORD y);
+
+private:
+
+	static DWORD	ToARGB(const BYTE *p, D3DFORMAT fmt);
+	static void		FromARGB(BYTE *p, D3DFORMAT fmt, DWORD c);
+	static int		BytesPerPixel(D3DFORMAT fmt);
+	static bool		IsKey(DWORD c, DWORD key);
+	static void		CopyRow32Key(DWORD *pTgt, const DWORD *pSrc, DWORD n, DWORD key, DWORD alpha);
+};
+
+#endif // !__SOFTBLIT_H
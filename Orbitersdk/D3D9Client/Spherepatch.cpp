@@ -70,12 +70,15 @@ void VBMESH::ComputeSphere()
 }
 
 
-void VBMESH::MapVertices(LPDIRECT3DDEVICE9 pDev, DWORD MemFlag)
+bool VBMESH::MapVertices(LPDIRECT3DDEVICE9 pDev, DWORD Flags)
 {
-	if (nv!=nv_cur && vtx) {
+	bool bDefer = (Flags & VBM_DEFER) != 0;
+
+	// A pooled buffer can be larger than requested
+	if ((nv>nv_cur || !pVB) && vtx) {
 		// Resize Vertex Buffer
 		if (pMgr) {
-			nv_cur = pMgr->RecycleVertexBuffer(nv, &pVB);
+			nv_cur = pMgr->RecycleVertexBuffer(nv, &pVB, bDefer);
 		} else {
 			SAFE_RELEASE(pVB);
 			HR(pDev->CreateVertexBuffer(nv*sizeof(VERTEX_2TEX), D3DUSAGE_DYNAMIC|D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &pVB, NULL));
@@ -83,10 +86,10 @@ void VBMESH::MapVertices(LPDIRECT3DDEVICE9 pDev, DWORD MemFlag)
 		}
 	}
 
-	if (nf!=nf_cur && idx) {
+	if ((nf>nf_cur || !pIB) && idx) {
 		// Resize Index Buffer
 		if (pMgr) {
-			nf_cur = pMgr->RecycleIndexBuffer(nf, &pIB);
+			nf_cur = pMgr->RecycleIndexBuffer(nf, &pIB, bDefer);
 		} else {
 			SAFE_RELEASE(pIB);
 			HR(pDev->CreateIndexBuffer(nf*sizeof(WORD)*3, D3DUSAGE_DYNAMIC|D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &pIB, NULL));
@@ -94,6 +97,9 @@ void VBMESH::MapVertices(LPDIRECT3DDEVICE9 pDev, DWORD MemFlag)
 		}
 	}
 
+	// The pool has run out of new buffers for this frame, the caller retries later
+	if (bDefer && !IsMapped()) return false;
+
 	VERTEX_2TEX *pVBuffer;
 	WORD *pIBuffer;
 
@@ -121,6 +127,27 @@ void VBMESH::MapVertices(LPDIRECT3DDEVICE9 pDev, DWORD MemFlag)
 			}
 		} else LogErr("Failed to create index buffer");
 	}
+
+	return IsMapped();
+}
+
+void VBMESH::UpdateVertices(LPDIRECT3DDEVICE9 pDev)
+{
+	if (!vtx) return;
+	if (!pVB || nv > nv_cur) {
+		MapVertices(pDev);
+		return;
+	}
+
+	HR(D3DXComputeBoundingSphere((const D3DXVECTOR3 *)&vtx->x, nv, sizeof(VERTEX_2TEX), &bsCnt, &bsRad));
+
+	VERTEX_2TEX *pVBuffer;
+	double time = D3D9GetTime();
+	if (HROK(pVB->Lock(0, 0, (LPVOID*)&pVBuffer, D3DLOCK_DISCARD))) {
+		D3D9SetTime(D3D9Stats.Timer.LockWait, time);
+		memcpy(pVBuffer, vtx, nv*sizeof(VERTEX_2TEX));
+		pVB->Unlock();
+	}
 }
 
 
@@ -15,14 +15,18 @@
 #include "D3D9Client.h"
 #include "D3D9Util.h"
 
+#define VBM_DEFER	0x1		// MapVertices: the tile buffer pool may defer the buffers to a later frame
+
 struct VBMESH {
 
 	explicit VBMESH(class TileManager2Base *pMgr);
 	VBMESH();
 	~VBMESH();
 
-	void MapVertices (LPDIRECT3DDEVICE9 dev, DWORD MemFlag=0); // copy vertices from vtx to vb
+	bool MapVertices (LPDIRECT3DDEVICE9 dev, DWORD Flags=0); // copy vertices from vtx to vb, false if the buffers were deferred (VBM_DEFER)
+	void UpdateVertices (LPDIRECT3DDEVICE9 dev); // copy modified vertices of a mapped mesh, the indices are left alone
 	void ComputeSphere();
+	inline bool IsMapped() const { return (pVB || !vtx) && (pIB || !idx); }
 
 	LPDIRECT3DVERTEXBUFFER9 pVB;	// mesh vertex buffer
 	LPDIRECT3DINDEXBUFFER9  pIB;	// mesh index buffer
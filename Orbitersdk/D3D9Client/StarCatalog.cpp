@@ -0,0 +1,79 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "StarCatalog.h"
+#include "Log.h"
+
+// ===========================================================================================
+//
+StarCatalog::StarCatalog() :
+	hFile(INVALID_HANDLE_VALUE),
+	hMap(NULL),
+	pData(NULL),
+	nStars(0)
+{
+}
+
+// ===========================================================================================
+//
+StarCatalog::~StarCatalog()
+{
+	Close();
+}
+
+// ===========================================================================================
+//
+bool StarCatalog::Open(const char *file)
+{
+	Close();
+
+	hFile = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart < LONGLONG(sizeof(STARREC))) {
+		Close();
+		return false;
+	}
+
+	if (size.QuadPart % sizeof(STARREC)) LogWrn("StarCatalog: Size of [%s] is not a multiple of the record size", file);
+
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap == NULL) {
+		Close();
+		return false;
+	}
+
+	pData = (const STARREC *)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (pData == NULL) {
+		Close();
+		return false;
+	}
+
+	nStars = DWORD(size.QuadPart / sizeof(STARREC));
+
+	LogAlw("StarCatalog: %u stars mapped from [%s]", nStars, file);
+	return true;
+}
+
+// ===========================================================================================
+//
+void StarCatalog::Close()
+{
+	if (pData) UnmapViewOfFile(pData);
+	if (hMap) CloseHandle(hMap);
+	if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+	pData = NULL;
+	hMap = NULL;
+	hFile = INVALID_HANDLE_VALUE;
+	nStars = 0;
+}
+
+// ===========================================================================================
+//
+DWORD StarCatalog::Count(float maglimit) const
+{
+	return Partition([maglimit](const STARREC &rec) { return rec.mag <= maglimit; });
+}
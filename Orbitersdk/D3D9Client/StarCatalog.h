@@ -0,0 +1,74 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class StarCatalog (interface)
+//
+// Read-only access to the background star data base (Star.bin).
+// The file is memory mapped and the records are expected to be
+// sorted by apparent magnitude (brightest first), which allows
+// magnitude limits to be resolved with a binary search.
+// ==============================================================
+
+#ifndef __STARCATALOG_H
+#define __STARCATALOG_H
+
+#include "D3D9Util.h"
+
+/**
+ * \brief Star record as stored in Star.bin
+ */
+typedef struct {
+	float lng, lat, mag;
+} STARREC;
+
+
+class StarCatalog
+{
+
+public:
+
+	StarCatalog();
+	~StarCatalog();
+
+	/**
+	 * \brief Map a star data base file
+	 * \param file Name of the binary star file
+	 * \return false if the file couldn't be opened or it's not a valid star file
+	 */
+	bool			Open(const char *file);
+	void			Close();
+
+	const STARREC *	Data() const { return pData; }
+	DWORD			Count() const { return nStars; }
+
+	/**
+	 * \brief Number of stars brighter or equal to the given magnitude, O(log n)
+	 */
+	DWORD			Count(float maglimit) const;
+
+	/**
+	 * \brief Find the number of leading records for which pred(record) holds.
+	 * The predicate must be monotonic in magnitude (true for bright stars, false for dim ones).
+	 */
+	template <class Pred> DWORD Partition(Pred pred) const
+	{
+		DWORD lo = 0, hi = nStars;
+		while (lo < hi) {
+			DWORD mid = (lo + hi) >> 1;
+			if (pred(pData[mid])) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo;
+	}
+
+private:
+
+	HANDLE			hFile, hMap;
+	const STARREC *	pData;
+	DWORD			nStars;
+};
+
+#endif // !__STARCATALOG_H
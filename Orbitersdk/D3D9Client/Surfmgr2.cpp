@@ -22,31 +22,14 @@
 #include "VectorHelpers.h"
 #include "DebugControls.h"
 #include "gcConst.h"
+#include "TileStitch.h"
+#include "CloudMap.h"
 
 // =======================================================================
 extern void FilterElevationGraphics(OBJHANDLE hPlanet, int lvl, int ilat, int ilng, float *elev);
 
 
 
-// =======================================================================
-// Utility functions
-
-static void VtxInterpolate (VERTEX_2TEX &res, const VERTEX_2TEX &a, const VERTEX_2TEX &b, double w)
-{
-	float w1 = (float)w;
-	float w0 = 1.0f-w1;
-	res.x = a.x*w0 + b.x*w1;
-	res.y = a.y*w0 + b.y*w1;
-	res.z = a.z*w0 + b.z*w1;
-	res.nx = a.nx*w0 + b.nx*w1;
-	res.ny = a.ny*w0 + b.ny*w1;
-	res.nz = a.nz*w0 + b.nz*w1;
-}
-
-
-int compare_lights(const void * a, const void * b);
-
-
 // =======================================================================
 // =======================================================================
 
@@ -794,6 +777,11 @@ void SurfTile::Render ()
 		has_lights = (render_lights && ltex && sdist > 1.35);
 	}
 
+	// No cloud shadow lookups under a clear sky
+	if (has_shadows && vPlanet->GetCloudMap()) {
+		if (vPlanet->GetCloudMap()->MaxDensity(bnd.minlat, bnd.maxlat, bnd.minlng, bnd.maxlng) == 0.0f) has_shadows = false;
+	}
+
 	if (vPlanet->CameraAltitude()>20e3) has_ripples = false;
 
 	double ca = 1.0 + saturate(vPlanet->CameraAltitude() / 150e3) * Config->OrbitalShadowMult;
@@ -969,43 +957,23 @@ void SurfTile::Render ()
 	// Setup local light sources
 	//---------------------------------------------------------------------
 
-	const D3D9Light *pLights = scene->GetLights();
-	int nSceneLights = scene->GetLightCount();
-
 	LightStruct Locals[4];
 
 	HR(Shader->SetBool(TileManager2Base::sbLocals, false));
 
+	// Find N most effective local lights effecting this mesh ---------------------------------
+	//
+	const D3D9Light *pLights = NULL;
+	_LightList LightList[4];
 
-	if (pLights && nSceneLights>0) {
-
-		int nMeshLights = 0;
-
-		_LightList LightList[MAX_SCENE_LIGHTS];
-
-		// Find all local lights effecting this mesh ------------------------------------------
-		//
-		for (int i = 0; i < nSceneLights; i++) {
-			float il = pLights[i].GetIlluminance(bs_pos, mesh->bsRad);
-			if (il > 0.005f) {
-				LightList[nMeshLights].illuminace = il;
-				LightList[nMeshLights++].idx = i;
-			}
-		}
-
-		if (nMeshLights > 0) {
-
-			// If any, Sort the list based on illuminance -------------------------------------------
-			qsort(LightList, nMeshLights, sizeof(_LightList), compare_lights);
+	int nMeshLights = scene->GetLocalLights(bs_pos, mesh->bsRad, LightList, 4, &pLights);
 
-			nMeshLights = min(nMeshLights, 4);
+	if (nMeshLights > 0) {
 
-			// Create a list of N most effective lights ---------------------------------------------
-			for (int i = 0; i < nMeshLights; i++) memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
+		for (int i = 0; i < nMeshLights; i++) memcpy(&Locals[i], &pLights[LightList[i].idx], sizeof(LightStruct));
 
-			HR(Shader->SetBool(TileManager2Base::sbLocals, true));
-			HR(Shader->SetValue(TileManager2Base::ssLight, &Locals, sizeof(Locals)));
-		}
+		HR(Shader->SetBool(TileManager2Base::sbLocals, true));
+		HR(Shader->SetValue(TileManager2Base::ssLight, &Locals, sizeof(Locals)));
 	}
 
 	/*
@@ -1068,11 +1036,14 @@ void SurfTile::MatchEdges ()
 {
 	if (edgeok) return; // done already
 	edgeok = true;
-	if (!mesh) return;  // sanity check
+	if (!mesh || !node) return;  // sanity check
 
-	QuadTreeNode<SurfTile> *lngnbr = smgr->FindNode (lvl, ilat, ilng + (ilng & 1 ? 1 : -1));
-	QuadTreeNode<SurfTile> *latnbr = smgr->FindNode (lvl, ilat + (ilat & 1 ? 1 : -1), ilng);
-	QuadTreeNode<SurfTile> *dianbr = smgr->FindNode (lvl, ilat + (ilat & 1 ? 1 : -1), ilng + (ilng & 1 ? 1 : -1));
+	// neighbour links are refreshed by TileManager2Base::LinkTree() every frame
+	int dlat = (ilat & 1 ? 1 : -1);
+	int dlng = (ilng & 1 ? 1 : -1);
+	QuadTreeNode<SurfTile> *lngnbr = node->Neighbour (QTNBR(0, dlng));
+	QuadTreeNode<SurfTile> *latnbr = node->Neighbour (QTNBR(dlat, 0));
+	QuadTreeNode<SurfTile> *dianbr = node->Neighbour (QTNBR(dlat, dlng));
 
 	if (lngnbr && !(lngnbr->Entry()->state & TILE_VALID)) lngnbr = 0;
 	if (latnbr && !(latnbr->Entry()->state & TILE_VALID)) latnbr = 0;
@@ -1114,10 +1085,11 @@ void SurfTile::MatchEdges ()
 			FixLongitudeBoundary (lngnbr ? lngnbr->Entry() : 0);
 			FixLatitudeBoundary (latnbr ? latnbr->Entry() : 0, true);
 		}
-		mesh->MapVertices(mgr->Dev()); // copy the updated vertices to the vertex buffer
+		mesh->UpdateVertices(mgr->Dev()); // copy the updated vertices to the vertex buffer
 		lngnbr_lvl = new_lngnbr_lvl;
 		latnbr_lvl = new_latnbr_lvl;
 		dianbr_lvl = new_dianbr_lvl;
+		D3D9Stats.Surf.Stitched++;
 	}
 }
 
@@ -1141,11 +1113,7 @@ void SurfTile::FixCorner (const SurfTile *nbr)
 		float corner_elev = elev[TILE_ELEVSTRIDE+1 + (ilat & 1 ? 0 : TILE_ELEVSTRIDE*res) + (ilng & 1 ? res : 0)];
 		float nbr_corner_elev = nbr_elev[TILE_ELEVSTRIDE+1 + (ilat & 1 ? TILE_ELEVSTRIDE*res : 0) + (ilng & 1 ? 0 : res)];
 
-		double rad = mgr->CbodySize();
-		double radfac = (rad+nbr_corner_elev)/(rad+corner_elev);
-		mesh->vtx[vtx_idx].x = (float)(vtx_store.x*radfac + vtxshift.x*(radfac-1.0));
-		mesh->vtx[vtx_idx].y = (float)(vtx_store.y*radfac + vtxshift.y*(radfac-1.0));
-		mesh->vtx[vtx_idx].z = (float)(vtx_store.z*radfac + vtxshift.z*(radfac-1.0));
+		StitchNode (mesh->vtx[vtx_idx], vtx_store, corner_elev, nbr_corner_elev, mgr->CbodySize(), vtxshift);
 	}
 }
 
@@ -1154,21 +1122,22 @@ void SurfTile::FixCorner (const SurfTile *nbr)
 void SurfTile::FixLongitudeBoundary (const SurfTile *nbr, bool keep_corner)
 {
 	// Fix the left or right edge
-	int i, i0, i1, j, vtx_ofs, nbrlvl, dlvl;
+	int i0, i1, nbrlvl, dlvl;
 	int res = mgr->GridRes();
-	VERTEX_2TEX *vtx_store;
 
-	vtx_ofs = (ilng & 1 ? res : 0); // check if neighbour is at left or right edge
+	int vtx_ofs = (ilng & 1 ? res : 0); // check if neighbour is at left or right edge
 	if (nbr && nbr->mesh && nbr->mesh->vtx) {
 		nbrlvl = min(nbr->lvl, lvl); // we don't need to worry about neigbour levels higher than ours
-		vtx_store = mesh->vtx + mesh->nv;
+		STITCHEDGE e;
+		e.pEdge = mesh->vtx + vtx_ofs;
+		e.vstep = res+1;
+		e.pStore = mesh->vtx + mesh->nv;
 		if (nbrlvl == lvl) { // put my own edge back
 			i0 = 0;
 			i1 = res;
 			if (keep_corner)
 				if (ilat & 1) i0++; else i1--;
-			for (i = i0; i <= i1; i++)
-				mesh->vtx[vtx_ofs+i*(res+1)] = vtx_store[i];
+			StitchRestore (e, i0, i1);
 		} else {  // interpolate to neighbour's left edge
 			dlvl = lvl-nbrlvl;
 			int nsub = 1 << dlvl; // number of tiles fitting alongside the lowres neighbour
@@ -1176,30 +1145,21 @@ void SurfTile::FixLongitudeBoundary (const SurfTile *nbr, bool keep_corner)
 				float *elev = ElevationData();
 				float *nbr_elev = nbr->ElevationData();
 				if (elev && nbr_elev) {
-					elev += TILE_ELEVSTRIDE+1 + vtx_ofs; // add offset
-					int nsub = 1 << dlvl;    // number of tiles fitting alongside the lowres neighbour
-					int vtx_skip = nsub*(res+1);  // interleave factor for nodes attaching to neigbour nodes
 					int nbr_range = res/nsub; // number of neighbour vertices attaching to us - 1
-					int subidxmask = (1<<dlvl)-1;
+					int subidxmask = nsub-1;
 					int subidx = ilat & subidxmask;
 					int nbr_ofs = (subidxmask-subidx) * nbr_range * TILE_ELEVSTRIDE;
-					nbr_elev += TILE_ELEVSTRIDE+1 + nbr_ofs + (res-vtx_ofs);
-					double rad = mgr->CbodySize();
+					e.pElev = elev + TILE_ELEVSTRIDE+1 + vtx_ofs;
+					e.pNbrElev = nbr_elev + TILE_ELEVSTRIDE+1 + nbr_ofs + (res-vtx_ofs);
+					e.estep = TILE_ELEVSTRIDE;
+					e.rad = mgr->CbodySize();
+					e.shift = vtxshift;
 					// match nodes to neighbour elevations
 					i0 = 0;
 					i1 = nbr_range;
 					if (keep_corner)
 						if (ilat & 1) i0++; else i1--;
-					for (i = i0; i <= i1; i++) {
-						double radfac = (rad+nbr_elev[i*TILE_ELEVSTRIDE])/(rad+elev[i*TILE_ELEVSTRIDE*nsub]);
-						mesh->vtx[vtx_ofs+i*vtx_skip].x = (float)(vtx_store[i*nsub].x*radfac + vtxshift.x*(radfac-1.0));
-						mesh->vtx[vtx_ofs+i*vtx_skip].y = (float)(vtx_store[i*nsub].y*radfac + vtxshift.y*(radfac-1.0));
-						mesh->vtx[vtx_ofs+i*vtx_skip].z = (float)(vtx_store[i*nsub].z*radfac + vtxshift.z*(radfac-1.0));
-					}
-					// interpolate the nodes that fall between neighbour nodes
-					for (i = 0; i < nbr_range; i++)
-						for (j = 1; j < nsub; j++)
-							VtxInterpolate (mesh->vtx[vtx_ofs+j*(res+1)+i*vtx_skip], mesh->vtx[vtx_ofs+i*vtx_skip], mesh->vtx[vtx_ofs+(i+1)*vtx_skip], (double)j/double(nsub));
+					StitchEdge (e, nsub, nbr_range, i0, i1);
 				}
 			} else {
 				// problems
@@ -1213,22 +1173,23 @@ void SurfTile::FixLongitudeBoundary (const SurfTile *nbr, bool keep_corner)
 void SurfTile::FixLatitudeBoundary (const SurfTile *nbr, bool keep_corner)
 {
 	// Fix the top or bottom edge
-	int i, i0, i1, j, nbrlvl, dlvl;
+	int i0, i1, nbrlvl, dlvl;
 	int res = mgr->GridRes();
-	VERTEX_2TEX *vtx_store;
 
 	int line = (ilat & 1 ? 0 : res);
 	int vtx_ofs = (ilat & 1 ? 0 : line*(res+1));
 	if (nbr && nbr->mesh && nbr->mesh->vtx) {
 		nbrlvl = min(nbr->lvl, lvl); // we don't need to worry about neigbour levels higher than ours
-		vtx_store = mesh->vtx + mesh->nv + res + 1;
+		STITCHEDGE e;
+		e.pEdge = mesh->vtx + vtx_ofs;
+		e.vstep = 1;
+		e.pStore = mesh->vtx + mesh->nv + res + 1;
 		if (nbrlvl == lvl) { // put my own edge back
 			i0 = 0;
 			i1 = res;
 			if (keep_corner)
 				if (ilng & 1) i1--; else i0++;
-			for (i = i0; i <= i1; i++)
-				mesh->vtx[vtx_ofs+i] = vtx_store[i];
+			StitchRestore (e, i0, i1);
 		} else {
 			dlvl = lvl-nbrlvl;
 			int nsub = 1 << dlvl; // number of tiles fitting alongside the lowres neighbour
@@ -1236,30 +1197,21 @@ void SurfTile::FixLatitudeBoundary (const SurfTile *nbr, bool keep_corner)
 				float *elev = ElevationData();
 				float *nbr_elev = nbr->ElevationData();
 				if (elev && nbr_elev) {
-					elev += (line+1)*TILE_ELEVSTRIDE + 1; // add offset
-					int nsub = 1 << dlvl;    // number of tiles fitting alongside the lowres neighbour
-					int vtx_skip = nsub;     // interleave factor for nodes attaching to neigbour nodes
 					int nbr_range = res/nsub; // number of neighbour vertices attaching to us - 1
-					int subidxmask = (1<<dlvl)-1;
+					int subidxmask = nsub-1;
 					int subidx = ilng & subidxmask;
 					int nbr_ofs = subidx * nbr_range;
-					nbr_elev += TILE_ELEVSTRIDE+1 + nbr_ofs + (res-line)*TILE_ELEVSTRIDE;
-					double rad = mgr->CbodySize();
+					e.pElev = elev + (line+1)*TILE_ELEVSTRIDE + 1;
+					e.pNbrElev = nbr_elev + TILE_ELEVSTRIDE+1 + nbr_ofs + (res-line)*TILE_ELEVSTRIDE;
+					e.estep = 1;
+					e.rad = mgr->CbodySize();
+					e.shift = vtxshift;
 					// match nodes to neighbour elevations
 					i0 = 0;
 					i1 = nbr_range;
 					if (keep_corner)
 						if (ilng & 1) i1--; else i0++;
-					for (i = i0; i <= i1; i++) {
-						double radfac = (rad+nbr_elev[i])/(rad+elev[i*nsub]);
-						mesh->vtx[vtx_ofs+i*vtx_skip].x = (float)(vtx_store[i*nsub].x*radfac + vtxshift.x*(radfac-1.0));
-						mesh->vtx[vtx_ofs+i*vtx_skip].y = (float)(vtx_store[i*nsub].y*radfac + vtxshift.y*(radfac-1.0));
-						mesh->vtx[vtx_ofs+i*vtx_skip].z = (float)(vtx_store[i*nsub].z*radfac + vtxshift.z*(radfac-1.0));
-					}
-					// interpolate the nodes that fall between neighbour nodes
-					for (i = 0; i < nbr_range; i++)
-						for (j = 1; j < nsub; j++)
-							VtxInterpolate (mesh->vtx[vtx_ofs+i*vtx_skip+j], mesh->vtx[vtx_ofs+i*vtx_skip], mesh->vtx[vtx_ofs+(i+1)*vtx_skip], (double)j/double(nsub));
+					StitchEdge (e, nsub, nbr_range, i0, i1);
 				}
 			} else {
 				// problems
@@ -1388,6 +1340,8 @@ void TileManager2<SurfTile>::Render (MATRIX4 &dwmat, bool use_zbuf, const vPlane
 	for (i = 0; i < 2; i++)
 		ProcessNode (tiletree+i);
 
+	LinkTree (tiletree);
+
 	vp->tile_cache = NULL;
 
 	if (scene->GetRenderPass() == RENDERPASS_MAINSCENE) ResetMinMaxElev();
@@ -0,0 +1,321 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "TextureStreamer.h"
+#include "D3D9Surface.h"
+#include "D3D9Pad.h"
+#include "D3D9Config.h"
+#include "Profiler.h"
+#include "Log.h"
+
+LPDIRECT3DDEVICE9 TextureStreamer::pDev = NULL;
+MipResidency * TextureStreamer::pPolicy = NULL;
+std::deque<TextureStreamer::JOB> TextureStreamer::Queue;
+std::deque<TextureStreamer::JOB> TextureStreamer::Done;
+CRITICAL_SECTION TextureStreamer::cs;
+HANDLE TextureStreamer::hThread = NULL;
+HANDLE TextureStreamer::hWake = NULL;
+volatile bool TextureStreamer::bExit = false;
+
+// ===========================================================================================
+//
+void TextureStreamer::GlobalInit(oapi::D3D9Client *gc)
+{
+	if (Config->TexStreamBudget == 0) {
+		LogAlw("Texture streaming disabled");
+		return;
+	}
+
+	pDev = gc->GetDevice();
+	pPolicy = new MipResidency(size_t(Config->TexStreamBudget) << 20, TSTREAM_MAXLOADS, TSTREAM_BIAS, TSTREAM_HOLD);
+
+	InitializeCriticalSection(&cs);
+	bExit = false;
+	hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hThread = CreateThread(NULL, 32768, LoadProc, NULL, 0, NULL);
+
+	LogAlw("Texture streaming: budget %d MB, textures of %d pixels and up", Config->TexStreamBudget, Config->TexStreamMinSize);
+}
+
+// ===========================================================================================
+//
+void TextureStreamer::GlobalExit()
+{
+	if (!pPolicy) return;
+
+	bExit = true;
+	SetEvent(hWake);
+	WaitForSingleObject(hThread, INFINITE);
+	CloseHandle(hThread);
+	CloseHandle(hWake);
+	hThread = hWake = NULL;
+
+	for (size_t i = 0; i < Done.size(); i++) SAFE_RELEASE(Done[i].pTex);
+	Done.clear();
+	Queue.clear();
+
+	MipResidency::STATS s = pPolicy->GetStats(false);
+	LogAlw("Texture streaming: %u textures (%u MB) at exit", s.Textures, DWORD(s.Bytes >> 20));
+
+	// Surfaces still alive keep their current texture
+	const std::vector<MIPTEX *> &list = pPolicy->GetTextures();
+	for (size_t i = 0; i < list.size(); i++) {
+		STREAMTEX *pStream = (STREAMTEX *)list[i]->pUser;
+		if (pStream->pSurf) pStream->pSurf->pMip = NULL;
+		delete pStream;
+	}
+
+	SAFE_DELETE(pPolicy);
+	DeleteCriticalSection(&cs);
+}
+
+// ===========================================================================================
+// Create a texture with the levels first..Levels()-1 of a file, used by both threads
+//
+LPDIRECT3DTEXTURE9 TextureStreamer::CreateTexture(const DDSFile *pFile, int first)
+{
+	int last = pFile->Levels() - 1;
+	int n = last - first + 1;
+	DWORD w = pFile->LevelWidth(first), h = pFile->LevelHeight(first);
+
+	BYTE *pData = new BYTE[pFile->RangeSize(first, last)];
+	LPDIRECT3DTEXTURE9 pSys = NULL, pTex = NULL;
+
+	if (pFile->ReadLevels(first, last, pData)) {
+
+		if (pDev->CreateTexture(w, h, n, 0, pFile->Format(), D3DPOOL_SYSTEMMEM, &pSys, NULL) == S_OK) {
+
+			const BYTE *pSrc = pData;
+			bool bOk = true;
+
+			for (int i = 0; i < n && bOk; i++) {
+				int lvl = first + i;
+				DWORD pitch = pFile->LevelPitch(lvl), rows = pFile->LevelRows(lvl);
+				D3DLOCKED_RECT lr;
+				bOk = (pSys->LockRect(i, &lr, NULL, 0) == S_OK);
+				if (bOk) {
+					for (DWORD r = 0; r < rows; r++) memcpy((BYTE *)lr.pBits + r * lr.Pitch, pSrc + r * pitch, pitch);
+					pSys->UnlockRect(i);
+				}
+				pSrc += pFile->LevelSize(lvl);
+			}
+
+			if (bOk && pDev->CreateTexture(w, h, n, 0, pFile->Format(), D3DPOOL_DEFAULT, &pTex, NULL) == S_OK) {
+				if (pDev->UpdateTexture(pSys, pTex) != S_OK) SAFE_RELEASE(pTex);
+			}
+
+			SAFE_RELEASE(pSys);
+		}
+	}
+
+	delete[] pData;
+
+	if (!pTex) LogErr("TextureStreamer: Failed to load levels %d-%d of %s", first, last, pFile->Path());
+	return pTex;
+}
+
+// ===========================================================================================
+//
+bool TextureStreamer::Load(D3D9ClientSurface *pSurf, const char *path)
+{
+	if (!pPolicy) return false;
+
+	STREAMTEX *pStream = new STREAMTEX;
+	DDSFile &file = pStream->file;
+
+	if (!file.ReadHeader(path)) {
+		delete pStream;
+		return false;
+	}
+
+	DWORD size = max(file.Width(), file.Height());
+
+	// Only large textures with a mip chain reaching the base size
+	if (size < DWORD(Config->TexStreamMinSize) || (size >> (file.Levels() - 1)) > TSTREAM_BASESIZE) {
+		delete pStream;
+		return false;
+	}
+
+	size_t bytes[DDS_MAXLEVELS];
+	for (int i = 0; i < file.Levels(); i++) bytes[i] = file.LevelSize(i);
+
+	MIPTEX *pMip = pPolicy->Add(size, file.Levels(), bytes, TSTREAM_BASESIZE, pStream);
+	LPDIRECT3DTEXTURE9 pTex = CreateTexture(&file, pMip->base);
+
+	if (!pTex) {
+		pPolicy->Remove(pMip);
+		delete pStream;
+		return false;
+	}
+
+	pStream->pSurf = pSurf;
+	pStream->pMip = pMip;
+
+	// The description keeps the size of the full texture
+	pSurf->pTex = pTex;
+	HR(pTex->GetSurfaceLevel(0, &pSurf->pSurf));
+	pSurf->GetDesc(&pSurf->desc);
+	pSurf->desc.Width = file.Width();
+	pSurf->desc.Height = file.Height();
+	pSurf->pMip = pMip;
+
+	return true;
+}
+
+// ===========================================================================================
+//
+void TextureStreamer::Remove(D3D9ClientSurface *pSurf)
+{
+	MIPTEX *pMip = pSurf->pMip;
+	if (!pMip) return;
+
+	pSurf->pMip = NULL;
+	if (!pPolicy) return;
+
+	STREAMTEX *pStream = (STREAMTEX *)pMip->pUser;
+
+	// Released when the load completes
+	if (pMip->loading >= 0) {
+		pStream->pSurf = NULL;
+		return;
+	}
+
+	pPolicy->Remove(pMip);
+	delete pStream;
+}
+
+// ===========================================================================================
+//
+bool TextureStreamer::Restore(D3D9ClientSurface *pSurf)
+{
+	MIPTEX *pMip = pSurf->pMip;
+	if (!pMip) return true;
+
+	STREAMTEX *pStream = (STREAMTEX *)pMip->pUser;
+	LPDIRECT3DTEXTURE9 pTex = CreateTexture(&pStream->file, 0);
+
+	if (pTex) {
+		pSurf->Sync();
+		SAFE_RELEASE(pSurf->pSurf);
+		SAFE_RELEASE(pSurf->pTex);
+		pSurf->pTex = pTex;
+		HR(pTex->GetSurfaceLevel(0, &pSurf->pSurf));
+		pSurf->GetDesc(&pSurf->desc);
+	}
+
+	Remove(pSurf);
+	return pTex != NULL;
+}
+
+// ===========================================================================================
+//
+void TextureStreamer::NewFrame()
+{
+	if (!pPolicy) return;
+
+	std::deque<JOB> done, busy;
+
+	EnterCriticalSection(&cs);
+	done.swap(Done);
+	LeaveCriticalSection(&cs);
+
+	for (size_t i = 0; i < done.size(); i++) {
+
+		STREAMTEX *pStream = done[i].pStream;
+		D3D9ClientSurface *pSurf = pStream->pSurf;
+
+		// Wait until the surface is no longer drawn into
+		if (pSurf && done[i].pTex) {
+			if (pSurf->bDCOpen || pSurf->SketchPad != SKETCHPAD_NONE || pSurf->iBindCount) {
+				busy.push_back(done[i]);
+				continue;
+			}
+		}
+
+		pPolicy->Loaded(pStream->pMip, done[i].pTex != NULL);
+
+		if (!pSurf) {
+			SAFE_RELEASE(done[i].pTex);
+			pPolicy->Remove(pStream->pMip);
+			delete pStream;
+			continue;
+		}
+
+		// The top level has been edited through a DC, keep it
+		if (pSurf->pDCSub) {
+			SAFE_RELEASE(done[i].pTex);
+			Remove(pSurf);
+			continue;
+		}
+
+		if (done[i].pTex) {
+			pSurf->Sync();
+			SAFE_RELEASE(pSurf->pSurf);
+			SAFE_RELEASE(pSurf->pTex);
+			pSurf->pTex = done[i].pTex;
+			HR(pSurf->pTex->GetSurfaceLevel(0, &pSurf->pSurf));
+		}
+	}
+
+	if (!busy.empty()) {
+		EnterCriticalSection(&cs);
+		Done.insert(Done.begin(), busy.begin(), busy.end());
+		LeaveCriticalSection(&cs);
+	}
+
+	std::vector<MipResidency::ACTION> actions;
+	pPolicy->Update(actions);
+
+	if (!actions.empty()) {
+		EnterCriticalSection(&cs);
+		for (size_t i = 0; i < actions.size(); i++) {
+			JOB job = { (STREAMTEX *)actions[i].pTex->pUser, actions[i].level, NULL };
+			Queue.push_back(job);
+		}
+		LeaveCriticalSection(&cs);
+		SetEvent(hWake);
+	}
+
+	MipResidency::STATS s = pPolicy->GetStats(true);
+	D3D9Stats.TexStream.Loads += s.Loads;
+	D3D9Stats.TexStream.Drops += s.Drops;
+	D3D9Stats.TexStream.Deferred += s.Deferred;
+	D3D9Stats.TexStream.Textures = s.Textures;
+	D3D9Stats.TexStream.KBytes = DWORD(s.Bytes >> 10);
+}
+
+// ===========================================================================================
+//
+DWORD WINAPI TextureStreamer::LoadProc(void *pParam)
+{
+	D3D9Profiler::SetThreadName("TextureStreamer");
+
+	while (WaitForSingleObject(hWake, INFINITE) == WAIT_OBJECT_0 && !bExit) {
+
+		while (!bExit) {
+
+			JOB job;
+			bool bJob;
+
+			EnterCriticalSection(&cs);
+			if (bJob = !Queue.empty()) {
+				job = Queue.front();
+				Queue.pop_front();
+			}
+			LeaveCriticalSection(&cs);
+
+			if (!bJob) break;
+
+			_PROFILE_ZONE("StreamLevels");
+			job.pTex = CreateTexture(&job.pStream->file, job.level);
+
+			EnterCriticalSection(&cs);
+			Done.push_back(job);
+			LeaveCriticalSection(&cs);
+		}
+	}
+
+	return 0;
+}
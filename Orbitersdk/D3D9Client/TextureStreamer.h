@@ -0,0 +1,100 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Class TextureStreamer (interface)
+//
+// Mip level streaming of large DDS textures. A streamed texture
+// is created with its coarse levels only, up to TSTREAM_BASESIZE.
+// The meshes report their projected size through
+// D3D9ClientSurface::RequestSize() and MipResidency decides which
+// levels to load or release under Config->TexStreamBudget.
+//
+// A loader thread reads the levels with DDSFile and builds a new
+// texture with the requested range of levels. The new texture
+// replaces the old one at the start of the next frame. The
+// surface keeps the size of the full texture in its description.
+//
+// The swap waits while a DC or a sketchpad is open on the surface.
+// Streaming stops when the surface is converted, for example to
+// a render target, the full texture is then loaded first.
+// ==============================================================
+
+#ifndef __TEXTURESTREAMER_H
+#define __TEXTURESTREAMER_H
+
+#include "D3D9Client.h"
+#include "DDSFile.h"
+#include "MipResidency.h"
+#include <deque>
+
+#define TSTREAM_BASESIZE	256			// Largest dimension of the levels loaded up front
+#define TSTREAM_MAXLOADS	4			// Loads in flight at most
+#define TSTREAM_BIAS		1.0f		// Texture size per projected pixel of the mesh
+#define TSTREAM_HOLD		300			// Frames a texture out of view keeps its levels
+
+class D3D9ClientSurface;
+
+class TextureStreamer
+{
+
+public:
+
+	static void		GlobalInit(oapi::D3D9Client *gc);
+	static void		GlobalExit();
+
+	/**
+	 * \brief Create the texture of a surface with the coarse levels of a file and stream the rest
+	 * \return false if the file isn't streamed, it's then loaded as usual
+	 */
+	static bool		Load(D3D9ClientSurface *pSurf, const char *path);
+
+	/**
+	 * \brief Stop streaming a surface, its current texture is kept
+	 */
+	static void		Remove(D3D9ClientSurface *pSurf);
+
+	/**
+	 * \brief Stop streaming a surface and load all levels of its texture, used
+	 * before a conversion that copies the top level
+	 * \return false if the levels failed to load, the texture is then kept as it is
+	 */
+	static bool		Restore(D3D9ClientSurface *pSurf);
+
+	static void		Request(MIPTEX *pMip, float pixels) { pPolicy->Request(pMip, pixels); }
+
+	/**
+	 * \brief Apply the completed loads and run the policy, once per frame
+	 */
+	static void		NewFrame();
+
+private:
+
+	struct STREAMTEX {
+		DDSFile				file;
+		D3D9ClientSurface *	pSurf;		///< NULL if removed while a load is in flight
+		MIPTEX *			pMip;
+	};
+
+	struct JOB {
+		STREAMTEX *			pStream;
+		int					level;		///< Finest level of the new texture
+		LPDIRECT3DTEXTURE9	pTex;		///< Result, NULL on failure
+	};
+
+	static LPDIRECT3DTEXTURE9 CreateTexture(const DDSFile *pFile, int first);
+	static DWORD WINAPI LoadProc(void *pParam);
+
+	static LPDIRECT3DDEVICE9 pDev;
+	static MipResidency *pPolicy;
+	static std::deque<JOB> Queue;		///< Jobs for the loader thread
+	static std::deque<JOB> Done;		///< Completed jobs
+	static CRITICAL_SECTION cs;
+	static HANDLE	hThread;
+	static HANDLE	hWake;
+	static volatile bool bExit;
+};
+
+#endif // !__TEXTURESTREAMER_H
@@ -22,6 +22,7 @@
 #include "D3D9Catalog.h"
 #include "D3D9Client.h"
 #include "OapiExtension.h"
+#include "Profiler.h"
 
 using namespace oapi;
 
@@ -1103,6 +1104,7 @@ DWORD WINAPI TileBuffer::LoadTile_ThreadProc (void *data)
 	DWORD idle = 1000/Config->PlanetLoadFrequency;
 
 	LogAlw("TileBuffer::LoadTile thread started");
+	D3D9Profiler::SetThreadName("TileBuffer");
 
 	bool bFirstRun = true;
 	while (bFirstRun || WAIT_OBJECT_0 != WaitForSingleObject(hStopThread, idle))
@@ -1118,6 +1120,7 @@ DWORD WINAPI TileBuffer::LoadTile_ThreadProc (void *data)
 		ReleaseMutex (hQueueMutex);
 
 		if (load) {
+			_PROFILE_ZONE("LoadTile");
 			char fname[MAX_PATH];
 			TILEDESC *td = qd.td;
 			LPDIRECT3DTEXTURE9 tex, mask = 0;
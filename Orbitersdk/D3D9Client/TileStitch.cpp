@@ -0,0 +1,56 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+#include "TileStitch.h"
+
+// ===========================================================================================
+//
+static void VtxInterpolate (VERTEX_2TEX &res, const VERTEX_2TEX &a, const VERTEX_2TEX &b, float w1)
+{
+	float w0 = 1.0f-w1;
+	res.x = a.x*w0 + b.x*w1;
+	res.y = a.y*w0 + b.y*w1;
+	res.z = a.z*w0 + b.z*w1;
+	res.nx = a.nx*w0 + b.nx*w1;
+	res.ny = a.ny*w0 + b.ny*w1;
+	res.nz = a.nz*w0 + b.nz*w1;
+}
+
+// ===========================================================================================
+//
+void StitchNode (VERTEX_2TEX &vtx, const VERTEX_2TEX &store, double elev, double nbr_elev, double rad, const VECTOR3 &shift)
+{
+	double radfac = (rad+nbr_elev)/(rad+elev);
+	vtx.x = (float)(store.x*radfac + shift.x*(radfac-1.0));
+	vtx.y = (float)(store.y*radfac + shift.y*(radfac-1.0));
+	vtx.z = (float)(store.z*radfac + shift.z*(radfac-1.0));
+}
+
+// ===========================================================================================
+//
+void StitchRestore (const STITCHEDGE &e, int i0, int i1)
+{
+	for (int i = i0; i <= i1; i++) e.pEdge[i*e.vstep] = e.pStore[i];
+}
+
+// ===========================================================================================
+//
+void StitchEdge (const STITCHEDGE &e, int nsub, int nrange, int i0, int i1)
+{
+	int vskip = nsub*e.vstep;	// vertex stride between nodes attaching to neighbour nodes
+
+	// match nodes to neighbour elevations
+	for (int i = i0; i <= i1; i++) {
+		StitchNode (e.pEdge[i*vskip], e.pStore[i*nsub], e.pElev[i*nsub*e.estep], e.pNbrElev[i*e.estep], e.rad, e.shift);
+	}
+
+	// interpolate the nodes that fall between neighbour nodes
+	for (int i = 0; i < nrange; i++) {
+		const VERTEX_2TEX &a = e.pEdge[i*vskip];
+		const VERTEX_2TEX &b = e.pEdge[(i+1)*vskip];
+		for (int j = 1; j < nsub; j++)
+			VtxInterpolate (e.pEdge[i*vskip + j*e.vstep], a, b, (float)((double)j/double(nsub)));
+	}
+}
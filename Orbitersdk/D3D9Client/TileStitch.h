@@ -0,0 +1,58 @@
+// ==============================================================
+// Part of the ORBITER VISUALISATION PROJECT (OVP)
+// Dual licensed under GPL v3 and LGPL v3
+// ==============================================================
+
+// ==============================================================
+// Surface tile edge stitching
+//
+// A tile rendered next to a lower resolution neighbour has more
+// nodes along the shared edge than the neighbour. The nodes that
+// coincide with neighbour nodes are moved to the neighbour's
+// elevation and the nodes in between are interpolated onto the
+// straight line joining them, which closes the crack.
+//
+// The functions work on one edge, described by strides into the
+// vertex and elevation arrays, and touch nothing else. They have
+// no dependency on the tile manager.
+// ==============================================================
+
+#ifndef __TILESTITCH_H
+#define __TILESTITCH_H
+
+#include "D3D9Util.h"
+
+/**
+ * \brief Description of a tile edge
+ */
+struct STITCHEDGE {
+	VERTEX_2TEX *pEdge;			///< First edge vertex of the tile mesh
+	int vstep;					///< Vertex stride along the edge
+	const VERTEX_2TEX *pStore;	///< Unmodified edge vertices, stored contiguously
+	const float *pElev;			///< Tile elevation at the first edge node
+	const float *pNbrElev;		///< Neighbour elevation at the node attaching to the first edge node
+	int estep;					///< Elevation stride along the edge, in both grids
+	double rad;					///< Body radius
+	VECTOR3 shift;				///< Shift of the tile origin from the body centre
+};
+
+/**
+ * \brief Put the unmodified edge nodes i0..i1 back
+ */
+void StitchRestore (const STITCHEDGE &e, int i0, int i1);
+
+/**
+ * \brief Attach the edge to a neighbour with nsub times lower resolution
+ * \param nsub Tile nodes per neighbour node interval, a power of two
+ * \param nrange Neighbour node intervals along the edge
+ * \param i0, i1 Range of neighbour nodes to match, the nodes in between all intervals
+ *  are interpolated
+ */
+void StitchEdge (const STITCHEDGE &e, int nsub, int nrange, int i0, int i1);
+
+/**
+ * \brief Move a node from elevation elev to nbr_elev along the radius
+ */
+void StitchNode (VERTEX_2TEX &vtx, const VERTEX_2TEX &store, double elev, double nbr_elev, double rad, const VECTOR3 &shift);
+
+#endif // !__TILESTITCH_H
@@ -16,6 +16,8 @@
 #include "D3D9Catalog.h"
 #include "Scene.h"
 #include "OapiExtension.h"
+#include "Profiler.h"
+#include "BufferPool.h"
 
 #include <stack>
 
@@ -134,6 +136,14 @@ bool Tile::PreDelete ()
 
 // -----------------------------------------------------------------------
 
+bool Tile::MapMesh (bool bDefer)
+{
+	if (!mesh || mesh->IsMapped()) return true;
+	return mesh->MapVertices(TileManager2Base::pDev, bDefer ? VBM_DEFER : 0);
+}
+
+// -----------------------------------------------------------------------
+
 bool Tile::GetParentSubTexRange (TEXCRDRANGE2 *subrange)
 {
 	Tile *parent = getParent();
@@ -624,7 +634,7 @@ VBMESH *Tile::CreateMesh_quadpatch (int grdlat, int grdlng, float *elev, double
 	mesh->Box[7] = _V(tmul (R, _V(tpmax.x, tpmax.y, tpmax.z)) + pref);
 
 	mesh->ComputeSphere();
-	mesh->MapVertices(TileManager2Base::pDev);
+	mesh->MapVertices(TileManager2Base::pDev, VBM_DEFER);
 
 	return mesh;
 }
@@ -999,6 +1009,7 @@ DWORD WINAPI TileLoader::Load_ThreadProc (void *data)
 	int nload, i;
 
 	LogAlw("TileLoader::Load thread started");
+	D3D9Profiler::SetThreadName("TileLoader");
 
 	bool bFirstRun = true;
 	while (bFirstRun || WAIT_OBJECT_0 != WaitForSingleObject(loader->hStopThread, idle))
@@ -1015,8 +1026,11 @@ DWORD WINAPI TileLoader::Load_ThreadProc (void *data)
 		ReleaseMutex ();
 
 		if (nload) {
-			for (i = 0; i < nload; i++)
+			_PROFILE_ZONE("LoadTiles");
+			for (i = 0; i < nload; i++) {
+				_PROFILE_ZONE("PreLoad");
 				tile[i]->PreLoad(); // load/create the tile
+			}
 
 			WaitForMutex ();
 			for (i = 0; i < nload; i++) {
@@ -1033,6 +1047,45 @@ DWORD WINAPI TileLoader::Load_ThreadProc (void *data)
 	return 0;
 }
 
+// =======================================================================
+// Buffer factories of the tile buffer pools
+
+class VtxBufferFactory : public BufferFactory
+{
+public:
+	explicit VtxBufferFactory(LPDIRECT3DDEVICE9 _pDev) : pDev(_pDev) {}
+
+	void * Create(DWORD size)
+	{
+		LPDIRECT3DVERTEXBUFFER9 pVB = NULL;
+		if (pDev->CreateVertexBuffer(size, D3DUSAGE_DYNAMIC|D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &pVB, NULL) != S_OK) return NULL;
+		return pVB;
+	}
+
+	void Release(void *pBuf) { ((LPDIRECT3DVERTEXBUFFER9)pBuf)->Release(); }
+
+private:
+	LPDIRECT3DDEVICE9 pDev;
+};
+
+class IdxBufferFactory : public BufferFactory
+{
+public:
+	explicit IdxBufferFactory(LPDIRECT3DDEVICE9 _pDev) : pDev(_pDev) {}
+
+	void * Create(DWORD size)
+	{
+		LPDIRECT3DINDEXBUFFER9 pIB = NULL;
+		if (pDev->CreateIndexBuffer(size, D3DUSAGE_DYNAMIC|D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &pIB, NULL) != S_OK) return NULL;
+		return pIB;
+	}
+
+	void Release(void *pBuf) { ((LPDIRECT3DINDEXBUFFER9)pBuf)->Release(); }
+
+private:
+	LPDIRECT3DDEVICE9 pDev;
+};
+
 // =======================================================================
 // =======================================================================
 
@@ -1048,11 +1101,13 @@ double TileManager2Base::resolutionBias = 4.0;
 double TileManager2Base::resolutionScale = 1.0;
 bool TileManager2Base::bTileLoadThread = true;
 HFONT TileManager2Base::hFont = NULL;
+BufferPool *TileManager2Base::VtxPool = NULL;
+BufferPool *TileManager2Base::IdxPool = NULL;
 
 // -----------------------------------------------------------------------
 
 TileManager2Base::TileManager2Base (const vPlanet *vplanet, int _maxres, int _gridres)
-: vp(vplanet), gridRes(_gridres), ElevMode(eElevMode::DontCare)
+: vp(vplanet), gridRes(_gridres), ElevMode(eElevMode::DontCare), elev_serial(0)
 {
 	// set persistent parameters
 	prm.maxlvl = max (0, _maxres-4);
@@ -1061,7 +1116,6 @@ TileManager2Base::TileManager2Base (const vPlanet *vplanet, int _maxres, int _gr
 	oapiGetObjectName (obj, cbody_name, 256);
 	emgr = oapiElevationManager(obj);
 	elevRes = *(double*)oapiGetObjectParam (obj, OBJPRM_PLANET_ELEVRESOLUTION);
-	for (int i=0;i<NPOOLS;i++) VtxPoolSize[i]=IdxPoolSize[i]=0;
 	ResetMinMaxElev();
 	LogClr("Teal", "Planet ElevRes %s = %g", vplanet->GetName(), elevRes);
 }
@@ -1075,23 +1129,6 @@ TileManager2Base::~TileManager2Base ()
 	if (loader) {
 		loader->Unqueue(this);
 	}
-
-	DWORD nVtx=0, nIdx=0;
-
-	for (int i=0;i<NPOOLS;i++) {
-		while (!VtxPool[i].empty()) {
-			VtxPool[i].top()->Release();
-			VtxPool[i].pop();
-			nVtx++;
-		}
-		while (!IdxPool[i].empty()) {
-			IdxPool[i].top()->Release();
-			IdxPool[i].pop();
-			nIdx++;
-		}
-	}
-
-	LogAlw("Recycling Pool Status nVtx=%u, nIdx=%u", nVtx, nIdx);
 }
 
 // -----------------------------------------------------------------------
@@ -1115,6 +1152,11 @@ void TileManager2Base::GlobalInit (class oapi::D3D9Client *gclient)
 
 	loader = new TileLoader (gc);
 
+	// The index buffers are about a quarter of the vertex buffers in size
+	size_t budget = size_t(Config->TileBufferBudget) << 20;
+	VtxPool = new BufferPool(new VtxBufferFactory(pDev), budget - budget/4, Config->TileBufferRate);
+	IdxPool = new BufferPool(new IdxBufferFactory(pDev), budget/4, Config->TileBufferRate);
+
 	hFont  = CreateFont(42, 0, 0, 0, 600, false, false, 0, 0, 0, 2, CLEARTYPE_QUALITY, 49, "Arial");
 }
 
@@ -1131,6 +1173,32 @@ void TileManager2Base::GlobalExit ()
 {
 	DeleteObject(hFont); hFont = NULL;
 	delete loader;
+
+	BufferPool::STATS vs = VtxPool->GetStats(false);
+	BufferPool::STATS is = IdxPool->GetStats(false);
+	LogAlw("Tile buffer pools: nVtx=%u (%u MB), nIdx=%u (%u MB)", vs.Buffers, DWORD(vs.Bytes >> 20), is.Buffers, DWORD(is.Bytes >> 20));
+	SAFE_DELETE(VtxPool);
+	SAFE_DELETE(IdxPool);
+}
+
+// -----------------------------------------------------------------------
+
+void TileManager2Base::NewFrame ()
+{
+	BufferPool *pool[2] = { VtxPool, IdxPool };
+
+	for (int i=0;i<2;i++) {
+		if (!pool[i]) continue;
+		pool[i]->NewFrame();
+		BufferPool::STATS s = pool[i]->GetStats(true);
+		D3D9Stats.TilePool[i].Hits += s.Hits;
+		D3D9Stats.TilePool[i].Misses += s.Misses;
+		D3D9Stats.TilePool[i].Deferred += s.Deferred;
+		D3D9Stats.TilePool[i].Trimmed += s.Trimmed;
+		D3D9Stats.TilePool[i].Buffers = s.Buffers;
+		D3D9Stats.TilePool[i].Idle = s.Idle;
+		D3D9Stats.TilePool[i].KBytes = DWORD(s.Bytes >> 10);
+	}
 }
 
 // -----------------------------------------------------------------------
@@ -1179,6 +1247,25 @@ void TileManager2Base::ResetMinMaxElev()
 
 // -----------------------------------------------------------------------
 
+void TileManager2Base::PostElevationEvent(const Tile *tile)
+{
+	elev_events[elev_serial % ELEVEVENTS] = tile->bnd;
+	elev_serial++;
+}
+
+// -----------------------------------------------------------------------
+
+bool TileManager2Base::GetElevationEvents(DWORD &serial, std::vector<TILEBOUNDS> &out) const
+{
+	DWORD count = elev_serial - serial;
+	serial = elev_serial;
+	if (count > ELEVEVENTS) return false;
+	for (DWORD i = elev_serial - count; i != elev_serial; i++) out.push_back(elev_events[i % ELEVEVENTS]);
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
 void TileManager2Base::SetMinMaxElev(double mi, double ma)
 {
 	if (bSet) {
@@ -1235,103 +1322,40 @@ MATRIX4 TileManager2Base::WorldMatrix (int ilng, int nlng, int ilat, int nlat)
 
 // -----------------------------------------------------------------------
 
-// TODO:   This should be global not a tile manager (i.e. planet specific)
-
-DWORD TileManager2Base::RecycleVertexBuffer(DWORD nv, LPDIRECT3DVERTEXBUFFER9 *pVB)
+DWORD TileManager2Base::RecycleVertexBuffer(DWORD nv, LPDIRECT3DVERTEXBUFFER9 *pVB, bool bDefer)
 {
-	int pool = -1;
 	D3DVERTEXBUFFER_DESC desc;
+	DWORD size = 0;
 
 	if (*pVB) {
 		(*pVB)->GetDesc(&desc);
-		desc.Size /= sizeof(VERTEX_2TEX);
-		for (int i=0;i<NPOOLS;i++) if (VtxPoolSize[i]==desc.Size) { pool = i; break; }
-		if (pool>=0) {
-			VtxPool[pool].push(*pVB);
-			*pVB = NULL;
-			if (nv==0) return 0; // Store buffer, do not allocate new one.
-		}
-		else LogErr("Pool Doesn't exists");
+		VtxPool->Free(*pVB, desc.Size);
+		*pVB = NULL;
 	}
 
+	if (nv==0) return 0; // Store buffer, do not allocate new one.
 
-	pool = -1;
-
-	// Find a pool
-	for (int i=0;i<NPOOLS;i++) if (VtxPoolSize[i]==nv) { pool = i; break; }
-
-	// Create a new pool size
-	if (pool==-1) {
-		for (int i=0;i<NPOOLS;i++) if (VtxPoolSize[i]==0) { VtxPoolSize[i] = nv; pool = i; break; }
-		if (pool<0) {
-			LogErr("Failed to Crerate a Pool (size=%u)", nv);
-			*pVB = NULL;
-			return 0;
-		}
-	}
-
-	if (VtxPool[pool].empty()) {
-		D3D9Stats.TilesCached++;
-		D3D9Stats.TilesCachedMB += nv*sizeof(VERTEX_2TEX);
-
-		HR(pDev->CreateVertexBuffer(nv*sizeof(VERTEX_2TEX), D3DUSAGE_DYNAMIC|D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, pVB, NULL));
-		//HR(pDev->CreateVertexBuffer(nv*sizeof(VERTEX_2TEX), 0, 0, D3DPOOL_DEFAULT, pVB, NULL));
-		//HR(pDev->CreateVertexBuffer(nv*sizeof(VERTEX_2TEX), D3DUSAGE_DYNAMIC, 0, D3DPOOL_DEFAULT, pVB, NULL));
-		return VtxPoolSize[pool];
-	}
-	else {
-		*pVB = VtxPool[pool].top();
-		VtxPool[pool].pop();
-		return VtxPoolSize[pool];
-	}
+	*pVB = (LPDIRECT3DVERTEXBUFFER9)VtxPool->Alloc(nv*sizeof(VERTEX_2TEX), &size, bDefer);
+	return size / sizeof(VERTEX_2TEX);
 }
 
 // -----------------------------------------------------------------------
 
-DWORD TileManager2Base::RecycleIndexBuffer(DWORD nf, LPDIRECT3DINDEXBUFFER9 *pIB)
+DWORD TileManager2Base::RecycleIndexBuffer(DWORD nf, LPDIRECT3DINDEXBUFFER9 *pIB, bool bDefer)
 {
-	int pool = -1;
 	D3DINDEXBUFFER_DESC desc;
+	DWORD size = 0;
 
 	if (*pIB) {
 		(*pIB)->GetDesc(&desc);
-		desc.Size /= (sizeof(WORD)*3);
-		for (int i=0;i<NPOOLS;i++) if (IdxPoolSize[i]==desc.Size) { pool = i; break; }
-		if (pool>=0) {
-			IdxPool[pool].push(*pIB);
-			*pIB = NULL;
-			if (nf==0) return 0; // Store buffer, do not allocate new one.
-		}
-		else LogErr("Pool Doesn't exists");
+		IdxPool->Free(*pIB, desc.Size);
+		*pIB = NULL;
 	}
 
+	if (nf==0) return 0; // Store buffer, do not allocate new one.
 
-	pool = -1;
-
-	// Find a pool
-	for (int i=0;i<NPOOLS;i++) if (IdxPoolSize[i]==nf) { pool = i; break; }
-
-	// Create a new pool size
-	if (pool==-1) {
-		for (int i=0;i<NPOOLS;i++) if (IdxPoolSize[i]==0) { IdxPoolSize[i] = nf; pool = i; break; }
-		if (pool<0) {
-			LogErr("Failed to Crerate a Pool (size=%u)", nf);
-			*pIB = NULL;
-			return 0;
-		}
-	}
-
-	if (IdxPool[pool].empty()) {
-		HR(pDev->CreateIndexBuffer(nf*sizeof(WORD)*3, D3DUSAGE_DYNAMIC|D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT, pIB, NULL));
-		//HR(pDev->CreateIndexBuffer(nf*sizeof(WORD)*3, 0, D3DFMT_INDEX16, D3DPOOL_DEFAULT, pIB, NULL));
-		//HR(pDev->CreateIndexBuffer(nf*sizeof(WORD) * 3, D3DUSAGE_DYNAMIC, D3DFMT_INDEX16, D3DPOOL_DEFAULT, pIB, NULL));
-		return IdxPoolSize[pool];
-	}
-	else {
-		*pIB = IdxPool[pool].top();
-		IdxPool[pool].pop();
-		return IdxPoolSize[pool];
-	}
+	*pIB = (LPDIRECT3DINDEXBUFFER9)IdxPool->Alloc(nf*sizeof(WORD)*3, &size, bDefer);
+	return size / (sizeof(WORD)*3);
 }
 
 // -----------------------------------------------------------------------
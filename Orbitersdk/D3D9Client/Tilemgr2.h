@@ -25,8 +25,8 @@
 #include <vector>
 #include <list>
 
-#define NPOOLS 32
 #define MAXQUEUE2 20
+#define ELEVEVENTS 256				// Length of the elevation event ring
 
 #define TILE_VALID  0x0001
 #define TILE_ACTIVE 0x0002
@@ -91,6 +91,13 @@ public:
 	bool PreDelete();
 	// Prepare tile for deletion. Return false if tile is locked
 
+	/**
+	 * \brief Create the mesh buffers if the pool has deferred them
+	 * \param bDefer If true, the creation may be deferred again
+	 * \return true if the mesh can be rendered
+	 */
+	bool MapMesh(bool bDefer);
+
 	bool InView (const MATRIX4 &transform);
 	// tile in view of camera, given by transformation matrix 'transform'?
 
@@ -326,6 +333,11 @@ public:
 	 */
 	static bool ShutDown ();
 
+	/**
+	 * \brief Start a new frame in the tile buffer pools and update the pool statistics
+	 */
+	static void NewFrame ();
+
 	static LPDIRECT3DDEVICE9 Dev() { return pDev; }
 	static ID3DXEffect * Shader() { return pShader; }
 	static HFONT GetDebugFont() { return hFont; }
@@ -343,6 +355,13 @@ public:
 	template<class TileType>
 	void RenderNode (QuadTreeNode<TileType> *node);
 
+	template<class TileType>
+	void LinkTree (QuadTreeNode<TileType> root[2]);
+	// Refresh the neighbour links of the active nodes, call after ProcessNode()
+
+	template<class TileType>
+	void LinkNode (QuadTreeNode<TileType> *node);
+
 	template<class TileType>
 	void QueryTiles(QuadTreeNode<TileType> *node, std::list<Tile*> &tiles);
 
@@ -356,10 +375,11 @@ public:
 	 * \brief Create and/or Recycle a vertex buffer
 	 * \param nVerts Number of vertices requested for a new buffer. Use "Zero" to recycle/release a buffer that is no-longer needed.
 	 * \param pVB (in/out) Pointer to vertex buffer. The "old" input buffer is recycled and a new one is returned.
+	 * \param bDefer If true, the pool may refuse to create a new buffer in this frame. *pVB is NULL then.
 	 * \return Number of vertices in a returned buffer. Could be larger than requested.
 	 */
-	DWORD RecycleVertexBuffer(DWORD nVerts, LPDIRECT3DVERTEXBUFFER9 *pVB);
-	DWORD RecycleIndexBuffer(DWORD nf, LPDIRECT3DINDEXBUFFER9 *pIB);
+	DWORD RecycleVertexBuffer(DWORD nVerts, LPDIRECT3DVERTEXBUFFER9 *pVB, bool bDefer = false);
+	DWORD RecycleIndexBuffer(DWORD nf, LPDIRECT3DINDEXBUFFER9 *pIB, bool bDefer = false);
 
 	inline class Scene * GetScene() const { return gc->GetScene(); }
 	inline oapi::D3D9Client *GetClient() const { return gc; }
@@ -379,6 +399,16 @@ public:
 	void SetMinMaxElev(double min, double max);
 	void ResetMinMaxElev();
 
+	/**
+	 * \brief Get the areas where GetElevation() may return a new value. An event is posted when
+	 * an elevated tile becomes the rendered tile of its area.
+	 * \param serial (in/out) Serial of the last event seen, receives the serial of the latest event.
+	 * \param out Receives the bounds of the areas changed since 'serial'
+	 * \return false if events have been dropped since 'serial' and every query must be repeated.
+	 */
+	bool GetElevationEvents(DWORD &serial, std::vector<TILEBOUNDS> &out) const;
+	inline DWORD GetElevationSerial() const { return elev_serial; }
+
 
 protected:
 	MATRIX4 WorldMatrix (int ilng, int nlng, int ilat, int nlat);
@@ -388,9 +418,14 @@ protected:
 	QuadTreeNode<TileType> *LoadChildNode (QuadTreeNode<TileType> *node, int idx);
 	// loads one of the four subnodes of 'node', given by 'idx'
 
+	void PostElevationEvent(const Tile *tile);
+	// record that elevation queries within the tile may return a new value
+
 	double obj_size;                 // planet radius
 	double min_elev;				 // minimum renderred elevation
 	double max_elev;				 // maximum renderred elevation
+	TILEBOUNDS elev_events[ELEVEVENTS]; // ring of elevation change events
+	DWORD elev_serial;				 // number of elevation change events posted
 	static TileLoader *loader;
 	const vPlanet *vp;				 // the planet visual
 private:
@@ -401,11 +436,8 @@ private:
 	int gridRes;                     // mesh grid resolution. must be multiple of 2. Default: 64 for surfaces, 32 for clouds
 	double elevRes;                  // target elevation resolution
 
-	DWORD VtxPoolSize[NPOOLS];
-	DWORD IdxPoolSize[NPOOLS];
-	std::stack<LPDIRECT3DVERTEXBUFFER9> VtxPool[NPOOLS];
-	std::stack<LPDIRECT3DINDEXBUFFER9> IdxPool[NPOOLS];
-
+	static class BufferPool *VtxPool;	// vertex buffers of all tile managers
+	static class BufferPool *IdxPool;	// index buffers of all tile managers
 	static HFONT hFont;
 	static double resolutionBias;
 	static double resolutionScale;
@@ -94,6 +94,7 @@ void TileManager2Base::ProcessNode (QuadTreeNode<TileType> *node)
 	const Scene *scene = GetScene();
 
 	Tile *tile = node->Entry();
+	Tile::TileState prevstate = tile->state;
 	tile->state = Tile::ForRender;
 	tile->edgeok = false;
 	int lvl = tile->lvl;
@@ -197,6 +198,8 @@ void TileManager2Base::ProcessNode (QuadTreeNode<TileType> *node)
 			Tile::TileState state = child->Entry()->state;
 			if (!(state & TILE_VALID))
 				subcomplete = false;
+			else if (!child->Entry()->MapMesh(true))
+				subcomplete = false;	// buffers deferred by the pool, keep rendering this tile
 		}
 		if (subcomplete) {
 			tile->state = Tile::Active;
@@ -210,6 +213,71 @@ void TileManager2Base::ProcessNode (QuadTreeNode<TileType> *node)
 		// Delete tile and sub-tree if the tile has not been needeed for a while
 		if (scene->GetRenderPass()==RENDERPASS_MAINSCENE && (scene->GetFrameId()-tile->FrameId)>64) node->DelChildren ();
 	}
+
+	// The tile has taken over the elevation queries of its area
+	if (prevstate != Tile::ForRender && tile->IsElevated()) PostElevationEvent(tile);
+}
+
+// -----------------------------------------------------------------------
+// Level 0 tiles wrap around in longitude, there is nothing across the poles
+
+template<class TileType>
+void TileManager2Base::LinkTree (QuadTreeNode<TileType> root[2])
+{
+	for (int i = 0; i < 2; i++) {
+		for (int k = 0; k < 9; k++) root[i].SetNeighbour (k, NULL);
+		root[i].SetNeighbour (QTNBR(0, -1), root + 1 - i);
+		root[i].SetNeighbour (QTNBR(0, 1), root + 1 - i);
+	}
+	for (int i = 0; i < 2; i++) LinkNode (root + i);
+}
+
+// -----------------------------------------------------------------------
+// The links of a child are taken from the links of its parent. A cell next to the child lies
+// either in the parent or in one of its neighbours, from there we step down at most one level.
+// Longitude wrap and poles are taken care of by the links of the level 0 tiles.
+// Unlike FindNode() we only step into the children of a node that is Active in this frame, the
+// subtree below a rendered tile may be left over from an earlier frame.
+// A rendered tile needs the three links pointing away from its siblings, see
+// SurfTile::MatchEdges(), an Active tile needs all of them for its children.
+
+template<class TileType>
+void TileManager2Base::LinkNode (QuadTreeNode<TileType> *node)
+{
+	static const int dir[8][2] = { {0,-1}, {0,1}, {-1,0}, {1,0}, {-1,-1}, {-1,1}, {1,-1}, {1,1} };
+
+	Tile *tile = node->Entry();
+	if (tile->state != Tile::Active) return;
+
+	for (int idx = 0; idx < 4; idx++) {
+		QuadTreeNode<TileType> *child = node->Child(idx);
+		if (!child) continue;
+
+		Tile::TileState state = child->Entry()->state;
+		if (state != Tile::Active && state != Tile::ForRender) continue;
+
+		int cy = idx/2, cx = idx%2;	// position in the parent
+		int ndir = 8;
+		int outer[3][2] = { {0, cx ? 1 : -1}, {cy ? 1 : -1, 0}, {cy ? 1 : -1, cx ? 1 : -1} };
+		const int (*d)[2] = dir;
+		if (state == Tile::ForRender) d = outer, ndir = 3;
+
+		for (int k = 0; k < ndir; k++) {
+			int y = cy + d[k][0], x = cx + d[k][1];	// -1..2, outside the parent if not 0 or 1
+			int py = y >> 1, px = x >> 1;
+			QuadTreeNode<TileType> *nbr = (py || px ? node->Neighbour (QTNBR(py, px)) : node);
+			if (nbr) {
+				Tile *t = nbr->Entry();
+				if (t->state == Tile::Invisible) nbr = NULL;
+				else if (t->state == Tile::Active && t->lvl == tile->lvl) {
+					QuadTreeNode<TileType> *sub = nbr->Child ((y & 1)*2 + (x & 1));
+					if (sub && (sub->Entry()->state & TILE_ACTIVE)) nbr = sub;
+				}
+			}
+			child->SetNeighbour (QTNBR(d[k][0], d[k][1]), nbr);
+		}
+		LinkNode (child);
+	}
 }
 
 // -----------------------------------------------------------------------
@@ -222,6 +290,7 @@ void TileManager2Base::RenderNode (QuadTreeNode<TileType> *node)
 
 	if (tile->state == Tile::ForRender) {
 		int lvl = tile->lvl;
+		tile->MapMesh (false);
 		tile->MatchEdges ();
 		SetWorldMatrix (tile->mWorld);
 		tile->StepIn ();
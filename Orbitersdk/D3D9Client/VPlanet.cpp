@@ -27,6 +27,7 @@
 #include "SurfMgr.h"
 #include "surfmgr2.h"
 #include "cloudmgr2.h"
+#include "CloudMap.h"
 #include "CloudMgr.h"
 #include "HazeMgr.h"
 #include "RingMgr.h"
@@ -35,6 +36,7 @@
 #include "AtmoControls.h"
 #include "VectorHelpers.h"
 #include "OapiExtension.h"
+#include "Profiler.h"
 
 using namespace oapi;
 
@@ -115,6 +117,7 @@ vPlanet::vPlanet (OBJHANDLE _hObj, const Scene *scene): vObject (_hObj, scene)
 
 	clouddata = 0;
 	cloudmgr2 = 0;
+	cloudmap = 0;
 	prm.bCloud = (*(bool*)gc->GetConfigParam (CFGPRM_CLOUDS) &&
 		*(bool*)oapiGetObjectParam (_hObj, OBJPRM_PLANET_HASCLOUDS));
 	if (prm.bCloud) {
@@ -140,6 +143,7 @@ vPlanet::vPlanet (OBJHANDLE _hObj, const Scene *scene): vObject (_hObj, scene)
 		} else { // v2 cloud engine
 			DWORD maxlvl = (DWORD)*(int*)oapiGetObjectParam (_hObj, OBJPRM_PLANET_CLOUDMAXLEVEL);
 			maxlvl = min (maxlvl, *(DWORD*)gc->GetConfigParam (CFGPRM_SURFACEMAXLEVEL));
+			cloudmap = new CloudMap;
 			cloudmgr2 = new TileManager2<CloudTile> (this, maxlvl, 32);
 		}
 	} else {
@@ -213,6 +217,7 @@ vPlanet::~vPlanet ()
 	if (surfmgr) delete surfmgr;
 	else if (surfmgr2) delete surfmgr2;
 	if (cloudmgr2) delete cloudmgr2;
+	if (cloudmap) delete cloudmap;
 
 	if (MicroCfg.bLoaded) {
 		for (int i = 0; i < ARRAYSIZE(MicroCfg.Level); ++i) {
@@ -407,6 +412,7 @@ bool vPlanet::Update (bool bMainScene)
 		double cloudrad = size + prm.cloudalt;
 		prm.cloudrot = *(double*)oapiGetObjectParam (hObj, OBJPRM_PLANET_CLOUDROTATION);
 		prm.cloudrot = posangle(prm.cloudrot);
+		if (cloudmap) cloudmap->SetRotation(prm.cloudrot);
 		prm.cloudvis = (cdist < cloudrad ? 1:0);
 		if (cdist > cloudrad*(1.0-1.5e-4)) prm.cloudvis |= 2;
 		//prm.bCloudFlatShadows = (cdist >= 1.05*size);
@@ -729,6 +735,7 @@ void vPlanet::RenderLabels(LPDIRECT3DDEVICE9 dev, D3D9Pad *skp, oapi::Font **lab
 
 void vPlanet::RenderSphere (LPDIRECT3DDEVICE9 dev)
 {
+	_PROFILE_ZONE("Surface");
 	float fogfactor;
 	D3D9Effect::FX->GetFloat(D3D9Effect::eFogDensity, &fogfactor);
 
@@ -806,6 +813,7 @@ void vPlanet::RenderSphere (LPDIRECT3DDEVICE9 dev)
 
 void vPlanet::RenderCloudLayer (LPDIRECT3DDEVICE9 dev, DWORD cullmode)
 {
+	_PROFILE_ZONE("Clouds");
 	bool bLog = false;
 	if (scn->GetRenderPass() == RENDERPASS_MAINSCENE && scn->GetCameraProxyVisual() == this) bLog = true;
 	double tot_cloud = D3D9GetTime();
@@ -16,6 +16,7 @@
 class D3D9Mesh;
 class SurfTile;
 class CloudTile;
+class CloudMap;
 
 
 // ==============================================================
@@ -142,6 +143,7 @@ public:
 	// Access functions
 	TileManager2<SurfTile> *SurfMgr2() const { return surfmgr2; }
 	TileManager2<CloudTile> *CloudMgr2() const { return cloudmgr2; }
+	CloudMap *GetCloudMap() const { return cloudmap; }	///< Cloud density map (v2 cloud engine), NULL if none
 
 protected:
 	void RenderSphere (LPDIRECT3DDEVICE9 dev);
@@ -176,6 +178,7 @@ private:
 	SurfaceManager *surfmgr;  // planet surface tile manager
 	TileManager2<SurfTile> *surfmgr2;   // planet surface tile manager (v2)
 	TileManager2<CloudTile> *cloudmgr2; // planet cloud layer tile manager (v2)
+	CloudMap *cloudmap;       // cloud density map, filled by the v2 cloud tiles
 	mutable class SurfTile *tile_cache;
 	HazeManager *hazemgr;     // horizon haze rendering
 	HazeManager2 *hazemgr2;	  // horizon haze rendering
@@ -129,6 +129,7 @@ void vVessel::GlobalExit ()
 	SAFE_DELETE(defexhausttex);
 	SAFE_DELETE(defreentrytex);
 	SAFE_DELETE(tHUD);
+	MatMgr::GlobalExit();
 }
 
 
@@ -274,7 +275,7 @@ void vVessel::LoadMeshes()
 	if (nmesh) DisposeMeshes();
 
 	MESHHANDLE hMesh = NULL;
-	const D3D9Mesh *mesh = NULL;
+	D3D9Mesh *mesh = NULL;
 	VECTOR3 ofs;
 	UINT idx;
 
@@ -290,11 +291,11 @@ void vVessel::LoadMeshes()
 	for (idx=0;idx<nmesh;idx++) {
 
 		hMesh = vessel->GetMeshTemplate(idx);
-		mesh = mmgr->GetMesh(hMesh);
+		mesh = mmgr->GetInstance(hMesh);												// Create new Instance from an existing mesh template
 
-		if (hMesh && mesh) {
+		if (mesh) {
 			// copy from preloaded template
-			meshlist[idx].mesh = new D3D9Mesh(hMesh, *mesh);							// Create new Instance from an existing mesh template
+			meshlist[idx].mesh = mesh;
 			meshlist[idx].mesh->SetClass(vClass);
 			meshlist[idx].mesh->SetName(idx);
 		}
@@ -366,11 +367,11 @@ void vVessel::InsertMesh(UINT idx)
 	// now add the new mesh
 	MeshManager *mmgr = gc->GetMeshMgr();
 	MESHHANDLE hMesh = vessel->GetMeshTemplate(idx);
-	const D3D9Mesh *mesh = mmgr->GetMesh(hMesh);
+	D3D9Mesh *mesh = mmgr->GetInstance(hMesh);										// Create new Instance from an existing mesh template
 
 
-	if (hMesh && mesh) {
-		meshlist[idx].mesh = new D3D9Mesh(hMesh, *mesh);								// Create new Instance from an existing mesh template
+	if (mesh) {
+		meshlist[idx].mesh = mesh;
 		meshlist[idx].mesh->SetClass(vClass);
 		meshlist[idx].mesh->SetName(idx);
 	} else if (hMesh = vessel->CopyMeshFromTemplate (idx)) {	
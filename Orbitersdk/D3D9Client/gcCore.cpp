@@ -29,6 +29,8 @@
 #include "VPlanet.h"
 #include "Surfmgr2.h"
 #include "WindowMgr.h"
+#include "InstanceBuffer.h"
+#include "DXTCodec.h"
 
 extern D3D9Client *g_client;
 extern WindowManager *g_pWM;
@@ -873,6 +875,30 @@ bool gcCore::GenerateMipMaps(HSURFNATIVE hSrf)
 }
 
 
+// ===============================================================================================
+// Encode a lockable A8R8G8B8 or X8R8G8B8 surface into the top level of a system memory DXT texture
+//
+static bool EncodeSurface(LPDIRECT3DSURFACE9 pSrc, LPDIRECT3DTEXTURE9 pTex, D3DFORMAT Fmt)
+{
+	D3DSURFACE_DESC desc;
+	D3DLOCKED_RECT src, dst;
+	bool bOk = false;
+
+	if (pSrc->GetDesc(&desc) != S_OK) return false;
+	if (desc.Format != D3DFMT_A8R8G8B8 && desc.Format != D3DFMT_X8R8G8B8) return false;
+	if (desc.Pool == D3DPOOL_DEFAULT && (desc.Usage & D3DUSAGE_DYNAMIC) == 0) return false;
+
+	if (pSrc->LockRect(&src, NULL, D3DLOCK_READONLY) == S_OK) {
+		if (pTex->LockRect(0, &dst, NULL, 0) == S_OK) {
+			bOk = DXTCodec::Encode(Fmt, (const BYTE *)src.pBits, src.Pitch, (BYTE *)dst.pBits, dst.Pitch, desc.Width, desc.Height, desc.Format == D3DFMT_X8R8G8B8);
+			pTex->UnlockRect(0);
+		}
+		pSrc->UnlockRect();
+	}
+	return bOk;
+}
+
+
 // ===============================================================================================
 //
 HSURFNATIVE	gcCore::CompressSurface(HSURFNATIVE hSurface, DWORD flags)
@@ -895,6 +921,7 @@ HSURFNATIVE	gcCore::CompressSurface(HSURFNATIVE hSurface, DWORD flags)
 		LPDIRECT3DSURFACE9 pSurf = static_cast<LPDIRECT3DSURFACE9>(hSurface);
 		HR(pSurf->GetDesc(&desc));
 		HR(D3DXCreateTexture(pDev, desc.Width, desc.Height, Mips, 0, Fmt, Pool, &pTex));
+		if (Pool == D3DPOOL_SYSTEMMEM && Mips == 1 && EncodeSurface(pSurf, pTex, Fmt)) return HSURFNATIVE(pTex);
 		for (DWORD i = 0; i < pTex->GetLevelCount(); i++) {
 			HR(pTex->GetSurfaceLevel(i, &pDest));
 			HR(D3DXLoadSurfaceFromSurface(pDest, NULL, NULL, pSurf, NULL, NULL, D3DX_FILTER_BOX, 0));
@@ -908,6 +935,10 @@ HSURFNATIVE	gcCore::CompressSurface(HSURFNATIVE hSurface, DWORD flags)
 		HR(pInp->GetLevelDesc(0, &desc));
 		HR(D3DXCreateTexture(pDev, desc.Width, desc.Height, Mips, 0, Fmt, Pool, &pTex));
 		HR(pInp->GetSurfaceLevel(0, &pSurf));
+		if (Pool == D3DPOOL_SYSTEMMEM && Mips == 1 && EncodeSurface(pSurf, pTex, Fmt)) {
+			pSurf->Release();
+			return HSURFNATIVE(pTex);
+		}
 		for (DWORD i = 0; i < pTex->GetLevelCount(); i++) {
 			HR(pTex->GetSurfaceLevel(i, &pDest));
 			HR(D3DXLoadSurfaceFromSurface(pDest, NULL, NULL, pSurf, NULL, NULL, D3DX_FILTER_BOX, 0));
@@ -967,7 +998,9 @@ void gcCore::RenderMesh(DEVMESHHANDLE hMesh, const oapi::FMATRIX4 *pWorld)
 //
 void gcCore::RenderMesh(DEVMESHHANDLE hMesh, HINSTBUF hInst)
 {
-
+	if (!hMesh || !hInst) return;
+	Scene *pScene = g_client->GetScene();
+	pScene->RenderMesh(hMesh, (InstanceBuffer *)hInst);
 }
 
 
@@ -994,6 +1027,25 @@ bool gcCore::PickMesh(gcCore::PickMeshStruct *pm, DEVMESHHANDLE hMesh, const FMA
 //
 bool gcCore::PickMesh(gcCore::PickMeshStruct *pm, DEVMESHHANDLE hMesh, HINSTBUF hInst)
 {
+	if (!hMesh || !hInst) return false;
+
+	// Pick under the mouse cursor
+	POINT pt;
+	GetCursorPos(&pt);
+	ScreenToClient(g_client->GetRenderWindow(), &pt);
+
+	int idx;
+	Scene *pScene = g_client->GetScene();
+	D3D9Pick pk = pScene->PickMesh(hMesh, (InstanceBuffer *)hInst, short(pt.x), short(pt.y), &idx);
+	if (idx >= 0 && pk.group >= 0) {
+		if (pk.dist < pm->dist) {
+			pm->pos = _FV(pk.pos);
+			pm->normal = _FV(pk.normal);
+			pm->grp_inst = idx;
+			pm->dist = pk.dist;
+			return true;
+		}
+	}
 	return false;
 }
 
@@ -1002,7 +1054,10 @@ bool gcCore::PickMesh(gcCore::PickMeshStruct *pm, DEVMESHHANDLE hMesh, HINSTBUF
 //
 HINSTBUF gcCore::CreateInstanceBuffer(const oapi::FMATRIX4 *pData, int size, HINSTBUF hBuf)
 {
-	return NULL;
+	if (!pData || size < int(sizeof(FMATRIX4))) return hBuf;
+	InstanceBuffer *pInst = hBuf ? (InstanceBuffer *)hBuf : new InstanceBuffer();
+	pInst->Update((const D3DXMATRIX *)pData, DWORD(size / sizeof(FMATRIX4)));
+	return pInst;
 }
 
 
@@ -1010,7 +1065,7 @@ HINSTBUF gcCore::CreateInstanceBuffer(const oapi::FMATRIX4 *pData, int size, HIN
 //
 void gcCore::ReleaseInstanceBuffer(HINSTBUF hBuf)
 {
-
+	delete (InstanceBuffer *)hBuf;
 }
 
 
@@ -35,6 +35,7 @@
 #include "Sketchpad2.h"
 #include "Orbit.h"
 #include "Reference.h"
+#include "Tessellator.h"
 
 #define NTEMP 5
 
@@ -46,6 +47,7 @@ struct Body {
 	OBJHANDLE hRef;		// Reference handle
 	OBJHANDLE hObj;		// Object handle
 	COrbit *  pOrb;		// Orbit information
+	OrbitTessellator *pTes;	// Orbit line
 	float	  fInts;	// Orbit line intensity
 };
 
@@ -79,7 +81,7 @@ public:
 	
 private:
 	void		Label(Sketchpad2 *pSkp2, IVECTOR2 *pt, VECTOR3 &plnDir, const char *label);
-	void		DrawOrbit(Sketchpad2 *pSkp2, COrbit *pOrb, OBJHANDLE hRef, oapi::FVECTOR4 &color, DWORD flags = 0);
+	void		DrawOrbit(Sketchpad2 *pSkp2, COrbit *pOrb, OrbitTessellator *pTes, OBJHANDLE hRef, oapi::FVECTOR4 &color, DWORD flags = 0);
 	void		CreateOrbitTemplates();
 	bool		IsVisible(VECTOR3 pos, oapi::IVECTOR2 *pt);
 	VECTOR3		WorldDirection(VECTOR3 d, MATRIX4 &mVP);
@@ -88,6 +90,10 @@ private:
 	HPOLY		pElliptic[NTEMP];
 	HPOLY		pHyperbolic[NTEMP];
 
+	OrbitTessellator Focus;
+	double		PixelError;		// Orbit line error in pixels, zero to use the templates
+	DWORD		ViewW, ViewH;
+
 	DWORD		upidx;
 	
 	Clipper		Clip[2];
@@ -137,11 +143,15 @@ DLLCLBK void ExitModule(HINSTANCE  hModule)
 //
 Orbits::Orbits(HINSTANCE hInst) : Module(hInst)
 {
+	PixelError = 0.5;
+	ViewW = ViewH = 0;
+
 	FILE *fp = fopen("Config/DrawOrbits.cfg", "rt");
 
 	if (fp) {
 		char buf[256];
 		while (fgets(buf, 256, fp)) {
+			if (strncmp(buf, "PixelError", 10) == 0) sscanf(buf, "PixelError %lf", &PixelError);
 			//if (strcmp(buf, "KeyActivation") == 0) sscanf(buf, "KeyActivation %X", &KeyActivation);
 			//if (strcmp(buf, "NullZone") == 0) sscanf(buf, "NullZone %d", &NullZone);
 		}
@@ -188,6 +198,7 @@ void Orbits::clbkSimulationStart(RenderMode rm)
 			pBody[i].hRef = Ref->GetReference(pBody[i].hObj);
 			if (pBody[i].hRef) {
 				pBody[i].pOrb = new COrbit(pBody[i].hObj, pBody[i].hRef);
+				pBody[i].pTes = new OrbitTessellator();
 			}
 			else {
 				if (i!=0) oapiWriteLogV("Orbits: No Reference for object %u, 0x%X", i, pBody[i].hObj);
@@ -212,6 +223,7 @@ void Orbits::clbkSimulationEnd()
 		int i = 0;
 		while (pBody[i].hObj) {
 			if (pBody[i].pOrb) delete pBody[i].pOrb;
+			if (pBody[i].pTes) delete pBody[i].pTes;
 			i++;
 		}
 
@@ -293,6 +305,8 @@ void Orbits::clbkRender(oapi::Sketchpad *pSkp)
 
 		dmVP = gcMatrix4(&mVP);
 
+		oapiGetViewportSize(&ViewW, &ViewH);
+
 		pSkp2->SetFont(hFnt);
 		pSkp2->QuickPen(0x80808080, 1.0f);
 
@@ -309,7 +323,7 @@ void Orbits::clbkRender(oapi::Sketchpad *pSkp)
 					SetClipper(pSkp2, pBody[i].hObj, PLN_MOON);
 					SetClipper(pSkp2, pBody[i].hRef, PLN_MAIN);
 
-					DrawOrbit(pSkp2, pBody[i].pOrb, pBody[i].hRef, color, ODR_APS|ODR_NOD);
+					DrawOrbit(pSkp2, pBody[i].pOrb, pBody[i].pTes, pBody[i].hRef, color, ODR_APS|ODR_NOD);
 				}
 			}
 
@@ -328,7 +342,7 @@ void Orbits::clbkRender(oapi::Sketchpad *pSkp)
 		SetClipper(pSkp2, oapiCameraTarget(), PLN_MOON);
 		SetClipper(pSkp2, hRef, PLN_MAIN);
 
-		DrawOrbit(pSkp2, &orb, hRef, color, ODR_APS|ODR_LON|ODR_NOD|ODR_LAB);
+		DrawOrbit(pSkp2, &orb, &Focus, hRef, color, ODR_APS|ODR_LON|ODR_NOD|ODR_LAB);
 	}
 }
 
@@ -400,7 +414,7 @@ bool Orbits::IsVisible(VECTOR3 pos, oapi::IVECTOR2 *pt)
 
 // =================================================================================================
 //
-void Orbits::DrawOrbit(Sketchpad2 *pSkp2, COrbit *pOrb, OBJHANDLE hRef, oapi::FVECTOR4 &color, DWORD of)
+void Orbits::DrawOrbit(Sketchpad2 *pSkp2, COrbit *pOrb, OrbitTessellator *pTes, OBJHANDLE hRef, oapi::FVECTOR4 &color, DWORD of)
 {
 	FMATRIX4 mat;
 	
@@ -409,45 +423,63 @@ void Orbits::DrawOrbit(Sketchpad2 *pSkp2, COrbit *pOrb, OBJHANDLE hRef, oapi::FV
 	double diff = 1e6;
 	int idx = 0;
 
-	// Choose a closest matching unit template, SMa = 1.0
-	//
-	if (ecc < 1.0) {
-		for (int i = 0; i < NTEMP; i++) if (abs(eEll[i] - ecc) < diff) idx = i, diff = abs(eEll[i] - ecc);
-		smi = sqrt(1.0 - eEll[idx] * eEll[idx]);
-	} else {
-		for (int i = 0; i < NTEMP; i++) if (abs(eHyp[i] - ecc) < diff) idx = i, diff = abs(eHyp[i] - ecc);
-		smi = sqrt(eHyp[idx] * eHyp[idx] - 1.0);
-	}
-
 	// Set pen colors
 	//
 	DWORD black = gcColor(&_FVECTOR4(0, 0, 0, color.a));
 	DWORD draw  = gcColor(&color);
 
-
-	// Build Matrix to render from a pre-computed orbit templates
-	//
 	VECTOR3 _P = pOrb->_P;
 	VECTOR3 _Q = pOrb->_Q;
 	VECTOR3 _W = crossp_LH(_P, _Q);
 
-	mat._y = _FVECTOR4(_Q * (pOrb->SMi() / smi) );
-	mat._x = _FVECTOR4(_P * (pOrb->SMa()) );
-	mat._z = _FVECTOR4(_W);
+	if (pTes && PixelError > 0.0 && ViewW && ViewH) {
 
-	// Offset the template to actual planet position
-	//
-	VECTOR3 offs = _P * (pOrb->SMa()*pOrb->Ecc());
+		// Tessellate the true conic in screen space, the polyline is in the perifocal frame
+		//
+		HPOLY hPoly = pTes->Update(pOrb, Clip[0].Pos, dmVP, double(ViewW), double(ViewH), PixelError);
 
-	gcSetTranslation(&mat, Clip[0].Pos - offs);
+		mat._y = _FVECTOR4(_Q);
+		mat._x = _FVECTOR4(_P);
+		mat._z = _FVECTOR4(_W);
 
-	pSkp2->SetWorldTransform(&mat);
-	pSkp2->SetViewMode(Sketchpad2::USER);
-	pSkp2->QuickPen(draw, 2.0f);
-	
+		gcSetTranslation(&mat, Clip[0].Pos);
+
+		pSkp2->SetWorldTransform(&mat);
+		pSkp2->SetViewMode(Sketchpad2::USER);
+		pSkp2->QuickPen(draw, 2.0f);
+		pSkp2->DrawPoly(hPoly);
+	}
+	else {
+
+		// Choose a closest matching unit template, SMa = 1.0
+		//
+		if (ecc < 1.0) {
+			for (int i = 0; i < NTEMP; i++) if (abs(eEll[i] - ecc) < diff) idx = i, diff = abs(eEll[i] - ecc);
+			smi = sqrt(1.0 - eEll[idx] * eEll[idx]);
+		} else {
+			for (int i = 0; i < NTEMP; i++) if (abs(eHyp[i] - ecc) < diff) idx = i, diff = abs(eHyp[i] - ecc);
+			smi = sqrt(eHyp[idx] * eHyp[idx] - 1.0);
+		}
 
-	if (ecc<1.0) pSkp2->DrawPoly(pElliptic[idx]);
-	else		 pSkp2->DrawPoly(pHyperbolic[idx]);
+		// Build Matrix to render from a pre-computed orbit templates
+		//
+		mat._y = _FVECTOR4(_Q * (pOrb->SMi() / smi) );
+		mat._x = _FVECTOR4(_P * (pOrb->SMa()) );
+		mat._z = _FVECTOR4(_W);
+
+		// Offset the template to actual planet position
+		//
+		VECTOR3 offs = _P * (pOrb->SMa()*pOrb->Ecc());
+
+		gcSetTranslation(&mat, Clip[0].Pos - offs);
+
+		pSkp2->SetWorldTransform(&mat);
+		pSkp2->SetViewMode(Sketchpad2::USER);
+		pSkp2->QuickPen(draw, 2.0f);
+
+		if (ecc<1.0) pSkp2->DrawPoly(pElliptic[idx]);
+		else		 pSkp2->DrawPoly(pHyperbolic[idx]);
+	}
 
 
 	// Update matrix for generic drawing in 3D ----------------------
@@ -0,0 +1,242 @@
+// =================================================================================================================================
+//
+// Copyright (C) 2016 Jarmo Nikkanen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation 
+// files (the "Software"), to use, copy, modify, merge, publish, distribute, interact with the Software and sublicense
+// copies of the Software, subject to the following conditions:
+//
+// a) You do not sell, rent or auction the Software.
+// b) You do not collect distribution fees.
+// c) You do not remove or alter any copyright notices contained within the Software.
+// d) This copyright notice must be included in all copies or substantial portions of the Software.
+//
+// If the Software is distributed in an object code form then in addition to conditions above:
+// e) It must inform that the source code is available and how to obtain it.
+// f) It must display "NO WARRANTY" and "DISCLAIMER OF LIABILITY" statements on behalf of all contributors like the one below.
+//
+// The accompanying materials such as artwork, if any, are provided under the terms of this license unless otherwise noted. 
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// =================================================================================================================================
+
+#include "Tessellator.h"
+
+
+// =================================================================================================
+//
+OrbitTessellator::OrbitTessellator()
+{
+	hPoly = NULL;
+	nAlloc = 0;
+	dMaxErr = 0.0;
+	ecc = sma = smi = dErr = 0.0;
+	dW = dH = 0.0;
+	memset(dPlane, 0, sizeof(dPlane));
+	memset(&mV, 0, sizeof(MATRIX4));
+}
+
+// =================================================================================================
+//
+OrbitTessellator::~OrbitTessellator()
+{
+	// hPoly is released by the client like the orbit templates
+}
+
+// =================================================================================================
+// Cached polyline is still on the conic and close to optimal for the view
+//
+bool OrbitTessellator::IsValid(const COrbit *pOrb, const VECTOR3 &_Ref, const MATRIX4 &mVP, double err) const
+{
+	if (Points.empty() || err != dErr) return false;
+
+	if (fabs(pOrb->Ecc() - ecc) > 1e-7) return false;
+	if (fabs(pOrb->SMa() - sma) > 1e-7 * fabs(sma)) return false;
+	if (length(pOrb->_P - _P) > 1e-7 || length(pOrb->_Q - _Q) > 1e-7) return false;
+
+	if (length(_Ref - _R) > 1e-4 * length(_R)) return false;
+
+	double mx = 0.0, dif = 0.0;
+	for (int i = 0; i < 16; i++) {
+		mx = max(mx, fabs(mV.data[i]));
+		dif = max(dif, fabs(mVP.data[i] - mV.data[i]));
+	}
+
+	return (dif <= 1e-4 * mx);
+}
+
+// =================================================================================================
+//
+OrbitTessellator::Sample OrbitTessellator::Eval(double e) const
+{
+	Sample s;
+	double x, y;
+
+	if (ecc < 1.0) x = (cos(e) - ecc)*sma, y = sin(e)*smi;
+	else		   x = (cosh(e) - ecc)*sma, y = sinh(e)*smi;
+
+	VECTOR3 p = _R + _P * x + _Q * y;
+
+	s.eca = e;
+	s.pq.x = float(x);
+	s.pq.y = float(y);
+
+	s.cx = p.x*mV.m11 + p.y*mV.m21 + p.z*mV.m31 + mV.m41;
+	s.cy = p.x*mV.m12 + p.y*mV.m22 + p.z*mV.m32 + mV.m42;
+	s.cw = p.x*mV.m14 + p.y*mV.m24 + p.z*mV.m34 + mV.m44;
+
+	if (s.cw < 1e-6) {
+		s.x = s.y = 0.0;
+		s.vis = 0x10;
+		return s;
+	}
+
+	s.x = (s.cx / s.cw * 0.5 + 0.5) * dW;
+	s.y = (0.5 - s.cy / s.cw * 0.5) * dH;
+	s.vis = 0;
+	return s;
+}
+
+// =================================================================================================
+// Upper bound of the distance between the arc e0..e1 and its chord, (e1-e0)^2/8 * max|r''(e)|
+//
+double OrbitTessellator::Bulge(double e0, double e1) const
+{
+	double d = e1 - e0;
+
+	if (ecc < 1.0) return d * d * 0.125 * fabs(sma);
+
+	double e = max(fabs(e0), fabs(e1));
+	double c = cosh(e) * sma, s = sinh(e) * smi;
+	return d * d * 0.125 * sqrt(c*c + s*s);
+}
+
+// =================================================================================================
+// The arc is within the bulge from the chord, it's outside of a plane if both end points are
+// farther than the bulge. The planes are left, right, bottom, top and the camera plane.
+//
+bool OrbitTessellator::IsOutside(const Sample &a, const Sample &b) const
+{
+	double h = Bulge(a.eca, b.eca);
+
+	if (a.cx + a.cw < -h * dPlane[0] && b.cx + b.cw < -h * dPlane[0]) return true;
+	if (a.cw - a.cx < -h * dPlane[1] && b.cw - b.cx < -h * dPlane[1]) return true;
+	if (a.cy + a.cw < -h * dPlane[2] && b.cy + b.cw < -h * dPlane[2]) return true;
+	if (a.cw - a.cy < -h * dPlane[3] && b.cw - b.cy < -h * dPlane[3]) return true;
+	if (a.cw < -h * dPlane[4] && b.cw < -h * dPlane[4]) return true;
+	return false;
+}
+
+// =================================================================================================
+// Split a segment until the projected mid-point is within dErr from the projected chord.
+// The segment end point is emitted, the start point is already in the list.
+//
+void OrbitTessellator::Subdivide(const Sample &a, const Sample &b, int depth)
+{
+	if (IsOutside(a, b)) {
+		Points.push_back(b.pq);
+		return;
+	}
+
+	Sample m = Eval((a.eca + b.eca) * 0.5);
+
+	// Crosses the camera plane, there is no projected chord. Split towards the crossing.
+	if ((a.vis | m.vis | b.vis) & 0x10) {
+		if (depth < TES_DEPTH) {
+			Subdivide(a, m, depth + 1);
+			Subdivide(m, b, depth + 1);
+			return;
+		}
+		Points.push_back(b.pq);
+		return;
+	}
+
+	double dx = b.x - a.x, dy = b.y - a.y;
+	double len2 = dx*dx + dy*dy;
+	double ex = m.x - a.x, ey = m.y - a.y;
+	double err;
+
+	if (len2 > 1e-12) {
+		double t = (ex*dx + ey*dy) / len2;
+		if (t < 0.0) t = 0.0; else if (t > 1.0) t = 1.0;
+		ex -= dx*t; ey -= dy*t;
+	}
+
+	err = sqrt(ex*ex + ey*ey);
+
+	if (err > dErr && depth < TES_DEPTH) {
+		Subdivide(a, m, depth + 1);
+		Subdivide(m, b, depth + 1);
+		return;
+	}
+
+	if (err > dMaxErr) dMaxErr = err;
+
+	Points.push_back(b.pq);
+}
+
+// =================================================================================================
+//
+HPOLY OrbitTessellator::Update(const COrbit *pOrb, const VECTOR3 &_Ref, const MATRIX4 &mVP, double W, double H, double err)
+{
+	if (IsValid(pOrb, _Ref, mVP, err) && hPoly) return hPoly;
+
+	ecc = pOrb->Ecc();
+	sma = pOrb->SMa();
+	smi = pOrb->SMi();
+	_P = pOrb->_P;
+	_Q = pOrb->_Q;
+	_R = _Ref;
+	mV = mVP;
+	dW = W;
+	dH = H;
+	dErr = err;
+	dMaxErr = 0.0;
+
+	// Clip space plane of x + w >= 0 is the sum of the first and the last column and so on
+	VECTOR3 cx = _V(mV.m11, mV.m21, mV.m31);
+	VECTOR3 cy = _V(mV.m12, mV.m22, mV.m32);
+	VECTOR3 cw = _V(mV.m14, mV.m24, mV.m34);
+	dPlane[0] = length(cw + cx);
+	dPlane[1] = length(cw - cx);
+	dPlane[2] = length(cw + cy);
+	dPlane[3] = length(cw - cy);
+	dPlane[4] = length(cw);
+
+	Points.clear();
+
+	double e0 = 0.0, e1 = PI2;
+	if (ecc >= 1.0) e0 = -TES_HYPERBOLIC, e1 = TES_HYPERBOLIC;
+
+	Sample a = Eval(e0);
+	Points.push_back(a.pq);
+
+	for (int i = 1; i <= TES_INITIAL; i++) {
+		Sample b = Eval(e0 + (e1 - e0) * double(i) / double(TES_INITIAL));
+		Subdivide(a, b, 0);
+		a = b;
+	}
+
+	DWORD flags = 0;
+
+	// Closed ellipse, the last point is the first one
+	if (ecc < 1.0) {
+		Points.pop_back();
+		flags = PF_CONNECT;
+	}
+
+	int n = int(Points.size());
+
+	if (hPoly == NULL || n > nAlloc) {
+		if (hPoly) gcDeletePoly(hPoly);
+		nAlloc = max(n, 512);
+		std::vector<FVECTOR2> buf(Points);
+		buf.resize(nAlloc, Points.back());
+		hPoly = gcCreatePoly(NULL, buf.data(), nAlloc, flags);
+	}
+
+	return gcCreatePoly(hPoly, Points.data(), n, flags);
+}
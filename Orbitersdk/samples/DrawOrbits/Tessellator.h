@@ -0,0 +1,98 @@
+// =================================================================================================================================
+//
+// Copyright (C) 2016 Jarmo Nikkanen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation 
+// files (the "Software"), to use, copy, modify, merge, publish, distribute, interact with the Software and sublicense
+// copies of the Software, subject to the following conditions:
+//
+// a) You do not sell, rent or auction the Software.
+// b) You do not collect distribution fees.
+// c) You do not remove or alter any copyright notices contained within the Software.
+// d) This copyright notice must be included in all copies or substantial portions of the Software.
+//
+// If the Software is distributed in an object code form then in addition to conditions above:
+// e) It must inform that the source code is available and how to obtain it.
+// f) It must display "NO WARRANTY" and "DISCLAIMER OF LIABILITY" statements on behalf of all contributors like the one below.
+//
+// The accompanying materials such as artwork, if any, are provided under the terms of this license unless otherwise noted. 
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+// IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// =================================================================================================================================
+
+#ifndef __ORBIT_Tessellator_H
+#define __ORBIT_Tessellator_H
+
+#include "OrbiterAPI.h"
+#include "gcAPI.h"
+#include "Orbit.h"
+#include <vector>
+
+#define TES_INITIAL		32		//!< Initial number of segments
+#define TES_DEPTH		16		//!< Maximum subdivision depth of an initial segment
+#define TES_HYPERBOLIC	6.0		//!< Range of hyperbolic eccentric anomaly [-x, x], same as the templates
+
+/*! \details Adaptive tessellation of an orbit in screen space.
+The conic is subdivided by eccentric anomaly until the projected mid-point of each segment is
+within a pixel error from the projected chord. Segments crossing the camera plane are split
+towards the crossing. A segment is left unrefined only if the arc, bounded by the chord and
+its bulge, is entirely outside one of the frustum planes or behind the camera. The result is a polyline in the perifocal frame of the orbit (x along _P, y along _Q,
+origin at the reference body) which is reused as long as the elements and the view stay close. */
+
+class OrbitTessellator
+{
+
+public:
+
+	OrbitTessellator();
+	~OrbitTessellator();
+
+	/*! \details Update the polyline if needed
+	\param pOrb Orbit to draw
+	\param _Ref Camera centric position of the reference body
+	\param mVP View projection matrix
+	\param W Viewport width in pixels
+	\param H Viewport height in pixels
+	\param err Allowed error in pixels
+	\return Polyline to be drawn with DrawPoly() */
+	HPOLY			Update(const COrbit *pOrb, const VECTOR3 &_Ref, const MATRIX4 &mVP, double W, double H, double err);
+
+	/*! \details Number of vertices in the current polyline */
+	int				GetVertexCount() const { return int(Points.size()); }
+
+	/*! \details Largest projected deviation of the last tessellation in pixels */
+	double			GetMaxError() const { return dMaxErr; }
+
+private:
+
+	struct Sample {
+		double		eca;
+		FVECTOR2	pq;		//!< Position in perifocal frame
+		double		cx, cy, cw;	//!< Clip space position
+		double		x, y;	//!< Screen position
+		int			vis;	//!< 0x10 if behind the camera
+	};
+
+	bool			IsValid(const COrbit *pOrb, const VECTOR3 &_Ref, const MATRIX4 &mVP, double err) const;
+	Sample			Eval(double eca) const;
+	double			Bulge(double e0, double e1) const;
+	bool			IsOutside(const Sample &a, const Sample &b) const;
+	void			Subdivide(const Sample &a, const Sample &b, int depth);
+
+	std::vector<FVECTOR2> Points;
+	HPOLY			hPoly;
+	int				nAlloc;
+	double			dMaxErr;
+
+	// Tessellation context
+	double			ecc, sma, smi, dErr;
+	VECTOR3			_P, _Q, _R;
+	MATRIX4			mV;
+	double			dW, dH;
+	double			dPlane[5];	//!< Length of the normals of the frustum planes in clip space
+};
+
+#endif